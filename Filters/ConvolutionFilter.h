@@ -56,6 +56,8 @@ typedef struct
 -(Texture*)GetOutputTexture;
 -(ImageBuffer*)GetOutputBuffer;
 
+-(ImageBuffer*)CreatePremultipliedInputBuffer;
+
 -(void)GenerateKernel;
 -(void)NormalizeKernel;
 
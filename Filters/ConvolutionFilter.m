@@ -11,6 +11,8 @@
 #import "NeonMath.h"
 
 #import "ImageBuffer.h"
+#import "AlphaUtilities.h"
+#import "Trace.h"
 
 #define DUMP_DEBUG_IMAGES   (0)
 
@@ -130,8 +132,12 @@
 
 -(void)Update:(CFTimeInterval)inTimeStep
 {    
+    TRACE_SCOPE("Convolution");
+    
     if (mConvolutionFilterParams.mInputTexture != NULL)
     {
+        TRACE_SCOPE("GPU Readback");
+        
         int width = mConvolutionFilterParams.mInputTexture->mGLWidth;
         int height = mConvolutionFilterParams.mInputTexture->mGLHeight;
         
@@ -150,6 +156,10 @@
         
         mConvolutionFilterParams.mInputTexture->mTexBytes = malloc(width * height * 4);
         glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, mConvolutionFilterParams.mInputTexture->mTexBytes);
+        
+        TRACE_ALLOCATION(width * height * 4);
+        TRACE_COUNT(TRACE_COUNTER_BYTES_READ, width * height * 4);
+        
         memcpy([mInputImageBuffer GetData], mConvolutionFilterParams.mInputTexture->mTexBytes, width * height * 4);
         
         glDeleteFramebuffersOES(1, &fb);
@@ -175,11 +185,15 @@
     ImageBuffer* inputImageBuffer = NULL;
     ImageBuffer* outputImageBuffer = NULL;
     
+    // Both passes run entirely in premultiplied alpha.  The input is converted once up front, and the
+    // output is only converted back at the end if the caller wants straight alpha.
+    ImageBuffer* premultipliedInputBuffer = [self CreatePremultipliedInputBuffer];
+    
     for (int pass = 0; pass < 2; pass++)
     {
         if (pass == 0)
         {
-            inputImageBuffer = mInputImageBuffer;
+            inputImageBuffer = premultipliedInputBuffer;
             outputImageBuffer = mScratchImageBuffer;
         }
         else
@@ -192,6 +206,8 @@
         
         int xMax = [outputImageBuffer GetEffectiveWidth];
         int yMax = [outputImageBuffer GetEffectiveHeight];
+        
+        TRACE_COUNT(TRACE_COUNTER_PIXELS_PROCESSED, xMax * yMax);
                 
         for (int y = 0; y < yMax; y++)
         {
@@ -203,8 +219,6 @@
                 }
                                 
                 float dstR = 0, dstG = 0, dstB = 0, dstA = 0;
-                float srcR = 0, srcG = 0, srcB = 0, srcA = 0;
-                float srcANormalized = 0;
                 
                 for (int k = 0; k < mConvolutionFilterParams.mKernelSize; k++)
                 {
@@ -240,39 +254,15 @@
                     
                     unsigned char* vals = (unsigned char*)&val;
                     
-                    srcR = (float)vals[0];
-                    srcG = (float)vals[1];
-                    srcB = (float)vals[2];
-                    srcA = (float)vals[3];
-                    
-                    srcANormalized = srcA / 255.0;
-                    
-                    // Premultiply alpha
-                    
-                    srcR *= srcANormalized;
-                    srcG *= srcANormalized;
-                    srcB *= srcANormalized;
-                    
-                    dstR += srcR * mKernel[k];
-                    dstG += srcG * mKernel[k];
-                    dstB += srcB * mKernel[k];
-                    dstA += srcA * mKernel[k];
+                    dstR += (float)vals[0] * mKernel[k];
+                    dstG += (float)vals[1] * mKernel[k];
+                    dstB += (float)vals[2] * mKernel[k];
+                    dstA += (float)vals[3] * mKernel[k];
                 }
                 
-                if (dstA != 0)
-                {
-                    // Only divide out the alpha if we're not using premultiplied alpha and it's the last pass
-                    if (!(mConvolutionFilterParams.mPremultipliedAlpha && (pass == 1)))
-                    {
-                        dstR /= (dstA / 255.0);
-                        dstG /= (dstA / 255.0);
-                        dstB /= (dstA / 255.0);
-                    }
-                    
-                    dstR = min(255.0, dstR);
-                    dstG = min(255.0, dstG);
-                    dstB = min(255.0, dstB);
-                }
+                dstR = min(255.0, dstR);
+                dstG = min(255.0, dstG);
+                dstB = min(255.0, dstB);
                                 
                 u32 outputValue = (((u8)dstA << 24) & 0xFF000000) | (((u8)dstB << 16) & 0x00FF0000) |
                                     (((u8)dstG << 8) & 0x0000FF00) | ((u8)dstR & 0x000000FF);
@@ -289,6 +279,19 @@
 #endif
     }
 
+    [premultipliedInputBuffer release];
+    
+    if (!mConvolutionFilterParams.mPremultipliedAlpha)
+    {
+        u8* outputData = [mOutputImageBuffer GetData];
+        u32 outputWidth = [mOutputImageBuffer GetWidth];
+        
+        for (int y = 0; y < [mOutputImageBuffer GetEffectiveHeight]; y++)
+        {
+            UnpremultiplyAlphaRGBA8(&outputData[y * outputWidth * 4], [mOutputImageBuffer GetEffectiveWidth]);
+        }
+    }
+
 #if DUMP_DEBUG_IMAGES
     WritePNG([mOutputImageBuffer GetData], @"output.png", [mOutputImageBuffer GetWidth], [mOutputImageBuffer GetHeight]);
 #endif
@@ -296,6 +299,27 @@
     [mOutputTexture CreateGLTexture];
 }
 
+-(ImageBuffer*)CreatePremultipliedInputBuffer
+{
+    ImageBufferParams imageBufferParams;
+    [ImageBuffer InitDefaultParams:&imageBufferParams];
+    
+    imageBufferParams.mWidth = [mInputImageBuffer GetWidth];
+    imageBufferParams.mHeight = [mInputImageBuffer GetHeight];
+    imageBufferParams.mEffectiveWidth = [mInputImageBuffer GetEffectiveWidth];
+    imageBufferParams.mEffectiveHeight = [mInputImageBuffer GetEffectiveHeight];
+    imageBufferParams.mDataOwner = TRUE;
+    
+    u32 numPixels = imageBufferParams.mWidth * imageBufferParams.mHeight;
+    
+    imageBufferParams.mData = malloc(numPixels * 4);
+    memcpy(imageBufferParams.mData, [mInputImageBuffer GetData], numPixels * 4);
+    
+    PremultiplyAlphaRGBA8(imageBufferParams.mData, numPixels);
+    
+    return [(ImageBuffer*)[ImageBuffer alloc] InitWithParams:&imageBufferParams];
+}
+
 -(ImageBuffer*)GetOutputBuffer
 {
     return mOutputImageBuffer;
@@ -6,6 +6,7 @@
 //
 
 #import "ImageBuffer.h"
+#import "Trace.h"
 
 @implementation ImageBuffer
 
@@ -25,6 +26,12 @@
     
     mWrapMode = WRAP_MODE_ZERO;
     
+    // Owned buffers are always freshly allocated by whoever created this buffer
+    if (mParams.mDataOwner)
+    {
+        TRACE_ALLOCATION(mParams.mWidth * mParams.mHeight * mParams.mBytesPerPixel);
+    }
+    
     NSAssert(mParams.mBytesPerPixel == 4, @"Support for other bit depths probably won't work");
     
     return self;
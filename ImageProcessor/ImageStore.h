@@ -0,0 +1,40 @@
+/*
+ *  ImageStore.h
+ *  Neon21ImageProcessor
+ *
+ *  Copyright 2010 Neon Games. All rights reserved.
+ *
+ */
+
+#import "ImageBuffer.h"
+
+// Decoded RGBA8 images that are passed between operations in memory instead of through PNGs on disk.
+//
+// Any input or output path that starts with IMAGE_STORE_PATH_PREFIX (eg. "mem:Title.png") lives here rather
+// than on the file system.  Paths are only names, there are no directories, but RemoveImagesWithPrefix: treats
+// "mem:Mipmaps" as covering "mem:Mipmaps/Title_0.png" so directory style outputs can be dropped in one go.
+// All methods are thread safe.
+
+extern NSString* IMAGE_STORE_PATH_PREFIX;
+
+BOOL IsImageStorePath(NSString* inPath);
+
+@interface ImageStore : NSObject
+{
+    NSMutableDictionary*    mImages;
+    NSLock*                 mLock;
+}
+
+-(ImageStore*)Init;
+-(void)dealloc;
+
++(void)CreateInstance;
++(void)DestroyInstance;
++(ImageStore*)GetInstance;
+
+// The store retains inImage.  Its data shouldn't be modified afterwards.
+-(void)SetImage:(ImageBuffer*)inImage forPath:(NSString*)inPath;
+-(ImageBuffer*)GetImageForPath:(NSString*)inPath;
+-(void)RemoveImagesWithPrefix:(NSString*)inPath;
+
+@end
@@ -0,0 +1,97 @@
+/*
+ *  ImageStore.m
+ *  Neon21ImageProcessor
+ *
+ *  Copyright 2010 Neon Games. All rights reserved.
+ *
+ */
+
+#import "ImageStore.h"
+
+NSString* IMAGE_STORE_PATH_PREFIX = @"mem:";
+
+static ImageStore* sInstance = NULL;
+
+BOOL IsImageStorePath(NSString* inPath)
+{
+    return [inPath hasPrefix:IMAGE_STORE_PATH_PREFIX];
+}
+
+@implementation ImageStore
+
+-(ImageStore*)Init
+{
+    mImages = [[NSMutableDictionary alloc] initWithCapacity:0];
+    mLock = [[NSLock alloc] init];
+    
+    return self;
+}
+
+-(void)dealloc
+{
+    [mImages release];
+    [mLock release];
+    
+    [super dealloc];
+}
+
++(void)CreateInstance
+{
+    NSAssert(sInstance == NULL, @"Trying to create ImageStore when one already exists.");
+    
+    sInstance = [(ImageStore*)[ImageStore alloc] Init];
+}
+
++(void)DestroyInstance
+{
+    NSAssert(sInstance != NULL, @"No image store exists.");
+    
+    [sInstance release];
+    sInstance = NULL;
+}
+
++(ImageStore*)GetInstance
+{
+    return sInstance;
+}
+
+-(void)SetImage:(ImageBuffer*)inImage forPath:(NSString*)inPath
+{
+    [mLock lock];
+    [mImages setObject:inImage forKey:inPath];
+    [mLock unlock];
+}
+
+-(ImageBuffer*)GetImageForPath:(NSString*)inPath
+{
+    [mLock lock];
+    
+    // Keep the image alive for the caller even if another thread removes it
+    ImageBuffer* retVal = [[[mImages objectForKey:inPath] retain] autorelease];
+    
+    [mLock unlock];
+    
+    return retVal;
+}
+
+-(void)RemoveImagesWithPrefix:(NSString*)inPath
+{
+    NSString* directory = [inPath hasSuffix:@"/"] ? inPath : [inPath stringByAppendingString:@"/"];
+    NSMutableArray* removePaths = [NSMutableArray arrayWithCapacity:0];
+    
+    [mLock lock];
+    
+    for (NSString* curPath in mImages)
+    {
+        if ([curPath isEqualToString:inPath] || [curPath hasPrefix:directory])
+        {
+            [removePaths addObject:curPath];
+        }
+    }
+    
+    [mImages removeObjectsForKeys:removePaths];
+    
+    [mLock unlock];
+}
+
+@end
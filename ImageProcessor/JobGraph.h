@@ -0,0 +1,101 @@
+/*
+ *  JobGraph.h
+ *  Neon21ImageProcessor
+ *
+ *  Copyright 2010 Neon Games. All rights reserved.
+ *
+ */
+
+@class Operation;
+@class JobGraph;
+
+// Runs a set of operations as a dependency graph.
+//
+// A node depends on every node that writes one of its inputs (or a file inside an input directory).  Ready nodes
+// run in parallel: operations that need OpenGL run on the calling thread one at a time, everything else runs on
+// GCD.  Intermediates written to "mem:" paths stay in the ImageStore and are dropped once every node reading them
+// has finished.
+//
+// With SetManifestOrder:, nodes that touch the same paths in any way (one reads what another writes, or both write
+// the same place) run in the order they were added instead of being rejected or racing.  Batch mode uses this.
+//
+// Cached nodes are skipped when all their outputs are on disk and newer than their inputs (and any extra inputs
+// added with AddInputFile:, eg. the graph description itself), and nothing upstream needs to run.  Nodes that only
+// write to memory run when something downstream does.
+
+typedef enum
+{
+    JOB_NODE_STATE_PENDING,
+    JOB_NODE_STATE_RUNNING,
+    JOB_NODE_STATE_SUCCEEDED,
+    JOB_NODE_STATE_FAILED,
+    JOB_NODE_STATE_SKIPPED_FAILED_DEPENDENCY,
+    JOB_NODE_STATE_SKIPPED_CACHED
+} JobNodeState;
+
+@interface JobNode : NSObject
+{
+    @public
+        JobGraph*       mGraph;             // Not retained
+        NSString*       mName;
+        Operation*      mOperation;
+        BOOL            mCache;
+        
+        NSArray*        mInputPaths;
+        NSArray*        mOutputPaths;
+        BOOL            mHasDiskOutputs;
+        BOOL            mHasMemoryOutputs;
+        
+        NSMutableArray* mDependencies;      // JobNodes we read from
+        NSMutableArray* mDependents;        // JobNodes that read from us
+        
+        JobNodeState    mState;
+        NSString*       mError;
+        
+        BOOL            mStale;
+        BOOL            mNeeded;
+        double          mNewestInputTime;
+        int             mNumPendingDependencies;
+        int             mNumPendingConsumers;
+}
+
+-(void)dealloc;
+
+@end
+
+@interface JobGraph : NSObject
+{
+    NSMutableArray*     mNodes;
+    NSMutableArray*     mExtraInputPaths;
+    
+    NSCondition*        mCondition;
+    NSMutableArray*     mReadyNodes;
+    int                 mNumRemaining;
+    
+    BOOL                mManifestOrder;
+}
+
+-(JobGraph*)Init;
+-(void)dealloc;
+
+// The graph retains inOperation
+-(void)AddNodeWithName:(NSString*)inName operation:(Operation*)inOperation cache:(BOOL)inCache;
+-(void)AddInputFile:(NSString*)inPath;
+-(void)SetManifestOrder:(BOOL)inManifestOrder;
+
+// Returns FALSE if the graph is invalid or any node failed
+-(BOOL)Run;
+
+// Nodes that failed or were skipped because a dependency failed.  Valid after Run.
+-(int)GetNumFailed;
+
+-(BOOL)BuildDependencies;
+-(NSArray*)SortNodes;
+-(void)DetermineNeededNodes:(NSArray*)inSortedNodes;
+-(void)PerformNode:(JobNode*)inNode;
+-(void)CompleteNode:(JobNode*)inNode;
+-(void)FailDependentsOfNode:(JobNode*)inNode;
+-(void)ReleaseInputsOfNode:(JobNode*)inNode;
+-(void)Report;
+
+@end
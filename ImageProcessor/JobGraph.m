@@ -0,0 +1,672 @@
+/*
+ *  JobGraph.m
+ *  Neon21ImageProcessor
+ *
+ *  Copyright 2010 Neon Games. All rights reserved.
+ *
+ */
+
+#import "JobGraph.h"
+#import "Operation.h"
+#import "ImageStore.h"
+
+#import <dispatch/dispatch.h>
+#import <sys/stat.h>
+
+static const double JOB_GRAPH_MISSING_TIME = -1.0;
+
+static NSString* JobGraphNormalizePath(NSString* inPath)
+{
+    if (IsImageStorePath(inPath))
+    {
+        while (([inPath length] > 1) && [inPath hasSuffix:@"/"])
+        {
+            inPath = [inPath substringToIndex:([inPath length] - 1)];
+        }
+        
+        return inPath;
+    }
+    
+    return [inPath stringByStandardizingPath];
+}
+
+// TRUE if inPath is inOuterPath or lies inside it
+static BOOL JobGraphPathContains(NSString* inOuterPath, NSString* inPath)
+{
+    return [inPath isEqualToString:inOuterPath] || [inPath hasPrefix:[inOuterPath stringByAppendingString:@"/"]];
+}
+
+static BOOL JobGraphPathsOverlap(NSArray* inPaths, NSArray* inOtherPaths)
+{
+    for (NSString* curPath in inPaths)
+    {
+        for (NSString* otherPath in inOtherPaths)
+        {
+            if (JobGraphPathContains(curPath, otherPath) || JobGraphPathContains(otherPath, curPath))
+            {
+                return TRUE;
+            }
+        }
+    }
+    
+    return FALSE;
+}
+
+static double JobGraphModificationTime(NSString* inPath, BOOL* outDirectory)
+{
+    struct stat fileStat;
+    
+    if (stat([inPath fileSystemRepresentation], &fileStat) != 0)
+    {
+        return JOB_GRAPH_MISSING_TIME;
+    }
+    
+    if (outDirectory != NULL)
+    {
+        *outDirectory = S_ISDIR(fileStat.st_mode);
+    }
+    
+    return (double)fileStat.st_mtimespec.tv_sec + ((double)fileStat.st_mtimespec.tv_nsec * 1e-9);
+}
+
+// For directories, returns the newest (or oldest) time of everything inside them.  The newest time of a directory also
+// includes the directory itself, so removing a file counts as a change.  Returns JOB_GRAPH_MISSING_TIME if the path
+// doesn't exist, or when looking for the oldest output in an empty directory.
+static double JobGraphDirectoryTime(NSString* inPath, BOOL inNewest)
+{
+    BOOL directory = FALSE;
+    double retVal = JobGraphModificationTime(inPath, &directory);
+    
+    if ((retVal == JOB_GRAPH_MISSING_TIME) || (!directory))
+    {
+        return retVal;
+    }
+    
+    if (!inNewest)
+    {
+        retVal = JOB_GRAPH_MISSING_TIME;
+    }
+    
+    for (NSString* curPath in [[NSFileManager defaultManager] enumeratorAtPath:inPath])
+    {
+        BOOL curDirectory = FALSE;
+        double curTime = JobGraphModificationTime([inPath stringByAppendingPathComponent:curPath], &curDirectory);
+        
+        if ((curTime == JOB_GRAPH_MISSING_TIME) || (curDirectory && !inNewest))
+        {
+            continue;
+        }
+        
+        if ((retVal == JOB_GRAPH_MISSING_TIME) || (inNewest && (curTime > retVal)) || (!inNewest && (curTime < retVal)))
+        {
+            retVal = curTime;
+        }
+    }
+    
+    return retVal;
+}
+
+static void JobGraphPerformNode(void* inContext)
+{
+    JobNode* node = (JobNode*)inContext;
+    
+    [node->mGraph PerformNode:node];
+}
+
+@implementation JobNode
+
+-(void)dealloc
+{
+    [mName release];
+    [mOperation release];
+    [mInputPaths release];
+    [mOutputPaths release];
+    [mDependencies release];
+    [mDependents release];
+    [mError release];
+    
+    [super dealloc];
+}
+
+@end
+
+@implementation JobGraph
+
+-(JobGraph*)Init
+{
+    mNodes = [[NSMutableArray alloc] initWithCapacity:0];
+    mExtraInputPaths = [[NSMutableArray alloc] initWithCapacity:0];
+    
+    mCondition = [[NSCondition alloc] init];
+    mReadyNodes = [[NSMutableArray alloc] initWithCapacity:0];
+    mNumRemaining = 0;
+    
+    mManifestOrder = FALSE;
+    
+    return self;
+}
+
+-(void)dealloc
+{
+    [mNodes release];
+    [mExtraInputPaths release];
+    [mCondition release];
+    [mReadyNodes release];
+    
+    [super dealloc];
+}
+
+-(void)AddNodeWithName:(NSString*)inName operation:(Operation*)inOperation cache:(BOOL)inCache
+{
+    JobNode* node = [JobNode alloc];
+    
+    node->mGraph = self;
+    node->mName = [inName retain];
+    node->mOperation = [inOperation retain];
+    node->mCache = inCache;
+    node->mDependencies = [[NSMutableArray alloc] initWithCapacity:0];
+    node->mDependents = [[NSMutableArray alloc] initWithCapacity:0];
+    node->mState = JOB_NODE_STATE_PENDING;
+    
+    NSMutableArray* inputPaths = [NSMutableArray arrayWithCapacity:0];
+    NSMutableArray* outputPaths = [NSMutableArray arrayWithCapacity:0];
+    
+    for (NSString* curPath in [inOperation GetInputPaths])
+    {
+        [inputPaths addObject:JobGraphNormalizePath(curPath)];
+    }
+    
+    for (NSString* curPath in [inOperation GetOutputPaths])
+    {
+        [outputPaths addObject:JobGraphNormalizePath(curPath)];
+        
+        if (IsImageStorePath(curPath))
+        {
+            node->mHasMemoryOutputs = TRUE;
+        }
+        else
+        {
+            node->mHasDiskOutputs = TRUE;
+        }
+    }
+    
+    node->mInputPaths = [inputPaths retain];
+    node->mOutputPaths = [outputPaths retain];
+    
+    [mNodes addObject:node];
+    [node release];
+}
+
+-(void)AddInputFile:(NSString*)inPath
+{
+    [mExtraInputPaths addObject:inPath];
+}
+
+-(void)SetManifestOrder:(BOOL)inManifestOrder
+{
+    mManifestOrder = inManifestOrder;
+}
+
+-(BOOL)Run
+{
+    if (![self BuildDependencies])
+    {
+        return FALSE;
+    }
+    
+    NSArray* sortedNodes = [self SortNodes];
+    
+    if (sortedNodes == NULL)
+    {
+        return FALSE;
+    }
+    
+    [self DetermineNeededNodes:sortedNodes];
+    
+    for (JobNode* curNode in mNodes)
+    {
+        if ((curNode->mNeeded) && (curNode->mNumPendingDependencies == 0))
+        {
+            [mReadyNodes addObject:curNode];
+        }
+    }
+    
+    dispatch_queue_t queue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+    
+    [mCondition lock];
+    
+    while (mNumRemaining > 0)
+    {
+        NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+        
+        // Hand everything that can run off this thread to GCD, and keep one OpenGL node for ourselves
+        JobNode* mainThreadNode = NULL;
+        NSArray* readyNodes = [NSArray arrayWithArray:mReadyNodes];
+        
+        [mReadyNodes removeAllObjects];
+        
+        for (JobNode* curNode in readyNodes)
+        {
+            if ([curNode->mOperation RequiresMainThread])
+            {
+                if (mainThreadNode == NULL)
+                {
+                    mainThreadNode = curNode;
+                }
+                else
+                {
+                    [mReadyNodes addObject:curNode];
+                }
+            }
+            else
+            {
+                curNode->mState = JOB_NODE_STATE_RUNNING;
+                dispatch_async_f(queue, curNode, JobGraphPerformNode);
+            }
+        }
+        
+        if (mainThreadNode != NULL)
+        {
+            mainThreadNode->mState = JOB_NODE_STATE_RUNNING;
+            
+            [mCondition unlock];
+            [self PerformNode:mainThreadNode];
+            [mCondition lock];
+        }
+        else if (mNumRemaining > 0)
+        {
+            [mCondition wait];
+        }
+        
+        [pool release];
+    }
+    
+    [mCondition unlock];
+    
+    [self Report];
+    
+    for (JobNode* curNode in mNodes)
+    {
+        if ((curNode->mState != JOB_NODE_STATE_SUCCEEDED) && (curNode->mState != JOB_NODE_STATE_SKIPPED_CACHED))
+        {
+            return FALSE;
+        }
+    }
+    
+    return TRUE;
+}
+
+-(BOOL)BuildDependencies
+{
+    int numNodes = [mNodes count];
+    
+    if (mManifestOrder)
+    {
+        // Later nodes wait for any earlier node they read from, write over, or write underneath.  Edges only point
+        // forward, so there can't be a cycle.
+        for (int consumerIndex = 0; consumerIndex < numNodes; consumerIndex++)
+        {
+            JobNode* consumer = [mNodes objectAtIndex:consumerIndex];
+            
+            for (int producerIndex = 0; producerIndex < consumerIndex; producerIndex++)
+            {
+                JobNode* producer = [mNodes objectAtIndex:producerIndex];
+                
+                if (JobGraphPathsOverlap(producer->mOutputPaths, consumer->mInputPaths) ||
+                    JobGraphPathsOverlap(producer->mOutputPaths, consumer->mOutputPaths) ||
+                    JobGraphPathsOverlap(producer->mInputPaths, consumer->mOutputPaths))
+                {
+                    [consumer->mDependencies addObject:producer];
+                    [producer->mDependents addObject:consumer];
+                }
+            }
+        }
+        
+        return TRUE;
+    }
+    
+    for (int producerIndex = 0; producerIndex < numNodes; producerIndex++)
+    {
+        JobNode* producer = [mNodes objectAtIndex:producerIndex];
+        
+        for (int consumerIndex = 0; consumerIndex < numNodes; consumerIndex++)
+        {
+            if (consumerIndex == producerIndex)
+            {
+                continue;
+            }
+            
+            JobNode* consumer = [mNodes objectAtIndex:consumerIndex];
+            
+            for (NSString* outputPath in producer->mOutputPaths)
+            {
+                // Two nodes writing the same place would race, and neither order is obviously right
+                if ((consumerIndex > producerIndex) && ([consumer->mOutputPaths containsObject:outputPath]))
+                {
+                    printf("\e[1;31mNodes %s and %s both write %s\e[m\n", [producer->mName UTF8String], [consumer->mName UTF8String],
+                            [outputPath UTF8String]);
+                    return FALSE;
+                }
+                
+                for (NSString* inputPath in consumer->mInputPaths)
+                {
+                    if ((JobGraphPathContains(outputPath, inputPath) || JobGraphPathContains(inputPath, outputPath)) &&
+                        (![consumer->mDependencies containsObject:producer]))
+                    {
+                        [consumer->mDependencies addObject:producer];
+                        [producer->mDependents addObject:consumer];
+                    }
+                }
+            }
+        }
+    }
+    
+    return TRUE;
+}
+
+-(NSArray*)SortNodes
+{
+    NSMutableArray* sortedNodes = [NSMutableArray arrayWithCapacity:[mNodes count]];
+    
+    for (JobNode* curNode in mNodes)
+    {
+        curNode->mNumPendingDependencies = [curNode->mDependencies count];
+        
+        if (curNode->mNumPendingDependencies == 0)
+        {
+            [sortedNodes addObject:curNode];
+        }
+    }
+    
+    for (int curIndex = 0; curIndex < [sortedNodes count]; curIndex++)
+    {
+        JobNode* curNode = [sortedNodes objectAtIndex:curIndex];
+        
+        for (JobNode* dependent in curNode->mDependents)
+        {
+            dependent->mNumPendingDependencies--;
+            
+            if (dependent->mNumPendingDependencies == 0)
+            {
+                [sortedNodes addObject:dependent];
+            }
+        }
+    }
+    
+    if ([sortedNodes count] != [mNodes count])
+    {
+        for (JobNode* curNode in mNodes)
+        {
+            if (curNode->mNumPendingDependencies != 0)
+            {
+                printf("\e[1;31mNode %s is part of a dependency cycle\e[m\n", [curNode->mName UTF8String]);
+            }
+        }
+        
+        return NULL;
+    }
+    
+    return sortedNodes;
+}
+
+-(void)DetermineNeededNodes:(NSArray*)inSortedNodes
+{
+    double extraInputTime = 0.0;
+    
+    for (NSString* curPath in mExtraInputPaths)
+    {
+        double inputTime = JobGraphDirectoryTime(curPath, TRUE);
+        extraInputTime = max(extraInputTime, inputTime);
+    }
+    
+    // First pass, inputs before outputs.  A node is stale if it can't be cached, something upstream is stale, or its
+    // outputs are older than anything it was built from.  Times flow through in memory intermediates unchanged.
+    for (JobNode* curNode in inSortedNodes)
+    {
+        curNode->mNewestInputTime = extraInputTime;
+        curNode->mStale = !curNode->mCache;
+        
+        for (NSString* inputPath in curNode->mInputPaths)
+        {
+            if (IsImageStorePath(inputPath))
+            {
+                continue;
+            }
+            
+            double inputTime = JobGraphDirectoryTime(inputPath, TRUE);
+            
+            if (inputTime == JOB_GRAPH_MISSING_TIME)
+            {
+                curNode->mStale = TRUE;
+            }
+            
+            curNode->mNewestInputTime = max(curNode->mNewestInputTime, inputTime);
+        }
+        
+        for (JobNode* dependency in curNode->mDependencies)
+        {
+            curNode->mStale = curNode->mStale || dependency->mStale;
+            curNode->mNewestInputTime = max(curNode->mNewestInputTime, dependency->mNewestInputTime);
+        }
+        
+        for (NSString* outputPath in curNode->mOutputPaths)
+        {
+            if (IsImageStorePath(outputPath))
+            {
+                continue;
+            }
+            
+            double outputTime = JobGraphDirectoryTime(outputPath, FALSE);
+            
+            if ((outputTime == JOB_GRAPH_MISSING_TIME) || (outputTime < curNode->mNewestInputTime))
+            {
+                curNode->mStale = TRUE;
+            }
+        }
+    }
+    
+    // Second pass, outputs before inputs.  Stale nodes that write to disk run, and memory only nodes run if anything
+    // reading from them does.  In manifest order everything runs, the same as it would one entry at a time.
+    for (JobNode* curNode in [inSortedNodes reverseObjectEnumerator])
+    {
+        curNode->mNeeded = (curNode->mHasDiskOutputs && curNode->mStale) || mManifestOrder;
+        curNode->mNumPendingConsumers = 0;
+        
+        for (JobNode* dependent in curNode->mDependents)
+        {
+            if (dependent->mNeeded)
+            {
+                curNode->mNumPendingConsumers++;
+                curNode->mNeeded = curNode->mNeeded || curNode->mHasMemoryOutputs;
+            }
+        }
+    }
+    
+    mNumRemaining = 0;
+    
+    for (JobNode* curNode in inSortedNodes)
+    {
+        curNode->mNumPendingDependencies = 0;
+        
+        if (!curNode->mNeeded)
+        {
+            curNode->mState = JOB_NODE_STATE_SKIPPED_CACHED;
+            continue;
+        }
+        
+        mNumRemaining++;
+        
+        for (JobNode* dependency in curNode->mDependencies)
+        {
+            if (dependency->mNeeded)
+            {
+                curNode->mNumPendingDependencies++;
+            }
+        }
+    }
+}
+
+-(void)PerformNode:(JobNode*)inNode
+{
+    NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+    
+    BOOL success = FALSE;
+    NSString* error = NULL;
+    
+    @try
+    {
+        success = [inNode->mOperation Perform];
+    }
+    @catch (NSException* exception)
+    {
+        error = [exception reason];
+    }
+    
+    [mCondition lock];
+    
+    inNode->mState = success ? JOB_NODE_STATE_SUCCEEDED : JOB_NODE_STATE_FAILED;
+    inNode->mError = [error retain];
+    
+    [self CompleteNode:inNode];
+    [mCondition broadcast];
+    
+    [mCondition unlock];
+    
+    [pool release];
+}
+
+-(void)CompleteNode:(JobNode*)inNode
+{
+    mNumRemaining--;
+    
+    [self ReleaseInputsOfNode:inNode];
+    
+    if (inNode->mState != JOB_NODE_STATE_SUCCEEDED)
+    {
+        [self FailDependentsOfNode:inNode];
+        return;
+    }
+    
+    for (JobNode* dependent in inNode->mDependents)
+    {
+        if ((dependent->mNeeded) && (dependent->mState == JOB_NODE_STATE_PENDING))
+        {
+            dependent->mNumPendingDependencies--;
+            
+            if (dependent->mNumPendingDependencies == 0)
+            {
+                [mReadyNodes addObject:dependent];
+            }
+        }
+    }
+}
+
+-(void)FailDependentsOfNode:(JobNode*)inNode
+{
+    for (JobNode* dependent in inNode->mDependents)
+    {
+        if ((dependent->mNeeded) && (dependent->mState == JOB_NODE_STATE_PENDING))
+        {
+            dependent->mState = JOB_NODE_STATE_SKIPPED_FAILED_DEPENDENCY;
+            mNumRemaining--;
+            
+            [self ReleaseInputsOfNode:dependent];
+            [self FailDependentsOfNode:dependent];
+        }
+    }
+}
+
+-(void)ReleaseInputsOfNode:(JobNode*)inNode
+{
+    // Drop in memory intermediates as soon as the last node reading them is done.  In manifest order a dependent may
+    // have overwritten the intermediate rather than read it, so everything is kept until the graph is released.
+    if (mManifestOrder)
+    {
+        return;
+    }
+    
+    for (JobNode* dependency in inNode->mDependencies)
+    {
+        if ((!dependency->mNeeded) || (!dependency->mHasMemoryOutputs))
+        {
+            continue;
+        }
+        
+        dependency->mNumPendingConsumers--;
+        
+        if (dependency->mNumPendingConsumers == 0)
+        {
+            for (NSString* outputPath in dependency->mOutputPaths)
+            {
+                if (IsImageStorePath(outputPath))
+                {
+                    [[ImageStore GetInstance] RemoveImagesWithPrefix:outputPath];
+                }
+            }
+        }
+    }
+}
+
+-(int)GetNumFailed
+{
+    int numFailed = 0;
+    
+    for (JobNode* curNode in mNodes)
+    {
+        if ((curNode->mState != JOB_NODE_STATE_SUCCEEDED) && (curNode->mState != JOB_NODE_STATE_SKIPPED_CACHED))
+        {
+            numFailed++;
+        }
+    }
+    
+    return numFailed;
+}
+
+-(void)Report
+{
+    int numRun = 0;
+    int numCached = 0;
+    int numFailed = 0;
+    
+    for (JobNode* curNode in mNodes)
+    {
+        switch (curNode->mState)
+        {
+            case JOB_NODE_STATE_SUCCEEDED:
+            {
+                numRun++;
+                break;
+            }
+            
+            case JOB_NODE_STATE_SKIPPED_CACHED:
+            {
+                numCached++;
+                break;
+            }
+            
+            case JOB_NODE_STATE_FAILED:
+            {
+                printf("\e[1;31mNode %s failed\e[m\n", [curNode->mName UTF8String]);
+                
+                if (curNode->mError != NULL)
+                {
+                    printf("\e[1;31m\t%s\e[m\n", [curNode->mError UTF8String]);
+                }
+                
+                numFailed++;
+                break;
+            }
+            
+            default:
+            {
+                printf("\e[1;31mNode %s was skipped because a node it depends on failed\e[m\n", [curNode->mName UTF8String]);
+                numFailed++;
+                break;
+            }
+        }
+    }
+    
+    printf("Job Graph:\t%d nodes, %d run, %d up to date, %d failed\n", (int)[mNodes count], numRun, numCached, numFailed);
+}
+
+@end
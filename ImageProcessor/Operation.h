@@ -7,6 +7,7 @@
  */
  
 #import "TextTextureBuilder.h"
+#import "PNGUtilities.h"
  
 typedef enum
 {
@@ -15,6 +16,9 @@ typedef enum
     OPERATION_GENERATE_MIPMAPS,
     OPERATION_GENERATE_TEXT,
     OPERATION_GENERATE_ATLAS,
+    OPERATION_PACK_BIGFILE,
+    OPERATION_GENERATE_SDF_ATLAS,
+    OPERATION_GENERATE_TEXT_ATLAS,
     OPERATION_MAX,
     OPERATION_INVALID = OPERATION_MAX
 } OperationType;
@@ -39,22 +43,52 @@ extern const char* GENERATE_STINGER_FLAG_NAME;
 }
 
 +(Operation*)OperationWithType:(OperationType)inType;
+-(void)dealloc;
+
 -(void)SetInputFile:(NSString*)inString;
 -(void)SetOutputFile:(NSString*)inString;
 -(void)SetOutputDirectory:(NSString*)inString;
 -(void)SetArguments:(NSMutableArray*)inArguments;
 
+// Input file (plus the font for text operations), and output file and/or output directory, whichever the operation uses
+-(NSArray*)GetInputPaths;
+-(NSArray*)GetOutputPaths;
+
 -(void)SanitizePaths;
 
--(void)Perform;
--(void)PerformBloom;
--(void)PerformPremultiplyAlpha;
--(void)PerformGenerateMipmaps;
--(void)PerformGenerateText;
+-(BOOL)Perform;
+-(BOOL)PerformBloom;
+-(BOOL)PerformPremultiplyAlpha;
+-(BOOL)PerformGenerateMipmaps;
+-(BOOL)PerformGenerateText;
+-(BOOL)PerformPackBigFile;
+-(BOOL)PerformGenerateSDFAtlas;
+-(BOOL)PerformGenerateTextAtlas;
+
+// Operations that don't require the main thread can be performed concurrently with each other
+-(BOOL)RequiresMainThread;
+-(void)ResolvePathsRelativeTo:(NSString*)inDirectory;
+
+// Images are read from and written to the ImageStore for "mem:" paths, and PNGs on disk otherwise
+-(BOOL)ReadImage:(NSString*)inPath info:(PNGInfo*)outInfo;
+-(BOOL)WriteImage:(u8*)inData width:(u32)inWidth height:(u32)inHeight path:(NSString*)inPath;
+-(Texture*)CreateTextureWithPath:(NSString*)inPath params:(TextureParams*)inParams;
+
+// Text rendering options shared by the text operations.  Loads the font and returns its data.  Arguments that aren't
+// text options are added to outUnhandledArguments, or asserted on if it's NULL.
+-(NSData*)ParseTextArguments:(TextTextureParams*)outTextParams bloom:(BOOL*)outBloom stinger:(BOOL*)outStinger retina:(BOOL*)outRetina
+    unhandledArguments:(NSMutableArray*)outUnhandledArguments;
+
+// Font a text operation renders with, from its fontPath and -fontName arguments.  NULL if either is missing.
+-(NSString*)GetFontPath;
+
+-(BOOL)GenerateTextCore:(TextTextureParams*)inTextParams bloom:(BOOL)inBloom outputStinger:(BOOL)inOutputStinger retina:(BOOL)inRetina pngInfo:(TextCorePNGInfo*)outPNGInfo;
 
--(void)GenerateTextCore:(TextTextureParams*)inTextParams bloom:(BOOL)inBloom outputStinger:(BOOL)inOutputStinger retina:(BOOL)inRetina pngInfo:(TextCorePNGInfo*)outPNGInfo;
+// Glyph metrics and kerning for an SDF atlas are written next to the atlas image with this extension
+-(NSString*)GetSDFMetricsPath;
 
--(void)GenerateMipmapsForFile:(NSString*)inFileName;
+-(BOOL)GenerateMipmapsForFile:(NSString*)inFileName;
+-(BOOL)GenerateMipmapsForImage:(PNGInfo*)inPNGInfo fileName:(NSString*)inFileName;
 
 -(void)Init;
 
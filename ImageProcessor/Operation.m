@@ -13,19 +13,74 @@
 #import "BloomGaussianFilter.h"
 #import "KaiserFilter.h"
 #import "ResourceManager.h"
+#import "BigFilePacker.h"
+#import "SDFAtlasBuilder.h"
+#import "TextAtlasWriter.h"
+#import "TextureAtlas.h"
+#import "MappedData.h"
+#import "JSONUtilities.h"
 
 #import "TextureManager.h"
 #import "PNGTexture.h"
 
 #import "PNGUtilities.h"
+#import "AlphaUtilities.h"
+#import "PrefetchLoader.h"
+#import "Trace.h"
+
+#import "ImageStore.h"
 
 #import "ImageProcessorDefines.h"
 
+#import <dispatch/dispatch.h>
+#import <libkern/OSAtomic.h>
+
 const char* FONT_PATH_PARAMETER_NAME = "fontPath";
 const char* GENERATE_TEXT_STRING_PARAMETER_NAME = "generateTextString";
 const char* GENERATE_STINGER_FLAG_NAME = "generateStinger";
 const char* GENERATE_RETINA_FLAG_NAME = "-generateRetina";
 
+typedef struct
+{
+    NSArray*        mInputFiles;
+    NSArray*        mOutputFiles;
+    PNGWriteParams* mParams;
+    volatile s32    mNumFailed;
+} PremultiplyAlphaBatch;
+
+static void PremultiplyAlphaRow(u8* ioRow, u32 inWidth, void* inContext)
+{
+    PremultiplyAlphaRGBA8(ioRow, inWidth);
+}
+
+static void PremultiplyAlphaBatchFile(void* inContext, size_t inIndex)
+{
+    PremultiplyAlphaBatch* batch = (PremultiplyAlphaBatch*)inContext;
+    
+    NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+    
+    if (!TransformPNGFile(  [batch->mInputFiles objectAtIndex:inIndex], [batch->mOutputFiles objectAtIndex:inIndex],
+                            PremultiplyAlphaRow, NULL, batch->mParams, NULL))
+    {
+        OSAtomicIncrement32(&batch->mNumFailed);
+    }
+    
+    [pool release];
+}
+
+static NSString* ResolvePathRelativeTo(NSString* inPath, NSString* inDirectory)
+{
+    NSString* resolvedPath = [inDirectory stringByAppendingPathComponent:inPath];
+    
+    // stringByAppendingPathComponent: strips the trailing slash that SanitizePaths put on directories
+    if ([inPath hasSuffix:@"/"])
+    {
+        resolvedPath = [resolvedPath stringByAppendingString:@"/"];
+    }
+    
+    return resolvedPath;
+}
+
 @implementation Operation
 
 +(Operation*)OperationWithType:(OperationType)inType
@@ -49,26 +104,89 @@ const char* GENERATE_RETINA_FLAG_NAME = "-generateRetina";
     mType = OPERATION_INVALID;
 }
 
+-(void)dealloc
+{
+    [mInputFile release];
+    [mOutputFile release];
+    [mOutputDirectory release];
+    [mArguments release];
+    
+    [super dealloc];
+}
+
 -(void)SetInputFile:(NSString*)inString
 {
+    [inString retain];
+    [mInputFile release];
     mInputFile = inString;
 }
 
 -(void)SetOutputFile:(NSString*)inString
 {
+    [inString retain];
+    [mOutputFile release];
     mOutputFile = inString;
 }
 
 -(void)SetOutputDirectory:(NSString*)inString
 {
+    [inString retain];
+    [mOutputDirectory release];
     mOutputDirectory = inString;
 }
 
 -(void)SetArguments:(NSMutableArray*)inArguments
 {
+    [inArguments retain];
+    [mArguments release];
     mArguments = inArguments;
 }
 
+-(NSArray*)GetInputPaths
+{
+    NSMutableArray* inputPaths = [NSMutableArray arrayWithCapacity:1];
+    
+    if (mInputFile != NULL)
+    {
+        [inputPaths addObject:mInputFile];
+    }
+    
+    // Text is rendered with a font that isn't the input file, so editing it has to invalidate the output too
+    if ((mType == OPERATION_GENERATE_TEXT) || (mType == OPERATION_GENERATE_TEXT_ATLAS))
+    {
+        NSString* fontPath = [self GetFontPath];
+        
+        if ((fontPath != NULL) && (![inputPaths containsObject:fontPath]))
+        {
+            [inputPaths addObject:fontPath];
+        }
+    }
+    
+    return inputPaths;
+}
+
+-(NSArray*)GetOutputPaths
+{
+    NSMutableArray* outputPaths = [NSMutableArray arrayWithCapacity:2];
+    
+    if (mOutputFile != NULL)
+    {
+        [outputPaths addObject:mOutputFile];
+    }
+    
+    if (mOutputDirectory != NULL)
+    {
+        [outputPaths addObject:mOutputDirectory];
+    }
+    
+    if ((mType == OPERATION_GENERATE_SDF_ATLAS) && (mOutputFile != NULL))
+    {
+        [outputPaths addObject:[self GetSDFMetricsPath]];
+    }
+    
+    return outputPaths;
+}
+
 -(void)SanitizePaths
 {
     if (mInputFile != NULL)
@@ -80,7 +198,7 @@ const char* GENERATE_RETINA_FLAG_NAME = "-generateRetina";
         {
             if (![mInputFile hasSuffix:@"/"])
             {
-                mInputFile = [mInputFile stringByAppendingString:@"/"];
+                [self SetInputFile:[mInputFile stringByAppendingString:@"/"]];
             }
         }
     }
@@ -94,7 +212,7 @@ const char* GENERATE_RETINA_FLAG_NAME = "-generateRetina";
         {
             if (![mOutputFile hasSuffix:@"/"])
             {
-                mOutputFile = [mOutputFile stringByAppendingString:@"/"];
+                [self SetOutputFile:[mOutputFile stringByAppendingString:@"/"]];
             }
         }
     }
@@ -103,45 +221,199 @@ const char* GENERATE_RETINA_FLAG_NAME = "-generateRetina";
     {
         if (![mOutputDirectory hasSuffix:@"/"])
         {
-            mOutputDirectory = [mOutputDirectory stringByAppendingString:@"/"];
+            [self SetOutputDirectory:[mOutputDirectory stringByAppendingString:@"/"]];
         }
     }
 }
 
--(void)Perform
+-(BOOL)Perform
 {
     [self SanitizePaths];
     
+    BOOL success = FALSE;
+    
     switch(mType)
     {
         case OPERATION_BLOOM:
         {
-            [self PerformBloom];
+            success = [self PerformBloom];
             break;
         }
         
         case OPERATION_PREMULTIPLY_ALPHA:
         {
-            [self PerformPremultiplyAlpha];
+            success = [self PerformPremultiplyAlpha];
             break;
         }
         
         case OPERATION_GENERATE_MIPMAPS:
         {
-            [self PerformGenerateMipmaps];
+            success = [self PerformGenerateMipmaps];
             break;
         }
         
         case OPERATION_GENERATE_TEXT:
         {
-            [self PerformGenerateText];
+            success = [self PerformGenerateText];
+            break;
+        }
+        
+        case OPERATION_PACK_BIGFILE:
+        {
+            success = [self PerformPackBigFile];
+            break;
+        }
+        
+        case OPERATION_GENERATE_SDF_ATLAS:
+        {
+            success = [self PerformGenerateSDFAtlas];
             break;
         }
+        
+        case OPERATION_GENERATE_TEXT_ATLAS:
+        {
+            success = [self PerformGenerateTextAtlas];
+            break;
+        }
+        
+        default:
+        {
+            printf("\e[1;31mOperation %d is not supported\e[m\n", mType);
+            break;
+        }
+    }
+    
+    return success;
+}
+
+-(BOOL)RequiresMainThread
+{
+    // Anything that touches OpenGL, the ResourceManager or the TextTextureBuilder has to stay on the main thread.
+    // The rest only use the thread safe PNG and BigFile paths.
+    switch(mType)
+    {
+        case OPERATION_PREMULTIPLY_ALPHA:
+        case OPERATION_GENERATE_MIPMAPS:
+        case OPERATION_PACK_BIGFILE:
+        case OPERATION_GENERATE_SDF_ATLAS:
+        {
+            return FALSE;
+        }
+        
+        default:
+        {
+            return TRUE;
+        }
+    }
+}
+
+-(void)ResolvePathsRelativeTo:(NSString*)inDirectory
+{
+    if ((mInputFile != NULL) && (![mInputFile isAbsolutePath]) && (!IsImageStorePath(mInputFile)))
+    {
+        [self SetInputFile:ResolvePathRelativeTo(mInputFile, inDirectory)];
+    }
+    
+    if ((mOutputFile != NULL) && (![mOutputFile isAbsolutePath]) && (!IsImageStorePath(mOutputFile)))
+    {
+        [self SetOutputFile:ResolvePathRelativeTo(mOutputFile, inDirectory)];
+    }
+    
+    if ((mOutputDirectory != NULL) && (![mOutputDirectory isAbsolutePath]) && (!IsImageStorePath(mOutputDirectory)))
+    {
+        [self SetOutputDirectory:ResolvePathRelativeTo(mOutputDirectory, inDirectory)];
+    }
+}
+
+-(BOOL)ReadImage:(NSString*)inPath info:(PNGInfo*)outInfo
+{
+    if (!IsImageStorePath(inPath))
+    {
+        return ReadPNGFile(inPath, TEX_ADDRESSING_8, outInfo);
+    }
+    
+    ImageBuffer* image = [[ImageStore GetInstance] GetImageForPath:inPath];
+    
+    if (image == NULL)
+    {
+        printf("\e[1;31mNo in memory image %s\e[m\n", [inPath UTF8String]);
+        return FALSE;
+    }
+    
+    // Callers own and may modify what they read, so hand out a copy
+    u32 size = [image GetWidth] * [image GetHeight] * 4;
+    
+    outInfo->mWidth = [image GetWidth];
+    outInfo->mHeight = [image GetHeight];
+    outInfo->mImageData = malloc(size);
+    
+    memcpy(outInfo->mImageData, [image GetData], size);
+    
+    return TRUE;
+}
+
+-(BOOL)WriteImage:(u8*)inData width:(u32)inWidth height:(u32)inHeight path:(NSString*)inPath
+{
+    if (!IsImageStorePath(inPath))
+    {
+        return WritePNG(inData, inPath, inWidth, inHeight);
+    }
+    
+    ImageBufferParams params;
+    [ImageBuffer InitDefaultParams:&params];
+    
+    params.mWidth = inWidth;
+    params.mHeight = inHeight;
+    params.mData = malloc(inWidth * inHeight * 4);
+    params.mDataOwner = TRUE;
+    
+    memcpy(params.mData, inData, inWidth * inHeight * 4);
+    
+    ImageBuffer* image = [(ImageBuffer*)[ImageBuffer alloc] InitWithParams:&params];
+    [[ImageStore GetInstance] SetImage:image forPath:inPath];
+    [image release];
+    
+    return TRUE;
+}
+
+-(Texture*)CreateTextureWithPath:(NSString*)inPath params:(TextureParams*)inParams
+{
+    if (!IsImageStorePath(inPath))
+    {
+        NSNumber* texHandle = [[ResourceManager GetInstance] LoadAssetWithPath:inPath];
+        
+        Texture* texture = [[PNGTexture alloc] InitWithData:[[ResourceManager GetInstance] GetDataForHandle:texHandle] textureParams:inParams];
+        
+        // The texture has its own decoded copy, so the file doesn't need to stay loaded
+        [[ResourceManager GetInstance] UnloadAssetWithHandle:texHandle];
+        
+        return texture;
+    }
+    
+    PNGInfo pngInfo;
+    
+    if (![self ReadImage:inPath info:&pngInfo])
+    {
+        return NULL;
     }
+    
+    Texture* texture = [(Texture*)[Texture alloc] Init];
+    
+    memcpy(&texture->mParams, inParams, sizeof(TextureParams));
+    
+    texture->mWidth = pngInfo.mWidth;
+    texture->mHeight = pngInfo.mHeight;
+    texture->mTexBytes = pngInfo.mImageData;
+    
+    [texture CreateGLTexture];
+    
+    return texture;
 }
 
--(void)PerformBloom
+-(BOOL)PerformBloom
 {
+    TRACE_SCOPE("Bloom");
+    
 	BOOL generateRetina = FALSE;
 	
     for (int curArgIndex = 0; curArgIndex < [mArguments count]; curArgIndex++)
@@ -160,12 +432,15 @@ const char* GENERATE_RETINA_FLAG_NAME = "-generateRetina";
 
     static const int BORDER_SIZE = 32.0;
     
-    NSNumber* texHandle = [[ResourceManager GetInstance] LoadAssetWithPath:mInputFile];
-    
     TextureParams texParams;
     
     [Texture InitDefaultParams:&texParams];
-    Texture* baseTexture = [[PNGTexture alloc] InitWithData:[[ResourceManager GetInstance] GetDataForHandle:texHandle] textureParams:&texParams];
+    Texture* baseTexture = [self CreateTextureWithPath:mInputFile params:&texParams];
+    
+    if (baseTexture == NULL)
+    {
+        return FALSE;
+    }
 
     BloomGaussianParams params;
     
@@ -200,62 +475,129 @@ const char* GENERATE_RETINA_FLAG_NAME = "-generateRetina";
     
     [bloomFilter Draw];
     
-    SaveScreenRect(mOutputFile, largestTexture->mWidth, largestTexture->mHeight);
+    u8* outputData = malloc(largestTexture->mWidth * largestTexture->mHeight * 4);
+    
+    SaveScreenRectMemory(outputData, largestTexture->mWidth, largestTexture->mHeight);
+    BOOL success = [self WriteImage:outputData width:largestTexture->mWidth height:largestTexture->mHeight path:mOutputFile];
+    
+    free(outputData);
+    
+    if (!success)
+    {
+        return FALSE;
+    }
     
     printf("Bloom:\tInput %s\n\tOutput %s\n", [mInputFile UTF8String], [mOutputFile UTF8String]);
+    
+    return TRUE;
 }
 
--(void)PerformPremultiplyAlpha
+-(BOOL)PerformPremultiplyAlpha
 {
-    PNGInfo pngInfo;
+    TRACE_SCOPE("Premultiply Alpha");
+    
+    BOOL inputIsDirectory = FALSE;
+    [[NSFileManager defaultManager] fileExistsAtPath:mInputFile isDirectory:&inputIsDirectory];
     
-    BOOL success = ReadPNG(mInputFile, TEX_ADDRESSING_8, &pngInfo);
+    PNGWriteParams params;
+    InitPNGWriteParamsWithMode(&params, GetDefaultPNGEncodeMode());
     
-    if (!success)
+    if (inputIsDirectory)
     {
-        printf("\e[1;31m%s isn't a valid PNG, aborting...\e[m\n", [mInputFile UTF8String]);
-        return;
+        // The directory was found relative to the working directory.  Make both sides absolute up front so the enumerator,
+        // the directory creation and TransformPNGFile (which treats relative paths as asset names) all agree.
+        NSString* currentDirectory = [[NSFileManager defaultManager] currentDirectoryPath];
+        
+        NSString* inputDirectory = [mInputFile isAbsolutePath] ? mInputFile : [currentDirectory stringByAppendingPathComponent:mInputFile];
+        NSString* outputDirectory = [mOutputDirectory isAbsolutePath] ? mOutputDirectory : [currentDirectory stringByAppendingPathComponent:mOutputDirectory];
+        
+        NSMutableArray* inputFiles = [[NSMutableArray alloc] initWithCapacity:0];
+        NSMutableArray* outputFiles = [[NSMutableArray alloc] initWithCapacity:0];
+        
+        NSDirectoryEnumerator* directoryEnumerator = [[NSFileManager defaultManager] enumeratorAtPath:inputDirectory];
+        
+        for (NSString* fileName in directoryEnumerator)
+        {
+            if ([[fileName pathExtension] caseInsensitiveCompare:@"png"] == NSOrderedSame)
+            {
+                NSString* outputFile = [outputDirectory stringByAppendingPathComponent:fileName];
+                
+                [[NSFileManager defaultManager] createDirectoryAtPath:[outputFile stringByDeletingLastPathComponent]
+                                                withIntermediateDirectories:TRUE attributes:NULL error:NULL];
+                
+                [inputFiles addObject:[inputDirectory stringByAppendingPathComponent:fileName]];
+                [outputFiles addObject:outputFile];
+            }
+        }
+        
+        PremultiplyAlphaBatch batch;
+        
+        batch.mInputFiles = inputFiles;
+        batch.mOutputFiles = outputFiles;
+        batch.mParams = &params;
+        batch.mNumFailed = 0;
+        
+        // Every file is an independent decode/premultiply/encode stream, so just spread them over the cores.
+        dispatch_apply_f([inputFiles count], dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), &batch, PremultiplyAlphaBatchFile);
+        
+        printf("Premultiply Alpha:\tInput %s\n\t\t\tOutput %s\n\t\t\t%d files, %d failed\n", [mInputFile UTF8String], [mOutputDirectory UTF8String],
+                    (int)[inputFiles count], batch.mNumFailed);
+        
+        [inputFiles release];
+        [outputFiles release];
+        
+        return (batch.mNumFailed == 0);
     }
-    
-    for (int y = 0; y < pngInfo.mHeight; y++)
+    else if (IsImageStorePath(mInputFile) || IsImageStorePath(mOutputFile))
     {
-        for (int x = 0; x < pngInfo.mWidth; x++)
+        // In memory images are already decoded, so there's nothing to stream
+        PNGInfo pngInfo;
+        
+        if (![self ReadImage:mInputFile info:&pngInfo])
         {
-            u8* imageBase = &((u8*)pngInfo.mImageData)[(y * pngInfo.mWidth + x) * 4];
-            
-            u8 r = imageBase[0];
-            u8 g = imageBase[1];
-            u8 b = imageBase[2];
-            u8 a = imageBase[3];
-                        
-            float rf = (float)r / 255.0;
-            float gf = (float)g / 255.0;
-            float bf = (float)b / 255.0;
-            float af = (float)a / 255.0;
-            
-            rf *= af;
-            gf *= af;
-            bf *= af;
-            
-            imageBase[0] = rf * 255.0;
-            imageBase[1] = gf * 255.0;
-            imageBase[2] = bf * 255.0;
+            return FALSE;
+        }
+        
+        PremultiplyAlphaRGBA8((u8*)pngInfo.mImageData, pngInfo.mWidth * pngInfo.mHeight);
+        
+        BOOL success = [self WriteImage:(u8*)pngInfo.mImageData width:pngInfo.mWidth height:pngInfo.mHeight path:mOutputFile];
+        
+        free(pngInfo.mImageData);
+        
+        if (!success)
+        {
+            return FALSE;
         }
+        
+        printf("Premultiply Alpha:\tInput %s\n\t\t\tOutput %s\n", [mInputFile UTF8String], [mOutputFile UTF8String]);
     }
+    else
+    {
+        // Output PNGs are never handed to the parallel encoder here, rows go straight from the decoder to the encoder.
+        if (!TransformPNGFile(mInputFile, mOutputFile, PremultiplyAlphaRow, NULL, &params, NULL))
+        {
+            return FALSE;
+        }
     
-    WritePNG((unsigned char*)pngInfo.mImageData, mOutputFile, pngInfo.mWidth, pngInfo.mHeight);
+        printf("Premultiply Alpha:\tInput %s\n\t\t\tOutput %s\n", [mInputFile UTF8String], [mOutputFile UTF8String]);
+    }
     
-    printf("Premultiply Alpha:\tInput %s\n\t\t\tOutput %s\n", [mInputFile UTF8String], [mOutputFile UTF8String]);
+    return TRUE;
 }
 
--(void)PerformGenerateMipmaps
+-(BOOL)PerformGenerateMipmaps
 {    
+    TRACE_SCOPE("Generate Mipmaps");
+    
+    BOOL success = TRUE;
+    
     BOOL inputIsDirectory = FALSE;
     [[NSFileManager defaultManager] fileExistsAtPath:mInputFile isDirectory:&inputIsDirectory];
     
     if (inputIsDirectory)
     {
         NSDirectoryEnumerator* directoryEnumerator = [[NSFileManager defaultManager] enumeratorAtPath:mInputFile];
+        NSMutableArray* inputFiles = [NSMutableArray arrayWithCapacity:0];
         
         NSString* fileName = NULL;
         
@@ -270,52 +612,108 @@ const char* GENERATE_RETINA_FLAG_NAME = "-generateRetina";
             
             if ([[fileName pathExtension] caseInsensitiveCompare:@"png"] == NSOrderedSame)
             {
-                [self GenerateMipmapsForFile:[mInputFile stringByAppendingString:fileName]];
+                [inputFiles addObject:[mInputFile stringByAppendingPathComponent:fileName]];
             }
             
         } while(fileName != NULL);
+        
+        // Decode the next few files in the background while we filter the current one
+        PrefetchLoaderParams prefetchParams;
+        [PrefetchLoader InitDefaultParams:&prefetchParams];
+        
+        prefetchParams.mReportStats = TRUE;
+        
+        PrefetchLoader* prefetchLoader = [(PrefetchLoader*)[PrefetchLoader alloc] InitWithFileNames:inputFiles params:&prefetchParams];
+        [prefetchLoader Start];
+        
+        while (true)
+        {
+            NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+            
+            PrefetchedImage* image = [prefetchLoader NextImage];
+            
+            if (image != NULL)
+            {
+                if (![self GenerateMipmapsForImage:&image->mPNGInfo fileName:image->mFileName])
+                {
+                    success = FALSE;
+                }
+            }
+            
+            [pool release];
+            
+            if (image == NULL)
+            {
+                break;
+            }
+        }
+        
+        PrefetchLoaderStats prefetchStats;
+        [prefetchLoader GetStats:&prefetchStats];
+        
+        success = success && (prefetchStats.mNumFailed == 0);
+        
+        [prefetchLoader release];
     }
     else
     {
-        [self GenerateMipmapsForFile:mInputFile];
+        success = [self GenerateMipmapsForFile:mInputFile];
     }
     
         
     printf("Generate Mipmaps:\tInput %s\n\t\t\tOutput %s\n", [mInputFile UTF8String], [mOutputDirectory UTF8String]);
+    
+    return success;
 }
 
--(void)GenerateMipmapsForFile:(NSString*)inFileName
+-(BOOL)GenerateMipmapsForFile:(NSString*)inFileName
 {
-    static const int KERNEL_SIZE = 4;
-
     PNGInfo pngInfo;
-    ReadPNG(inFileName, TEX_ADDRESSING_8, &pngInfo);
+    
+    if (![self ReadImage:inFileName info:&pngInfo])
+    {
+        printf("\e[1;31mCould not read %s\e[m\n", [inFileName UTF8String]);
+        return FALSE;
+    }
+    
+    BOOL success = [self GenerateMipmapsForImage:&pngInfo fileName:inFileName];
+    
+    free(pngInfo.mImageData);
+    
+    return success;
+}
+
+-(BOOL)GenerateMipmapsForImage:(PNGInfo*)inPNGInfo fileName:(NSString*)inFileName
+{
+    TRACE_SCOPE("Mipmap Image");
+    
+    static const int KERNEL_SIZE = 4;
     
     ImageBufferParams imageBufferParams;
     [ImageBuffer InitDefaultParams:&imageBufferParams];
     
-    imageBufferParams.mWidth = pngInfo.mWidth;
-    imageBufferParams.mHeight = pngInfo.mHeight;
-    imageBufferParams.mData = (u8*)pngInfo.mImageData;
+    imageBufferParams.mWidth = inPNGInfo->mWidth;
+    imageBufferParams.mHeight = inPNGInfo->mHeight;
+    imageBufferParams.mData = (u8*)inPNGInfo->mImageData;
     
     int curWidth = imageBufferParams.mWidth / 2;
     int curHeight = imageBufferParams.mHeight / 2;
     int level = 0;
 
-    NSString* inputFileName = [inFileName lastPathComponent];
-    NSString* extension = [inputFileName pathExtension];
+    // In memory images are named after their path without the prefix, so "mem:Title.png" writes Title_0.png and so on
+    NSString* inputPath = inFileName;
     
-    const char* inputFileNameBuffer = [inputFileName UTF8String];
-    const char* extensionBuffer = [extension UTF8String];
+    if (IsImageStorePath(inputPath))
+    {
+        inputPath = [inputPath substringFromIndex:[IMAGE_STORE_PATH_PREFIX length]];
+    }
     
-    char* inputFileNameOnly = malloc(strlen(inputFileNameBuffer) + 1);
-    strcpy(inputFileNameOnly, inputFileNameBuffer);
-    inputFileNameOnly[strlen(inputFileNameBuffer) - 1 - strlen(extensionBuffer)] = 0;
+    NSString* inputFileNameOnly = [[inputPath lastPathComponent] stringByDeletingPathExtension];
     
     // First, write out the base level
     
-    NSString* baseLevelFileName = [NSString stringWithFormat:@"%s_0.png", inputFileNameOnly];
-    WritePNG((u8*)pngInfo.mImageData, [mOutputDirectory stringByAppendingString:baseLevelFileName], pngInfo.mWidth, pngInfo.mHeight);
+    NSString* baseLevelFileName = [NSString stringWithFormat:@"%@_0.png", inputFileNameOnly];
+    BOOL success = [self WriteImage:(u8*)inPNGInfo->mImageData width:inPNGInfo->mWidth height:inPNGInfo->mHeight path:[mOutputDirectory stringByAppendingPathComponent:baseLevelFileName]];
     
     while (true)
     {
@@ -330,15 +728,20 @@ const char* GENERATE_RETINA_FLAG_NAME = "-generateRetina";
         params.mDynamicOutput = TRUE;
         
         KaiserFilter* kaiserFilter = [(KaiserFilter*)[KaiserFilter alloc] InitWithParams:&params];
+        [params.mInputBuffer release];
         
         [kaiserFilter SetOutputSizeX:curWidth Y:curHeight];
         [kaiserFilter Update:0.0];
                 
-        NSString* outputFileName = [NSString stringWithFormat:@"%s_%d.png", inputFileNameOnly, level + 1];
+        NSString* outputFileName = [NSString stringWithFormat:@"%@_%d.png", inputFileNameOnly, level + 1];
         
         ImageBuffer* outputBuffer = [kaiserFilter GetOutputBuffer];
-        WritePNG(   (unsigned char*)[outputBuffer GetData], [mOutputDirectory stringByAppendingString:outputFileName],
-                    [outputBuffer GetWidth], [outputBuffer GetHeight]);
+        
+        if (![self WriteImage:[outputBuffer GetData] width:[outputBuffer GetWidth] height:[outputBuffer GetHeight]
+              path:[mOutputDirectory stringByAppendingPathComponent:outputFileName]])
+        {
+            success = FALSE;
+        }
         
         [kaiserFilter release];
 
@@ -352,6 +755,8 @@ const char* GENERATE_RETINA_FLAG_NAME = "-generateRetina";
         
         level++;
     }
+    
+    return success;
 }
 
 static const char* GENERATE_TEXT_FONT_NAME = "-fontName";
@@ -362,16 +767,46 @@ static const char* GENERATE_TEXT_FILL_COLOR = "-fillColor";
 static const char* GENERATE_TEXT_STROKE_SIZE = "-strokeSize";
 static const char* GENERATE_TEXT_BLOOM = "-bloom";
 
--(void)PerformGenerateText
+-(NSString*)GetFontPath
 {
-    TextTextureParams textParams;
     NSString* fontPath = NULL;
     NSString* fontName = NULL;
-    BOOL bloom = FALSE;
-    BOOL stingerOutput = FALSE;
-    BOOL generateRetina = FALSE;
     
-    [TextTextureBuilder InitDefaultParams:&textParams];
+    for (int curArgIndex = 0; curArgIndex < ((int)[mArguments count] - 1); curArgIndex++)
+    {
+        NSString* curArg = [mArguments objectAtIndex:curArgIndex];
+        
+        if ([curArg caseInsensitiveCompare:[NSString stringWithUTF8String:FONT_PATH_PARAMETER_NAME]] == NSOrderedSame)
+        {
+            fontPath = [mArguments objectAtIndex:(curArgIndex + 1)];
+            curArgIndex++;
+        }
+        else if ([curArg caseInsensitiveCompare:[NSString stringWithUTF8String:GENERATE_TEXT_FONT_NAME]] == NSOrderedSame)
+        {
+            fontName = [mArguments objectAtIndex:(curArgIndex + 1)];
+            curArgIndex++;
+        }
+    }
+    
+    if ((fontPath == NULL) || (fontName == NULL))
+    {
+        return NULL;
+    }
+    
+    return [fontPath stringByAppendingFormat:@"/%@", fontName];
+}
+
+-(NSData*)ParseTextArguments:(TextTextureParams*)outTextParams bloom:(BOOL*)outBloom stinger:(BOOL*)outStinger retina:(BOOL*)outRetina
+    unhandledArguments:(NSMutableArray*)outUnhandledArguments
+{
+    NSString* fontPath = NULL;
+    NSString* fontName = NULL;
+    
+    *outBloom = FALSE;
+    *outStinger = FALSE;
+    *outRetina = FALSE;
+    
+    [TextTextureBuilder InitDefaultParams:outTextParams];
     
     for (int curArgIndex = 0; curArgIndex < [mArguments count]; curArgIndex++)
     {
@@ -392,7 +827,7 @@ static const char* GENERATE_TEXT_BLOOM = "-bloom";
             NSString* fontSize = [mArguments objectAtIndex:(curArgIndex + 1)];
             curArgIndex++;
             
-            textParams.mPointSize = [fontSize intValue];
+            outTextParams->mPointSize = [fontSize intValue];
         }
         else if ([curArg caseInsensitiveCompare:[NSString stringWithUTF8String:GENERATE_TEXT_BORDER_SIZE]] == NSOrderedSame)
         {
@@ -401,10 +836,10 @@ static const char* GENERATE_TEXT_BLOOM = "-bloom";
             
             int borderVal = [border intValue];
             
-            textParams.mLeadWidth = borderVal;
-            textParams.mLeadHeight = borderVal;
-            textParams.mTrailWidth = borderVal;
-            textParams.mTrailHeight = borderVal;
+            outTextParams->mLeadWidth = borderVal;
+            outTextParams->mLeadHeight = borderVal;
+            outTextParams->mTrailWidth = borderVal;
+            outTextParams->mTrailHeight = borderVal;
         }
         else if ([curArg caseInsensitiveCompare:[NSString stringWithUTF8String:GENERATE_TEXT_STROKE_COLOR]] == NSOrderedSame)
         {
@@ -415,11 +850,11 @@ static const char* GENERATE_TEXT_BLOOM = "-bloom";
             
             if ((strokeColorCStr[0] == '0') && (toupper(strokeColorCStr[1]) == 'X'))
             {
-                sscanf(strokeColorCStr, "%x", &textParams.mStrokeColor);
+                sscanf(strokeColorCStr, "%x", &outTextParams->mStrokeColor);
             }
             else
             {
-                sscanf(strokeColorCStr, "%d", &textParams.mStrokeColor);
+                sscanf(strokeColorCStr, "%d", &outTextParams->mStrokeColor);
             }
         }
         else if ([curArg caseInsensitiveCompare:[NSString stringWithUTF8String:GENERATE_TEXT_FILL_COLOR]] == NSOrderedSame)
@@ -431,11 +866,11 @@ static const char* GENERATE_TEXT_BLOOM = "-bloom";
             
             if ((fillColorCStr[0] == '0') && (toupper(fillColorCStr[1]) == 'X'))
             {
-                sscanf(fillColorCStr, "%x", &textParams.mColor);
+                sscanf(fillColorCStr, "%x", &outTextParams->mColor);
             }
             else
             {
-                sscanf(fillColorCStr, "%d", &textParams.mColor);
+                sscanf(fillColorCStr, "%d", &outTextParams->mColor);
             }
         }
         else if ([curArg caseInsensitiveCompare:[NSString stringWithUTF8String:GENERATE_TEXT_STROKE_SIZE]] == NSOrderedSame)
@@ -443,24 +878,28 @@ static const char* GENERATE_TEXT_BLOOM = "-bloom";
             NSString* strokeSize = [mArguments objectAtIndex:(curArgIndex + 1)];
             curArgIndex++;
             
-            textParams.mStrokeSize = [strokeSize intValue];
+            outTextParams->mStrokeSize = [strokeSize intValue];
         }
         else if ([curArg caseInsensitiveCompare:[NSString stringWithUTF8String:GENERATE_TEXT_STRING_PARAMETER_NAME]] == NSOrderedSame)
         {
-            textParams.mString = [mArguments objectAtIndex:(curArgIndex + 1)];
+            outTextParams->mString = [mArguments objectAtIndex:(curArgIndex + 1)];
             curArgIndex++;
         }
         else if ([curArg caseInsensitiveCompare:[NSString stringWithUTF8String:GENERATE_TEXT_BLOOM]] == NSOrderedSame)
         {
-            bloom = TRUE;
+            *outBloom = TRUE;
         }
         else if ([curArg caseInsensitiveCompare:[NSString stringWithUTF8String:GENERATE_STINGER_FLAG_NAME]] == NSOrderedSame)
         {
-            stingerOutput = TRUE;
+            *outStinger = TRUE;
         }
         else if ([curArg caseInsensitiveCompare:[NSString stringWithUTF8String:GENERATE_RETINA_FLAG_NAME]] == NSOrderedSame)
         {
-            generateRetina = TRUE;
+            *outRetina = TRUE;
+        }
+        else if (outUnhandledArguments != NULL)
+        {
+            [outUnhandledArguments addObject:curArg];
         }
         else
         {
@@ -470,28 +909,64 @@ static const char* GENERATE_TEXT_BLOOM = "-bloom";
     
     NSAssert(fontPath != NULL, @"No font path was specified, define the NEON_IMAGE_PROCESSOR_FONT_PATH environment variable to point to the fonts");
     
-    if (!stingerOutput)
-    {
-        NSAssert(!generateRetina, @"We don't currently support pregenerated strings for retina dsplay.  Generate normal text at double the point size");
-    }
-    
     NSString* assetPath = NULL;
     
     if (fontPath == NULL)
     {
-        assetPath = [fontPath stringByAppendingFormat:@"/%@", textParams.mFontName];
+        assetPath = [fontPath stringByAppendingFormat:@"/%@", outTextParams->mFontName];
     }
     else
     {
         assetPath = [fontPath stringByAppendingFormat:@"/%@", fontName];
     }
      
-    NSNumber* texHandle = [[ResourceManager GetInstance] LoadAssetWithPath:assetPath];
+    // Fonts stay loaded until the engine shuts down, so every text operation in a batch shares one mapping
+    // and one FreeType face.  A -serve worker lives across edits to the fonts, so a font that changed on disk
+    // is closed and loaded again.
+    ResourceNode* fontNode = [[ResourceManager GetInstance] FindResourceWithPath:assetPath];
+    NSNumber* texHandle = NULL;
+    
+    if ((fontNode != NULL) && ([[ResourceManager GetInstance] IsAssetModifiedWithHandle:fontNode->mHandle]))
+    {
+        [[TextTextureBuilder GetInstance] ReleaseFontData:fontNode->mData];
+        [[ResourceManager GetInstance] UnloadAssetWithHandle:fontNode->mHandle];
+        
+        fontNode = NULL;
+    }
+    
+    if (fontNode != NULL)
+    {
+        texHandle = fontNode->mHandle;
+    }
+    else
+    {
+        texHandle = [[ResourceManager GetInstance] LoadMappedAssetWithPath:assetPath];
+    }
+    
     NSData* fontData = [[ResourceManager GetInstance] GetDataForHandle:texHandle];
     
-    textParams.mFontData = fontData;
-    textParams.mFontName = NULL;
-    textParams.mPremultipliedAlpha = TRUE;
+    outTextParams->mFontData = fontData;
+    outTextParams->mFontName = NULL;
+    outTextParams->mPremultipliedAlpha = TRUE;
+    
+    return fontData;
+}
+
+-(BOOL)PerformGenerateText
+{
+    TRACE_SCOPE("Generate Text");
+    
+    TextTextureParams textParams;
+    BOOL bloom = FALSE;
+    BOOL stingerOutput = FALSE;
+    BOOL generateRetina = FALSE;
+    
+    [self ParseTextArguments:&textParams bloom:&bloom stinger:&stingerOutput retina:&generateRetina unhandledArguments:NULL];
+    
+    if (!stingerOutput)
+    {
+        NSAssert(!generateRetina, @"We don't currently support pregenerated strings for retina dsplay.  Generate normal text at double the point size");
+    }
     
     StingerHeader stingerHeader;
     
@@ -503,10 +978,18 @@ static const char* GENERATE_TEXT_BLOOM = "-bloom";
     stingerHeader.mNumEmbeddedStingers = 0;
     
     FILE* stingerFile = NULL;
+    BOOL success = TRUE;
     
     if (stingerOutput)
     {
+        NSAssert(!IsImageStorePath(mOutputFile), @"Stingers can only be written to disk");
         stingerFile = fopen([mOutputFile UTF8String], "w");
+        
+        if (stingerFile == NULL)
+        {
+            printf("\e[1;31mCould not open %s for writing\e[m\n", [mOutputFile UTF8String]);
+            return FALSE;
+        }
     }
     
     int curOffset = sizeof(StingerHeader);
@@ -532,7 +1015,11 @@ static const char* GENERATE_TEXT_BLOOM = "-bloom";
             textParams.mTrailHeight *= 2;
         }
         
-        [self GenerateTextCore:&textParams bloom:bloom outputStinger:stingerOutput retina:curGenerateRetina pngInfo:&pngInfo[curGenerateRetina]];
+        if (![self GenerateTextCore:&textParams bloom:bloom outputStinger:stingerOutput retina:curGenerateRetina pngInfo:&pngInfo[curGenerateRetina]])
+        {
+            success = FALSE;
+            break;
+        }
 
         if (stingerOutput)
         {
@@ -554,23 +1041,318 @@ static const char* GENERATE_TEXT_BLOOM = "-bloom";
     
     if (stingerOutput)
     {
-        fwrite(&stingerHeader, sizeof(stingerHeader), 1, stingerFile);
+        if (success)
+        {
+            if (fwrite(&stingerHeader, sizeof(stingerHeader), 1, stingerFile) != 1)
+            {
+                success = FALSE;
+            }
         
-        for (int i = 0; i < stingerHeader.mNumEmbeddedStingers; i++)
+            for (int i = 0; i < stingerHeader.mNumEmbeddedStingers; i++)
+            {
+                if (fwrite(pngInfo[i].mPNGData, pngInfo[i].mPNGSize, 1, stingerFile) != 1)
+                {
+                    success = FALSE;
+                }
+            }
+        }
+        
+        if (fclose(stingerFile) != 0)
         {
-            fwrite(pngInfo[i].mPNGData, pngInfo[i].mPNGSize, 1, stingerFile);
+            success = FALSE;
         }
         
-        fclose(stingerFile);
+        if (!success)
+        {
+            printf("\e[1;31mCould not write %s\e[m\n", [mOutputFile UTF8String]);
+        }
     }
     
-    [[ResourceManager GetInstance] UnloadAssetWithHandle:texHandle];
+    return success;
 }
 
--(void)GenerateTextCore:(TextTextureParams*)inTextParams bloom:(BOOL)inBloom outputStinger:(BOOL)inOutputStinger
+static const char* TEXT_ATLAS_PAGE_SIZE = "-pageSize";
+static const char* TEXT_ATLAS_PADDING = "-padding";
+
+-(BOOL)PerformGenerateTextAtlas
+{
+    TRACE_SCOPE("Generate Text Atlas");
+    
+    TextTextureParams textParams;
+    BOOL bloom = FALSE;
+    BOOL stingerOutput = FALSE;
+    BOOL generateRetina = FALSE;
+    NSMutableArray* atlasArguments = [NSMutableArray arrayWithCapacity:0];
+    
+    [self ParseTextArguments:&textParams bloom:&bloom stinger:&stingerOutput retina:&generateRetina unhandledArguments:atlasArguments];
+    
+    NSAssert(!bloom && !stingerOutput && !generateRetina, @"Text atlases don't support bloom, stingers or retina output");
+    
+    TextAtlasWriterParams writerParams;
+    [TextAtlasWriter InitDefaultParams:&writerParams];
+    
+    for (int curArgIndex = 0; curArgIndex < [atlasArguments count]; curArgIndex++)
+    {
+        NSString* curArg = [atlasArguments objectAtIndex:curArgIndex];
+        
+        if ([curArg caseInsensitiveCompare:[NSString stringWithUTF8String:TEXT_ATLAS_PAGE_SIZE]] == NSOrderedSame)
+        {
+            writerParams.mMaxPageSize = [[atlasArguments objectAtIndex:(curArgIndex + 1)] intValue];
+            curArgIndex++;
+        }
+        else if ([curArg caseInsensitiveCompare:[NSString stringWithUTF8String:TEXT_ATLAS_PADDING]] == NSOrderedSame)
+        {
+            writerParams.mPadding = [[atlasArguments objectAtIndex:(curArgIndex + 1)] intValue];
+            curArgIndex++;
+        }
+        else
+        {
+            NSAssert(FALSE, @"Unknown argument provided %@", curArg);
+        }
+    }
+    
+    NSAssert(!IsImageStorePath(mOutputFile), @"Text atlases are written to disk, since the pages go alongside the table");
+    
+    // Lines are "string" or "name<tab>string", blank lines and lines starting with # are ignored
+    NSString* strings = [NSString stringWithContentsOfFile:mInputFile encoding:NSUTF8StringEncoding error:NULL];
+    
+    if (strings == NULL)
+    {
+        printf("\e[1;31mCouldn't read strings file %s\e[m\n", [mInputFile UTF8String]);
+        return FALSE;
+    }
+    
+    // The atlas is never created, setting it only stops the builder from padding each string to a power of two
+    TextureAtlasParams atlasParams;
+    [TextureAtlas InitDefaultParams:&atlasParams];
+    
+    TextureAtlas* unpaddedAtlas = [(TextureAtlas*)[TextureAtlas alloc] InitWithParams:&atlasParams];
+    textParams.mTextureAtlas = unpaddedAtlas;
+    
+    TextAtlasWriter* writer = [(TextAtlasWriter*)[TextAtlasWriter alloc] InitWithParams:&writerParams];
+    
+    BOOL success = TRUE;
+    u32 numEntries = 0;
+    
+    for (NSString* curLine in [strings componentsSeparatedByCharactersInSet:[NSCharacterSet newlineCharacterSet]])
+    {
+        if (([curLine length] == 0) || [curLine hasPrefix:@"#"])
+        {
+            continue;
+        }
+        
+        NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+        
+        NSString* name = curLine;
+        NSRange tabRange = [curLine rangeOfString:@"\t"];
+        
+        if (tabRange.location != NSNotFound)
+        {
+            name = [curLine substringToIndex:tabRange.location];
+            textParams.mString = [curLine substringFromIndex:(tabRange.location + 1)];
+        }
+        else
+        {
+            textParams.mString = curLine;
+        }
+        
+        // Strings share the builder's font faces and glyph cache, so they're rendered in order on this thread
+        Texture* textTexture = [[TextTextureBuilder GetInstance] GenerateTextureWithParams:&textParams];
+        
+        success = [writer AddEntry:name data:(u8*)textTexture->mTexBytes width:textTexture->mWidth height:textTexture->mHeight content:&textParams];
+        
+        [pool release];
+        
+        if (!success)
+        {
+            break;
+        }
+        
+        numEntries++;
+    }
+    
+    if (success && (numEntries == 0))
+    {
+        printf("\e[1;31mStrings file %s has no strings in it\e[m\n", [mInputFile UTF8String]);
+        success = FALSE;
+    }
+    
+    success = success && [writer WriteToFile:mOutputFile];
+    
+    if (success)
+    {
+        printf("Generate Text Atlas:\tInput %s\n\t\tOutput %s, %u strings\n", [mInputFile UTF8String], [mOutputFile UTF8String], numEntries);
+    }
+    
+    [writer release];
+    [unpaddedAtlas release];
+    
+    return success;
+}
+
+static const char* PACK_BIGFILE_COMPRESS = "-compress";
+static const char* PACK_BIGFILE_COMPRESSION_LEVEL = "-compressionLevel";
+static const char* PACK_BIGFILE_ALIGNMENT = "-alignment";
+
+-(BOOL)PerformPackBigFile
+{
+    TRACE_SCOPE("Pack BigFile");
+    
+    BigFilePackerParams params;
+    [BigFilePacker InitDefaultParams:&params];
+    
+    for (int curArgIndex = 0; curArgIndex < [mArguments count]; curArgIndex++)
+    {
+        NSString* curArg = [mArguments objectAtIndex:curArgIndex];
+        
+        if ([curArg caseInsensitiveCompare:[NSString stringWithUTF8String:PACK_BIGFILE_COMPRESS]] == NSOrderedSame)
+        {
+            params.mCompress = TRUE;
+        }
+        else if ([curArg caseInsensitiveCompare:[NSString stringWithUTF8String:PACK_BIGFILE_COMPRESSION_LEVEL]] == NSOrderedSame)
+        {
+            params.mCompress = TRUE;
+            params.mCompressionLevel = [[mArguments objectAtIndex:(curArgIndex + 1)] intValue];
+            curArgIndex++;
+        }
+        else if ([curArg caseInsensitiveCompare:[NSString stringWithUTF8String:PACK_BIGFILE_ALIGNMENT]] == NSOrderedSame)
+        {
+            params.mAlignment = [[mArguments objectAtIndex:(curArgIndex + 1)] intValue];
+            curArgIndex++;
+        }
+    }
+    
+    if ((params.mAlignment == 0) || ((params.mAlignment & (params.mAlignment - 1)) != 0))
+    {
+        printf("\e[1;31mBigFile alignment must be a power of two, got %u\e[m\n", params.mAlignment);
+        return FALSE;
+    }
+    
+    BigFilePacker* packer = [(BigFilePacker*)[BigFilePacker alloc] InitWithParams:&params];
+    
+    BOOL inputIsDirectory = FALSE;
+    [[NSFileManager defaultManager] fileExistsAtPath:mInputFile isDirectory:&inputIsDirectory];
+    
+    BOOL success = TRUE;
+    
+    if (inputIsDirectory)
+    {
+        [packer AddDirectory:mInputFile];
+    }
+    else
+    {
+        success = [packer AddManifest:mInputFile];
+    }
+    
+    success = success && [packer WriteToFile:mOutputFile];
+    
+    if (success)
+    {
+        printf("Pack BigFile:\tInput %s\n\t\tOutput %s\n", [mInputFile UTF8String], [mOutputFile UTF8String]);
+    }
+    
+    [packer release];
+    
+    return success;
+}
+
+static const char* SDF_ATLAS_GLYPH_SIZE = "-glyphSize";
+static const char* SDF_ATLAS_SPREAD = "-spread";
+static const char* SDF_ATLAS_PADDING = "-padding";
+static const char* SDF_ATLAS_CHARACTERS = "-characters";
+
+-(BOOL)PerformGenerateSDFAtlas
+{
+    TRACE_SCOPE("Generate SDF Atlas");
+    
+    SDFAtlasParams params;
+    [SDFAtlasBuilder InitDefaultParams:&params];
+    
+    for (int curArgIndex = 0; curArgIndex < [mArguments count]; curArgIndex++)
+    {
+        NSString* curArg = [mArguments objectAtIndex:curArgIndex];
+        
+        if ([curArg caseInsensitiveCompare:[NSString stringWithUTF8String:SDF_ATLAS_GLYPH_SIZE]] == NSOrderedSame)
+        {
+            params.mGlyphSize = [[mArguments objectAtIndex:(curArgIndex + 1)] intValue];
+            curArgIndex++;
+        }
+        else if ([curArg caseInsensitiveCompare:[NSString stringWithUTF8String:SDF_ATLAS_SPREAD]] == NSOrderedSame)
+        {
+            params.mSpread = [[mArguments objectAtIndex:(curArgIndex + 1)] intValue];
+            curArgIndex++;
+        }
+        else if ([curArg caseInsensitiveCompare:[NSString stringWithUTF8String:SDF_ATLAS_PADDING]] == NSOrderedSame)
+        {
+            params.mPadding = [[mArguments objectAtIndex:(curArgIndex + 1)] intValue];
+            curArgIndex++;
+        }
+        else if ([curArg caseInsensitiveCompare:[NSString stringWithUTF8String:SDF_ATLAS_CHARACTERS]] == NSOrderedSame)
+        {
+            params.mCharacters = [mArguments objectAtIndex:(curArgIndex + 1)];
+            curArgIndex++;
+        }
+    }
+    
+    if ((params.mGlyphSize == 0) || (params.mSpread == 0))
+    {
+        printf("\e[1;31mSDF atlas glyph size and spread must be non-zero\e[m\n");
+        return FALSE;
+    }
+    
+    NSAssert(!IsImageStorePath(mOutputFile), @"SDF atlases are written to disk, since the metrics go alongside them");
+    
+    NSData* fontData = [[MappedData alloc] InitWithPath:mInputFile advice:MAPPED_DATA_ADVICE_SEQUENTIAL];
+    
+    if (fontData == NULL)
+    {
+        printf("\e[1;31mCouldn't read font file %s\e[m\n", [mInputFile UTF8String]);
+        return FALSE;
+    }
+    
+    SDFAtlasBuilder* builder = [(SDFAtlasBuilder*)[SDFAtlasBuilder alloc] InitWithParams:&params];
+    
+    BOOL success = [builder BuildWithFontData:fontData];
+    
+    if (success)
+    {
+        success = [self WriteImage:[builder GetAtlasData] width:[builder GetAtlasWidth] height:[builder GetAtlasHeight] path:mOutputFile];
+    }
+    
+    if (success)
+    {
+        NSData* metricsData = JSONDataFromObject([builder GetMetrics]);
+        
+        success = (metricsData != NULL) && [metricsData writeToFile:[self GetSDFMetricsPath] atomically:YES];
+        
+        if (!success)
+        {
+            printf("\e[1;31mCouldn't write SDF metrics to %s\e[m\n", [[self GetSDFMetricsPath] UTF8String]);
+        }
+    }
+    
+    if (success)
+    {
+        printf("Generate SDF Atlas:\tInput %s\n\t\tOutput %s (%ux%u), %lu glyphs\n", [mInputFile UTF8String], [mOutputFile UTF8String],
+                [builder GetAtlasWidth], [builder GetAtlasHeight], (unsigned long)[[[builder GetMetrics] objectForKey:@"glyphs"] count]);
+    }
+    
+    [builder release];
+    [fontData release];
+    
+    return success;
+}
+
+-(NSString*)GetSDFMetricsPath
+{
+    return [[mOutputFile stringByDeletingPathExtension] stringByAppendingPathExtension:@"sdffont"];
+}
+
+-(BOOL)GenerateTextCore:(TextTextureParams*)inTextParams bloom:(BOOL)inBloom outputStinger:(BOOL)inOutputStinger
     retina:(BOOL)inRetina pngInfo:(TextCorePNGInfo*)outPNGInfo
 {
     Texture* textTexture = [[TextTextureBuilder GetInstance] GenerateTextureWithParams:inTextParams];
+    BOOL success = FALSE;
     
     outPNGInfo->mPNGData = NULL;
     outPNGInfo->mPNGSize = 0;
@@ -579,7 +1361,7 @@ static const char* GENERATE_TEXT_BLOOM = "-bloom";
     {
         NSAssert([[mOutputFile pathExtension] caseInsensitiveCompare:@"png"] == NSOrderedSame, @"Only .png output files are supported");
         NSAssert(inOutputStinger == FALSE, @"We only support output as stingers when bloom is on.");
-        WritePNG((u8*)textTexture->mTexBytes, mOutputFile, textTexture->mGLWidth, textTexture->mGLHeight);
+        success = [self WriteImage:(u8*)textTexture->mTexBytes width:textTexture->mGLWidth height:textTexture->mGLHeight path:mOutputFile];
     }
     else
     {
@@ -623,20 +1405,23 @@ static const char* GENERATE_TEXT_BLOOM = "-bloom";
         [bloomFilter SetDrawBaseLayer:TRUE];
         [bloomFilter Draw];
         
+        unsigned char* outputData = malloc(largestTexture->mWidth * largestTexture->mHeight * 4);
+        
+        SaveScreenRectMemory(outputData, largestTexture->mWidth, largestTexture->mHeight);
+        
         if (!inOutputStinger)
         {
-            SaveScreenRect(mOutputFile, largestTexture->mWidth, largestTexture->mHeight);
+            success = [self WriteImage:outputData width:largestTexture->mWidth height:largestTexture->mHeight path:mOutputFile];
         }
         else
         {
-            unsigned char* outputData = malloc(largestTexture->mWidth * largestTexture->mHeight * 4);
-                        
-            SaveScreenRectMemory(outputData, largestTexture->mWidth, largestTexture->mHeight);
-            WritePNGMemory(outputData, largestTexture->mWidth, largestTexture->mHeight, &outPNGInfo->mPNGData, &outPNGInfo->mPNGSize);
-            
-            free(outputData);
+            success = WritePNGMemory(outputData, largestTexture->mWidth, largestTexture->mHeight, &outPNGInfo->mPNGData, &outPNGInfo->mPNGSize);
         }
+                        
+        free(outputData);
     }
+    
+    return success;
 }
 
 @end
\ No newline at end of file
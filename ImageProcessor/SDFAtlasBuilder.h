@@ -0,0 +1,70 @@
+/*
+ *  SDFAtlasBuilder.h
+ *  Neon21ImageProcessor
+ *
+ *  Copyright 2010 Neon Games. All rights reserved.
+ *
+ */
+
+#include "ft2build.h"
+#include "freetype.h"
+
+// Rasterizes a set of glyphs from a font once, and packs their signed distance fields into a single atlas.  Text can
+// then be drawn at any size from the one atlas instead of pre-rendering every string at every size.
+//
+// Glyphs are rasterized at mGlyphSize pixels per em with mSpread pixels of padding on each side.  Distances are exact
+// Euclidean distances to the glyph's edge, computed with a linear time transform, one glyph per core.  A distance of
+// mSpread or more maps to 0 (outside) or 255 (inside), the edge itself is 128.
+//
+// The atlas is RGBA8 with the distance in alpha and white color, so it loads like any other texture.  Metrics are
+// in pixels at mGlyphSize, scale them by the size being drawn over mGlyphSize.
+
+typedef struct
+{
+    u32         mGlyphSize;
+    u32         mSpread;
+    u32         mPadding;       // Empty texels between glyphs in the atlas
+    NSString*   mCharacters;    // Characters to include, NULL for printable ASCII
+} SDFAtlasParams;
+
+typedef struct SDFGlyph SDFGlyph;
+
+@interface SDFAtlasBuilder : NSObject
+{
+    SDFAtlasParams          mParams;
+    
+    FT_Library              mLibrary;
+    FT_Face                 mFace;
+    NSData*                 mFontData;
+    
+    SDFGlyph*               mGlyphs;
+    u32                     mNumGlyphs;
+    
+    u8*                     mAtlasData;
+    u32                     mAtlasWidth;
+    u32                     mAtlasHeight;
+    
+    NSMutableDictionary*    mMetrics;
+}
+
+-(SDFAtlasBuilder*)InitWithParams:(SDFAtlasParams*)inParams;
+-(void)dealloc;
++(void)InitDefaultParams:(SDFAtlasParams*)outParams;
+
+// Returns FALSE if the font can't be loaded or has none of the requested characters
+-(BOOL)BuildWithFontData:(NSData*)inFontData;
+
+// Valid after a successful BuildWithFontData:, owned by the builder
+-(u8*)GetAtlasData;
+-(u32)GetAtlasWidth;
+-(u32)GetAtlasHeight;
+
+// Font metrics, per glyph metrics and atlas placement, and kerning pairs.  Suitable for JSONDataFromObject.
+-(NSDictionary*)GetMetrics;
+
+-(BOOL)RasterizeGlyphs;
+-(void)GenerateDistanceFields;
+-(void)PackAtlas;
+-(void)BuildMetrics;
+
+@end
@@ -0,0 +1,555 @@
+/*
+ *  SDFAtlasBuilder.m
+ *  Neon21ImageProcessor
+ *
+ *  Copyright 2010 Neon Games. All rights reserved.
+ *
+ */
+
+#import "SDFAtlasBuilder.h"
+#import "Trace.h"
+
+#import <dispatch/dispatch.h>
+
+#define SDF_DEFAULT_GLYPH_SIZE      (48)
+#define SDF_DEFAULT_SPREAD          (6)
+#define SDF_DEFAULT_PADDING         (1)
+
+#define SDF_FIRST_ASCII_CHARACTER   (32)
+#define SDF_LAST_ASCII_CHARACTER    (126)
+
+#define SDF_MIN_ATLAS_WIDTH         (64)
+
+// Coverage at or above this counts as inside the glyph
+#define SDF_INSIDE_THRESHOLD        (128)
+
+static const float SDF_INFINITY = 1e20f;
+
+struct SDFGlyph
+{
+    u32         mCharCode;
+    FT_UInt     mGlyphIndex;
+    
+    // Bitmap size including mSpread on every side, zero for empty glyphs like spaces
+    int         mWidth;
+    int         mHeight;
+    
+    int         mBearingX;
+    int         mBearingY;
+    float       mAdvance;
+    
+    u8*         mCoverage;
+    u8*         mDistance;
+    
+    u32         mAtlasX;
+    u32         mAtlasY;
+};
+
+typedef struct
+{
+    SDFGlyph*   mGlyphs;
+    u32         mSpread;
+} SDFDistanceFieldBatch;
+
+// Felzenszwalb and Huttenlocher's one dimensional squared distance transform.  outD[q] is the minimum over p of
+// (q - p)^2 + inF[p].  ioV and ioZ are scratch space of inN and inN + 1 entries.
+static void DistanceTransform1D(const float* inF, float* outD, int* ioV, float* ioZ, int inN)
+{
+    int k = 0;
+    
+    ioV[0] = 0;
+    ioZ[0] = -SDF_INFINITY;
+    ioZ[1] = SDF_INFINITY;
+    
+    for (int q = 1; q < inN; q++)
+    {
+        float s = ((inF[q] + (q * q)) - (inF[ioV[k]] + (ioV[k] * ioV[k]))) / (2 * q - 2 * ioV[k]);
+        
+        while (s <= ioZ[k])
+        {
+            k--;
+            s = ((inF[q] + (q * q)) - (inF[ioV[k]] + (ioV[k] * ioV[k]))) / (2 * q - 2 * ioV[k]);
+        }
+        
+        k++;
+        
+        ioV[k] = q;
+        ioZ[k] = s;
+        ioZ[k + 1] = SDF_INFINITY;
+    }
+    
+    k = 0;
+    
+    for (int q = 0; q < inN; q++)
+    {
+        while (ioZ[k + 1] < q)
+        {
+            k++;
+        }
+        
+        outD[q] = ((q - ioV[k]) * (q - ioV[k])) + inF[ioV[k]];
+    }
+}
+
+// Squared distance transform of ioGrid in place, columns then rows
+static void DistanceTransform2D(float* ioGrid, int inWidth, int inHeight, float* ioF, float* ioD, int* ioV, float* ioZ)
+{
+    for (int x = 0; x < inWidth; x++)
+    {
+        for (int y = 0; y < inHeight; y++)
+        {
+            ioF[y] = ioGrid[(y * inWidth) + x];
+        }
+        
+        DistanceTransform1D(ioF, ioD, ioV, ioZ, inHeight);
+        
+        for (int y = 0; y < inHeight; y++)
+        {
+            ioGrid[(y * inWidth) + x] = ioD[y];
+        }
+    }
+    
+    for (int y = 0; y < inHeight; y++)
+    {
+        DistanceTransform1D(&ioGrid[y * inWidth], ioD, ioV, ioZ, inWidth);
+        memcpy(&ioGrid[y * inWidth], ioD, sizeof(float) * inWidth);
+    }
+}
+
+static void GenerateDistanceField(SDFGlyph* ioGlyph, u32 inSpread)
+{
+    int width = ioGlyph->mWidth;
+    int height = ioGlyph->mHeight;
+    int numTexels = width * height;
+    int maxDimension = max(width, height);
+    
+    // Distance to the nearest inside texel, and to the nearest outside texel
+    float* distanceToInside = malloc(sizeof(float) * numTexels);
+    float* distanceToOutside = malloc(sizeof(float) * numTexels);
+    
+    float* f = malloc(sizeof(float) * maxDimension);
+    float* d = malloc(sizeof(float) * maxDimension);
+    int* v = malloc(sizeof(int) * maxDimension);
+    float* z = malloc(sizeof(float) * (maxDimension + 1));
+    
+    for (int curTexel = 0; curTexel < numTexels; curTexel++)
+    {
+        BOOL inside = (ioGlyph->mCoverage[curTexel] >= SDF_INSIDE_THRESHOLD);
+        
+        distanceToInside[curTexel] = inside ? 0.0f : SDF_INFINITY;
+        distanceToOutside[curTexel] = inside ? SDF_INFINITY : 0.0f;
+    }
+    
+    DistanceTransform2D(distanceToInside, width, height, f, d, v, z);
+    DistanceTransform2D(distanceToOutside, width, height, f, d, v, z);
+    
+    ioGlyph->mDistance = malloc(numTexels);
+    
+    for (int curTexel = 0; curTexel < numTexels; curTexel++)
+    {
+        // Distances are between texel centers, the edge is half a texel from the nearest texel on the other side
+        float signedDistance = 0.0f;
+        
+        if (distanceToInside[curTexel] == 0.0f)
+        {
+            signedDistance = sqrtf(distanceToOutside[curTexel]) - 0.5f;
+        }
+        else
+        {
+            signedDistance = 0.5f - sqrtf(distanceToInside[curTexel]);
+        }
+        
+        float value = 0.5f + (signedDistance / (2.0f * (float)inSpread));
+        
+        value = ClampFloat(value, 0.0f, 1.0f);
+        
+        ioGlyph->mDistance[curTexel] = (u8)((value * 255.0f) + 0.5f);
+    }
+    
+    free(distanceToInside);
+    free(distanceToOutside);
+    free(f);
+    free(d);
+    free(v);
+    free(z);
+}
+
+static void GenerateDistanceFieldForGlyph(void* inContext, size_t inIndex)
+{
+    SDFDistanceFieldBatch* batch = (SDFDistanceFieldBatch*)inContext;
+    SDFGlyph* glyph = &batch->mGlyphs[inIndex];
+    
+    if ((glyph->mWidth != 0) && (glyph->mHeight != 0))
+    {
+        GenerateDistanceField(glyph, batch->mSpread);
+    }
+}
+
+static int CompareGlyphHeight(const void* inLeft, const void* inRight)
+{
+    const SDFGlyph* left = *(const SDFGlyph**)inLeft;
+    const SDFGlyph* right = *(const SDFGlyph**)inRight;
+    
+    // Tallest first, then by character so the layout is stable
+    if (left->mHeight != right->mHeight)
+    {
+        return right->mHeight - left->mHeight;
+    }
+    
+    return (int)left->mCharCode - (int)right->mCharCode;
+}
+
+static u32 RoundUpToPowerOfTwo(u32 inValue)
+{
+    u32 retVal = 1;
+    
+    while (retVal < inValue)
+    {
+        retVal <<= 1;
+    }
+    
+    return retVal;
+}
+
+@implementation SDFAtlasBuilder
+
+-(SDFAtlasBuilder*)InitWithParams:(SDFAtlasParams*)inParams
+{
+    memcpy(&mParams, inParams, sizeof(SDFAtlasParams));
+    [mParams.mCharacters retain];
+    
+    FT_Error error = FT_Init_FreeType(&mLibrary);
+    NSAssert(error == 0, @"Error initializing freetype");
+    
+    mFace = NULL;
+    mFontData = NULL;
+    
+    mGlyphs = NULL;
+    mNumGlyphs = 0;
+    
+    mAtlasData = NULL;
+    mAtlasWidth = 0;
+    mAtlasHeight = 0;
+    
+    mMetrics = NULL;
+    
+    return self;
+}
+
+-(void)dealloc
+{
+    for (u32 curGlyph = 0; curGlyph < mNumGlyphs; curGlyph++)
+    {
+        free(mGlyphs[curGlyph].mCoverage);
+        free(mGlyphs[curGlyph].mDistance);
+    }
+    
+    free(mGlyphs);
+    free(mAtlasData);
+    
+    if (mFace != NULL)
+    {
+        FT_Done_Face(mFace);
+    }
+    
+    FT_Done_FreeType(mLibrary);
+    
+    [mFontData release];
+    [mMetrics release];
+    [mParams.mCharacters release];
+    
+    [super dealloc];
+}
+
++(void)InitDefaultParams:(SDFAtlasParams*)outParams
+{
+    outParams->mGlyphSize = SDF_DEFAULT_GLYPH_SIZE;
+    outParams->mSpread = SDF_DEFAULT_SPREAD;
+    outParams->mPadding = SDF_DEFAULT_PADDING;
+    outParams->mCharacters = NULL;
+}
+
+-(BOOL)BuildWithFontData:(NSData*)inFontData
+{
+    NSAssert(mFace == NULL, @"An SDFAtlasBuilder can only build one atlas");
+    
+    // The face reads straight out of the font data
+    mFontData = [inFontData retain];
+    
+    if (FT_New_Memory_Face(mLibrary, (const FT_Byte*)[mFontData bytes], [mFontData length], 0, &mFace) != 0)
+    {
+        mFace = NULL;
+        
+        printf("\e[1;31mCouldn't load the font for the distance field atlas\e[m\n");
+        return FALSE;
+    }
+    
+    if (![self RasterizeGlyphs])
+    {
+        return FALSE;
+    }
+    
+    [self GenerateDistanceFields];
+    [self PackAtlas];
+    [self BuildMetrics];
+    
+    return TRUE;
+}
+
+-(u8*)GetAtlasData
+{
+    return mAtlasData;
+}
+
+-(u32)GetAtlasWidth
+{
+    return mAtlasWidth;
+}
+
+-(u32)GetAtlasHeight
+{
+    return mAtlasHeight;
+}
+
+-(NSDictionary*)GetMetrics
+{
+    return mMetrics;
+}
+
+-(BOOL)RasterizeGlyphs
+{
+    TRACE_SCOPE("SDF Rasterize");
+    
+    // FreeType faces aren't thread safe, so rasterizing is serial.  It's cheap next to the distance transforms.
+    FT_Set_Pixel_Sizes(mFace, 0, mParams.mGlyphSize);
+    
+    NSMutableIndexSet* characters = [NSMutableIndexSet indexSet];
+    
+    if (mParams.mCharacters == NULL)
+    {
+        [characters addIndexesInRange:NSMakeRange(SDF_FIRST_ASCII_CHARACTER, SDF_LAST_ASCII_CHARACTER - SDF_FIRST_ASCII_CHARACTER + 1)];
+    }
+    else
+    {
+        for (u32 curChar = 0; curChar < [mParams.mCharacters length]; curChar++)
+        {
+            [characters addIndex:[mParams.mCharacters characterAtIndex:curChar]];
+        }
+    }
+    
+    mGlyphs = malloc(sizeof(SDFGlyph) * [characters count]);
+    memset(mGlyphs, 0, sizeof(SDFGlyph) * [characters count]);
+    
+    int spread = mParams.mSpread;
+    
+    for (NSUInteger curChar = [characters firstIndex]; curChar != NSNotFound; curChar = [characters indexGreaterThanIndex:curChar])
+    {
+        FT_UInt glyphIndex = FT_Get_Char_Index(mFace, curChar);
+        
+        if ((glyphIndex == 0) || (FT_Load_Glyph(mFace, glyphIndex, FT_LOAD_RENDER) != 0))
+        {
+            printf("Character 0x%04lx isn't in the font, skipping\n", (unsigned long)curChar);
+            continue;
+        }
+        
+        FT_GlyphSlot slot = mFace->glyph;
+        SDFGlyph* glyph = &mGlyphs[mNumGlyphs++];
+        
+        glyph->mCharCode = curChar;
+        glyph->mGlyphIndex = glyphIndex;
+        glyph->mAdvance = (float)slot->advance.x / 64.0f;
+        
+        if ((slot->bitmap.width == 0) || (slot->bitmap.rows == 0))
+        {
+            continue;
+        }
+        
+        glyph->mWidth = slot->bitmap.width + (2 * spread);
+        glyph->mHeight = slot->bitmap.rows + (2 * spread);
+        glyph->mBearingX = slot->bitmap_left - spread;
+        glyph->mBearingY = slot->bitmap_top + spread;
+        
+        glyph->mCoverage = malloc(glyph->mWidth * glyph->mHeight);
+        memset(glyph->mCoverage, 0, glyph->mWidth * glyph->mHeight);
+        
+        for (int y = 0; y < slot->bitmap.rows; y++)
+        {
+            memcpy( &glyph->mCoverage[((y + spread) * glyph->mWidth) + spread],
+                    &slot->bitmap.buffer[y * slot->bitmap.pitch], slot->bitmap.width);
+        }
+    }
+    
+    if (mNumGlyphs == 0)
+    {
+        printf("\e[1;31mNone of the requested characters are in the font\e[m\n");
+        return FALSE;
+    }
+    
+    return TRUE;
+}
+
+-(void)GenerateDistanceFields
+{
+    TRACE_SCOPE("SDF Distance Transform");
+    
+    SDFDistanceFieldBatch batch;
+    
+    batch.mGlyphs = mGlyphs;
+    batch.mSpread = mParams.mSpread;
+    
+    // Glyphs are independent, each one is transformed on its own core
+    dispatch_apply_f(mNumGlyphs, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), &batch, GenerateDistanceFieldForGlyph);
+}
+
+-(void)PackAtlas
+{
+    TRACE_SCOPE("SDF Pack");
+    
+    u32 padding = mParams.mPadding;
+    u32 totalArea = 0;
+    u32 widestGlyph = 0;
+    
+    SDFGlyph** sortedGlyphs = malloc(sizeof(SDFGlyph*) * mNumGlyphs);
+    
+    for (u32 curGlyph = 0; curGlyph < mNumGlyphs; curGlyph++)
+    {
+        SDFGlyph* glyph = &mGlyphs[curGlyph];
+        
+        sortedGlyphs[curGlyph] = glyph;
+        
+        totalArea += (glyph->mWidth + padding) * (glyph->mHeight + padding);
+        widestGlyph = max(widestGlyph, glyph->mWidth + (2 * padding));
+    }
+    
+    qsort(sortedGlyphs, mNumGlyphs, sizeof(SDFGlyph*), CompareGlyphHeight);
+    
+    // Shelf packing, tallest glyphs first.  Start from a square that would fit everything if packing were perfect.
+    u32 minWidth = max(widestGlyph, SDF_MIN_ATLAS_WIDTH);
+    
+    mAtlasWidth = RoundUpToPowerOfTwo(max((u32)ceilf(sqrtf((float)totalArea)), minWidth));
+    
+    u32 shelfX = padding;
+    u32 shelfY = padding;
+    u32 shelfHeight = 0;
+    
+    for (u32 curGlyph = 0; curGlyph < mNumGlyphs; curGlyph++)
+    {
+        SDFGlyph* glyph = sortedGlyphs[curGlyph];
+        
+        if (glyph->mWidth == 0)
+        {
+            continue;
+        }
+        
+        if ((shelfX + glyph->mWidth + padding) > mAtlasWidth)
+        {
+            shelfX = padding;
+            shelfY += shelfHeight + padding;
+            shelfHeight = 0;
+        }
+        
+        glyph->mAtlasX = shelfX;
+        glyph->mAtlasY = shelfY;
+        
+        shelfX += glyph->mWidth + padding;
+        shelfHeight = max(shelfHeight, glyph->mHeight);
+    }
+    
+    free(sortedGlyphs);
+    
+    mAtlasHeight = RoundUpToPowerOfTwo(shelfY + shelfHeight + padding);
+    
+    u32 atlasSize = mAtlasWidth * mAtlasHeight * 4;
+    
+    mAtlasData = malloc(atlasSize);
+    
+    TRACE_ALLOCATION(atlasSize);
+    
+    // White everywhere, with zero distance (fully outside) in the gaps
+    for (u32 curTexel = 0; curTexel < (mAtlasWidth * mAtlasHeight); curTexel++)
+    {
+        mAtlasData[(curTexel * 4) + 0] = 0xFF;
+        mAtlasData[(curTexel * 4) + 1] = 0xFF;
+        mAtlasData[(curTexel * 4) + 2] = 0xFF;
+        mAtlasData[(curTexel * 4) + 3] = 0;
+    }
+    
+    for (u32 curGlyph = 0; curGlyph < mNumGlyphs; curGlyph++)
+    {
+        SDFGlyph* glyph = &mGlyphs[curGlyph];
+        
+        for (int y = 0; y < glyph->mHeight; y++)
+        {
+            u8* destRow = &mAtlasData[(((glyph->mAtlasY + y) * mAtlasWidth) + glyph->mAtlasX) * 4];
+            u8* srcRow = &glyph->mDistance[y * glyph->mWidth];
+            
+            for (int x = 0; x < glyph->mWidth; x++)
+            {
+                destRow[(x * 4) + 3] = srcRow[x];
+            }
+        }
+    }
+}
+
+-(void)BuildMetrics
+{
+    NSMutableArray* glyphs = [NSMutableArray arrayWithCapacity:mNumGlyphs];
+    
+    for (u32 curGlyph = 0; curGlyph < mNumGlyphs; curGlyph++)
+    {
+        SDFGlyph* glyph = &mGlyphs[curGlyph];
+        
+        NSDictionary* glyphMetrics = [NSDictionary dictionaryWithObjectsAndKeys:
+                                        [NSNumber numberWithUnsignedInt:glyph->mCharCode], @"char",
+                                        [NSNumber numberWithUnsignedInt:glyph->mAtlasX], @"x",
+                                        [NSNumber numberWithUnsignedInt:glyph->mAtlasY], @"y",
+                                        [NSNumber numberWithInt:glyph->mWidth], @"width",
+                                        [NSNumber numberWithInt:glyph->mHeight], @"height",
+                                        [NSNumber numberWithInt:glyph->mBearingX], @"bearingX",
+                                        [NSNumber numberWithInt:glyph->mBearingY], @"bearingY",
+                                        [NSNumber numberWithFloat:glyph->mAdvance], @"advance",
+                                        NULL];
+        
+        [glyphs addObject:glyphMetrics];
+    }
+    
+    // Only pairs that actually adjust the spacing are listed, as [left char, right char, pixels]
+    NSMutableArray* kerning = [NSMutableArray arrayWithCapacity:0];
+    
+    if (FT_HAS_KERNING(mFace))
+    {
+        for (u32 leftGlyph = 0; leftGlyph < mNumGlyphs; leftGlyph++)
+        {
+            for (u32 rightGlyph = 0; rightGlyph < mNumGlyphs; rightGlyph++)
+            {
+                FT_Vector delta;
+                
+                if (    (FT_Get_Kerning(mFace, mGlyphs[leftGlyph].mGlyphIndex, mGlyphs[rightGlyph].mGlyphIndex, FT_KERNING_UNFITTED, &delta) == 0) &&
+                        (delta.x != 0)  )
+                {
+                    [kerning addObject:[NSArray arrayWithObjects:
+                                            [NSNumber numberWithUnsignedInt:mGlyphs[leftGlyph].mCharCode],
+                                            [NSNumber numberWithUnsignedInt:mGlyphs[rightGlyph].mCharCode],
+                                            [NSNumber numberWithFloat:((float)delta.x / 64.0f)],
+                                            NULL]];
+                }
+            }
+        }
+    }
+    
+    FT_Size_Metrics* sizeMetrics = &mFace->size->metrics;
+    
+    mMetrics = [[NSMutableDictionary alloc] initWithObjectsAndKeys:
+                    [NSNumber numberWithUnsignedInt:mParams.mGlyphSize], @"glyphSize",
+                    [NSNumber numberWithUnsignedInt:mParams.mSpread], @"spread",
+                    [NSNumber numberWithUnsignedInt:mAtlasWidth], @"atlasWidth",
+                    [NSNumber numberWithUnsignedInt:mAtlasHeight], @"atlasHeight",
+                    [NSNumber numberWithFloat:((float)sizeMetrics->height / 64.0f)], @"lineHeight",
+                    [NSNumber numberWithFloat:((float)sizeMetrics->ascender / 64.0f)], @"ascender",
+                    [NSNumber numberWithFloat:((float)sizeMetrics->descender / 64.0f)], @"descender",
+                    glyphs, @"glyphs",
+                    kerning, @"kerning",
+                    NULL];
+}
+
+@end
@@ -0,0 +1,104 @@
+/*
+ *  TextAtlasWriter.h
+ *  Neon21ImageProcessor
+ *
+ *  Copyright 2010 Neon Games. All rights reserved.
+ *
+ */
+
+#import "TextTextureBuilder.h"
+
+// Packs rendered strings tightly into one or more atlas pages, and writes a binary lookup table alongside them.
+//
+// For a table at Strings.textatlas, pages are written as Strings_0.png, Strings_1.png and so on.  The table is a
+// TextAtlasHeader, then mNumPages TextAtlasPageInfos, then mNumEntries TextAtlasEntryInfos sorted by name (bytewise,
+// so they can be binary searched), then a string table of NUL terminated UTF-8 names.
+
+#define TEXT_ATLAS_MAGIC_NUMBER     ('NTXA')
+#define TEXT_ATLAS_VERSION          (1)
+
+typedef struct
+{
+    u32 mMagicNumber;
+    u32 mVersion;
+    u32 mNumPages;
+    u32 mNumEntries;
+    u32 mStringTableSize;
+} TextAtlasHeader;
+
+typedef struct
+{
+    u32 mWidth;
+    u32 mHeight;
+} TextAtlasPageInfo;
+
+typedef struct
+{
+    u32 mNameOffset;    // Into the string table
+    u32 mPage;
+    
+    // Placement of the rendered string on its page
+    u32 mX;
+    u32 mY;
+    u32 mWidth;
+    u32 mHeight;
+    
+    // Bounds of the drawn texels within the rendered string, as in TextTextureParams
+    u32 mStartX;
+    u32 mStartY;
+    u32 mEndX;
+    u32 mEndY;
+} TextAtlasEntryInfo;
+
+typedef struct
+{
+    u32     mMaxPageSize;   // Pages are at most this wide and tall, and are cropped to what's on them
+    u32     mPadding;       // Empty texels between entries so filtering doesn't bleed
+} TextAtlasWriterParams;
+
+@interface TextAtlasWriterEntry : NSObject
+{
+    @public
+        NSString*   mName;
+        u8*         mData;
+        u32         mWidth;
+        u32         mHeight;
+        
+        u32         mStartX;
+        u32         mStartY;
+        u32         mEndX;
+        u32         mEndY;
+        
+        u32         mPage;
+        u32         mX;
+        u32         mY;
+}
+
+-(void)dealloc;
+-(NSComparisonResult)CompareHeight:(TextAtlasWriterEntry*)inEntry;
+-(NSComparisonResult)CompareName:(TextAtlasWriterEntry*)inEntry;
+
+@end
+
+@interface TextAtlasWriter : NSObject
+{
+    TextAtlasWriterParams   mParams;
+    NSMutableArray*         mEntries;
+    NSMutableSet*           mEntryNames;
+}
+
+-(TextAtlasWriter*)InitWithParams:(TextAtlasWriterParams*)inParams;
+-(void)dealloc;
++(void)InitDefaultParams:(TextAtlasWriterParams*)outParams;
+
+// inData is RGBA8, inWidth texels per row, and is copied.  inContent is the drawn bounds from TextTextureParams.
+// Returns FALSE if an entry with this name was already added.
+-(BOOL)AddEntry:(NSString*)inName data:(u8*)inData width:(u32)inWidth height:(u32)inHeight content:(TextTextureParams*)inContent;
+
+// Packs every entry, then writes the pages and the lookup table
+-(BOOL)WriteToFile:(NSString*)inPath;
+
+-(BOOL)PackEntries:(NSMutableArray*)outPages;
+-(NSString*)PagePathForFile:(NSString*)inPath page:(u32)inPage;
+
+@end
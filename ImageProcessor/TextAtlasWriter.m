@@ -0,0 +1,316 @@
+/*
+ *  TextAtlasWriter.m
+ *  Neon21ImageProcessor
+ *
+ *  Copyright 2010 Neon Games. All rights reserved.
+ *
+ */
+
+#import "TextAtlasWriter.h"
+#import "PNGUtilities.h"
+#import "Trace.h"
+
+#import <dispatch/dispatch.h>
+#import <libkern/OSAtomic.h>
+
+#define TEXT_ATLAS_DEFAULT_MAX_PAGE_SIZE    (1024)
+#define TEXT_ATLAS_DEFAULT_PADDING          (1)
+
+typedef struct
+{
+    NSArray*            mPages;         // Array of entry arrays, one per page
+    NSArray*            mPagePaths;
+    TextAtlasPageInfo*  mPageInfo;
+    volatile s32        mNumFailed;
+} TextAtlasPageBatch;
+
+// Pages don't share any texels, so each one is composited and encoded on its own core
+static void WriteTextAtlasPage(void* inContext, size_t inIndex)
+{
+    TextAtlasPageBatch* batch = (TextAtlasPageBatch*)inContext;
+    TextAtlasPageInfo* pageInfo = &batch->mPageInfo[inIndex];
+    
+    NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+    
+    u32 pageSize = pageInfo->mWidth * pageInfo->mHeight * 4;
+    u8* pageData = malloc(pageSize);
+    
+    memset(pageData, 0, pageSize);
+    
+    TRACE_ALLOCATION(pageSize);
+    
+    for (TextAtlasWriterEntry* curEntry in [batch->mPages objectAtIndex:inIndex])
+    {
+        for (u32 y = 0; y < curEntry->mHeight; y++)
+        {
+            memcpy( &pageData[(((curEntry->mY + y) * pageInfo->mWidth) + curEntry->mX) * 4],
+                    &curEntry->mData[y * curEntry->mWidth * 4], curEntry->mWidth * 4);
+        }
+    }
+    
+    if (!WritePNG(pageData, [batch->mPagePaths objectAtIndex:inIndex], pageInfo->mWidth, pageInfo->mHeight))
+    {
+        OSAtomicIncrement32(&batch->mNumFailed);
+    }
+    
+    free(pageData);
+    
+    [pool release];
+}
+
+@implementation TextAtlasWriterEntry
+
+-(void)dealloc
+{
+    [mName release];
+    free(mData);
+    
+    [super dealloc];
+}
+
+-(NSComparisonResult)CompareHeight:(TextAtlasWriterEntry*)inEntry
+{
+    // Tallest first
+    if (mHeight != inEntry->mHeight)
+    {
+        return (mHeight > inEntry->mHeight) ? NSOrderedAscending : NSOrderedDescending;
+    }
+    
+    return [self CompareName:inEntry];
+}
+
+-(NSComparisonResult)CompareName:(TextAtlasWriterEntry*)inEntry
+{
+    // Bytewise, which is what readers of the table binary search with
+    int result = strcmp([mName UTF8String], [inEntry->mName UTF8String]);
+    
+    if (result == 0)
+    {
+        return NSOrderedSame;
+    }
+    
+    return (result < 0) ? NSOrderedAscending : NSOrderedDescending;
+}
+
+@end
+
+@implementation TextAtlasWriter
+
+-(TextAtlasWriter*)InitWithParams:(TextAtlasWriterParams*)inParams
+{
+    memcpy(&mParams, inParams, sizeof(TextAtlasWriterParams));
+    
+    mEntries = [[NSMutableArray alloc] initWithCapacity:0];
+    mEntryNames = [[NSMutableSet alloc] initWithCapacity:0];
+    
+    return self;
+}
+
+-(void)dealloc
+{
+    [mEntries release];
+    [mEntryNames release];
+    
+    [super dealloc];
+}
+
++(void)InitDefaultParams:(TextAtlasWriterParams*)outParams
+{
+    outParams->mMaxPageSize = TEXT_ATLAS_DEFAULT_MAX_PAGE_SIZE;
+    outParams->mPadding = TEXT_ATLAS_DEFAULT_PADDING;
+}
+
+-(BOOL)AddEntry:(NSString*)inName data:(u8*)inData width:(u32)inWidth height:(u32)inHeight content:(TextTextureParams*)inContent
+{
+    if ([mEntryNames containsObject:inName])
+    {
+        printf("\e[1;31mText atlas already has an entry named %s\e[m\n", [inName UTF8String]);
+        return FALSE;
+    }
+    
+    TextAtlasWriterEntry* entry = [TextAtlasWriterEntry alloc];
+    
+    entry->mName = [inName retain];
+    entry->mWidth = inWidth;
+    entry->mHeight = inHeight;
+    
+    entry->mData = malloc(inWidth * inHeight * 4);
+    memcpy(entry->mData, inData, inWidth * inHeight * 4);
+    
+    entry->mStartX = inContent->mStartX;
+    entry->mStartY = inContent->mStartY;
+    entry->mEndX = inContent->mEndX;
+    entry->mEndY = inContent->mEndY;
+    
+    [mEntries addObject:entry];
+    [mEntryNames addObject:inName];
+    
+    [entry release];
+    
+    return TRUE;
+}
+
+-(BOOL)WriteToFile:(NSString*)inPath
+{
+    TRACE_SCOPE("Write Text Atlas");
+    
+    NSMutableArray* pages = [NSMutableArray arrayWithCapacity:1];
+    
+    if (![self PackEntries:pages])
+    {
+        return FALSE;
+    }
+    
+    u32 numPages = [pages count];
+    
+    TextAtlasPageInfo* pageInfo = malloc(sizeof(TextAtlasPageInfo) * numPages);
+    NSMutableArray* pagePaths = [NSMutableArray arrayWithCapacity:numPages];
+    
+    for (u32 curPage = 0; curPage < numPages; curPage++)
+    {
+        // Crop each page to what was actually placed on it
+        pageInfo[curPage].mWidth = 0;
+        pageInfo[curPage].mHeight = 0;
+        
+        for (TextAtlasWriterEntry* curEntry in [pages objectAtIndex:curPage])
+        {
+            pageInfo[curPage].mWidth = max(pageInfo[curPage].mWidth, curEntry->mX + curEntry->mWidth + mParams.mPadding);
+            pageInfo[curPage].mHeight = max(pageInfo[curPage].mHeight, curEntry->mY + curEntry->mHeight + mParams.mPadding);
+        }
+        
+        [pagePaths addObject:[self PagePathForFile:inPath page:curPage]];
+    }
+    
+    TextAtlasPageBatch batch;
+    
+    batch.mPages = pages;
+    batch.mPagePaths = pagePaths;
+    batch.mPageInfo = pageInfo;
+    batch.mNumFailed = 0;
+    
+    dispatch_apply_f(numPages, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), &batch, WriteTextAtlasPage);
+    
+    if (batch.mNumFailed != 0)
+    {
+        printf("\e[1;31m%d text atlas pages couldn't be written\e[m\n", batch.mNumFailed);
+        
+        free(pageInfo);
+        return FALSE;
+    }
+    
+    // Lookup table
+    NSArray* sortedEntries = [mEntries sortedArrayUsingSelector:@selector(CompareName:)];
+    NSMutableData* stringTable = [NSMutableData dataWithCapacity:0];
+    
+    u32 numEntries = [sortedEntries count];
+    TextAtlasEntryInfo* entryInfo = malloc(sizeof(TextAtlasEntryInfo) * numEntries);
+    
+    for (u32 curEntryIndex = 0; curEntryIndex < numEntries; curEntryIndex++)
+    {
+        TextAtlasWriterEntry* curEntry = [sortedEntries objectAtIndex:curEntryIndex];
+        TextAtlasEntryInfo* curInfo = &entryInfo[curEntryIndex];
+        
+        const char* name = [curEntry->mName UTF8String];
+        
+        curInfo->mNameOffset = [stringTable length];
+        [stringTable appendBytes:name length:(strlen(name) + 1)];
+        
+        curInfo->mPage = curEntry->mPage;
+        curInfo->mX = curEntry->mX;
+        curInfo->mY = curEntry->mY;
+        curInfo->mWidth = curEntry->mWidth;
+        curInfo->mHeight = curEntry->mHeight;
+        curInfo->mStartX = curEntry->mStartX;
+        curInfo->mStartY = curEntry->mStartY;
+        curInfo->mEndX = curEntry->mEndX;
+        curInfo->mEndY = curEntry->mEndY;
+    }
+    
+    TextAtlasHeader header;
+    
+    header.mMagicNumber = TEXT_ATLAS_MAGIC_NUMBER;
+    header.mVersion = TEXT_ATLAS_VERSION;
+    header.mNumPages = numPages;
+    header.mNumEntries = numEntries;
+    header.mStringTableSize = [stringTable length];
+    
+    NSMutableData* tableData = [NSMutableData dataWithCapacity:0];
+    
+    [tableData appendBytes:&header length:sizeof(TextAtlasHeader)];
+    [tableData appendBytes:pageInfo length:(sizeof(TextAtlasPageInfo) * numPages)];
+    [tableData appendBytes:entryInfo length:(sizeof(TextAtlasEntryInfo) * numEntries)];
+    [tableData appendData:stringTable];
+    
+    free(pageInfo);
+    free(entryInfo);
+    
+    if (![tableData writeToFile:inPath atomically:YES])
+    {
+        printf("\e[1;31mCouldn't write text atlas table %s\e[m\n", [inPath UTF8String]);
+        return FALSE;
+    }
+    
+    TRACE_COUNT(TRACE_COUNTER_BYTES_WRITTEN, [tableData length]);
+    
+    return TRUE;
+}
+
+-(BOOL)PackEntries:(NSMutableArray*)outPages
+{
+    // Shelf packing, tallest entries first.  Entries go at their exact size, there's no power of two padding.
+    NSArray* sortedEntries = [mEntries sortedArrayUsingSelector:@selector(CompareHeight:)];
+    
+    u32 padding = mParams.mPadding;
+    u32 maxPageSize = mParams.mMaxPageSize;
+    
+    NSMutableArray* curPage = NULL;
+    
+    u32 shelfX = 0;
+    u32 shelfY = 0;
+    u32 shelfHeight = 0;
+    
+    for (TextAtlasWriterEntry* curEntry in sortedEntries)
+    {
+        if (((curEntry->mWidth + (2 * padding)) > maxPageSize) || ((curEntry->mHeight + (2 * padding)) > maxPageSize))
+        {
+            printf("\e[1;31m%s is %ux%u, which doesn't fit on a %u texel text atlas page\e[m\n", [curEntry->mName UTF8String],
+                    curEntry->mWidth, curEntry->mHeight, maxPageSize);
+            return FALSE;
+        }
+        
+        if ((curPage != NULL) && ((shelfX + curEntry->mWidth + padding) > maxPageSize))
+        {
+            shelfX = padding;
+            shelfY += shelfHeight + padding;
+            shelfHeight = 0;
+        }
+        
+        if ((curPage == NULL) || ((shelfY + curEntry->mHeight + padding) > maxPageSize))
+        {
+            curPage = [NSMutableArray arrayWithCapacity:0];
+            [outPages addObject:curPage];
+            
+            shelfX = padding;
+            shelfY = padding;
+            shelfHeight = 0;
+        }
+        
+        curEntry->mPage = [outPages count] - 1;
+        curEntry->mX = shelfX;
+        curEntry->mY = shelfY;
+        
+        [curPage addObject:curEntry];
+        
+        shelfX += curEntry->mWidth + padding;
+        shelfHeight = max(shelfHeight, curEntry->mHeight);
+    }
+    
+    return TRUE;
+}
+
+-(NSString*)PagePathForFile:(NSString*)inPath page:(u32)inPage
+{
+    return [[inPath stringByDeletingPathExtension] stringByAppendingFormat:@"_%u.png", inPage];
+}
+
+@end
@@ -0,0 +1,45 @@
+/*
+ *  WorkerProtocol.h
+ *  Neon21ImageProcessor
+ *
+ *  Copyright 2010 Neon Games. All rights reserved.
+ *
+ */
+
+// Wire protocol between the -serve worker and CLI invocations forwarded to it.
+//
+// Clients connect to a Unix domain socket, send one request and read one response, then the connection is closed.
+// Every message is a 32 bit little endian byte count followed by that many bytes of UTF-8 JSON.
+//
+// Request:     { "args" : [ "-premultiplyAlpha", "In.png", "Out.papng" ], "directory" : "/client/working/directory",
+//                "environment" : { "NEON_IMAGE_PROCESSOR_PNG_MODE" : "fast" } }
+// Response:    { "success" : true, "outputs" : [ "/client/working/directory/Out.papng" ], "error" : "..." }
+//
+// "args" are the command line arguments after the executable name, relative paths in them are relative to "directory".
+// In memory "mem:" paths are rejected, the worker keeps nothing between requests.
+// "environment" holds the client's settings from WorkerGetEnvironment.  The worker reads those once at startup, so it
+// rejects requests whose settings differ rather than produce something the same command wouldn't produce locally.
+// "error" is only present when the operation failed.
+
+#define WORKER_MAX_MESSAGE_SIZE     (16 * 1024 * 1024)
+
+// The worker reads requests one connection at a time, so a client that stops sending for this long is dropped
+#define WORKER_REQUEST_TIMEOUT_SECONDS  (5)
+
+extern const char* WORKER_SOCKET_ENVIRONMENT_VARIABLE;
+
+// Both return a socket descriptor, or -1 on failure
+int WorkerListen(NSString* inSocketPath);
+int WorkerConnect(NSString* inSocketPath);
+
+// The NEON_IMAGE_PROCESSOR_* settings that change what operations produce, for the ones that are set
+NSDictionary* WorkerGetEnvironment();
+
+// Returns NULL if inEnvironment matches this process's settings, otherwise a description of the first difference
+NSString* WorkerCheckEnvironment(NSDictionary* inEnvironment);
+
+// Reads that wait longer than inSeconds for data fail, rather than blocking forever
+BOOL WorkerSetReceiveTimeout(int inSocket, int inSeconds);
+
+BOOL WorkerWriteMessage(int inSocket, NSDictionary* inMessage);
+NSDictionary* WorkerReadMessage(int inSocket, NSString** outError);
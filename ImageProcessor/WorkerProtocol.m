@@ -0,0 +1,265 @@
+/*
+ *  WorkerProtocol.m
+ *  Neon21ImageProcessor
+ *
+ *  Copyright 2010 Neon Games. All rights reserved.
+ *
+ */
+
+#import "WorkerProtocol.h"
+#import "JSONUtilities.h"
+
+#import <sys/socket.h>
+#import <sys/un.h>
+#import <errno.h>
+
+const char* WORKER_SOCKET_ENVIRONMENT_VARIABLE = "NEON_IMAGE_PROCESSOR_SERVER";
+
+static const char* sWorkerEnvironmentVariables[] = {   "NEON_IMAGE_PROCESSOR_FONT_PATH",
+                                                        "NEON_IMAGE_PROCESSOR_PNG_MODE",
+                                                        "NEON_IMAGE_PROCESSOR_PNG_STATS",
+                                                        "NEON_IMAGE_PROCESSOR_TEXT_CACHE",
+                                                        NULL };
+
+static BOOL WorkerMakeAddress(NSString* inSocketPath, struct sockaddr_un* outAddress)
+{
+    const char* path = [inSocketPath fileSystemRepresentation];
+    
+    memset(outAddress, 0, sizeof(struct sockaddr_un));
+    outAddress->sun_family = AF_UNIX;
+    
+    if (strlen(path) >= sizeof(outAddress->sun_path))
+    {
+        printf("\e[1;31mSocket path %s is too long\e[m\n", path);
+        return FALSE;
+    }
+    
+    strcpy(outAddress->sun_path, path);
+    
+    return TRUE;
+}
+
+int WorkerListen(NSString* inSocketPath)
+{
+    struct sockaddr_un address;
+    
+    if (!WorkerMakeAddress(inSocketPath, &address))
+    {
+        return -1;
+    }
+    
+    // A socket file left behind by a worker that didn't shut down cleanly is removed, but not one that's still being served
+    int existingSocket = WorkerConnect(inSocketPath);
+    
+    if (existingSocket >= 0)
+    {
+        close(existingSocket);
+        printf("\e[1;31mA worker is already serving %s\e[m\n", address.sun_path);
+        return -1;
+    }
+    
+    unlink(address.sun_path);
+    
+    int listenSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+    
+    if (listenSocket < 0)
+    {
+        return -1;
+    }
+    
+    if ((bind(listenSocket, (struct sockaddr*)&address, sizeof(address)) != 0) || (listen(listenSocket, SOMAXCONN) != 0))
+    {
+        printf("\e[1;31mCould not listen on %s: %s\e[m\n", address.sun_path, strerror(errno));
+        close(listenSocket);
+        return -1;
+    }
+    
+    return listenSocket;
+}
+
+int WorkerConnect(NSString* inSocketPath)
+{
+    struct sockaddr_un address;
+    
+    if (!WorkerMakeAddress(inSocketPath, &address))
+    {
+        return -1;
+    }
+    
+    int connectSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+    
+    if (connectSocket < 0)
+    {
+        return -1;
+    }
+    
+    if (connect(connectSocket, (struct sockaddr*)&address, sizeof(address)) != 0)
+    {
+        close(connectSocket);
+        return -1;
+    }
+    
+    return connectSocket;
+}
+
+static BOOL WorkerWriteFully(int inSocket, const u8* inBytes, u32 inLength)
+{
+    while (inLength > 0)
+    {
+        ssize_t written = write(inSocket, inBytes, inLength);
+        
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            
+            return FALSE;
+        }
+        
+        inBytes += written;
+        inLength -= written;
+    }
+    
+    return TRUE;
+}
+
+static BOOL WorkerReadFully(int inSocket, u8* outBytes, u32 inLength)
+{
+    while (inLength > 0)
+    {
+        ssize_t numRead = read(inSocket, outBytes, inLength);
+        
+        if (numRead < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            
+            return FALSE;
+        }
+        else if (numRead == 0)
+        {
+            return FALSE;
+        }
+        
+        outBytes += numRead;
+        inLength -= numRead;
+    }
+    
+    return TRUE;
+}
+
+NSDictionary* WorkerGetEnvironment()
+{
+    NSMutableDictionary* environment = [NSMutableDictionary dictionaryWithCapacity:0];
+    
+    for (int curVariable = 0; sWorkerEnvironmentVariables[curVariable] != NULL; curVariable++)
+    {
+        char* value = getenv(sWorkerEnvironmentVariables[curVariable]);
+        
+        if (value != NULL)
+        {
+            [environment setObject:[NSString stringWithUTF8String:value] forKey:[NSString stringWithUTF8String:sWorkerEnvironmentVariables[curVariable]]];
+        }
+    }
+    
+    return environment;
+}
+
+NSString* WorkerCheckEnvironment(NSDictionary* inEnvironment)
+{
+    if (![inEnvironment isKindOfClass:[NSDictionary class]])
+    {
+        return @"Requests need an \"environment\" object";
+    }
+    
+    NSDictionary* workerEnvironment = WorkerGetEnvironment();
+    
+    for (int curVariable = 0; sWorkerEnvironmentVariables[curVariable] != NULL; curVariable++)
+    {
+        NSString* name = [NSString stringWithUTF8String:sWorkerEnvironmentVariables[curVariable]];
+        
+        id requestValue = [inEnvironment objectForKey:name];
+        id workerValue = [workerEnvironment objectForKey:name];
+        
+        if ((requestValue != workerValue) && (![requestValue isEqual:workerValue]))
+        {
+            return [NSString stringWithFormat:@"%@ is %@ here but %@ for the worker, restart the worker with the same settings or unset %s",
+                    name, (requestValue != NULL) ? [requestValue description] : @"unset", (workerValue != NULL) ? workerValue : @"unset",
+                    WORKER_SOCKET_ENVIRONMENT_VARIABLE];
+        }
+    }
+    
+    return NULL;
+}
+
+BOOL WorkerSetReceiveTimeout(int inSocket, int inSeconds)
+{
+    struct timeval timeout;
+    
+    timeout.tv_sec = inSeconds;
+    timeout.tv_usec = 0;
+    
+    if (setsockopt(inSocket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) != 0)
+    {
+        printf("\e[1;31mCould not set a receive timeout: %s\e[m\n", strerror(errno));
+        return FALSE;
+    }
+    
+    return TRUE;
+}
+
+BOOL WorkerWriteMessage(int inSocket, NSDictionary* inMessage)
+{
+    NSData* data = JSONDataFromObject(inMessage);
+    
+    if ((data == NULL) || ([data length] > WORKER_MAX_MESSAGE_SIZE))
+    {
+        return FALSE;
+    }
+    
+    u32 length = [data length];
+    u8 header[4] = { length & 0xFF, (length >> 8) & 0xFF, (length >> 16) & 0xFF, (length >> 24) & 0xFF };
+    
+    return WorkerWriteFully(inSocket, header, sizeof(header)) && WorkerWriteFully(inSocket, [data bytes], length);
+}
+
+NSDictionary* WorkerReadMessage(int inSocket, NSString** outError)
+{
+    u8 header[4];
+    
+    if (!WorkerReadFully(inSocket, header, sizeof(header)))
+    {
+        *outError = ((errno == EAGAIN) || (errno == EWOULDBLOCK)) ? @"Timed out waiting for a message" : @"Connection closed before a message was received";
+        return NULL;
+    }
+    
+    u32 length = header[0] | (header[1] << 8) | (header[2] << 16) | ((u32)header[3] << 24);
+    
+    if (length > WORKER_MAX_MESSAGE_SIZE)
+    {
+        *outError = [NSString stringWithFormat:@"Message of %u bytes is too large", length];
+        return NULL;
+    }
+    
+    NSMutableData* data = [NSMutableData dataWithLength:length];
+    
+    if (!WorkerReadFully(inSocket, [data mutableBytes], length))
+    {
+        *outError = ((errno == EAGAIN) || (errno == EWOULDBLOCK)) ? @"Timed out in the middle of a message" : @"Connection closed in the middle of a message";
+        return NULL;
+    }
+    
+    NSDictionary* message = (NSDictionary*)JSONObjectFromData(data, outError);
+    
+    if ((message != NULL) && (![message isKindOfClass:[NSDictionary class]]))
+    {
+        *outError = @"Messages must be JSON objects";
+        return NULL;
+    }
+    
+    return message;
+}
@@ -10,4 +10,6 @@ typedef signed int      s32;
 typedef unsigned short  u16;
 typedef signed short    s16;
 typedef unsigned char   u8;
-typedef signed char     s8;
\ No newline at end of file
+typedef signed char     s8;
+typedef unsigned long long  u64;
+typedef signed long long    s64;
\ No newline at end of file
@@ -7,15 +7,39 @@
 
 #import "BigFileDefines.h"
 
+// Reads both version 1 and version 2 archives.  Version 1 entries are converted to TOCEntryV2 at load time
+// (uncompressed, no checksum) so the rest of the class doesn't need to care which version it has.
+
 @interface BigFile : NSObject
 {
-    TOCEntry*   mTOC;
-    int         mNumFiles;
+    TOCEntryV2*     mTOC;
+    int             mNumFiles;
+    int             mMajorVersion;
     
-    NSData*     mData;
+    NSData*         mData;
+    NSDictionary*   mNameIndex;     // Filename -> NSNumber index into mTOC
 }
 
 -(BigFile*)InitWithData:(NSData*)inData;
+-(void)dealloc;
+
+-(BOOL)InitV1;
+-(BOOL)InitV2;
+
+// Uncompressed entries point directly into the archive (no copy is made) and keep the archive alive for as long as
+// they're retained.  Compressed entries are inflated and checked against their CRC32, NULL is returned on a mismatch.
 -(NSData*)GetFileAtIndex:(int)inIndex;
+-(NSData*)GetFileWithName:(NSString*)inName;
+
+// Checks an entry against its stored CRC32.  Version 1 entries have no checksum and always pass.
+-(BOOL)VerifyFileAtIndex:(int)inIndex;
+
+// Returns -1 if there's no file with this name
+-(int)GetIndexOfFileWithName:(NSString*)inName;
+-(int)GetNumFiles;
+
+@end
+
 
-@end
\ No newline at end of file
+// CRC32 as stored in TOCEntryV2.  Handles lengths beyond what a single zlib call accepts.
+u32 BigFileCRC32(const void* inData, u64 inLength);
@@ -6,14 +6,143 @@
 //
 
 #import "BigFile.h"
+#import "zlib-1.2.3/zlib.h"
+
+// A read only window onto part of another NSData.  The parent is retained rather than copied.
+@interface BigFileEntryData : NSData
+{
+    NSData*         mParent;
+    const void*     mBytes;
+    NSUInteger      mLength;
+}
+
+-(BigFileEntryData*)InitWithParent:(NSData*)inParent offset:(NSUInteger)inOffset length:(NSUInteger)inLength;
+-(void)dealloc;
+
+-(const void*)bytes;
+-(NSUInteger)length;
+
+@end
+
+@implementation BigFileEntryData
+
+-(BigFileEntryData*)InitWithParent:(NSData*)inParent offset:(NSUInteger)inOffset length:(NSUInteger)inLength
+{
+    NSAssert((inOffset + inLength) <= [inParent length], @"Bigfile entry extends past the end of the archive");
+    
+    mParent = [inParent retain];
+    mBytes = (const u8*)[inParent bytes] + inOffset;
+    mLength = inLength;
+    
+    return self;
+}
+
+-(void)dealloc
+{
+    [mParent release];
+    
+    [super dealloc];
+}
+
+-(const void*)bytes
+{
+    return mBytes;
+}
+
+-(NSUInteger)length
+{
+    return mLength;
+}
+
+@end
+
+// zlib takes 32 bit lengths
+#define BIGFILE_CRC_CHUNK_SIZE  (1 << 30)
+
+u32 BigFileCRC32(const void* inData, u64 inLength)
+{
+    uLong crc = crc32(0L, Z_NULL, 0);
+    const u8* data = (const u8*)inData;
+    
+    while (inLength > 0)
+    {
+        uInt chunkSize = (uInt)min(inLength, (u64)BIGFILE_CRC_CHUNK_SIZE);
+        
+        crc = crc32(crc, data, chunkSize);
+        
+        data += chunkSize;
+        inLength -= chunkSize;
+    }
+    
+    return (u32)crc;
+}
+
+static void SwapTOCEntryV2ToHost(TOCEntryV2* ioEntry)
+{
+    ioEntry->mOffset = CFSwapInt64LittleToHost(ioEntry->mOffset);
+    ioEntry->mStoredSize = CFSwapInt64LittleToHost(ioEntry->mStoredSize);
+    ioEntry->mSize = CFSwapInt64LittleToHost(ioEntry->mSize);
+    ioEntry->mCRC32 = CFSwapInt32LittleToHost(ioEntry->mCRC32);
+    ioEntry->mCompression = CFSwapInt32LittleToHost(ioEntry->mCompression);
+    ioEntry->mNameOffset = CFSwapInt32LittleToHost(ioEntry->mNameOffset);
+    ioEntry->mNameLength = CFSwapInt32LittleToHost(ioEntry->mNameLength);
+}
 
 @implementation BigFile
 
 -(BigFile*)InitWithData:(NSData*)inData
 {
-    unsigned const char* stream = [inData bytes];
+    mData = [inData retain];
+    mTOC = NULL;
+    mNumFiles = 0;
+    mMajorVersion = 0;
+    mNameIndex = NULL;
+    
+    BOOL success = FALSE;
+    
+    if ([inData length] >= sizeof(BigFileHeader))
+    {
+        BigFileHeader header;
+        
+        memcpy(&header, [inData bytes], sizeof(BigFileHeader));
+        
+        mMajorVersion = header.mMajorVersion;
+        
+        if (CFSwapInt32LittleToHost(header.mMajorVersion) == NEON21_BIGFILE_V2_MAJOR_VERSION)
+        {
+            mMajorVersion = NEON21_BIGFILE_V2_MAJOR_VERSION;
+            success = [self InitV2];
+        }
+        else
+        {
+            success = [self InitV1];
+        }
+    }
     
-    mData = inData;
+    NSAssert(success, @"Invalid or unsupported bigfile");
+    
+    if (!success)
+    {
+        free(mTOC);
+        mTOC = NULL;
+        mNumFiles = 0;
+        
+        [mNameIndex release];
+        mNameIndex = NULL;
+    }
+    
+    if (mNameIndex == NULL)
+    {
+        mNameIndex = [[NSDictionary alloc] init];
+    }
+    
+    return self;
+}
+
+-(BOOL)InitV1
+{
+    unsigned const char* stream = [mData bytes];
+    u64 dataLength = [mData length];
     
     BigFileHeader header;
     
@@ -22,42 +151,260 @@
     NSAssert(header.mMajorVersion == NEON21_BIGFILE_MAJOR_VERSION, @"Major version mismatch during bigfile load");
     NSAssert(header.mMinorVersion == NEON21_BIGFILE_MINOR_VERSION, @"Minor version mismatch during bigfile load");
     
-    mNumFiles = 0;
+    if ((header.mMajorVersion != NEON21_BIGFILE_MAJOR_VERSION) || (header.mMinorVersion != NEON21_BIGFILE_MINOR_VERSION))
+    {
+        return FALSE;
+    }
+    
+    if ((header.mNumFiles < 0) || ((sizeof(header) + (sizeof(TOCEntry) * (u64)header.mNumFiles)) > [mData length]))
+    {
+        return FALSE;
+    }
+    
+    mNumFiles = header.mNumFiles;
+    mTOC = malloc(sizeof(TOCEntryV2) * mNumFiles);
+    
+    const TOCEntry* toc = (const TOCEntry*)(stream + sizeof(header));
+    
+    // Index the TOC by name.  Filenames fill the whole field when they're exactly BIGFILE_FILENAME_LENGTH long, so
+    // they aren't necessarily terminated.  The first entry with a given name wins.
+    NSMutableDictionary* nameIndex = [[NSMutableDictionary alloc] initWithCapacity:mNumFiles];
+    
+    for (int curFile = 0; curFile < mNumFiles; curFile++)
+    {
+        TOCEntry entry;
+        memcpy(&entry, &toc[curFile], sizeof(TOCEntry));
+        
+        // Version 1 entries run up to the start of the next one, the last runs to the end of the file
+        s64 endOffset = dataLength;
+        
+        if (curFile < (mNumFiles - 1))
+        {
+            TOCEntry nextEntry;
+            memcpy(&nextEntry, &toc[curFile + 1], sizeof(TOCEntry));
+            
+            endOffset = nextEntry.mOffset;
+        }
+        
+        // Offsets out of order or past the end of the file would give an entry outside the data, reject the whole file
+        // the same as a bad version 2 TOC
+        if ((entry.mOffset < 0) || (endOffset < entry.mOffset) || (endOffset > (s64)dataLength))
+        {
+            [nameIndex release];
+            return FALSE;
+        }
+        
+        mTOC[curFile].mOffset = entry.mOffset;
+        mTOC[curFile].mStoredSize = endOffset - entry.mOffset;
+        mTOC[curFile].mSize = mTOC[curFile].mStoredSize;
+        mTOC[curFile].mCRC32 = 0;
+        mTOC[curFile].mCompression = BIGFILE_COMPRESSION_NONE;
+        mTOC[curFile].mNameOffset = 0;
+        mTOC[curFile].mNameLength = 0;
+        
+        NSString* name = [[NSString alloc] initWithBytes:entry.mFilename
+                                            length:strnlen(entry.mFilename, BIGFILE_FILENAME_LENGTH)
+                                            encoding:NSASCIIStringEncoding];
+        
+        if ((name != NULL) && ([nameIndex objectForKey:name] == NULL))
+        {
+            [nameIndex setObject:[NSNumber numberWithInt:curFile] forKey:name];
+        }
+        
+        [name release];
+    }
+    
+    mNameIndex = nameIndex;
+    
+    return TRUE;
+}
+
+-(BOOL)InitV2
+{
+    unsigned const char* stream = [mData bytes];
+    u64 dataLength = [mData length];
+    
+    if (dataLength < sizeof(BigFileHeaderV2))
+    {
+        return FALSE;
+    }
+    
+    BigFileHeaderV2 header;
+    
+    memcpy(&header, stream, sizeof(BigFileHeaderV2));
+    
+    header.mMajorVersion = CFSwapInt32LittleToHost(header.mMajorVersion);
+    header.mMinorVersion = CFSwapInt32LittleToHost(header.mMinorVersion);
+    header.mNumFiles = CFSwapInt32LittleToHost(header.mNumFiles);
+    header.mAlignment = CFSwapInt32LittleToHost(header.mAlignment);
+    header.mTOCOffset = CFSwapInt64LittleToHost(header.mTOCOffset);
+    header.mNameTableOffset = CFSwapInt64LittleToHost(header.mNameTableOffset);
+    header.mNameTableSize = CFSwapInt64LittleToHost(header.mNameTableSize);
     
-    if ((header.mMajorVersion == NEON21_BIGFILE_MAJOR_VERSION) && (header.mMinorVersion == NEON21_BIGFILE_MINOR_VERSION))
+    NSAssert(header.mMinorVersion == NEON21_BIGFILE_V2_MINOR_VERSION, @"Minor version mismatch during bigfile load");
+    
+    u64 tocSize = sizeof(TOCEntryV2) * (u64)header.mNumFiles;
+    
+    if (    (header.mMinorVersion != NEON21_BIGFILE_V2_MINOR_VERSION) ||
+            (header.mTOCOffset > dataLength) || (tocSize > (dataLength - header.mTOCOffset)) ||
+            (header.mNameTableOffset > dataLength) || (header.mNameTableSize > (dataLength - header.mNameTableOffset)) )
+    {
+        return FALSE;
+    }
+    
+    mNumFiles = header.mNumFiles;
+    mTOC = malloc(tocSize);
+    
+    memcpy(mTOC, stream + header.mTOCOffset, tocSize);
+    
+    const char* nameTable = (const char*)(stream + header.mNameTableOffset);
+    
+    NSMutableDictionary* nameIndex = [[NSMutableDictionary alloc] initWithCapacity:mNumFiles];
+    mNameIndex = nameIndex;
+    
+    for (int curFile = 0; curFile < mNumFiles; curFile++)
     {
-        mNumFiles = header.mNumFiles;
+        TOCEntryV2* entry = &mTOC[curFile];
         
-        mTOC = malloc(sizeof(TOCEntry) * (mNumFiles + 1));
+        SwapTOCEntryV2ToHost(entry);
         
-        memcpy(mTOC, stream + sizeof(header), sizeof(TOCEntry) * mNumFiles);
+        if (    (entry->mOffset > dataLength) || (entry->mStoredSize > (dataLength - entry->mOffset)) ||
+                (((u64)entry->mNameOffset + entry->mNameLength) > header.mNameTableSize) ||
+                (entry->mCompression >= BIGFILE_COMPRESSION_NUM) )
+        {
+            return FALSE;
+        }
         
-        // Populate the dummy TOC entry with the end of file
-        mTOC[mNumFiles].mOffset = [inData length];
-        memset(mTOC[mNumFiles].mFilename, 0, BIGFILE_FILENAME_LENGTH);
+        NSString* name = [[NSString alloc] initWithBytes:&nameTable[entry->mNameOffset] length:entry->mNameLength encoding:NSUTF8StringEncoding];
+        
+        if ((name != NULL) && ([nameIndex objectForKey:name] == NULL))
+        {
+            [nameIndex setObject:[NSNumber numberWithInt:curFile] forKey:name];
+        }
+        
+        [name release];
     }
     
-    return self;
+    return TRUE;
+}
+
+-(void)dealloc
+{
+    free(mTOC);
+    
+    [mNameIndex release];
+    [mData release];
+    
+    [super dealloc];
 }
 
 -(NSData*)GetFileAtIndex:(int)inIndex
 {
-    unsigned const char* stream = [mData bytes];
     NSData* retData = NULL;
     
     BOOL validIndex = (inIndex >= 0) && (inIndex < mNumFiles);
     
     NSAssert(validIndex, @"Invalid file index specified during a load from bigfile.\n");
     
-    if (validIndex)
+    if (!validIndex)
     {
-        int fileOffset = mTOC[inIndex].mOffset;
-        int length = mTOC[inIndex + 1].mOffset - fileOffset;
+        return NULL;
+    }
+    
+    TOCEntryV2* entry = &mTOC[inIndex];
+    
+    switch(entry->mCompression)
+    {
+        case BIGFILE_COMPRESSION_NONE:
+        {
+            retData = [[[BigFileEntryData alloc] InitWithParent:mData offset:entry->mOffset length:entry->mStoredSize] autorelease];
+            break;
+        }
+        
+        case BIGFILE_COMPRESSION_ZLIB:
+        {
+            u8* buffer = malloc(entry->mSize);
+            uLongf bufferSize = entry->mSize;
+            
+            if ((buffer == NULL) && (entry->mSize != 0))
+            {
+                NSAssert(FALSE, @"Not enough memory to decompress bigfile entry");
+                break;
+            }
+            
+            int result = uncompress(buffer, &bufferSize, (const u8*)[mData bytes] + entry->mOffset, entry->mStoredSize);
+            
+            if ((result != Z_OK) || (bufferSize != entry->mSize) || (BigFileCRC32(buffer, bufferSize) != entry->mCRC32))
+            {
+                NSAssert(FALSE, @"Corrupt compressed bigfile entry");
+                free(buffer);
+                break;
+            }
+            
+            retData = [NSData dataWithBytesNoCopy:buffer length:bufferSize freeWhenDone:TRUE];
+            break;
+        }
         
-        retData = [NSData dataWithBytes:&stream[fileOffset] length:length];
+        default:
+        {
+            NSAssert(FALSE, @"Unsupported bigfile compression type");
+            break;
+        }
     }
     
     return retData;
 }
 
-@end
\ No newline at end of file
+-(BOOL)VerifyFileAtIndex:(int)inIndex
+{
+    if (mMajorVersion != NEON21_BIGFILE_V2_MAJOR_VERSION)
+    {
+        return TRUE;
+    }
+    
+    // Decompressing already checks the CRC, so only uncompressed entries need it computed here
+    NSData* data = [self GetFileAtIndex:inIndex];
+    
+    if (data == NULL)
+    {
+        return FALSE;
+    }
+    
+    if (mTOC[inIndex].mCompression != BIGFILE_COMPRESSION_NONE)
+    {
+        return TRUE;
+    }
+    
+    return BigFileCRC32([data bytes], [data length]) == mTOC[inIndex].mCRC32;
+}
+
+-(NSData*)GetFileWithName:(NSString*)inName
+{
+    int index = [self GetIndexOfFileWithName:inName];
+    
+    if (index < 0)
+    {
+        return NULL;
+    }
+    
+    return [self GetFileAtIndex:index];
+}
+
+-(int)GetIndexOfFileWithName:(NSString*)inName
+{
+    NSNumber* index = [mNameIndex objectForKey:inName];
+    
+    if (index == NULL)
+    {
+        return -1;
+    }
+    
+    return [index intValue];
+}
+
+-(int)GetNumFiles
+{
+    return mNumFiles;
+}
+
+@end
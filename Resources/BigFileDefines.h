@@ -25,3 +25,47 @@ typedef struct
     int     mOffset;                    // Offset from the start of the file
     char    mFilename[BIGFILE_FILENAME_LENGTH];     // File name (ASCII)
 } TOCEntry;
+
+// Version 2
+//
+// Layout: BigFileHeaderV2, then entry payloads (each starting on an mAlignment boundary), then the TOC
+// (mNumFiles TOCEntryV2 structures, sorted by name), then the name table.  The TOC and name table are at the
+// end so an archive can be written in a single pass and the header patched afterwards.
+//
+// The first two fields line up with BigFileHeader so the version can be read before knowing which header is
+// present.  Everything is stored little endian.
+
+#define NEON21_BIGFILE_V2_MAJOR_VERSION     2
+#define NEON21_BIGFILE_V2_MINOR_VERSION     0
+
+#define BIGFILE_DEFAULT_ALIGNMENT           16
+
+typedef enum
+{
+    BIGFILE_COMPRESSION_NONE,
+    BIGFILE_COMPRESSION_ZLIB,
+    BIGFILE_COMPRESSION_LZ4,        // Reserved.  LZ4 isn't part of this tree, so these entries can't be read yet.
+    BIGFILE_COMPRESSION_NUM
+} BigFileCompression;
+
+typedef struct
+{
+    u32     mMajorVersion;
+    u32     mMinorVersion;
+    u32     mNumFiles;
+    u32     mAlignment;             // Payload alignment in bytes, a power of two
+    u64     mTOCOffset;             // Offset of the first TOCEntryV2
+    u64     mNameTableOffset;       // Offset of the name table
+    u64     mNameTableSize;         // Size of the name table in bytes
+} BigFileHeaderV2;
+
+typedef struct
+{
+    u64     mOffset;                // Offset of the stored payload from the start of the file
+    u64     mStoredSize;            // Size of the payload as stored (compressed size if compressed)
+    u64     mSize;                  // Size of the payload once decompressed
+    u32     mCRC32;                 // CRC32 of the decompressed payload
+    u32     mCompression;           // BigFileCompression
+    u32     mNameOffset;            // Offset of the entry's name in the name table (UTF-8, not terminated)
+    u32     mNameLength;            // Length of the name in bytes
+} TOCEntryV2;
@@ -0,0 +1,47 @@
+//
+//  BigFilePacker.h
+//  Neon21
+//
+//  Copyright Neon Games 2010. All rights reserved.
+//
+
+#import "BigFileDefines.h"
+
+// Writes version 2 BigFile archives (see BigFileDefines.h).
+//
+// Payloads are written in a single sequential pass, ordered by locality group and then by the order files
+// were added, so assets that are loaded together end up next to each other on disk.  Entries are compressed
+// a batch at a time across all cores, and only kept compressed when that actually saves space.
+
+typedef struct
+{
+    u32     mAlignment;             // Payload alignment, must be a power of two
+    BOOL    mCompress;              // zlib compress entries
+    int     mCompressionLevel;      // zlib compression level (0-9)
+    BOOL    mReportStats;
+} BigFilePackerParams;
+
+@interface BigFilePacker : NSObject
+{
+    BigFilePackerParams mParams;
+    NSMutableArray*     mEntries;
+    NSMutableSet*       mEntryNames;
+}
+
+-(BigFilePacker*)InitWithParams:(BigFilePackerParams*)inParams;
+-(void)dealloc;
++(void)InitDefaultParams:(BigFilePackerParams*)outParams;
+
+// Returns FALSE if an entry with this name was already added.  Lower locality groups are written first.
+-(BOOL)AddFile:(NSString*)inPath name:(NSString*)inName locality:(int)inLocality;
+
+// Adds every file under inDirectory, named by their path relative to it.  Each subdirectory is its own locality group.
+-(void)AddDirectory:(NSString*)inDirectory;
+
+// Manifest lines are "path" or "path<tab>locality".  Paths are relative to the manifest's directory and are used as the
+// entry names.  Blank lines and lines starting with # are ignored.
+-(BOOL)AddManifest:(NSString*)inManifestPath;
+
+-(BOOL)WriteToFile:(NSString*)inPath;
+
+@end
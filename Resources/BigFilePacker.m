@@ -0,0 +1,447 @@
+//
+//  BigFilePacker.m
+//  Neon21
+//
+//  Copyright Neon Games 2010. All rights reserved.
+//
+
+#import "BigFilePacker.h"
+#import "BigFile.h"
+#import "MappedData.h"
+#import "zlib-1.2.3/zlib.h"
+
+#import <dispatch/dispatch.h>
+
+// Upper bound on the source bytes compressed at once.  Keeps memory flat no matter how big the archive is.
+#define BIGFILE_PACK_BATCH_BYTES    (64 * 1024 * 1024)
+
+// The TOC is 8 byte aligned regardless of the payload alignment
+#define BIGFILE_TOC_ALIGNMENT       (8)
+
+@interface BigFilePackerEntry : NSObject
+{
+    @public
+        NSString*   mPath;
+        NSString*   mName;
+        int         mLocality;
+        int         mOrder;
+        
+        u64         mOffset;
+        u64         mStoredSize;
+        u64         mSize;
+        u32         mCRC32;
+        u32         mCompression;
+}
+
+@end
+
+@implementation BigFilePackerEntry
+
+-(void)dealloc
+{
+    [mPath release];
+    [mName release];
+    
+    [super dealloc];
+}
+
+@end
+
+typedef struct
+{
+    BigFilePackerEntry* mEntry;
+    NSData*             mSource;
+    u8*                 mCompressedData;
+    BOOL                mCompress;
+    int                 mCompressionLevel;
+} BigFilePackJob;
+
+static NSInteger CompareEntryLocality(id inLeft, id inRight, void* inContext)
+{
+    BigFilePackerEntry* left = (BigFilePackerEntry*)inLeft;
+    BigFilePackerEntry* right = (BigFilePackerEntry*)inRight;
+    
+    if (left->mLocality != right->mLocality)
+    {
+        return (left->mLocality < right->mLocality) ? NSOrderedAscending : NSOrderedDescending;
+    }
+    
+    if (left->mOrder != right->mOrder)
+    {
+        return (left->mOrder < right->mOrder) ? NSOrderedAscending : NSOrderedDescending;
+    }
+    
+    return NSOrderedSame;
+}
+
+static NSInteger CompareEntryName(id inLeft, id inRight, void* inContext)
+{
+    int result = strcmp([((BigFilePackerEntry*)inLeft)->mName UTF8String], [((BigFilePackerEntry*)inRight)->mName UTF8String]);
+    
+    if (result == 0)
+    {
+        return NSOrderedSame;
+    }
+    
+    return (result < 0) ? NSOrderedAscending : NSOrderedDescending;
+}
+
+static void PackEntry(void* inContext, size_t inIndex)
+{
+    BigFilePackJob* job = &((BigFilePackJob*)inContext)[inIndex];
+    BigFilePackerEntry* entry = job->mEntry;
+    
+    u64 size = [job->mSource length];
+    
+    entry->mSize = size;
+    entry->mStoredSize = size;
+    entry->mCRC32 = BigFileCRC32([job->mSource bytes], size);
+    entry->mCompression = BIGFILE_COMPRESSION_NONE;
+    
+    if (job->mCompress && (size > 0))
+    {
+        uLongf compressedSize = compressBound(size);
+        job->mCompressedData = malloc(compressedSize);
+        
+        int result = compress2(job->mCompressedData, &compressedSize, [job->mSource bytes], size, job->mCompressionLevel);
+        
+        // Entries that don't shrink are cheaper to load stored
+        if ((result == Z_OK) && (compressedSize < size))
+        {
+            entry->mStoredSize = compressedSize;
+            entry->mCompression = BIGFILE_COMPRESSION_ZLIB;
+        }
+        else
+        {
+            free(job->mCompressedData);
+            job->mCompressedData = NULL;
+        }
+    }
+}
+
+static BOOL WritePadding(FILE* inFile, u64* ioOffset, u32 inAlignment)
+{
+    static const u8 sZeroes[256] = { 0 };
+    
+    u64 padding = (inAlignment - (*ioOffset & (inAlignment - 1))) & (inAlignment - 1);
+    
+    while (padding > 0)
+    {
+        size_t chunkSize = (size_t)min(padding, (u64)sizeof(sZeroes));
+        
+        if (fwrite(sZeroes, 1, chunkSize, inFile) != chunkSize)
+        {
+            return FALSE;
+        }
+        
+        padding -= chunkSize;
+        *ioOffset += chunkSize;
+    }
+    
+    return TRUE;
+}
+
+static BOOL WriteBytes(FILE* inFile, u64* ioOffset, const void* inBytes, u64 inLength)
+{
+    if ((inLength > 0) && (fwrite(inBytes, inLength, 1, inFile) != 1))
+    {
+        return FALSE;
+    }
+    
+    *ioOffset += inLength;
+    
+    return TRUE;
+}
+
+@implementation BigFilePacker
+
+-(BigFilePacker*)InitWithParams:(BigFilePackerParams*)inParams
+{
+    NSAssert((inParams->mAlignment != 0) && ((inParams->mAlignment & (inParams->mAlignment - 1)) == 0), @"Alignment must be a power of two");
+    
+    memcpy(&mParams, inParams, sizeof(BigFilePackerParams));
+    
+    mEntries = [[NSMutableArray alloc] initWithCapacity:0];
+    mEntryNames = [[NSMutableSet alloc] initWithCapacity:0];
+    
+    return self;
+}
+
+-(void)dealloc
+{
+    [mEntries release];
+    [mEntryNames release];
+    
+    [super dealloc];
+}
+
++(void)InitDefaultParams:(BigFilePackerParams*)outParams
+{
+    outParams->mAlignment = BIGFILE_DEFAULT_ALIGNMENT;
+    outParams->mCompress = FALSE;
+    outParams->mCompressionLevel = Z_DEFAULT_COMPRESSION;
+    outParams->mReportStats = TRUE;
+}
+
+-(BOOL)AddFile:(NSString*)inPath name:(NSString*)inName locality:(int)inLocality
+{
+    if ([mEntryNames containsObject:inName])
+    {
+        printf("\e[1;31mDuplicate bigfile entry %s, skipping %s\e[m\n", [inName UTF8String], [inPath UTF8String]);
+        return FALSE;
+    }
+    
+    BigFilePackerEntry* entry = [BigFilePackerEntry alloc];
+    
+    entry->mPath = [inPath retain];
+    entry->mName = [inName retain];
+    entry->mLocality = inLocality;
+    entry->mOrder = [mEntries count];
+    
+    [mEntries addObject:entry];
+    [mEntryNames addObject:inName];
+    
+    [entry release];
+    
+    return TRUE;
+}
+
+-(void)AddDirectory:(NSString*)inDirectory
+{
+    NSDirectoryEnumerator* directoryEnumerator = [[NSFileManager defaultManager] enumeratorAtPath:inDirectory];
+    NSMutableArray* fileNames = [[NSMutableArray alloc] initWithCapacity:0];
+    
+    for (NSString* fileName in directoryEnumerator)
+    {
+        BOOL directory = FALSE;
+        
+        [[NSFileManager defaultManager] fileExistsAtPath:[inDirectory stringByAppendingPathComponent:fileName] isDirectory:&directory];
+        
+        if (!directory)
+        {
+            [fileNames addObject:fileName];
+        }
+    }
+    
+    // Sorting by path keeps each directory's files together, and each directory gets its own locality group
+    [fileNames sortUsingSelector:@selector(compare:)];
+    
+    NSString* lastDirectory = NULL;
+    int locality = -1;
+    
+    for (NSString* fileName in fileNames)
+    {
+        NSString* directory = [fileName stringByDeletingLastPathComponent];
+        
+        if ((lastDirectory == NULL) || ([directory compare:lastDirectory] != NSOrderedSame))
+        {
+            lastDirectory = directory;
+            locality++;
+        }
+        
+        [self AddFile:[inDirectory stringByAppendingPathComponent:fileName] name:fileName locality:locality];
+    }
+    
+    [fileNames release];
+}
+
+-(BOOL)AddManifest:(NSString*)inManifestPath
+{
+    NSString* manifest = [NSString stringWithContentsOfFile:inManifestPath encoding:NSUTF8StringEncoding error:NULL];
+    
+    if (manifest == NULL)
+    {
+        printf("\e[1;31mCouldn't read manifest %s\e[m\n", [inManifestPath UTF8String]);
+        return FALSE;
+    }
+    
+    NSString* baseDirectory = [inManifestPath stringByDeletingLastPathComponent];
+    
+    for (NSString* line in [manifest componentsSeparatedByCharactersInSet:[NSCharacterSet newlineCharacterSet]])
+    {
+        line = [line stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+        
+        if (([line length] == 0) || [line hasPrefix:@"#"])
+        {
+            continue;
+        }
+        
+        NSArray* fields = [line componentsSeparatedByString:@"\t"];
+        NSString* name = [fields objectAtIndex:0];
+        int locality = 0;
+        
+        if ([fields count] > 1)
+        {
+            locality = [[fields objectAtIndex:1] intValue];
+        }
+        
+        NSString* path = [name isAbsolutePath] ? name : [baseDirectory stringByAppendingPathComponent:name];
+        
+        [self AddFile:path name:[name isAbsolutePath] ? [name lastPathComponent] : name locality:locality];
+    }
+    
+    return TRUE;
+}
+
+-(BOOL)WriteToFile:(NSString*)inPath
+{
+    CFAbsoluteTime startTime = CFAbsoluteTimeGetCurrent();
+    
+    FILE* file = fopen([inPath UTF8String], "wb");
+    
+    if (file == NULL)
+    {
+        printf("\e[1;31mCouldn't open %s for writing...aborting\e[m\n", [inPath UTF8String]);
+        return FALSE;
+    }
+    
+    [mEntries sortUsingFunction:CompareEntryLocality context:NULL];
+    
+    int numEntries = [mEntries count];
+    u64 offset = 0;
+    u64 totalSize = 0;
+    BOOL success = TRUE;
+    
+    // Placeholder header, the real one is written once the TOC location is known
+    BigFileHeaderV2 header;
+    memset(&header, 0, sizeof(header));
+    
+    success = WriteBytes(file, &offset, &header, sizeof(header));
+    
+    BigFilePackJob* jobs = malloc(sizeof(BigFilePackJob) * max(numEntries, 1));
+    int batchStart = 0;
+    
+    while (success && (batchStart < numEntries))
+    {
+        NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+        
+        // Map inputs until the batch is full.  Always take at least one, however big it is.
+        int batchEnd = batchStart;
+        u64 batchBytes = 0;
+        
+        while ((batchEnd < numEntries) && ((batchEnd == batchStart) || (batchBytes < BIGFILE_PACK_BATCH_BYTES)))
+        {
+            BigFilePackerEntry* entry = [mEntries objectAtIndex:batchEnd];
+            BigFilePackJob* job = &jobs[batchEnd];
+            
+            job->mEntry = entry;
+            job->mSource = [[MappedData alloc] InitWithPath:entry->mPath advice:MAPPED_DATA_ADVICE_SEQUENTIAL];
+            job->mCompressedData = NULL;
+            job->mCompress = mParams.mCompress;
+            job->mCompressionLevel = mParams.mCompressionLevel;
+            
+            if (job->mSource == NULL)
+            {
+                printf("\e[1;31mCouldn't read %s...aborting\e[m\n", [entry->mPath UTF8String]);
+                success = FALSE;
+                break;
+            }
+            
+            batchBytes += [job->mSource length];
+            batchEnd++;
+        }
+        
+        if (success)
+        {
+            dispatch_apply_f(batchEnd - batchStart, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), &jobs[batchStart], PackEntry);
+        }
+        
+        // Payloads go out strictly in locality order
+        for (int curJob = batchStart; curJob < batchEnd; curJob++)
+        {
+            BigFilePackJob* job = &jobs[curJob];
+            BigFilePackerEntry* entry = job->mEntry;
+            
+            if (success)
+            {
+                const void* storedBytes = (job->mCompressedData != NULL) ? job->mCompressedData : [job->mSource bytes];
+                
+                success = WritePadding(file, &offset, mParams.mAlignment);
+                
+                entry->mOffset = offset;
+                
+                success = success && WriteBytes(file, &offset, storedBytes, entry->mStoredSize);
+                
+                totalSize += entry->mSize;
+            }
+            
+            free(job->mCompressedData);
+            [job->mSource release];
+        }
+        
+        batchStart = batchEnd;
+        
+        [pool release];
+    }
+    
+    free(jobs);
+    
+    // The TOC is sorted by name, the payloads above are in locality order
+    NSMutableArray* sortedEntries = [[NSMutableArray alloc] initWithArray:mEntries];
+    [sortedEntries sortUsingFunction:CompareEntryName context:NULL];
+    
+    success = success && WritePadding(file, &offset, BIGFILE_TOC_ALIGNMENT);
+    
+    u64 tocOffset = offset;
+    u32 nameOffset = 0;
+    
+    for (int curEntry = 0; success && (curEntry < numEntries); curEntry++)
+    {
+        BigFilePackerEntry* entry = [sortedEntries objectAtIndex:curEntry];
+        u32 nameLength = strlen([entry->mName UTF8String]);
+        
+        TOCEntryV2 tocEntry;
+        
+        tocEntry.mOffset = CFSwapInt64HostToLittle(entry->mOffset);
+        tocEntry.mStoredSize = CFSwapInt64HostToLittle(entry->mStoredSize);
+        tocEntry.mSize = CFSwapInt64HostToLittle(entry->mSize);
+        tocEntry.mCRC32 = CFSwapInt32HostToLittle(entry->mCRC32);
+        tocEntry.mCompression = CFSwapInt32HostToLittle(entry->mCompression);
+        tocEntry.mNameOffset = CFSwapInt32HostToLittle(nameOffset);
+        tocEntry.mNameLength = CFSwapInt32HostToLittle(nameLength);
+        
+        success = WriteBytes(file, &offset, &tocEntry, sizeof(tocEntry));
+        
+        nameOffset += nameLength;
+    }
+    
+    u64 nameTableOffset = offset;
+    
+    for (int curEntry = 0; success && (curEntry < numEntries); curEntry++)
+    {
+        const char* name = [((BigFilePackerEntry*)[sortedEntries objectAtIndex:curEntry])->mName UTF8String];
+        success = WriteBytes(file, &offset, name, strlen(name));
+    }
+    
+    [sortedEntries release];
+    
+    if (success)
+    {
+        header.mMajorVersion = CFSwapInt32HostToLittle(NEON21_BIGFILE_V2_MAJOR_VERSION);
+        header.mMinorVersion = CFSwapInt32HostToLittle(NEON21_BIGFILE_V2_MINOR_VERSION);
+        header.mNumFiles = CFSwapInt32HostToLittle(numEntries);
+        header.mAlignment = CFSwapInt32HostToLittle(mParams.mAlignment);
+        header.mTOCOffset = CFSwapInt64HostToLittle(tocOffset);
+        header.mNameTableOffset = CFSwapInt64HostToLittle(nameTableOffset);
+        header.mNameTableSize = CFSwapInt64HostToLittle(nameOffset);
+        
+        success = (fseeko(file, 0, SEEK_SET) == 0) && (fwrite(&header, sizeof(header), 1, file) == 1);
+    }
+    
+    success = (fclose(file) == 0) && success;
+    
+    if (!success)
+    {
+        printf("\e[1;31mFailed writing %s\e[m\n", [inPath UTF8String]);
+        unlink([inPath UTF8String]);
+    }
+    else if (mParams.mReportStats)
+    {
+        printf("BigFile:\t%s\n\t\t%d files, %llu bytes packed into %llu bytes, %.2f ms\n", [inPath UTF8String], numEntries,
+                    totalSize, offset, (CFAbsoluteTimeGetCurrent() - startTime) * 1000.0);
+    }
+    
+    return success;
+}
+
+@end
@@ -0,0 +1,35 @@
+//
+//  MappedData.h
+//  Neon21
+//
+//  Copyright Neon Games 2010. All rights reserved.
+//
+
+typedef enum
+{
+    MAPPED_DATA_ADVICE_NORMAL,
+    MAPPED_DATA_ADVICE_SEQUENTIAL,  // Read front to back once, eg: PNG decode
+    MAPPED_DATA_ADVICE_RANDOM,
+    MAPPED_DATA_ADVICE_WILLNEED,    // Start paging the file in now, it's about to be used
+    MAPPED_DATA_ADVICE_NUM
+} MappedDataAdvice;
+
+// NSData backed by a read only mmap of a file.  Pages are only read in as they're touched and are never
+// copied into the heap.  The mapping is removed when the object is deallocated.
+
+@interface MappedData : NSData
+{
+    void*       mBytes;
+    NSUInteger  mLength;
+}
+
+// Returns NULL (and releases the receiver) if the file can't be opened or mapped
+-(MappedData*)InitWithPath:(NSString*)inPath advice:(MappedDataAdvice)inAdvice;
+-(void)dealloc;
+
+-(void)Advise:(MappedDataAdvice)inAdvice;
+
+-(const void*)bytes;
+-(NSUInteger)length;
+
+@end
@@ -0,0 +1,98 @@
+//
+//  MappedData.m
+//  Neon21
+//
+//  Copyright Neon Games 2010. All rights reserved.
+//
+
+#import "MappedData.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+static const int sMAdviceValues[MAPPED_DATA_ADVICE_NUM] = { MADV_NORMAL, MADV_SEQUENTIAL, MADV_RANDOM, MADV_WILLNEED };
+
+@implementation MappedData
+
+-(MappedData*)InitWithPath:(NSString*)inPath advice:(MappedDataAdvice)inAdvice
+{
+    mBytes = NULL;
+    mLength = 0;
+    
+    int fd = open([inPath fileSystemRepresentation], O_RDONLY);
+    
+    if (fd < 0)
+    {
+        [self release];
+        return NULL;
+    }
+    
+    struct stat fileStats;
+    
+    if (fstat(fd, &fileStats) != 0)
+    {
+        close(fd);
+        [self release];
+        return NULL;
+    }
+    
+    mLength = fileStats.st_size;
+    
+    // mmap doesn't accept zero length mappings.  An empty file is just empty data.
+    if (mLength > 0)
+    {
+        void* bytes = mmap(NULL, mLength, PROT_READ, MAP_FILE | MAP_PRIVATE, fd, 0);
+        
+        if (bytes == MAP_FAILED)
+        {
+            close(fd);
+            
+            mLength = 0;
+            [self release];
+            return NULL;
+        }
+        
+        mBytes = bytes;
+    }
+    
+    // The mapping holds its own reference to the file
+    close(fd);
+    
+    [self Advise:inAdvice];
+    
+    return self;
+}
+
+-(void)dealloc
+{
+    if (mBytes != NULL)
+    {
+        munmap(mBytes, mLength);
+    }
+    
+    [super dealloc];
+}
+
+-(void)Advise:(MappedDataAdvice)inAdvice
+{
+    NSAssert((inAdvice >= 0) && (inAdvice < MAPPED_DATA_ADVICE_NUM), @"Invalid mapped data advice");
+    
+    if (mBytes != NULL)
+    {
+        madvise(mBytes, mLength, sMAdviceValues[inAdvice]);
+    }
+}
+
+-(const void*)bytes
+{
+    return mBytes;
+}
+
+-(NSUInteger)length
+{
+    return mLength;
+}
+
+@end
@@ -27,9 +27,12 @@ typedef enum
         int             mReferenceCount;
         NSNumber*       mHandle;
         ResourceType    mResourceType;
+        LoadType        mLoadType;
         
         NSData*         mData;
         NSObject*       mMetadata;
+        
+        NSDate*         mModificationDate;  // Of the file when it was loaded
 };
 
 -(void)Reset;
@@ -47,11 +50,20 @@ typedef enum
 @interface ResourceManager : NSObject
 {
     @private
-        NSMutableArray*  mFileNodes;
-        NSMutableArray*  mResourceNodes;
-        NSMutableArray*  mFreeHandles;
+        NSMutableArray*         mFileNodes;
+        NSMutableDictionary*    mFileNodesByName;       // Lowercase asset name -> FileNode
+        
+        NSMutableDictionary*    mResourceNodesByPath;   // Path -> ResourceNode
+        NSMutableDictionary*    mResourceNodesByName;   // Last path component -> NSMutableArray of ResourceNodes, in load order
+        
+        ResourceNode**          mHandleTable;           // Indexed by handle, owns a reference to each loaded ResourceNode
+        int                     mHandleTableSize;
+        
+        NSMutableArray*         mFreeHandles;
         
         NSString*        mApplicationResourcePath;
+        NSString*        mDataPath;
+        BOOL             mFileNodesGenerated;
         
         int              mCurHandle;
 }
@@ -68,11 +80,26 @@ typedef enum
 // Asset loading functions, these are safe - use these freely.
 -(NSNumber*)LoadAssetWithPath:(NSString*)inPath;
 -(NSNumber*)LoadAssetWithName:(NSString*)inName;
+
+// Mapped assets are backed by an mmap of the file (see MappedData.h) and never copied into the heap.
+// The mapping is removed when the last reference is unloaded.
+-(NSNumber*)LoadMappedAssetWithPath:(NSString*)inPath;
 -(NSNumber*)LoadMappedAssetWithName:(NSString*)inName;
+
+// Hints that a mapped asset will be read soon so the kernel can start paging it in.  No-op for other assets.
+-(void)PrefetchAssetWithHandle:(NSNumber*)inHandle;
+
 -(NSString*)FindAssetWithName:(NSString*)inName;
 -(void)UnloadAssetWithHandle:(NSNumber*)inHandle;
 -(NSData*)GetDataForHandle:(NSNumber*)inHandle;
 
+// TRUE if the asset's file has changed (or gone away) since it was loaded.  Long running processes use this to
+// reload assets that are kept around between requests.
+-(BOOL)IsAssetModifiedWithHandle:(NSNumber*)inHandle;
+
+// Same lookup as LoadAssetWithName, but returns the path the asset would be loaded from.  NULL if there's no such asset.
+-(NSString*)FindAssetPathWithName:(NSString*)inName;
+
 // You should not need to call these, but they are there and should be relatively safe.
 -(ResourceNode*)FindResourceWithPath:(NSString*)inPath;
 -(ResourceNode*)FindResourceWithHandle:(NSNumber*)inHandle;
@@ -82,13 +109,23 @@ typedef enum
 // Internally used functions.  Don't call these externally, can be dangerous.
 
 -(ResourceNode*)CreateResourceNodeWithPath:(NSString*)inPath;
+-(void)RemoveResourceNode:(ResourceNode*)inResourceNode;
+-(void)AddFileNode:(FileNode*)inFileNode;
+-(NSNumber*)InternalLoadAssetWithPath:(NSString*)inPath loadType:(LoadType)inLoadType;
 -(NSNumber*)InternalLoadAssetWithName:(NSString*)inName loadType:(LoadType)inLoadType;
 -(void)CreateMetadataForNode:(ResourceNode*)inResourceNode withExtension:(NSString*)inFileExtension;
 -(BigFile*)GetBigFile:(NSNumber*)inHandle;
 
 -(void)LoadData:(ResourceNode*)inResourceNode;
 
--(void)SetWorkingDirectory;
+-(NSString*)ResolveAssetPath:(NSString*)inPath;
+
+// The asset index is built on the first name lookup rather than at startup.  It's cached on disk and the cache is
+// reused for as long as none of the directories under Data have been modified.
 -(void)GenerateFileNodes;
+-(void)EnumerateFileNodes;
+-(BOOL)LoadFileNodeCache;
+-(void)SaveFileNodeCache:(NSDictionary*)inDirectoryTimes;
+-(NSString*)GetFileNodeCachePath;
 
 @end
\ No newline at end of file
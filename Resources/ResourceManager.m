@@ -6,6 +6,8 @@
 
 #import "ResourceManager.h"
 #import "BigFile.h"
+#import "MappedData.h"
+#import "Trace.h"
 
 @implementation FileNode
 -(void)dealloc
@@ -26,9 +28,12 @@
     mReferenceCount = 0;
     mHandle = 0;
     mResourceType = RESOURCETYPE_INVALID;
+    mLoadType = LOADTYPE_ALLOC;
     
     mData = 0;
     mMetadata = 0;
+    
+    mModificationDate = NULL;
 }
 
 -(void)dealloc
@@ -37,6 +42,7 @@
     [mHandle release];
     [mData release];
     [mMetadata release];
+    [mModificationDate release];
 
     [super dealloc];
 }
@@ -50,6 +56,14 @@ static ResourceManager* sInstance = NULL;
 static const int INITIAL_NUM_FILENODES = 10;
 static const int INITIAL_NUM_FREEHANDLES = 0;
 static const int INITIAL_HANDLE = 0;
+static const int INITIAL_HANDLE_TABLE_SIZE = 64;
+
+static const int FILE_NODE_CACHE_VERSION = 1;
+
+static NSString* FILE_NODE_CACHE_VERSION_KEY = @"Version";
+static NSString* FILE_NODE_CACHE_DATA_PATH_KEY = @"DataPath";
+static NSString* FILE_NODE_CACHE_DIRECTORIES_KEY = @"Directories";
+static NSString* FILE_NODE_CACHE_FILES_KEY = @"Files";
 
 +(void)CreateInstance
 {
@@ -75,72 +89,216 @@ static const int INITIAL_HANDLE = 0;
 -(void)Init
 {
     mFileNodes = [[NSMutableArray alloc] initWithCapacity:INITIAL_NUM_FILENODES];
-    mResourceNodes = [[NSMutableArray alloc] initWithCapacity:INITIAL_NUM_FILENODES];
+    mFileNodesByName = [[NSMutableDictionary alloc] initWithCapacity:INITIAL_NUM_FILENODES];
+    
+    mResourceNodesByPath = [[NSMutableDictionary alloc] initWithCapacity:INITIAL_NUM_FILENODES];
+    mResourceNodesByName = [[NSMutableDictionary alloc] initWithCapacity:INITIAL_NUM_FILENODES];
+    
+    mHandleTableSize = INITIAL_HANDLE_TABLE_SIZE;
+    mHandleTable = calloc(mHandleTableSize, sizeof(ResourceNode*));
+    
     mFreeHandles = [[NSMutableArray alloc] initWithCapacity:INITIAL_NUM_FREEHANDLES];
     mApplicationResourcePath = [[NSString alloc] initWithString:[[NSBundle mainBundle] resourcePath]];
+    mDataPath = [[[[NSBundle mainBundle] bundlePath] stringByAppendingPathComponent:@"Data"] retain];
+    mFileNodesGenerated = FALSE;
     
     mCurHandle = INITIAL_HANDLE;
-    
-#if TARGET_OS_IPHONE 
-    [self GenerateFileNodes];
-#endif
 }
 
 -(void)Term
 {
-    [mResourceNodes release];
+    for (int curHandle = 0; curHandle < mHandleTableSize; curHandle++)
+    {
+        [mHandleTable[curHandle] release];
+    }
+    
+    free(mHandleTable);
+    
+    [mResourceNodesByPath release];
+    [mResourceNodesByName release];
     [mFreeHandles release];
     [mApplicationResourcePath release];
+    [mDataPath release];
     [mFileNodes release];
+    [mFileNodesByName release];
 }
 
 -(void)GenerateFileNodes
 {
-    NSString* appPath = [[NSBundle mainBundle] bundlePath];
-    NSString* dataPath = [appPath stringByAppendingPathComponent:@"Data"];
+    if (mFileNodesGenerated)
+    {
+        return;
+    }
     
-    NSDirectoryEnumerator* directoryEnumerator = [[NSFileManager defaultManager] enumeratorAtPath:dataPath];
+    mFileNodesGenerated = TRUE;
+    
+    if (![self LoadFileNodeCache])
+    {
+        [self EnumerateFileNodes];
+    }
+}
+
+-(void)EnumerateFileNodes
+{
+    NSDirectoryEnumerator* directoryEnumerator = [[NSFileManager defaultManager] enumeratorAtPath:mDataPath];
     NSAssert(directoryEnumerator != NULL, @"Game data not found, are the paths set up correctly?\n");
     
-    NSString* fileName = NULL;
+    NSMutableDictionary* directoryTimes = [[NSMutableDictionary alloc] initWithCapacity:0];
+    NSDate* rootModificationDate = [[[NSFileManager defaultManager] attributesOfItemAtPath:mDataPath error:NULL] fileModificationDate];
     
-    [[NSFileManager defaultManager] changeCurrentDirectoryPath:dataPath];
+    if (rootModificationDate != NULL)
+    {
+        [directoryTimes setObject:[NSNumber numberWithDouble:[rootModificationDate timeIntervalSinceReferenceDate]] forKey:@""];
+    }
     
-    do
+    // The enumerator already has each entry's attributes, so there's no need to stat anything again
+    for (NSString* fileName in directoryEnumerator)
     {
-        fileName = [directoryEnumerator nextObject];
+        NSDictionary* attributes = [directoryEnumerator fileAttributes];
         
-        if (fileName != NULL)
+        if ([[attributes fileType] isEqualToString:NSFileTypeDirectory])
         {
-            BOOL directory = FALSE;
+            [directoryTimes setObject:[NSNumber numberWithDouble:[[attributes fileModificationDate] timeIntervalSinceReferenceDate]] forKey:fileName];
+        }
+        else
+        {
+            FileNode* curNode = [FileNode alloc];
             
-            [[NSFileManager defaultManager] fileExistsAtPath:fileName isDirectory:&directory];
+            curNode->mPath = [[NSString alloc] initWithString:fileName];
+            curNode->mAssetName = [[NSString alloc] initWithString:[fileName lastPathComponent]];
             
-            if (!directory)
-            {
-                FileNode* curNode = [FileNode alloc];
-                
-                curNode->mPath = [[NSString alloc] initWithString:fileName];
-                curNode->mAssetName = [[NSString alloc] initWithString:[fileName lastPathComponent]];
-                
-                [mFileNodes addObject:curNode];
-                
-                [curNode release];
-            }
+            [self AddFileNode:curNode];
+            
+            [curNode release];
         }
     }
-    while (fileName != NULL);
+    
+    [self SaveFileNodeCache:directoryTimes];
+    
+    [directoryTimes release];
+}
+
+-(BOOL)LoadFileNodeCache
+{
+    NSData* cacheData = [NSData dataWithContentsOfFile:[self GetFileNodeCachePath]];
+    
+    if (cacheData == NULL)
+    {
+        return FALSE;
+    }
+    
+    NSDictionary* cache = [NSPropertyListSerialization propertyListFromData:cacheData mutabilityOption:NSPropertyListImmutable format:NULL errorDescription:NULL];
+    
+    if (    (![cache isKindOfClass:[NSDictionary class]]) ||
+            ([[cache objectForKey:FILE_NODE_CACHE_VERSION_KEY] intValue] != FILE_NODE_CACHE_VERSION) ||
+            (![[cache objectForKey:FILE_NODE_CACHE_DATA_PATH_KEY] isEqualToString:mDataPath]) )
+    {
+        return FALSE;
+    }
+    
+    // Adding, removing or renaming anything changes its directory's modification time, so if every directory
+    // matches, the file list does too.  This is one stat per directory, no directory contents are read.
+    NSDictionary* directoryTimes = [cache objectForKey:FILE_NODE_CACHE_DIRECTORIES_KEY];
+    
+    if ([directoryTimes count] == 0)
+    {
+        return FALSE;
+    }
+    
+    for (NSString* directory in directoryTimes)
+    {
+        NSString* directoryPath = ([directory length] == 0) ? mDataPath : [mDataPath stringByAppendingPathComponent:directory];
+        NSDate* modificationDate = [[[NSFileManager defaultManager] attributesOfItemAtPath:directoryPath error:NULL] fileModificationDate];
+        
+        if ((modificationDate == NULL) || ([modificationDate timeIntervalSinceReferenceDate] != [[directoryTimes objectForKey:directory] doubleValue]))
+        {
+            return FALSE;
+        }
+    }
+    
+    for (NSString* fileName in [cache objectForKey:FILE_NODE_CACHE_FILES_KEY])
+    {
+        FileNode* curNode = [FileNode alloc];
+        
+        curNode->mPath = [[NSString alloc] initWithString:fileName];
+        curNode->mAssetName = [[NSString alloc] initWithString:[fileName lastPathComponent]];
+        
+        [self AddFileNode:curNode];
+        
+        [curNode release];
+    }
+    
+    return TRUE;
+}
+
+-(void)SaveFileNodeCache:(NSDictionary*)inDirectoryTimes
+{
+    NSMutableArray* files = [[NSMutableArray alloc] initWithCapacity:[mFileNodes count]];
+    
+    for (FileNode* curNode in mFileNodes)
+    {
+        [files addObject:curNode->mPath];
+    }
+    
+    NSDictionary* cache = [NSDictionary dictionaryWithObjectsAndKeys:
+                                [NSNumber numberWithInt:FILE_NODE_CACHE_VERSION], FILE_NODE_CACHE_VERSION_KEY,
+                                mDataPath, FILE_NODE_CACHE_DATA_PATH_KEY,
+                                inDirectoryTimes, FILE_NODE_CACHE_DIRECTORIES_KEY,
+                                files, FILE_NODE_CACHE_FILES_KEY,
+                                NULL];
+    
+    [files release];
+    
+    NSData* cacheData = [NSPropertyListSerialization dataFromPropertyList:cache format:NSPropertyListBinaryFormat_v1_0 errorDescription:NULL];
+    NSString* cachePath = [self GetFileNodeCachePath];
+    
+    // The cache is only an optimization, failing to write it is harmless
+    [[NSFileManager defaultManager] createDirectoryAtPath:[cachePath stringByDeletingLastPathComponent] withIntermediateDirectories:TRUE attributes:NULL error:NULL];
+    [cacheData writeToFile:cachePath atomically:TRUE];
+}
+
+-(NSString*)GetFileNodeCachePath
+{
+    NSArray* cacheDirectories = NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, TRUE);
+    NSString* cacheDirectory = ([cacheDirectories count] > 0) ? [cacheDirectories objectAtIndex:0] : NSTemporaryDirectory();
+    
+    // One cache per data directory, so different tools and bundles don't fight over it
+    NSString* cacheName = [NSString stringWithFormat:@"AssetIndex-%08lx.plist", (unsigned long)[mDataPath hash]];
+    
+    return [[cacheDirectory stringByAppendingPathComponent:@"Neon21"] stringByAppendingPathComponent:cacheName];
+}
+
+-(void)AddFileNode:(FileNode*)inFileNode
+{
+    [mFileNodes addObject:inFileNode];
+    
+    // Lookups are case insensitive, and the first file found with a given name wins
+    NSString* key = [inFileNode->mAssetName lowercaseString];
+    
+    if ([mFileNodesByName objectForKey:key] == NULL)
+    {
+        [mFileNodesByName setObject:inFileNode forKey:key];
+    }
 }
 
 -(NSNumber*)LoadAssetWithPath:(NSString*)inPath
+{
+    return [self InternalLoadAssetWithPath:inPath loadType:LOADTYPE_ALLOC];
+}
+
+-(NSNumber*)LoadMappedAssetWithPath:(NSString*)inPath
+{
+    return [self InternalLoadAssetWithPath:inPath loadType:LOADTYPE_MMAP];
+}
+
+-(NSNumber*)InternalLoadAssetWithPath:(NSString*)inPath loadType:(LoadType)inLoadType
 {
     // Check and see if this asset exists in the resource list
     
     NSNumber* retHandle = NULL;
     
-    [self SetWorkingDirectory];
-    
-    ResourceNode* resourceNode = [self FindResourceWithPath:inPath];
+    NSString* path = [self ResolveAssetPath:inPath];
+    ResourceNode* resourceNode = [self FindResourceWithPath:path];
     
     if (resourceNode != NULL)
     {
@@ -149,7 +307,8 @@ static const int INITIAL_HANDLE = 0;
     }
     else
     {
-        ResourceNode* resourceNode = [self CreateResourceNodeWithPath:inPath];
+        ResourceNode* resourceNode = [self CreateResourceNodeWithPath:path];
+        resourceNode->mLoadType = inLoadType;
         
         [self LoadData:resourceNode];
         
@@ -184,15 +343,13 @@ static const int INITIAL_HANDLE = 0;
     }
     else
     {
-        FileNode* fileNode = [self FindFileWithName:inName];
-        NSAssert1(fileNode != NULL, @"Could not find file %s.  No data will be loaded here.\n", [inName UTF8String]);
+        NSString* tempString = [self FindAssetPathWithName:inName];
+        NSAssert1(tempString != NULL, @"Could not find file %s.  No data will be loaded here.\n", [inName UTF8String]);
         
-        if (fileNode != NULL)
+        if (tempString != NULL)
         {
-            NSMutableString* tempString = [NSMutableString stringWithString:@"Data/"];
-            [tempString appendString:fileNode->mPath];
-            
             ResourceNode* resourceNode = [self CreateResourceNodeWithPath:tempString];
+            resourceNode->mLoadType = inLoadType;
             
             [self LoadData:resourceNode];
             
@@ -213,6 +370,26 @@ static const int INITIAL_HANDLE = 0;
     return retString;
 }
 
+-(NSString*)FindAssetPathWithName:(NSString*)inName
+{
+    FileNode* fileNode = [self FindFileWithName:inName];
+    
+    if (fileNode == NULL)
+    {
+        return NULL;
+    }
+    
+#if TARGET_OS_IPHONE
+    NSMutableString* retString = [NSMutableString stringWithString:@"Data/"];
+    [retString appendString:fileNode->mPath];
+#else
+    // Resolve the path up front rather than depending on whatever the working directory happens to be
+    NSString* retString = [mDataPath stringByAppendingPathComponent:fileNode->mPath];
+#endif
+    
+    return retString;
+}
+
 -(ResourceNode*)CreateResourceNodeWithPath:(NSString*)inPath
 {
     ResourceNode* resourceNode = [ResourceNode alloc];
@@ -220,6 +397,7 @@ static const int INITIAL_HANDLE = 0;
     resourceNode->mPath = [[NSString alloc] initWithString:inPath];
     resourceNode->mReferenceCount = 1;
     resourceNode->mMetadata = NULL;
+    resourceNode->mLoadType = LOADTYPE_ALLOC;
     
     int numFreeHandles = [mFreeHandles count];
     
@@ -241,13 +419,92 @@ static const int INITIAL_HANDLE = 0;
         }
     }
     
-    [mResourceNodes addObject:resourceNode];
-                
-    [resourceNode release];
+    int handle = [resourceNode->mHandle intValue];
+    
+    if (handle >= mHandleTableSize)
+    {
+        int newSize = max(mHandleTableSize * 2, handle + 1);
+        
+        mHandleTable = realloc(mHandleTable, newSize * sizeof(ResourceNode*));
+        memset(&mHandleTable[mHandleTableSize], 0, (newSize - mHandleTableSize) * sizeof(ResourceNode*));
+        
+        mHandleTableSize = newSize;
+    }
+    
+    NSAssert(mHandleTable[handle] == NULL, @"Handle is already in use");
+    
+    // The handle table holds the reference we got from alloc
+    mHandleTable[handle] = resourceNode;
+    
+    // As with the name list, the first node loaded with a given path is the one that's found
+    if ([mResourceNodesByPath objectForKey:resourceNode->mPath] == NULL)
+    {
+        [mResourceNodesByPath setObject:resourceNode forKey:resourceNode->mPath];
+    }
+    
+    NSString* name = [resourceNode->mPath lastPathComponent];
+    NSMutableArray* nameList = [mResourceNodesByName objectForKey:name];
+    
+    if (nameList == NULL)
+    {
+        nameList = [[NSMutableArray alloc] initWithCapacity:1];
+        [mResourceNodesByName setObject:nameList forKey:name];
+        [nameList release];
+    }
+    
+    [nameList addObject:resourceNode];
     
     return resourceNode;
 }
 
+-(void)RemoveResourceNode:(ResourceNode*)inResourceNode
+{
+    int handle = [inResourceNode->mHandle intValue];
+    
+    NSAssert(mHandleTable[handle] == inResourceNode, @"Handle table is out of sync with the resource node");
+    
+    NSString* name = [inResourceNode->mPath lastPathComponent];
+    NSMutableArray* nameList = [mResourceNodesByName objectForKey:name];
+    
+    [nameList removeObjectIdenticalTo:inResourceNode];
+    
+    // Another node with the same path may be the one in the path map, only remove it if it's ours.  If another node
+    // with our path is still loaded, the earliest one takes over the slot so path lookups keep finding it.  Nodes with
+    // the same path have the same name, so they're all in our name list.
+    if ([mResourceNodesByPath objectForKey:inResourceNode->mPath] == inResourceNode)
+    {
+        ResourceNode* replacementNode = NULL;
+        
+        for (ResourceNode* curNode in nameList)
+        {
+            if ([curNode->mPath isEqualToString:inResourceNode->mPath])
+            {
+                replacementNode = curNode;
+                break;
+            }
+        }
+        
+        if (replacementNode != NULL)
+        {
+            [mResourceNodesByPath setObject:replacementNode forKey:inResourceNode->mPath];
+        }
+        else
+        {
+            [mResourceNodesByPath removeObjectForKey:inResourceNode->mPath];
+        }
+    }
+    
+    // This releases the name list, so it goes after anything that looks through it
+    if ([nameList count] == 0)
+    {
+        [mResourceNodesByName removeObjectForKey:name];
+    }
+    
+    mHandleTable[handle] = NULL;
+    
+    [inResourceNode release];
+}
+
 -(void)UnloadAssetWithHandle:(NSNumber*)inHandle
 {
     ResourceNode* resourceNode = [self FindResourceWithHandle:inHandle];
@@ -265,73 +522,49 @@ static const int INITIAL_HANDLE = 0;
             [mFreeHandles addObject:resourceNode->mHandle];
             
             // Get rid of the defunct resource node.  The resource is no longer loaded.
-            [mResourceNodes removeObject:resourceNode];
+            [self RemoveResourceNode:resourceNode];
         }
     }
 }
 
 -(ResourceNode*)FindResourceWithPath:(NSString*)inPath
 {
-    ResourceNode* retNode = NULL;
-    
-    int numResources = [mResourceNodes count];
-
-    for (int i = 0; i < numResources; i++)
-    {
-        ResourceNode* curResource = [mResourceNodes objectAtIndex:i];
-        
-        if ([inPath compare:curResource->mPath] == NSOrderedSame)
-        {
-            retNode = curResource;
-            break;
-        }
-    }
-
-    return retNode;
+    return [mResourceNodesByPath objectForKey:[self ResolveAssetPath:inPath]];
 }
 
 -(ResourceNode*)FindResourceWithHandle:(NSNumber*)inHandle
 {
-    ResourceNode* retNode = NULL;
+    if (inHandle == NULL)
+    {
+        return NULL;
+    }
     
-    int numResources = [mResourceNodes count];
-
-    for (int i = 0; i < numResources; i++)
+    int handle = [inHandle intValue];
+    
+    if ((handle < 0) || (handle >= mHandleTableSize))
     {
-        ResourceNode* curResource = [mResourceNodes objectAtIndex:i];
-        
-        if ([inHandle isEqualToValue:curResource->mHandle])
-        {
-            retNode = curResource;
-            break;
-        }
+        return NULL;
     }
-
-    return retNode;
+    
+    return mHandleTable[handle];
 }
 
 -(ResourceNode*)FindResourceWithName:(NSString*)inPath
 {
-    ResourceNode* retNode = NULL;
+    NSMutableArray* nameList = [mResourceNodesByName objectForKey:inPath];
     
-    int numResources = [mResourceNodes count];
-
-    for (int i = 0; i < numResources; i++)
+    if (nameList == NULL)
     {
-        ResourceNode* curResource = [mResourceNodes objectAtIndex:i];
-        
-        if ([inPath compare:[curResource->mPath lastPathComponent]] == NSOrderedSame)
-        {
-            retNode = curResource;
-            break;
-        }
+        return NULL;
     }
-
-    return retNode;
+    
+    return [nameList objectAtIndex:0];
 }
 
 -(void)LoadData:(ResourceNode*)inResourceNode
 {
+    TRACE_SCOPE("Resource Load");
+    
 #if TARGET_OS_IPHONE
     NSMutableString* loadPath = [[[NSMutableString alloc] initWithString:mApplicationResourcePath] autorelease];
     
@@ -341,7 +574,22 @@ static const int INITIAL_HANDLE = 0;
     NSString* loadPath = inResourceNode->mPath;
 #endif
     
-    inResourceNode->mData = [[[NSFileManager defaultManager] contentsAtPath:loadPath] retain];
+    inResourceNode->mData = NULL;
+    
+    if (inResourceNode->mLoadType == LOADTYPE_MMAP)
+    {
+        // Most mapped assets are decoded front to back.  If the mapping fails, fall back to reading the file.
+        inResourceNode->mData = [[MappedData alloc] InitWithPath:loadPath advice:MAPPED_DATA_ADVICE_SEQUENTIAL];
+    }
+    
+    if (inResourceNode->mData == NULL)
+    {
+        inResourceNode->mData = [[[NSFileManager defaultManager] contentsAtPath:loadPath] retain];
+    }
+    
+    TRACE_COUNT(TRACE_COUNTER_BYTES_READ, [inResourceNode->mData length]);
+    
+    inResourceNode->mModificationDate = [[[[NSFileManager defaultManager] attributesOfItemAtPath:loadPath error:NULL] fileModificationDate] retain];
     
     NSString* fileExtension = [inResourceNode->mPath pathExtension];
 
@@ -365,33 +613,60 @@ static const int INITIAL_HANDLE = 0;
     return retData;
 }
 
--(void)SetWorkingDirectory
+-(BOOL)IsAssetModifiedWithHandle:(NSNumber*)inHandle
 {
-    NSString* appPath = [[NSBundle mainBundle] bundlePath];
-    NSString* dataPath = [appPath stringByAppendingPathComponent:@"Data"];
+    ResourceNode* resource = [self FindResourceWithHandle:inHandle];
+    NSAssert(resource != NULL, @"Invalid resource handle was specified");
     
-    [[NSFileManager defaultManager] changeCurrentDirectoryPath:dataPath];
-
+    if (resource == NULL)
+    {
+        return FALSE;
+    }
+    
+#if TARGET_OS_IPHONE
+    NSString* loadPath = [mApplicationResourcePath stringByAppendingPathComponent:resource->mPath];
+#else
+    NSString* loadPath = resource->mPath;
+#endif
+    
+    NSDate* modificationDate = [[[NSFileManager defaultManager] attributesOfItemAtPath:loadPath error:NULL] fileModificationDate];
+    
+    return (modificationDate == NULL) || (resource->mModificationDate == NULL) || (![modificationDate isEqualToDate:resource->mModificationDate]);
 }
 
--(FileNode*)FindFileWithName:(NSString*)inName
+-(void)PrefetchAssetWithHandle:(NSNumber*)inHandle
 {
-    FileNode* retNode = NULL;
+    ResourceNode* resource = [self FindResourceWithHandle:inHandle];
+    NSAssert(resource != NULL, @"Invalid resource handle was specified");
     
-    int numFiles = [mFileNodes count];
+    if ((resource != NULL) && [resource->mData isKindOfClass:[MappedData class]])
+    {
+        [(MappedData*)resource->mData Advise:MAPPED_DATA_ADVICE_WILLNEED];
+    }
+}
 
-    for (int i = 0; i < numFiles; i++)
+-(NSString*)ResolveAssetPath:(NSString*)inPath
+{
+#if TARGET_OS_IPHONE
+    // LoadData puts these under the application's resources
+    return inPath;
+#else
+    // Relative paths are relative to the data directory.  This used to change the working directory, which moved
+    // every other relative path in the process out from under whatever thread was using it.
+    if (![inPath isAbsolutePath])
     {
-        FileNode* curFile = [mFileNodes objectAtIndex:i];
-        
-        if ([inName caseInsensitiveCompare:curFile->mAssetName] == NSOrderedSame)
-        {
-            retNode = curFile;
-            break;
-        }
+        return [mDataPath stringByAppendingPathComponent:inPath];
     }
+    
+    return inPath;
+#endif
+}
 
-    return retNode;
+-(FileNode*)FindFileWithName:(NSString*)inName
+{
+    [self GenerateFileNodes];
+    
+    return [mFileNodesByName objectForKey:[inName lowercaseString]];
 }
 
 -(void)CreateMetadataForNode:(ResourceNode*)inResourceNode withExtension:(NSString*)inFileExtension
@@ -0,0 +1,101 @@
+//
+//  GlyphCache.h
+//  Neon21
+//
+//  Copyright Neon Games 2010. All rights reserved.
+//
+
+#include "ft2build.h"
+#include "freetype.h"
+
+// Rendered glyph bitmaps and metrics, so strings that reuse the same characters only pay for FreeType once.
+//
+// Unstroked glyphs are 8 bit coverage and are colored when they're composited, so their colors aren't part of the
+// key.  Stroked glyphs have their colors baked in and are RGBA8.
+//
+// The cache can go over budget while a string is being built, entries are only evicted by EvictToBudget.  Entries
+// returned by LookupGlyph or passed to AddGlyph stay valid until then.
+
+typedef struct
+{
+    FT_Face     mFace;
+    FT_ULong    mCharCode;
+    u32         mPointSize;
+    u32         mStrokeSize;
+    u32         mColor;             // Zero for unstroked glyphs
+    u32         mStrokeColor;       // Zero for unstroked glyphs
+} GlyphCacheKey;
+
+typedef struct
+{
+    u32     mBudgetBytes;
+    BOOL    mReportStats;           // Print the hit rate when the cache is released
+} GlyphCacheParams;
+
+typedef struct
+{
+    u32     mNumHits;
+    u32     mNumMisses;
+    u32     mNumEvictions;
+    u32     mNumEntries;
+    u32     mSizeBytes;
+} GlyphCacheStats;
+
+@interface GlyphCacheEntry : NSObject
+{
+    @public
+        GlyphCacheKey   mKey;
+        
+        u8*             mBitmap;            // Freed with the entry, NULL for empty glyphs like spaces
+        u32             mBitmapSize;
+        int             mWidth;
+        int             mHeight;
+        int             mLeftOffset;
+        int             mHorizBearingY;
+        int             mAdvanceX;
+        
+        // Bounds of the texels with any coverage, within the bitmap.  mInkMaxX < mInkMinX if there aren't any.
+        int             mInkMinX;
+        int             mInkMinY;
+        int             mInkMaxX;
+        int             mInkMaxY;
+        
+        u32             mLastUsed;
+}
+
+-(GlyphCacheEntry*)Init;
+-(void)dealloc;
+
+-(NSComparisonResult)CompareLastUsed:(GlyphCacheEntry*)inEntry;
+
+@end
+
+@interface GlyphCache : NSObject
+{
+    GlyphCacheParams        mParams;
+    GlyphCacheStats         mStats;
+    
+    NSMutableDictionary*    mEntries;
+    u32                     mUseCounter;
+}
+
+-(GlyphCache*)InitWithParams:(GlyphCacheParams*)inParams;
+-(void)dealloc;
++(void)InitDefaultParams:(GlyphCacheParams*)outParams;
+
+// Keys are hashed as raw bytes, so always start from one of these
++(void)InitKey:(GlyphCacheKey*)outKey;
+
+-(GlyphCacheEntry*)LookupGlyph:(GlyphCacheKey*)inKey;
+-(void)AddGlyph:(GlyphCacheEntry*)inEntry;
+
+// Evicts the least recently used glyphs until the cache is back under budget
+-(void)EvictToBudget;
+
+// Drops every glyph rendered from inFace.  Call this before the face is released, a new face could reuse its address.
+-(void)RemoveGlyphsForFace:(FT_Face)inFace;
+
+-(void)GetStats:(GlyphCacheStats*)outStats;
+-(void)ReportStats;
+
+@end
@@ -0,0 +1,200 @@
+//
+//  GlyphCache.m
+//  Neon21
+//
+//  Copyright Neon Games 2010. All rights reserved.
+//
+
+#import "GlyphCache.h"
+
+#if TARGET_OS_IPHONE
+#define GLYPH_CACHE_DEFAULT_BUDGET      (256 * 1024)
+#else
+#define GLYPH_CACHE_DEFAULT_BUDGET      (4 * 1024 * 1024)
+#endif
+
+// Evict down to this fraction of the budget, so we aren't evicting again on the very next string
+#define GLYPH_CACHE_EVICT_NUMERATOR     (3)
+#define GLYPH_CACHE_EVICT_DENOMINATOR   (4)
+
+@implementation GlyphCacheEntry
+
+-(GlyphCacheEntry*)Init
+{
+    memset(&mKey, 0, sizeof(GlyphCacheKey));
+    
+    mBitmap = NULL;
+    mBitmapSize = 0;
+    mWidth = 0;
+    mHeight = 0;
+    mLeftOffset = 0;
+    mHorizBearingY = 0;
+    mAdvanceX = 0;
+    
+    mInkMinX = 0;
+    mInkMinY = 0;
+    mInkMaxX = -1;
+    mInkMaxY = -1;
+    
+    mLastUsed = 0;
+    
+    return self;
+}
+
+-(void)dealloc
+{
+    free(mBitmap);
+    
+    [super dealloc];
+}
+
+-(NSComparisonResult)CompareLastUsed:(GlyphCacheEntry*)inEntry
+{
+    if (mLastUsed < inEntry->mLastUsed)
+    {
+        return NSOrderedAscending;
+    }
+    else if (mLastUsed > inEntry->mLastUsed)
+    {
+        return NSOrderedDescending;
+    }
+    
+    return NSOrderedSame;
+}
+
+@end
+
+@implementation GlyphCache
+
+-(GlyphCache*)InitWithParams:(GlyphCacheParams*)inParams
+{
+    memcpy(&mParams, inParams, sizeof(GlyphCacheParams));
+    memset(&mStats, 0, sizeof(GlyphCacheStats));
+    
+    mEntries = [[NSMutableDictionary alloc] initWithCapacity:0];
+    mUseCounter = 0;
+    
+    return self;
+}
+
+-(void)dealloc
+{
+    if ((mParams.mReportStats) && ((mStats.mNumHits + mStats.mNumMisses) > 0))
+    {
+        [self ReportStats];
+    }
+    
+    [mEntries release];
+    
+    [super dealloc];
+}
+
++(void)InitDefaultParams:(GlyphCacheParams*)outParams
+{
+    outParams->mBudgetBytes = GLYPH_CACHE_DEFAULT_BUDGET;
+    outParams->mReportStats = FALSE;
+}
+
++(void)InitKey:(GlyphCacheKey*)outKey
+{
+    memset(outKey, 0, sizeof(GlyphCacheKey));
+}
+
+-(GlyphCacheEntry*)LookupGlyph:(GlyphCacheKey*)inKey
+{
+    NSData* key = [[NSData alloc] initWithBytesNoCopy:inKey length:sizeof(GlyphCacheKey) freeWhenDone:NO];
+    GlyphCacheEntry* entry = [mEntries objectForKey:key];
+    [key release];
+    
+    if (entry != NULL)
+    {
+        entry->mLastUsed = ++mUseCounter;
+        mStats.mNumHits++;
+    }
+    else
+    {
+        mStats.mNumMisses++;
+    }
+    
+    return entry;
+}
+
+-(void)AddGlyph:(GlyphCacheEntry*)inEntry
+{
+    NSData* key = [[NSData alloc] initWithBytes:&inEntry->mKey length:sizeof(GlyphCacheKey)];
+    
+    NSAssert([mEntries objectForKey:key] == NULL, @"Glyph is already in the cache");
+    
+    inEntry->mLastUsed = ++mUseCounter;
+    
+    [mEntries setObject:inEntry forKey:key];
+    [key release];
+    
+    mStats.mSizeBytes += inEntry->mBitmapSize;
+    mStats.mNumEntries++;
+}
+
+-(void)EvictToBudget
+{
+    if (mStats.mSizeBytes <= mParams.mBudgetBytes)
+    {
+        return;
+    }
+    
+    u32 targetSize = (mParams.mBudgetBytes / GLYPH_CACHE_EVICT_DENOMINATOR) * GLYPH_CACHE_EVICT_NUMERATOR;
+    
+    // Eviction is rare, so sorting everything here is cheaper than keeping a list in order on every lookup
+    NSArray* sortedKeys = [mEntries keysSortedByValueUsingSelector:@selector(CompareLastUsed:)];
+    
+    for (NSData* curKey in sortedKeys)
+    {
+        if (mStats.mSizeBytes <= targetSize)
+        {
+            break;
+        }
+        
+        GlyphCacheEntry* curEntry = [mEntries objectForKey:curKey];
+        
+        mStats.mSizeBytes -= curEntry->mBitmapSize;
+        mStats.mNumEntries--;
+        mStats.mNumEvictions++;
+        
+        [mEntries removeObjectForKey:curKey];
+    }
+}
+
+-(void)RemoveGlyphsForFace:(FT_Face)inFace
+{
+    NSMutableArray* removedKeys = [NSMutableArray arrayWithCapacity:0];
+    
+    for (NSData* curKey in mEntries)
+    {
+        GlyphCacheEntry* curEntry = [mEntries objectForKey:curKey];
+        
+        if (curEntry->mKey.mFace == inFace)
+        {
+            mStats.mSizeBytes -= curEntry->mBitmapSize;
+            mStats.mNumEntries--;
+            
+            [removedKeys addObject:curKey];
+        }
+    }
+    
+    [mEntries removeObjectsForKeys:removedKeys];
+}
+
+-(void)GetStats:(GlyphCacheStats*)outStats
+{
+    memcpy(outStats, &mStats, sizeof(GlyphCacheStats));
+}
+
+-(void)ReportStats
+{
+    u32 numLookups = mStats.mNumHits + mStats.mNumMisses;
+    float hitRate = (numLookups == 0) ? 0.0f : (100.0f * (float)mStats.mNumHits / (float)numLookups);
+    
+    printf("Glyph Cache:\t%u hits, %u misses (%.1f%% hit rate)\n\t\t%u glyphs, %u bytes, %u evictions\n",
+            mStats.mNumHits, mStats.mNumMisses, hitRate, mStats.mNumEntries, mStats.mSizeBytes, mStats.mNumEvictions);
+}
+
+@end
@@ -0,0 +1,449 @@
+//
+//  TextLayoutCheck.c
+//  Neon21
+//
+//  Copyright Neon Games 2010. All rights reserved.
+//
+//  Checks TextLineBreaker against the word wrapping TextTextureBuilder used before it, and times both on long strings.
+//  This is a standalone tool, it isn't part of the image processor target.  From this directory:
+//
+//      cc -O2 -std=c99 -I.. TextLayoutCheck.c ../TextLineBreaker.c -o TextLayoutCheck
+//      ./TextLayoutCheck Corpus.txt
+//
+//  Every corpus line is laid out at a range of widths.  Corpus lines can use \n, \r, \t and \\ escapes.  Glyph metrics
+//  come from a made up proportional font, so the check doesn't need FreeType or a font file.
+//
+//  TextLineBreaker fixes two bugs in the old layout: a first line with no whitespace wrote before the glyph array, and
+//  the first line's width didn't count glyph 0.  The old layout is run with the same fixes applied, and that has to match
+//  TextLineBreaker exactly, or this returns non-zero.  Layouts the fixes changed are only counted.
+//
+
+#include "TextLineBreaker.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_CORPUS_LINE_LENGTH  (4096)
+
+static const int sLayoutWidths[] = { 0, 1, 8, 20, 32, 48, 64, 100, 128, 160, 256, 512 };
+static const int sNumLayoutWidths = sizeof(sLayoutWidths) / sizeof(sLayoutWidths[0]);
+
+static const int sBenchmarkLengths[] = { 1000, 10000, 100000 };
+static const int sNumBenchmarkLengths = sizeof(sBenchmarkLengths) / sizeof(sBenchmarkLengths[0]);
+static const int sBenchmarkWidth = 320;
+
+typedef struct
+{
+    int     mNumLines;
+    int*    mLines;         // Line of each glyph
+    int*    mLineWidths;
+} Layout;
+
+static void GetGlyphMetrics(char inCharacter, TextLineGlyph* outGlyph)
+{
+    int advance = 7;
+    
+    if ((inCharacter == ' ') || (inCharacter == '\t') || (inCharacter == '\n') || (inCharacter == '\r'))
+    {
+        advance = 4;
+    }
+    else if (strchr("il.,:;'!|", inCharacter) != NULL)
+    {
+        advance = 3;
+    }
+    else if (strchr("mwMW@", inCharacter) != NULL)
+    {
+        advance = 11;
+    }
+    else if ((inCharacter >= 'A') && (inCharacter <= 'Z'))
+    {
+        advance = 9;
+    }
+    
+    outGlyph->mCharacter = inCharacter;
+    outGlyph->mAdvanceWidth = advance;
+    
+    // A few glyphs overhang their advance, which only counts at the end of a line
+    outGlyph->mWidth = (strchr("fjW", inCharacter) != NULL) ? (advance + 3) : advance;
+    outGlyph->mLine = 0;
+}
+
+static void InitLayout(Layout* outLayout, int inLength)
+{
+    outLayout->mNumLines = 0;
+    outLayout->mLines = calloc(inLength + 1, sizeof(int));
+    outLayout->mLineWidths = calloc(inLength + 1, sizeof(int));
+}
+
+static void FreeLayout(Layout* inLayout)
+{
+    free(inLayout->mLines);
+    free(inLayout->mLineWidths);
+}
+
+static int OldOverhang(TextLineGlyph* inGlyphs, int inIndex)
+{
+    // The old layout read before the array here when the first line had no whitespace
+    if (inIndex < 0)
+    {
+        return 0;
+    }
+    
+    int maxGlyphWidth = (inGlyphs[inIndex].mWidth > inGlyphs[inIndex].mAdvanceWidth) ? inGlyphs[inIndex].mWidth : inGlyphs[inIndex].mAdvanceWidth;
+    
+    return maxGlyphWidth - inGlyphs[inIndex].mAdvanceWidth;
+}
+
+// The layout loop from TextTextureBuilder before TextLineBreaker, minus the glyph rendering.  Apart from guards on the
+// reads and writes it made outside the glyph array, it only changes when inFixed is set, which is noted inline.
+static void OldLayout(const char* inString, TextLineGlyph* ioGlyphs, int inLength, int inStringWidth, int inFixed, Layout* outLayout)
+{
+    int curLine = 0;
+    int curLineWidth = 0;
+    
+    outLayout->mNumLines = 0;
+    
+    for (int i = 0; i < inLength; i++)
+    {
+        ioGlyphs[i].mLine = 0;
+    }
+    
+    for (int i = 0; i < inLength; i++)
+    {
+        // Fixed: the first glyph on a line stays there, even if it's wider than the line
+        int firstOnLine = (i == 0) || (ioGlyphs[i - 1].mLine < curLine);
+        
+        if ((inStringWidth == 0) || (inFixed && firstOnLine) || ((curLineWidth + ioGlyphs[i].mAdvanceWidth) <= inStringWidth))
+        {
+            curLineWidth += ioGlyphs[i].mAdvanceWidth;
+        }
+        else
+        {
+            // Search backwards for a whitespace character
+            int searchIndex = 0;
+            int fail = 0;
+            
+            for (searchIndex = (i - 1); searchIndex >= 0; searchIndex--)
+            {
+                char val = inString[searchIndex];
+                
+                if (ioGlyphs[searchIndex].mLine != curLine)
+                {
+                    fail = 1;
+                    break;
+                }
+                
+                if ((val == ' ') || (val == '\n') || (val == '\r') || (val == '\t'))
+                {
+                    searchIndex++;
+                    break;
+                }
+            }
+            
+            int lastCharIndex = i - 1;
+            
+            // Fixed: a search that ran off the start of the array (searchIndex is -1) wraps by character
+            if ((inFixed ? (searchIndex > 0) : (searchIndex != 0)) && (!fail))
+            {
+                for (int curIndex = searchIndex; curIndex < i; curIndex++)
+                {
+                    // Was an unguarded write to index -1 when the search ran off the start of the array
+                    if (curIndex >= 0)
+                    {
+                        ioGlyphs[curIndex].mLine++;
+                    }
+                }
+                
+                lastCharIndex = searchIndex - 1;
+            }
+            
+            curLineWidth = 0;
+            
+            // Was "curIndex != 0", which never stopped when i was 0.  Fixed: glyph 0 counts too.
+            for (int curIndex = (i - 1); curIndex >= (inFixed ? 0 : 1); curIndex--)
+            {
+                if (ioGlyphs[curIndex].mLine == curLine)
+                {
+                    curLineWidth += ioGlyphs[curIndex].mAdvanceWidth;
+                }
+                
+                if (ioGlyphs[curIndex].mLine < curLine)
+                {
+                    break;
+                }
+            }
+            
+            curLineWidth += OldOverhang(ioGlyphs, lastCharIndex);
+            
+            outLayout->mLineWidths[outLayout->mNumLines++] = curLineWidth;
+            curLine++;
+            
+            curLineWidth = 0;
+            
+            for (int curIndex = 0; curIndex <= i; curIndex++)
+            {
+                if (ioGlyphs[curIndex].mLine == curLine)
+                {
+                    curLineWidth += ioGlyphs[curIndex].mAdvanceWidth;
+                }
+            }
+            
+            curLineWidth += ioGlyphs[i].mAdvanceWidth;
+        }
+        
+        ioGlyphs[i].mLine = curLine;
+    }
+    
+    curLineWidth += OldOverhang(ioGlyphs, inLength - 1);
+    outLayout->mLineWidths[outLayout->mNumLines++] = curLineWidth;
+    
+    for (int i = 0; i < inLength; i++)
+    {
+        outLayout->mLines[i] = ioGlyphs[i].mLine;
+    }
+}
+
+static void NewLayout(TextLineGlyph* ioGlyphs, int inLength, int inStringWidth, Layout* outLayout)
+{
+    TextLineBreaker lineBreaker;
+    TextLineBreakerInit(&lineBreaker, inStringWidth);
+    
+    outLayout->mNumLines = 0;
+    
+    for (int i = 0; i < inLength; i++)
+    {
+        int finishedWidth = 0;
+        
+        if (TextLineBreakerAddGlyph(&lineBreaker, ioGlyphs, i, &finishedWidth))
+        {
+            outLayout->mLineWidths[outLayout->mNumLines++] = finishedWidth;
+        }
+    }
+    
+    outLayout->mLineWidths[outLayout->mNumLines++] = TextLineBreakerFinish(&lineBreaker, ioGlyphs, inLength);
+    
+    for (int i = 0; i < inLength; i++)
+    {
+        outLayout->mLines[i] = ioGlyphs[i].mLine;
+    }
+}
+
+static TextLineGlyph* CreateGlyphs(const char* inString, int inLength)
+{
+    TextLineGlyph* glyphs = malloc(sizeof(TextLineGlyph) * inLength);
+    
+    for (int i = 0; i < inLength; i++)
+    {
+        GetGlyphMetrics(inString[i], &glyphs[i]);
+    }
+    
+    return glyphs;
+}
+
+// Returns 1 if the layouts match.  Otherwise prints the first difference if inVerbose is set.
+static int CompareLayouts(int inCorpusLine, int inStringWidth, Layout* inOldLayout, Layout* inNewLayout, int inLength, int inVerbose)
+{
+    for (int i = 0; i < inLength; i++)
+    {
+        if (inOldLayout->mLines[i] != inNewLayout->mLines[i])
+        {
+            if (inVerbose)
+            {
+                printf("Line %d, width %d: glyph %d is on line %d, was on line %d\n", inCorpusLine, inStringWidth, i,
+                        inNewLayout->mLines[i], inOldLayout->mLines[i]);
+            }
+            
+            return 0;
+        }
+    }
+    
+    if (inOldLayout->mNumLines != inNewLayout->mNumLines)
+    {
+        if (inVerbose)
+        {
+            printf("Line %d, width %d: %d lines, was %d\n", inCorpusLine, inStringWidth, inNewLayout->mNumLines, inOldLayout->mNumLines);
+        }
+        
+        return 0;
+    }
+    
+    for (int curLine = 0; curLine < inOldLayout->mNumLines; curLine++)
+    {
+        if (inOldLayout->mLineWidths[curLine] != inNewLayout->mLineWidths[curLine])
+        {
+            if (inVerbose)
+            {
+                printf("Line %d, width %d: line %d is %d wide, was %d\n", inCorpusLine, inStringWidth, curLine,
+                        inNewLayout->mLineWidths[curLine], inOldLayout->mLineWidths[curLine]);
+            }
+            
+            return 0;
+        }
+    }
+    
+    return 1;
+}
+
+static int UnescapeCorpusLine(char* ioLine)
+{
+    int readIndex = 0;
+    int writeIndex = 0;
+    
+    while ((ioLine[readIndex] != 0) && (ioLine[readIndex] != '\n'))
+    {
+        char val = ioLine[readIndex++];
+        
+        if ((val == '\\') && (ioLine[readIndex] != 0))
+        {
+            char escape = ioLine[readIndex++];
+            
+            switch (escape)
+            {
+                case 'n':   val = '\n';     break;
+                case 'r':   val = '\r';     break;
+                case 't':   val = '\t';     break;
+                default:    val = escape;   break;
+            }
+        }
+        
+        ioLine[writeIndex++] = val;
+    }
+    
+    ioLine[writeIndex] = 0;
+    
+    return writeIndex;
+}
+
+static int CheckCorpus(const char* inCorpusPath)
+{
+    FILE* corpusFile = fopen(inCorpusPath, "r");
+    
+    if (corpusFile == NULL)
+    {
+        printf("Couldn't open %s\n", inCorpusPath);
+        return 0;
+    }
+    
+    char line[MAX_CORPUS_LINE_LENGTH];
+    int corpusLine = 0;
+    int numLayouts = 0;
+    int numMismatches = 0;
+    int numFixed = 0;
+    
+    while (fgets(line, sizeof(line), corpusFile) != NULL)
+    {
+        corpusLine++;
+        
+        int length = UnescapeCorpusLine(line);
+        
+        // The old layout read before the glyph array for empty strings, there's nothing to compare
+        if (length == 0)
+        {
+            continue;
+        }
+        
+        TextLineGlyph* glyphs = CreateGlyphs(line, length);
+        
+        for (int curWidth = 0; curWidth < sNumLayoutWidths; curWidth++)
+        {
+            Layout oldLayout;
+            Layout fixedLayout;
+            Layout newLayout;
+            
+            InitLayout(&oldLayout, length);
+            InitLayout(&fixedLayout, length);
+            InitLayout(&newLayout, length);
+            
+            OldLayout(line, glyphs, length, sLayoutWidths[curWidth], 0, &oldLayout);
+            OldLayout(line, glyphs, length, sLayoutWidths[curWidth], 1, &fixedLayout);
+            NewLayout(glyphs, length, sLayoutWidths[curWidth], &newLayout);
+            
+            if (!CompareLayouts(corpusLine, sLayoutWidths[curWidth], &fixedLayout, &newLayout, length, 1))
+            {
+                numMismatches++;
+            }
+            
+            if (!CompareLayouts(corpusLine, sLayoutWidths[curWidth], &oldLayout, &newLayout, length, 0))
+            {
+                numFixed++;
+            }
+            
+            numLayouts++;
+            
+            FreeLayout(&oldLayout);
+            FreeLayout(&fixedLayout);
+            FreeLayout(&newLayout);
+        }
+        
+        free(glyphs);
+    }
+    
+    fclose(corpusFile);
+    
+    printf("Layout check:\t%d layouts of %d corpus lines, %d mismatches, %d changed by the fixes\n", numLayouts, corpusLine,
+            numMismatches, numFixed);
+    
+    return (numMismatches == 0);
+}
+
+static double Seconds()
+{
+    return (double)clock() / (double)CLOCKS_PER_SEC;
+}
+
+static void Benchmark()
+{
+    static const char* BENCHMARK_WORDS = "The dealer stands on all 17s and blackjack pays three to two ";
+    int numWordChars = strlen(BENCHMARK_WORDS);
+    
+    printf("Benchmark:\twidth %d\n", sBenchmarkWidth);
+    
+    for (int curLength = 0; curLength < sNumBenchmarkLengths; curLength++)
+    {
+        int length = sBenchmarkLengths[curLength];
+        char* string = malloc(length + 1);
+        
+        for (int i = 0; i < length; i++)
+        {
+            string[i] = BENCHMARK_WORDS[i % numWordChars];
+        }
+        
+        string[length] = 0;
+        
+        TextLineGlyph* glyphs = CreateGlyphs(string, length);
+        
+        Layout layout;
+        InitLayout(&layout, length);
+        
+        double startTime = Seconds();
+        OldLayout(string, glyphs, length, sBenchmarkWidth, 0, &layout);
+        double oldTime = Seconds() - startTime;
+        
+        startTime = Seconds();
+        NewLayout(glyphs, length, sBenchmarkWidth, &layout);
+        double newTime = Seconds() - startTime;
+        
+        printf("\t\t%7d glyphs, %5d lines: old %9.3f ms, new %7.3f ms\n", length, layout.mNumLines, oldTime * 1000.0, newTime * 1000.0);
+        
+        FreeLayout(&layout);
+        free(glyphs);
+        free(string);
+    }
+}
+
+int main(int argc, const char* argv[])
+{
+    if (argc != 2)
+    {
+        printf("Usage: TextLayoutCheck <Corpus.txt>\n");
+        return 1;
+    }
+    
+    int success = CheckCorpus(argv[1]);
+    
+    Benchmark();
+    
+    return success ? 0 : 1;
+}
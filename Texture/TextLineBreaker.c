@@ -0,0 +1,103 @@
+//
+//  TextLineBreaker.c
+//  Neon21
+//
+//  Copyright Neon Games 2010. All rights reserved.
+//
+
+#include "TextLineBreaker.h"
+
+static bool IsBreakCharacter(char inCharacter)
+{
+    return (inCharacter == ' ') || (inCharacter == '\n') || (inCharacter == '\r') || (inCharacter == '\t');
+}
+
+// The glyph's bitmap can stick out past its advance.  This only matters for the last glyph on a line, so that the
+// texture is allocated wide enough.
+static int TrailingOverhang(TextLineGlyph* inGlyph)
+{
+    return (inGlyph->mWidth > inGlyph->mAdvanceWidth) ? (inGlyph->mWidth - inGlyph->mAdvanceWidth) : 0;
+}
+
+void TextLineBreakerInit(TextLineBreaker* outBreaker, int inMaxWidth)
+{
+    outBreaker->mMaxWidth = inMaxWidth;
+    
+    outBreaker->mLine = 0;
+    outBreaker->mLineStart = 0;
+    outBreaker->mLineWidth = 0;
+    outBreaker->mLastBreak = -1;
+    outBreaker->mWidthAfterBreak = 0;
+}
+
+bool TextLineBreakerAddGlyph(TextLineBreaker* ioBreaker, TextLineGlyph* ioGlyphs, int inIndex, int* outFinishedWidth)
+{
+    TextLineGlyph* glyph = &ioGlyphs[inIndex];
+    int advanceWidth = glyph->mAdvanceWidth;
+    bool finishedLine = false;
+    
+    // A glyph that's wider than the line on its own stays where it is, there's nothing to wrap
+    if ((ioBreaker->mMaxWidth == 0) || (inIndex == ioBreaker->mLineStart) || ((ioBreaker->mLineWidth + advanceWidth) <= ioBreaker->mMaxWidth))
+    {
+        ioBreaker->mLineWidth += advanceWidth;
+    }
+    else
+    {
+        int finishedWidth = 0;
+        int nextLineWidth = 0;
+        int nextLineStart = inIndex;
+        
+        if (ioBreaker->mLastBreak >= 0)
+        {
+            // Move the word we're in the middle of down to the next line.  The whitespace stays on this line.
+            for (int curIndex = ioBreaker->mLastBreak + 1; curIndex < inIndex; curIndex++)
+            {
+                ioGlyphs[curIndex].mLine++;
+            }
+            
+            finishedWidth = ioBreaker->mLineWidth - ioBreaker->mWidthAfterBreak;
+            nextLineWidth = ioBreaker->mWidthAfterBreak;
+            nextLineStart = ioBreaker->mLastBreak + 1;
+            
+            finishedWidth += TrailingOverhang(&ioGlyphs[ioBreaker->mLastBreak]);
+        }
+        else
+        {
+            // No whitespace, we'll just wrap by the character instead of whole word - we have no choice
+            finishedWidth = ioBreaker->mLineWidth + TrailingOverhang(&ioGlyphs[inIndex - 1]);
+        }
+        
+        *outFinishedWidth = finishedWidth;
+        finishedLine = true;
+        
+        ioBreaker->mLine++;
+        ioBreaker->mLineStart = nextLineStart;
+        ioBreaker->mLineWidth = nextLineWidth + advanceWidth;
+        ioBreaker->mLastBreak = -1;
+        ioBreaker->mWidthAfterBreak = nextLineWidth;
+    }
+    
+    glyph->mLine = ioBreaker->mLine;
+    
+    if (IsBreakCharacter(glyph->mCharacter))
+    {
+        ioBreaker->mLastBreak = inIndex;
+        ioBreaker->mWidthAfterBreak = 0;
+    }
+    else
+    {
+        ioBreaker->mWidthAfterBreak += advanceWidth;
+    }
+    
+    return finishedLine;
+}
+
+int TextLineBreakerFinish(TextLineBreaker* inBreaker, TextLineGlyph* inGlyphs, int inNumGlyphs)
+{
+    if (inNumGlyphs == 0)
+    {
+        return inBreaker->mLineWidth;
+    }
+    
+    return inBreaker->mLineWidth + TrailingOverhang(&inGlyphs[inNumGlyphs - 1]);
+}
@@ -0,0 +1,52 @@
+//
+//  TextLineBreaker.h
+//  Neon21
+//
+//  Copyright Neon Games 2010. All rights reserved.
+//
+
+#pragma once
+
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+// Word wrapping for TextTextureBuilder, in one forward pass over the string.
+//
+// Each line is a contiguous run of glyphs starting at mLineStart.  The breaker remembers the last whitespace on the
+// current line and the width of everything after it, so when a glyph doesn't fit, the word it's in the middle of moves
+// down a line without looking back over the string.  If the line has no whitespace, it wraps by character instead.
+
+typedef struct
+{
+    char    mCharacter;
+    int     mAdvanceWidth;
+    int     mWidth;         // Bitmap width, which can be wider than the advance for the last glyph on a line
+    int     mLine;          // Output
+} TextLineGlyph;
+
+typedef struct
+{
+    int     mMaxWidth;      // Zero doesn't wrap at all
+    
+    int     mLine;
+    int     mLineStart;
+    int     mLineWidth;
+    int     mLastBreak;     // Index of the last whitespace on the current line, -1 if there isn't any
+    int     mWidthAfterBreak;
+} TextLineBreaker;
+
+void TextLineBreakerInit(TextLineBreaker* outBreaker, int inMaxWidth);
+
+// Places ioGlyphs[inIndex] once every glyph before it has been placed.  A wrap can move earlier glyphs on the current
+// line down to the next one.  Returns true if this finished a line, with that line's width in outFinishedWidth.
+bool TextLineBreakerAddGlyph(TextLineBreaker* ioBreaker, TextLineGlyph* ioGlyphs, int inIndex, int* outFinishedWidth);
+
+// Width of the last line, once all inNumGlyphs glyphs have been placed
+int TextLineBreakerFinish(TextLineBreaker* inBreaker, TextLineGlyph* inGlyphs, int inNumGlyphs);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
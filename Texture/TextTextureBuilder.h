@@ -10,8 +10,10 @@
 
 #include "ft2build.h"
 #include "freetype.h"
+#include FT_STROKER_H
 
 #include "Color.h"
+#import "GlyphCache.h"
 
 @class TextureAtlas;
 
@@ -46,30 +48,50 @@ typedef struct
     @public
         FT_Face     mFace;
         NSNumber*   mResourceHandle;
+        NSData*     mFontData;          // Only set for faces created from TextTextureParams.mFontData
+        u64         mFontDataHash;      // Identifies mFontData in text texture cache keys
+        
+        NSMutableDictionary*    mSizes;             // FT_Size for each point size the face has been used at
+        u32                     mActivePointSize;
 }
 
-@end
+-(void)dealloc;
 
-@interface GlyphSpan : NSObject
-{
-    @public
-        int x;
-        int y;
-        int width;
-        int coverage;
-}
+// Activates the face's FT_Size for this point size, only setting the character size the first time it's used
+-(void)SetPointSize:(u32)inPointSize;
 
 @end
 
+// Spans from FreeType's direct rendering, one array per field.  The lists are reused for every glyph.
+typedef struct
+{
+    int*    mX;
+    int*    mY;
+    int*    mWidth;
+    u8*     mCoverage;
+    u32     mNumSpans;
+    u32     mCapacity;
+} GlyphSpanList;
+
 @interface TextTextureBuilderCacheEntry : NSObject
 {
     @public
+        NSString*           mKey;
         Texture*            mTexture;
-        TextTextureParams   mParams;
         
-        CFAbsoluteTime      mLastUsedTime;
+        // Output parameters from when the texture was generated
+        u32                 mStartX;
+        u32                 mStartY;
+        u32                 mEndX;
+        u32                 mEndY;
+        
+        // Least recently used list, not retained
+        TextTextureBuilderCacheEntry*   mPrev;
+        TextTextureBuilderCacheEntry*   mNext;
 }
 
+-(void)dealloc;
+
 @end
 
 @interface TextTextureBuilder : NSObject
@@ -77,13 +99,21 @@ typedef struct
     @public
         FT_Library mLibrary;
         
-        NSMutableArray* mFontNodes;
-        NSMutableArray* mOutlineSpans;
-        NSMutableArray* mInsideSpans;
+        NSMutableDictionary*    mFontNodes;     // FontNodes by font name or data, and face index
+        GlyphSpanList   mOutlineSpans;
+        GlyphSpanList   mInsideSpans;
         
-        NSMutableArray* mTextureCache;
+        FT_Stroker      mStroker;
+        u32             mStrokerSize;
+        
+        NSMutableDictionary*            mTextureCache;
+        TextTextureBuilderCacheEntry*   mCacheHead;     // Most recently used
+        TextTextureBuilderCacheEntry*   mCacheTail;     // Least recently used
         
         u32             mCacheSize;
+        NSString*       mPersistentCacheDirectory;
+        
+        GlyphCache*     mGlyphCache;
 }
 
 +(void)CreateInstance;
@@ -99,11 +129,27 @@ typedef struct
 -(Texture*)GenerateTextureWithFont:(NSString*)inFontName PointSize:(u32)inPointSize String:(NSString*)inString Color:(u32)inColor Width:(u32)inWidth;
 -(Texture*)GenerateTextureWithParams:(TextTextureParams*)inParams;
 
+// Finds or opens the face for the font in inParams.  Each font is opened once and shared by every string and point size.
+-(FontNode*)FontNodeForParams:(TextTextureParams*)inParams;
+
+// Closes the face opened for inFontData, and drops its glyphs, so the data can be unloaded.  No-op if there isn't one.
+-(void)ReleaseFontData:(NSData*)inFontData;
+
+// Returns a new glyph cache entry holding the rendered bitmap and metrics.  The caller owns it.
+-(GlyphCacheEntry*)RenderGlyph:(GlyphCacheKey*)inKey;
 -(void)GenerateStrokeBitmap:(FT_GlyphSlot)inSlot insideColor:(Color*)inInsideColor outsideColor:(Color*)inOutsideColor;
 
--(void)AddToCache:(Texture*)inTexture withParams:(TextTextureParams*)inParams;
--(BOOL)CompareParams:(TextTextureParams*)inLeftParams withParams:(TextTextureParams*)inRightParams;
--(Texture*)LookupInCache:(TextTextureParams*)inParams;
+// Generated textures are also written here, and read back on a later run instead of being generated again.  NULL,
+// the default, keeps the cache in memory only.
+-(void)SetPersistentCacheDirectory:(NSString*)inDirectory;
+
+-(NSString*)CacheKeyForParams:(TextTextureParams*)inParams fontNode:(FontNode*)inFontNode;
+-(void)AddToCache:(Texture*)inTexture withParams:(TextTextureParams*)inParams key:(NSString*)inKey;
+-(Texture*)LookupInCache:(TextTextureParams*)inParams key:(NSString*)inKey;
 -(void)EvictCacheToWatermark;
 
+-(NSString*)PersistentCachePathForKey:(NSString*)inKey;
+-(Texture*)LoadPersistentTexture:(TextTextureParams*)inParams key:(NSString*)inKey;
+-(void)SavePersistentTexture:(Texture*)inTexture params:(TextTextureParams*)inParams key:(NSString*)inKey;
+
 @end
\ No newline at end of file
@@ -6,19 +6,27 @@
 //
 
 #import "TextTextureBuilder.h"
+#import "TextLineBreaker.h"
 #import "ResourceManager.h"
 
 #import "NeonMath.h"
+#import "AlphaUtilities.h"
+#import "Trace.h"
 
 #import FT_STROKER_H
 #import FT_BITMAP_H
+#import FT_SIZES_H
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 static TextTextureBuilder* sInstance = NULL;
 
 #define FONT_RESOURCE_HANDLE_CAPACITY   (3)
+#define FONT_FACE_INDEX                 (0)
 #define GLYPH_SPANS_INITIAL_CAPACITY    (256) 
 #define INITIAL_LINE_WIDTH_CAPACITY     (5)
-#define TEXT_TEXTURE_PARAMS_SIZE        (76)    // Update this as new fields are added to the parameter structure
 
 // 512K cache makes sense for iPhone 3G, we may want to
 // not have a cache at all for release builds since we won't have
@@ -26,6 +34,32 @@ static TextTextureBuilder* sInstance = NULL;
 #define CACHE_EVICT_BEGIN_WATERMARK     (2048 * 1024)
 #define CACHE_EVICT_END_WATERMARK       (1536 * 1024)
 
+#define USE_TEXT_CACHE                  (1)
+
+#define TEXT_CACHE_FILE_MAGIC_NUMBER    ('NTXC')
+#define TEXT_CACHE_FILE_VERSION         (1)
+
+#define FNV_64_OFFSET_BASIS             (0xCBF29CE484222325ULL)
+#define FNV_64_PRIME                    (0x100000001B3ULL)
+
+// Persistent text cache files are this header, the key's UTF8 bytes, then mGLWidth * mGLHeight RGBA8 texels
+typedef struct
+{
+    u32 mMagicNumber;
+    u32 mVersion;
+    u32 mKeyLength;
+    
+    u32 mWidth;
+    u32 mHeight;
+    u32 mGLWidth;
+    u32 mGLHeight;
+    
+    u32 mStartX;
+    u32 mStartY;
+    u32 mEndX;
+    u32 mEndY;
+} TextCacheFileHeader;
+
 typedef struct
 {
     u8* mTexBytes;
@@ -34,39 +68,323 @@ typedef struct
     int mAdvanceWidth;
     int mLeftOffset;
     int mHorizBearingY;
+    int mInkMinX;
+    int mInkMinY;
+    int mInkMaxX;
+    int mInkMaxY;
     int mLine;
     char mCharacter;
 } GlyphTexture;
 
+// Stroke bitmaps are RGBA8 in memory order.  Every texel of a span has the same coverage, so the coverage scaled color
+// is worked out once per span and whole spans are written at a time.
+
+static u32 PackStrokeTexel(u32 inColor, u8 inAlpha)
+{
+    u32 texel = 0;
+    u8* bytes = (u8*)&texel;
+    
+    bytes[0] = (inColor >> 24) & 0xFF;
+    bytes[1] = (inColor >> 16) & 0xFF;
+    bytes[2] = (inColor >> 8) & 0xFF;
+    bytes[3] = inAlpha;
+    
+    return texel;
+}
+
+static void FillStrokeSpan(u32* ioTexels, u32 inWidth, u32 inTexel)
+{
+    for (u32 curTexel = 0; curTexel < inWidth; curTexel++)
+    {
+        ioTexels[curTexel] = inTexel;
+    }
+}
+
+// Transparent inside color, the inside coverage is cut out of the outline's alpha
+static void EraseStrokeSpan(u32* ioTexels, u32 inWidth, u32 inColor, u8 inCoverage)
+{
+    u32 curTexel = 0;
+    
+#if defined(__SSE2__)
+    const __m128i alphaMask = _mm_set1_epi32(0xFF000000);
+    const __m128i color = _mm_set1_epi32(PackStrokeTexel(inColor, 0));
+    const __m128i coverage = _mm_set1_epi32(PackStrokeTexel(0, inCoverage));
+    
+    for (; (curTexel + 4) <= inWidth; curTexel += 4)
+    {
+        __m128i texels = _mm_loadu_si128((const __m128i*)&ioTexels[curTexel]);
+        
+        texels = _mm_and_si128(_mm_subs_epu8(texels, coverage), alphaMask);
+        
+        _mm_storeu_si128((__m128i*)&ioTexels[curTexel], _mm_or_si128(texels, color));
+    }
+#endif
+
+    for (; curTexel < inWidth; curTexel++)
+    {
+        u8* texel = (u8*)&ioTexels[curTexel];
+        
+        ioTexels[curTexel] = PackStrokeTexel(inColor, (u8)max(0, texel[3] - inCoverage));
+    }
+}
+
+// Inside color over the outline, result = (src * coverage + dest * (255 - coverage)) / 255 rounded, with opaque alpha.
+// Rounds the same way as PremultiplyAlphaRGBA8: (t + (t >> 8)) >> 8 with t = x + 128 is round(x / 255) for x <= 255 * 255.
+static void BlendStrokeSpan(u32* ioTexels, u32 inWidth, u32 inColor, u8 inCoverage)
+{
+    u32 inverseCoverage = 255 - inCoverage;
+    
+    u32 red = ((((inColor >> 24) & 0xFF) * inCoverage) + 128);
+    u32 green = ((((inColor >> 16) & 0xFF) * inCoverage) + 128);
+    u32 blue = ((((inColor >> 8) & 0xFF) * inCoverage) + 128);
+    
+    u32 curTexel = 0;
+    
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alphaMask = _mm_set1_epi32(0xFF000000);
+    const __m128i inverse = _mm_set1_epi16(inverseCoverage);
+    const __m128i source = _mm_setr_epi16(red, green, blue, 0, red, green, blue, 0);
+    
+    for (; (curTexel + 4) <= inWidth; curTexel += 4)
+    {
+        __m128i texels = _mm_loadu_si128((const __m128i*)&ioTexels[curTexel]);
+        
+        __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(texels, zero), inverse), source);
+        __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(texels, zero), inverse), source);
+        
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+        
+        texels = _mm_or_si128(_mm_packus_epi16(lo, hi), alphaMask);
+        
+        _mm_storeu_si128((__m128i*)&ioTexels[curTexel], texels);
+    }
+#endif
+
+    for (; curTexel < inWidth; curTexel++)
+    {
+        u8* texel = (u8*)&ioTexels[curTexel];
+        
+        u32 r = (texel[0] * inverseCoverage) + red;
+        u32 g = (texel[1] * inverseCoverage) + green;
+        u32 b = (texel[2] * inverseCoverage) + blue;
+        
+        texel[0] = (u8)((r + (r >> 8)) >> 8);
+        texel[1] = (u8)((g + (g >> 8)) >> 8);
+        texel[2] = (u8)((b + (b >> 8)) >> 8);
+        texel[3] = 0xFF;
+    }
+}
+
+// Texels with any coverage in a glyph bitmap, so content bounds are worked out once per cached glyph instead of per
+// composited texel
+static void ComputeInkBounds(GlyphCacheEntry* ioEntry, u32 inTexelSize)
+{
+    ioEntry->mInkMinX = ioEntry->mWidth;
+    ioEntry->mInkMinY = ioEntry->mHeight;
+    ioEntry->mInkMaxX = -1;
+    ioEntry->mInkMaxY = -1;
+    
+    for (int y = 0; y < ioEntry->mHeight; y++)
+    {
+        for (int x = 0; x < ioEntry->mWidth; x++)
+        {
+            u8* texel = &ioEntry->mBitmap[((y * ioEntry->mWidth) + x) * inTexelSize];
+            BOOL inked = (inTexelSize == 1) ? (texel[0] != 0) : (*((u32*)texel) != 0);
+            
+            if (inked)
+            {
+                ioEntry->mInkMinX = min(ioEntry->mInkMinX, x);
+                ioEntry->mInkMaxX = max(ioEntry->mInkMaxX, x);
+                ioEntry->mInkMinY = min(ioEntry->mInkMinY, y);
+                ioEntry->mInkMaxY = max(ioEntry->mInkMaxY, y);
+            }
+        }
+    }
+}
+
+// Final texel for each coverage value of an unstroked glyph, in memory order.  Coverage 0 is never written.
+static void BuildCoverageTexels(u32* outTexels, u32 inColor, BOOL inPremultipliedAlpha)
+{
+    u8* texels = (u8*)outTexels;
+    
+    for (u32 coverage = 0; coverage < 256; coverage++)
+    {
+        texels[(coverage * 4) + 0] = (inColor >> 24) & 0xFF;
+        texels[(coverage * 4) + 1] = (inColor >> 16) & 0xFF;
+        texels[(coverage * 4) + 2] = (inColor >> 8) & 0xFF;
+        texels[(coverage * 4) + 3] = coverage;
+    }
+    
+    if (inPremultipliedAlpha)
+    {
+        PremultiplyAlphaRGBA8(texels, 256);
+    }
+    
+    outTexels[0] = 0;
+}
+
+// Writes inColors[x] wherever inSource[x] is non-zero.  Glyphs replace what's under them rather than blending, so where
+// glyphs overlap the later one wins.
+static void CompositeGlyphRow(u32* ioDest, const u32* inSource, const u32* inColors, u32 inWidth)
+{
+    u32 curTexel = 0;
+    
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+    
+    for (; (curTexel + 4) <= inWidth; curTexel += 4)
+    {
+        __m128i source = _mm_loadu_si128((const __m128i*)&inSource[curTexel]);
+        __m128i colors = _mm_loadu_si128((const __m128i*)&inColors[curTexel]);
+        __m128i dest = _mm_loadu_si128((const __m128i*)&ioDest[curTexel]);
+        
+        __m128i keep = _mm_cmpeq_epi32(source, zero);
+        
+        dest = _mm_or_si128(_mm_andnot_si128(keep, colors), _mm_and_si128(keep, dest));
+        
+        _mm_storeu_si128((__m128i*)&ioDest[curTexel], dest);
+    }
+#endif
+
+    for (; curTexel < inWidth; curTexel++)
+    {
+        if (inSource[curTexel] != 0)
+        {
+            ioDest[curTexel] = inColors[curTexel];
+        }
+    }
+}
+
 @implementation FontNode
-@end
 
-@implementation GlyphSpan
+-(void)dealloc
+{
+    // The face's sizes go with it
+    if (mFace != NULL)
+    {
+        FT_Done_Face(mFace);
+    }
+    
+    [mSizes release];
+    [mFontData release];
+    
+    [super dealloc];
+}
+
+-(void)SetPointSize:(u32)inPointSize
+{
+    if (inPointSize == mActivePointSize)
+    {
+        return;
+    }
+    
+    NSNumber* sizeKey = [NSNumber numberWithUnsignedInt:inPointSize];
+    NSValue* sizeValue = [mSizes objectForKey:sizeKey];
+    
+    if (sizeValue != NULL)
+    {
+        FT_Activate_Size((FT_Size)[sizeValue pointerValue]);
+    }
+    else
+    {
+        FT_Size size = NULL;
+        
+        FT_Error error = FT_New_Size(mFace, &size);
+        NSAssert(error == 0, @"Error creating a size for the font face");
+        
+        FT_Activate_Size(size);
+        
+        error = FT_Set_Char_Size(   mFace,              /* handle to face object           */
+                                    0,                  /* char_width in 1/64th of points  */
+                                    inPointSize * 64,   /* char_height in 1/64th of points */
+                                    72,                 /* horizontal device resolution    */
+                                    72 );               /* vertical device resolution      */
+        
+        NSAssert(error == 0, @"Error setting character size.  Double check your arguments here");
+        
+        [mSizes setObject:[NSValue valueWithPointer:size] forKey:sizeKey];
+    }
+    
+    mActivePointSize = inPointSize;
+}
+
 @end
 
 @implementation TextTextureBuilderCacheEntry
+
+-(void)dealloc
+{
+    [mKey release];
+    [mTexture release];
+    
+    [super dealloc];
+}
+
 @end
 
+static u64 HashBytes(const u8* inBytes, u32 inLength)
+{
+    u64 hash = FNV_64_OFFSET_BASIS;
+    
+    for (u32 i = 0; i < inLength; i++)
+    {
+        hash ^= inBytes[i];
+        hash *= FNV_64_PRIME;
+    }
+    
+    return hash;
+}
+
+static void InitGlyphSpanList(GlyphSpanList* outList, u32 inCapacity)
+{
+    outList->mX = malloc(sizeof(int) * inCapacity);
+    outList->mY = malloc(sizeof(int) * inCapacity);
+    outList->mWidth = malloc(sizeof(int) * inCapacity);
+    outList->mCoverage = malloc(sizeof(u8) * inCapacity);
+    outList->mNumSpans = 0;
+    outList->mCapacity = inCapacity;
+}
+
+static void FreeGlyphSpanList(GlyphSpanList* inList)
+{
+    free(inList->mX);
+    free(inList->mY);
+    free(inList->mWidth);
+    free(inList->mCoverage);
+}
+
 static void
 RasterCallback(const int y,
                const int count,
                const FT_Span * const spans,
                void * const user) 
 {
-    NSMutableArray* array = user;
+    GlyphSpanList* list = user;
+    
+    // Lists only ever grow, so after the first few glyphs this never allocates
+    if ((list->mNumSpans + count) > list->mCapacity)
+    {
+        list->mCapacity = max(list->mCapacity * 2, list->mNumSpans + count);
+        
+        list->mX = realloc(list->mX, sizeof(int) * list->mCapacity);
+        list->mY = realloc(list->mY, sizeof(int) * list->mCapacity);
+        list->mWidth = realloc(list->mWidth, sizeof(int) * list->mCapacity);
+        list->mCoverage = realloc(list->mCoverage, sizeof(u8) * list->mCapacity);
+    }
 
     for (int i = 0; i < count; i++)
     {
-        GlyphSpan* newSpan = [GlyphSpan alloc];
+        u32 index = list->mNumSpans + i;
         
-        newSpan->x = spans[i].x;
-        newSpan->y = y;
-        newSpan->width = spans[i].len;
-        newSpan->coverage = spans[i].coverage;
-        
-        [array addObject:newSpan];
-        [newSpan release];
+        list->mX[index] = spans[i].x;
+        list->mY[index] = y;
+        list->mWidth[index] = spans[i].len;
+        list->mCoverage[index] = spans[i].coverage;
     }
+        
+    list->mNumSpans += count;
 }
 
 @implementation TextTextureBuilder
@@ -98,11 +416,31 @@ RasterCallback(const int y,
     error = FT_Init_FreeType(&mLibrary);
     NSAssert(error == 0, @"Error initializing freetype");
     
-    mFontNodes = [[NSMutableArray alloc] initWithCapacity:FONT_RESOURCE_HANDLE_CAPACITY];
-    mOutlineSpans = [[NSMutableArray alloc] initWithCapacity:GLYPH_SPANS_INITIAL_CAPACITY];
-    mInsideSpans = [[NSMutableArray alloc] initWithCapacity:GLYPH_SPANS_INITIAL_CAPACITY];
+    mFontNodes = [[NSMutableDictionary alloc] initWithCapacity:FONT_RESOURCE_HANDLE_CAPACITY];
+    InitGlyphSpanList(&mOutlineSpans, GLYPH_SPANS_INITIAL_CAPACITY);
+    InitGlyphSpanList(&mInsideSpans, GLYPH_SPANS_INITIAL_CAPACITY);
     
-    mTextureCache = [[NSMutableArray alloc] initWithCapacity:0];
+    // The stroker only depends on the stroke size, it's set up again when that changes
+    error = FT_Stroker_New(mLibrary, &mStroker);
+    NSAssert(error == 0, @"Error creating stroker");
+    
+    mStrokerSize = 0;
+    
+    mTextureCache = [[NSMutableDictionary alloc] initWithCapacity:0];
+    mCacheHead = NULL;
+    mCacheTail = NULL;
+    mCacheSize = 0;
+    mPersistentCacheDirectory = NULL;
+    
+    GlyphCacheParams glyphCacheParams;
+    [GlyphCache InitDefaultParams:&glyphCacheParams];
+    
+#if !TARGET_OS_IPHONE
+    // The image processor is where large string tables get built, the hit rate is worth seeing there
+    glyphCacheParams.mReportStats = TRUE;
+#endif
+    
+    mGlyphCache = [(GlyphCache*)[GlyphCache alloc] InitWithParams:&glyphCacheParams];
     
     return self;
 }
@@ -110,9 +448,13 @@ RasterCallback(const int y,
 -(void)dealloc
 {
     [mFontNodes release];
-    [mOutlineSpans release];
-    [mInsideSpans release];
+    FreeGlyphSpanList(&mOutlineSpans);
+    FreeGlyphSpanList(&mInsideSpans);
+    
+    FT_Stroker_Done(mStroker);
     [mTextureCache release];
+    [mPersistentCacheDirectory release];
+    [mGlyphCache release];
     
     [super dealloc];
 }
@@ -161,19 +503,8 @@ RasterCallback(const int y,
 
 -(Texture*)GenerateTextureWithParams:(TextTextureParams*)inParams
 {
-#if USE_TEXT_CACHE
-    Texture* texture = [self LookupInCache:inParams];
+    TRACE_SCOPE("Text Texture");
     
-    if (texture != NULL)
-    {
-        [texture retain];
-        [texture autorelease];
-        
-        return texture;
-    }
-#endif
-    
-    NSString* fontName = inParams->mFontName;
     u32 pointSize = inParams->mPointSize;
     NSString* string = inParams->mString;
     u32 stringWidth = inParams->mWidth;
@@ -185,89 +516,43 @@ RasterCallback(const int y,
     u32 trailWidth = inParams->mTrailWidth;
     u32 strokeSize = inParams->mStrokeSize;
     
-    NSNumber* resourceHandle = NULL;
-    FontNode* curNode = NULL;
-    NSData* fontData = NULL;
-    FT_Error error = 0;
-    BOOL createFontNode = FALSE;
-    BOOL fontLoaded = FALSE;
-        
     NSAssert( ((inParams->mFontName != NULL) ^ (inParams->mFontData != NULL)), @"*EITHER* a font name or NSData for the font should be specified.  Not both." );
     
-    if (inParams->mFontData == NULL)
+    FontNode* curNode = [self FontNodeForParams:inParams];
+    NSAssert(curNode != NULL, @"Couldn't load the font for this string");
+    
+#if USE_TEXT_CACHE
+    NSString* cacheKey = NULL;
+    
+    // Don't cache in the case where a caller wants us to load texel data into a pre-existing texture object.
+    if (inParams->mTexture == NULL)
     {
-        ResourceNode* resourceNode = [[ResourceManager GetInstance] FindResourceWithName:fontName];
+        cacheKey = [self CacheKeyForParams:inParams fontNode:curNode];
         
-        if (resourceNode == NULL)
-        {
-            resourceHandle = [[ResourceManager GetInstance] LoadAssetWithName:fontName];
-            
-            createFontNode = TRUE;
-            fontLoaded = TRUE;
-        }
-        else
+        Texture* texture = [self LookupInCache:inParams key:cacheKey];
+        
+        if (texture == NULL)
         {
-            resourceHandle = resourceNode->mHandle;
+            texture = [self LoadPersistentTexture:inParams key:cacheKey];
             
-            createFontNode = TRUE;
-            
-            for (int i = 0; i < [mFontNodes count]; i++)
+            if (texture != NULL)
             {
-                curNode = [mFontNodes objectAtIndex:i];
-                
-                if (curNode->mResourceHandle == resourceHandle)
-                {
-                    createFontNode = FALSE;
-                    break;
-                }
+                [self AddToCache:texture withParams:inParams key:cacheKey];
             }
         }
-    }
-    else
-    {
-        createFontNode = TRUE;
-    }
-        
-    if (createFontNode)
-    {
-        if (inParams->mFontData == NULL)
-        {
-            fontData = [[ResourceManager GetInstance] GetDataForHandle:resourceHandle];
-        }
-        else
-        {
-            fontData = inParams->mFontData;
-        }
-        
-        curNode = [FontNode alloc];
-        curNode->mResourceHandle = resourceHandle;
         
-        error = FT_New_Memory_Face( mLibrary, (unsigned char*)[fontData bytes], [fontData length], 0, &curNode->mFace);
-        
-        if (error != 0)
+        if (texture != NULL)
         {
-            [curNode release];
+            [texture retain];
+            [texture autorelease];
             
-            if (fontLoaded)
-            {
-                [[ResourceManager GetInstance] UnloadAssetWithHandle:resourceHandle];
-            }
-        }
-        else
-        {
-            [mFontNodes addObject:curNode];
+            return texture;
         }
     }
+#endif
     
     // At this point, curNode->mFace should contain our font face.  This is all we need to render glyphs of a certain font.
-    
-    error = FT_Set_Char_Size(   curNode->mFace,     /* handle to face object           */
-                                0,                  /* char_width in 1/64th of points  */
-                                pointSize * 64,   /* char_height in 1/64th of points */
-                                72,                 /* horizontal device resolution    */
-                                72 );               /* vertical device resolution      */
-    
-    NSAssert(error == 0, @"Error setting character size.  Double check your arguments here");
+    [curNode SetPointSize:pointSize];
     
     Texture* newTexture = NULL;
     
@@ -292,6 +577,8 @@ RasterCallback(const int y,
     GlyphTexture* textureArray = malloc(sizeof(GlyphTexture) * stringLength);
     memset(textureArray, 0, sizeof(GlyphTexture) * stringLength);
     
+    TextLineGlyph* lineGlyphs = malloc(sizeof(TextLineGlyph) * stringLength);
+    
     u32 texWidth = 0;
     u32 texHeight = 0;
     int maxY = 0;
@@ -301,221 +588,95 @@ RasterCallback(const int y,
 	int firstCharXOffset = 0;
     
     NSMutableArray* lineWidth = [[NSMutableArray alloc] initWithCapacity:INITIAL_LINE_WIDTH_CAPACITY];
-    int curLineWidth = 0;
+    
+    TextLineBreaker lineBreaker;
+    TextLineBreakerInit(&lineBreaker, stringWidth);
     
     for (int i = 0; i < stringLength; i++)
     {
-        // Render one character.
-        error = FT_Load_Char( curNode->mFace, cString[i], FT_LOAD_DEFAULT );
-        NSAssert(error == 0, @"Could not load a glyph.");
+        GlyphCacheKey key;
+        [GlyphCache InitKey:&key];
         
-        FT_GlyphSlot glyphSlot = curNode->mFace->glyph;
+        key.mFace = curNode->mFace;
+        key.mCharCode = cString[i];
+        key.mPointSize = pointSize;
+        key.mStrokeSize = strokeSize;
         
-        if (strokeSize == 0)
-        {
-            FT_Render_Glyph(glyphSlot, FT_RENDER_MODE_NORMAL);
-        }
-        else
+        // Unstroked glyphs are colored as they're composited below, so one bitmap serves every color
+        if (strokeSize != 0)
         {
-            NSAssert(glyphSlot->format == FT_GLYPH_FORMAT_OUTLINE, @"Can't generate a stroke for a font with no outlines.");
-            
-            FT_Stroker stroker;
-            FT_Stroker_New(mLibrary, &stroker);
-            
-            FT_Stroker_Set(stroker,
-                           (int)(strokeSize * 64),
-                           FT_STROKER_LINECAP_ROUND,
-                           FT_STROKER_LINEJOIN_ROUND,
-                           0);
-
-            FT_Glyph glyph;
-            
-            FT_Raster_Params params;
-            memset(&params, 0, sizeof(params));
-            
-            params.flags = FT_RASTER_FLAG_AA | FT_RASTER_FLAG_DIRECT;
-            params.gray_spans = RasterCallback;
-            params.user = mInsideSpans;
-            
-            FT_Error err = FT_Outline_Render(mLibrary, &curNode->mFace->glyph->outline, &params);
-            
-            if (FT_Get_Glyph(glyphSlot, &glyph) == 0)
-            {
-                FT_Glyph_StrokeBorder(&glyph, stroker, 0, 1);
-                
-                if (glyph->format == FT_GLYPH_FORMAT_OUTLINE)
-                {
-                    // Render the outline spans to the span list
-                    FT_Outline* outline = &((FT_OutlineGlyph)(glyph))->outline;
-                    
-                    memset(&params, 0, sizeof(params));
-                    
-                    params.flags = FT_RASTER_FLAG_AA | FT_RASTER_FLAG_DIRECT;
-                    params.gray_spans = RasterCallback;
-                    params.user = mOutlineSpans;
-
-                    err = FT_Outline_Render(mLibrary, outline, &params); 
-                    NSAssert(err == 0, @"Error rendering outline");
-                    
-                    FT_Stroker_Done(stroker);
-                    FT_Done_Glyph(glyph);
-                    
-                    Color insideColor, outsideColor;
-                    
-                    SetColorFromU32(&insideColor, color);
-                    SetColorFromU32(&outsideColor, strokeColor);
-                    
-                    [self GenerateStrokeBitmap:glyphSlot insideColor:&insideColor outsideColor:&outsideColor];
-                }
-                else
-                {
-                    NSAssert(FALSE, @"Glyph isn't outline format for some reason.  Make sure you're using a TrueType font or other vector font.");
-                }
-
-            }
-            else
-            {
-                NSAssert(FALSE, @"Couldn't get glyph for some reason.");
-            }
-            
+            key.mColor = color;
+            key.mStrokeColor = strokeColor;
         }
 
-        int height = glyphSlot->bitmap.rows;
-        int width = glyphSlot->bitmap.width;
+        GlyphCacheEntry* glyph = [mGlyphCache LookupGlyph:&key];
         
-        if ((height != 0) && (width != 0))
+        if (glyph == NULL)
         {
-            u32 texelSize = (strokeSize == 0) ? 1 : sizeof(u32);
-            
-            textureArray[i].mTexBytes = malloc(texelSize * height * width);
-            memcpy(textureArray[i].mTexBytes, glyphSlot->bitmap.buffer, texelSize * height * width);
-            
-            if (strokeSize != 0)
-            {
-                free(glyphSlot->bitmap.buffer);
-            }
+            glyph = [self RenderGlyph:&key];
+            [mGlyphCache AddGlyph:glyph];
+            [glyph release];
         }
         
+        int height = glyph->mHeight;
+        
+        // The bitmap belongs to the glyph cache, which doesn't evict anything until we're done with this string
+        textureArray[i].mTexBytes = glyph->mBitmap;
         textureArray[i].mHeight = height;
-        textureArray[i].mWidth = width;
+        textureArray[i].mWidth = glyph->mWidth;
+        
+        textureArray[i].mLeftOffset = glyph->mLeftOffset;
+        textureArray[i].mHorizBearingY = glyph->mHorizBearingY;
         
-        textureArray[i].mLeftOffset = glyphSlot->bitmap_left;
-        textureArray[i].mHorizBearingY = glyphSlot->metrics.horiBearingY >> 6;
+        textureArray[i].mInkMinX = glyph->mInkMinX;
+        textureArray[i].mInkMinY = glyph->mInkMinY;
+        textureArray[i].mInkMaxX = glyph->mInkMaxX;
+        textureArray[i].mInkMaxY = glyph->mInkMaxY;
         
-        textureArray[i].mAdvanceWidth = (glyphSlot->advance.x >> 6) + (2 * strokeSize);
+        textureArray[i].mAdvanceWidth = glyph->mAdvanceX + (2 * strokeSize);
         
         textureArray[i].mCharacter = cString[i];
 		
 		if (i == 0)
 		{
-			if (glyphSlot->bitmap_left < 0)
+			if (glyph->mLeftOffset < 0)
 			{
-				texWidth += (-glyphSlot->bitmap_left);
-				firstCharXOffset = -glyphSlot->bitmap_left;
+				texWidth += (-glyph->mLeftOffset);
+				firstCharXOffset = -glyph->mLeftOffset;
 			}
 		}
         
-        if ((stringWidth == 0) || ((curLineWidth + textureArray[i].mAdvanceWidth) <= stringWidth))
+        lineGlyphs[i].mCharacter = cString[i];
+        lineGlyphs[i].mAdvanceWidth = textureArray[i].mAdvanceWidth;
+        lineGlyphs[i].mWidth = textureArray[i].mWidth;
+        
+        int finishedWidth = 0;
+        
+        if (TextLineBreakerAddGlyph(&lineBreaker, lineGlyphs, i, &finishedWidth))
         {
-            curLineWidth += textureArray[i].mAdvanceWidth;
+            [lineWidth addObject:[NSNumber numberWithUnsignedInt:finishedWidth]];
+            minY = 0;
         }
-        else
+        
+        curLine = lineBreaker.mLine;
+        
+        if (curLine == 0)
         {
-            // Search backwards for a whitespace character
-            int searchIndex = 0;
-            BOOL fail = FALSE;
-            
-            for (searchIndex = (i - 1); searchIndex >= 0; searchIndex--)
-            {
-                char val = cString[searchIndex];
-                
-                if (textureArray[searchIndex].mLine != curLine)
-                {
-                    fail = TRUE;
-                    break;
-                }
+            maxY = max(maxY, glyph->mHorizBearingY);
+        }
+        
+        minY = min(minY, glyph->mHorizBearingY - height);
+    }
+    
+    [lineWidth addObject:[NSNumber numberWithUnsignedInt:TextLineBreakerFinish(&lineBreaker, lineGlyphs, stringLength)]];
 
-                if ((val == ' ') || (val == '\n') || (val == '\r') || (val == '\t'))
-                {
-                    // Don't move the whitespace down to the next line
-                    searchIndex++;
-                    break;
-                }
-            }
-            
-            int lastCharIndex = i - 1;
-            
-            // No whitespace, we'll just wrap by the character instead of whole word - we have no choice
-            if ((searchIndex != 0) && (!fail))
-            {
-                for (int curIndex = searchIndex; curIndex < i; curIndex++)
-                {
-                    textureArray[curIndex].mLine++;
-                }
-                
-                lastCharIndex = searchIndex - 1;
-            }
-
-            // Recalculate the previous line's width since we removed some characters from it.
-            
-            curLineWidth = 0;
-            
-            for (int curIndex = (i - 1); curIndex != 0; curIndex--)
-            {
-                if (textureArray[curIndex].mLine == curLine)
-                {
-                    curLineWidth += textureArray[curIndex].mAdvanceWidth;
-                }
-                
-                if (textureArray[curIndex].mLine < curLine)
-                {
-                    break;
-                }
-            }
-            
-            // The previous character might have an advance width smaller than the actual width.  Bump up the
-            // line width appropriately.  This only matters for the last character in a line so that we allocate
-            // a texture wide enough.
-            
-            int maxGlyphWidth = max(textureArray[lastCharIndex].mAdvanceWidth, textureArray[lastCharIndex].mWidth);
-            int delta = maxGlyphWidth - textureArray[lastCharIndex].mAdvanceWidth;
-            
-            curLineWidth += delta;
-            
-            [lineWidth addObject:[NSNumber numberWithUnsignedInt:curLineWidth]];
-            curLine++;
-            
-            curLineWidth = 0;
-            
-            // Since we shifted characters onto the next line, we have to recalculate its starting width.
-            for (int curIndex = 0; curIndex <= i; curIndex++)
-            {
-                if (textureArray[curIndex].mLine == curLine)
-                {
-                    curLineWidth += textureArray[curIndex].mAdvanceWidth;
-                }
-            }
-            
-            curLineWidth += textureArray[i].mAdvanceWidth;
-            minY = 0;
-        }
-        
-        textureArray[i].mLine = curLine;
-        
-        if (curLine == 0)
-        {
-            maxY = max(maxY, glyphSlot->metrics.horiBearingY >> 6);
-        }
-        
-        minY = min(minY, (glyphSlot->metrics.horiBearingY >> 6) - height);
+    // Wrapping can move glyphs down after they've been placed, so lines are only final now
+    for (int i = 0; i < stringLength; i++)
+    {
+        textureArray[i].mLine = lineGlyphs[i].mLine;
     }
-    
-    int maxGlyphWidth = max(textureArray[stringLength - 1].mAdvanceWidth, textureArray[stringLength - 1].mWidth);
-    int delta = maxGlyphWidth - textureArray[stringLength - 1].mAdvanceWidth;
-
-    curLineWidth += delta;
 
-    [lineWidth addObject:[NSNumber numberWithUnsignedInt:curLineWidth]];
+    free(lineGlyphs);
     
     int numLines = [lineWidth count];
 
@@ -553,10 +714,21 @@ RasterCallback(const int y,
     newTexture->mTexBytes = malloc(sizeof(u32) * paddedWidth * paddedHeight);
     memset(newTexture->mTexBytes, 0, sizeof(u32) * paddedWidth * paddedHeight);
     
-    inParams->mStartX = texWidth - 1;
-    inParams->mEndX = 0;
-    inParams->mStartY = texHeight - 1;
-    inParams->mEndY = 0;
+    TRACE_ALLOCATION(sizeof(u32) * paddedWidth * paddedHeight);
+    TRACE_COUNT(TRACE_COUNTER_PIXELS_PROCESSED, texWidth * texHeight);
+    
+    int startX = texWidth - 1;
+    int endX = 0;
+    int startY = texHeight - 1;
+    int endY = 0;
+    
+    // Unstroked glyphs are coverage only, so every texel comes out of this table.  Premultiplying the table here means
+    // the texture doesn't need its own premultiply pass.
+    u32 coverageTexels[256];
+    BuildCoverageTexels(coverageTexels, color, inParams->mPremultipliedAlpha);
+    
+    // One glyph row at a time, colored or premultiplied
+    u32* rowColors = malloc(sizeof(u32) * paddedWidth);
     
     int baseX = 0;
     int lastLine = 0;
@@ -571,119 +743,79 @@ RasterCallback(const int y,
             baseX = 0;
         }
         
-        u32 useColor = (strokeSize == 0) ? color : strokeColor;
+        // Nothing to draw for whitespace
+        if ((curGlyph->mTexBytes == NULL) || (curGlyph->mInkMaxX < curGlyph->mInkMinX))
+        {
+            baseX += curGlyph->mAdvanceWidth;
+            continue;
+        }
                 
-        for (int y = 0; y < curGlyph->mHeight; y++)
+        int glyphX = baseX + leadWidth + firstCharXOffset + curGlyph->mLeftOffset;
+        int glyphY = (maxY - curGlyph->mHorizBearingY) + leadHeight + (curGlyph->mLine * lineHeight);
+        
+        // Only the inked rows and columns are touched, everything outside them is zero coverage
+        int inkWidth = curGlyph->mInkMaxX - curGlyph->mInkMinX + 1;
+        int firstWrite = ((glyphY + curGlyph->mInkMinY) * paddedWidth) + glyphX + curGlyph->mInkMinX;
+        int lastWrite = ((glyphY + curGlyph->mInkMaxY) * paddedWidth) + glyphX + curGlyph->mInkMaxX;
+        
+        NSAssert((firstWrite >= 0) && (lastWrite < (paddedWidth * paddedHeight)), @"About to write glyph out of the allocated block of memory.");
+        
+        // Save off the bounds that we rendered texels to.  Useful for centering and positioning text without regard for texture
+        // padding (eg: power-of-two padding)
+        startX = min(startX, glyphX + curGlyph->mInkMinX);
+        endX = max(endX, glyphX + curGlyph->mInkMaxX);
+        startY = min(startY, glyphY + curGlyph->mInkMinY);
+        endY = max(endY, glyphY + curGlyph->mInkMaxY);
+        
+        for (int y = curGlyph->mInkMinY; y <= curGlyph->mInkMaxY; y++)
         {
-            for (int x = 0; x < curGlyph->mWidth; x++)
+            u32* dest = &newTexture->mTexBytes[((glyphY + y) * paddedWidth) + glyphX + curGlyph->mInkMinX];
+            u32 readIndex = (y * curGlyph->mWidth) + curGlyph->mInkMinX;
+            
+            if (strokeSize == 0)
             {
-                // Number of lines from the top to start writing
-                int writeYOffset = maxY - curGlyph->mHorizBearingY;
+                u8* coverage = &curGlyph->mTexBytes[readIndex];
             
-                int readIndex = x + (y * curGlyph->mWidth);
-                
-                if (strokeSize != 0)
+                for (int x = 0; x < inkWidth; x++)
                 {
-                    readIndex *= sizeof(u32);
+                    rowColors[x] = coverageTexels[coverage[x]];
                 }
                 
-                int writeX = baseX + leadWidth + x + firstCharXOffset + curGlyph->mLeftOffset;
-                int writeY = y + writeYOffset + leadHeight + (curGlyph->mLine * lineHeight);
-                int writeIndex = writeX + (writeY * paddedWidth);
+                CompositeGlyphRow(dest, rowColors, rowColors, inkWidth);
+            }
+            else
+            {
+                // Stroked glyphs are already RGBA8 in memory order.  Which texels get written is decided before
+                // premultiplying, as it always has been.
+                u32* texels = &((u32*)curGlyph->mTexBytes)[readIndex];
                 
-                // Only render something is the alpha is greater than 0
-                BOOL renderedTexel = strokeSize == 0 ?
-                                     (curGlyph->mTexBytes[readIndex] & 0xFF) > 0 :
-                                     *((u32*)&curGlyph->mTexBytes[readIndex]) != 0;
+                if (inParams->mPremultipliedAlpha)
+                {
+                    memcpy(rowColors, texels, sizeof(u32) * inkWidth);
+                    PremultiplyAlphaRGBA8((u8*)rowColors, inkWidth);
                 
-                if (renderedTexel)
+                    CompositeGlyphRow(dest, texels, rowColors, inkWidth);
+                }
+                else
                 {
-                    u32 texVal = (useColor & 0xFFFFFF00) | curGlyph->mTexBytes[readIndex];
-                    texVal = CFSwapInt32BigToHost(texVal);
-                    
-                    if (strokeSize != 0)
-                    {
-                        u8 r = curGlyph->mTexBytes[readIndex];
-                        u8 g = curGlyph->mTexBytes[readIndex + 1];
-                        u8 b = curGlyph->mTexBytes[readIndex + 2];
-                        u8 a = curGlyph->mTexBytes[readIndex + 3];
-                        
-                        if (inParams->mPremultipliedAlpha)
-                        {
-                            float rf = (float)r / 255.0f;
-                            float gf = (float)g / 255.0f;
-                            float bf = (float)b / 255.0f;
-                            float af = (float)a / 255.0f;
-                            
-                            r = (u8)((rf * af) * 255.0f);
-                            g = (u8)((gf * af) * 255.0f);
-                            b = (u8)((bf * af) * 255.0f);
-                        }
-                        
-                        texVal =    (r << 24) | (g << 16) | (b << 8) | a;                                                                        
-                        texVal = CFSwapInt32BigToHost(texVal);
-                    }
-                    else if (inParams->mPremultipliedAlpha)
-                    {
-                        u8 r = (texVal & 0xFF);
-                        u8 g = (texVal >> 8) & 0xFF;
-                        u8 b = (texVal >> 16) & 0xFF;
-                        u8 a = (texVal >> 24) & 0xFF;
-                        
-                        float rf = (float)r / 255.0f;
-                        float gf = (float)g / 255.0f;
-                        float bf = (float)b / 255.0f;
-                        float af = (float)a / 255.0f;
-
-                        r = (u8)((rf * af) * 255.0f);
-                        g = (u8)((gf * af) * 255.0f);
-                        b = (u8)((bf * af) * 255.0f);
-                        
-                        texVal =    (r << 24) | (g << 16) | (b << 8) | a;                                                                        
-                        texVal = CFSwapInt32BigToHost(texVal);
-                    }
-                    
-                    // Save off the bounds that we rendered texels to.  Useful for centering and positioning text without regard for texture
-                    // padding (eg: power-of-two padding)
-                    
-                    if (writeX < inParams->mStartX)
-                    {
-                        inParams->mStartX = writeX;
-                    }
-                    
-                    if (writeX > inParams->mEndX)
-                    {
-                        inParams->mEndX = writeX;
-                    }
-                    
-                    if (writeY < inParams->mStartY)
-                    {
-                        inParams->mStartY = writeY;
-                    }
-                    
-                    if (writeY > inParams->mEndY)
-                    {
-                        inParams->mEndY = writeY;
-                    }
-
-                    NSAssert(writeIndex < (paddedWidth * paddedHeight), @"About to write glyph out of the allocated block of memory.");
-
-                    newTexture->mTexBytes[writeIndex] = texVal;
+                    CompositeGlyphRow(dest, texels, texels, inkWidth);
                 }
             }
         }
         
-        if (strokeSize != 0)
-        {
-//            WritePNG(curGlyph->mTexBytes, @"Test.PNG", curGlyph->mWidth, curGlyph->mHeight);
-        }
-        
-		free(textureArray[i].mTexBytes);
-
         baseX += curGlyph->mAdvanceWidth;
     }
 
+    inParams->mStartX = startX;
+    inParams->mEndX = endX;
+    inParams->mStartY = startY;
+    inParams->mEndY = endY;
+    
+    free(rowColors);
 	free(textureArray);
+    
+    [mGlyphCache EvictToBudget];
+    
     newTexture->mWidth = paddedWidth;
     newTexture->mHeight = paddedHeight;
     
@@ -703,16 +835,236 @@ RasterCallback(const int y,
     }
     
 #if USE_TEXT_CACHE
-    // We only specify mFontData in the Neon21ImageProcessor.  It's not worth supporting this case.
-    if (inParams->mFontData == NULL)
+    if (cacheKey != NULL)
     {
-        [self AddToCache:newTexture withParams:inParams];
+        [self AddToCache:newTexture withParams:inParams key:cacheKey];
+        [self SavePersistentTexture:newTexture params:inParams key:cacheKey];
     }
 #endif
 	
     return newTexture;
 }
 
+-(FontNode*)FontNodeForParams:(TextTextureParams*)inParams
+{
+    // Fonts given by name are keyed by their lowercased name, like the ResourceManager's lookups.  Fonts given as data
+    // are keyed by the NSData itself, which the node retains so the address can't be reused.
+    NSString* registryKey = NULL;
+    
+    if (inParams->mFontData == NULL)
+    {
+        registryKey = [NSString stringWithFormat:@"name:%@#%d", [inParams->mFontName lowercaseString], FONT_FACE_INDEX];
+    }
+    else
+    {
+        registryKey = [NSString stringWithFormat:@"data:%p#%d", inParams->mFontData, FONT_FACE_INDEX];
+    }
+    
+    FontNode* fontNode = [mFontNodes objectForKey:registryKey];
+    
+    if (fontNode != NULL)
+    {
+        return fontNode;
+    }
+    
+    NSNumber* resourceHandle = NULL;
+    NSData* fontData = inParams->mFontData;
+    BOOL fontLoaded = FALSE;
+    
+    if (fontData == NULL)
+    {
+        ResourceNode* resourceNode = [[ResourceManager GetInstance] FindResourceWithName:inParams->mFontName];
+        
+        if (resourceNode == NULL)
+        {
+            // FreeType reads the face straight out of the mapping, the font is never copied into the heap
+            resourceHandle = [[ResourceManager GetInstance] LoadMappedAssetWithName:inParams->mFontName];
+            fontLoaded = TRUE;
+        }
+        else
+        {
+            resourceHandle = resourceNode->mHandle;
+        }
+        
+        fontData = [[ResourceManager GetInstance] GetDataForHandle:resourceHandle];
+    }
+    
+    fontNode = [FontNode alloc];
+    fontNode->mResourceHandle = resourceHandle;
+    fontNode->mSizes = [[NSMutableDictionary alloc] initWithCapacity:0];
+    fontNode->mActivePointSize = 0;
+    
+    // The face reads straight out of the font data, so hold on to it for as long as the face is around
+    fontNode->mFontData = [inParams->mFontData retain];
+    
+    FT_Error error = FT_New_Memory_Face(mLibrary, (unsigned char*)[fontData bytes], [fontData length], FONT_FACE_INDEX, &fontNode->mFace);
+    
+    if (error != 0)
+    {
+        [fontNode release];
+        
+        if (fontLoaded)
+        {
+            [[ResourceManager GetInstance] UnloadAssetWithHandle:resourceHandle];
+        }
+        
+        return NULL;
+    }
+    
+    if (fontNode->mFontData != NULL)
+    {
+        fontNode->mFontDataHash = HashBytes([fontNode->mFontData bytes], [fontNode->mFontData length]);
+    }
+    
+    [mFontNodes setObject:fontNode forKey:registryKey];
+    [fontNode release];
+    
+    return fontNode;
+}
+
+-(void)ReleaseFontData:(NSData*)inFontData
+{
+    NSString* registryKey = [NSString stringWithFormat:@"data:%p#%d", inFontData, FONT_FACE_INDEX];
+    FontNode* fontNode = [mFontNodes objectForKey:registryKey];
+    
+    if (fontNode == NULL)
+    {
+        return;
+    }
+    
+    [mGlyphCache RemoveGlyphsForFace:fontNode->mFace];
+    [mFontNodes removeObjectForKey:registryKey];
+}
+
+-(GlyphCacheEntry*)RenderGlyph:(GlyphCacheKey*)inKey
+{
+    TRACE_SCOPE("Glyph Rasterize");
+    
+    FT_Face face = inKey->mFace;
+    u32 strokeSize = inKey->mStrokeSize;
+    
+    // Render one character.
+    FT_Error error = FT_Load_Char( face, inKey->mCharCode, FT_LOAD_DEFAULT );
+    NSAssert(error == 0, @"Could not load a glyph.");
+    
+    FT_GlyphSlot glyphSlot = face->glyph;
+    
+    if (strokeSize == 0)
+    {
+        FT_Render_Glyph(glyphSlot, FT_RENDER_MODE_NORMAL);
+    }
+    else
+    {
+        NSAssert(glyphSlot->format == FT_GLYPH_FORMAT_OUTLINE, @"Can't generate a stroke for a font with no outlines.");
+        
+        if (mStrokerSize != strokeSize)
+        {
+            FT_Stroker_Set(mStroker,
+                           (int)(strokeSize * 64),
+                           FT_STROKER_LINECAP_ROUND,
+                           FT_STROKER_LINEJOIN_ROUND,
+                           0);
+        
+            mStrokerSize = strokeSize;
+        }
+        
+        mOutlineSpans.mNumSpans = 0;
+        mInsideSpans.mNumSpans = 0;
+
+        FT_Glyph glyph;
+        
+        FT_Raster_Params params;
+        memset(&params, 0, sizeof(params));
+        
+        params.flags = FT_RASTER_FLAG_AA | FT_RASTER_FLAG_DIRECT;
+        params.gray_spans = RasterCallback;
+        params.user = &mInsideSpans;
+        
+        FT_Error err = FT_Outline_Render(mLibrary, &face->glyph->outline, &params);
+        
+        if (FT_Get_Glyph(glyphSlot, &glyph) == 0)
+        {
+            FT_Glyph_StrokeBorder(&glyph, mStroker, 0, 1);
+            
+            if (glyph->format == FT_GLYPH_FORMAT_OUTLINE)
+            {
+                // Render the outline spans to the span list
+                FT_Outline* outline = &((FT_OutlineGlyph)(glyph))->outline;
+                
+                memset(&params, 0, sizeof(params));
+                
+                params.flags = FT_RASTER_FLAG_AA | FT_RASTER_FLAG_DIRECT;
+                params.gray_spans = RasterCallback;
+                params.user = &mOutlineSpans;
+
+                err = FT_Outline_Render(mLibrary, outline, &params); 
+                NSAssert(err == 0, @"Error rendering outline");
+                
+                FT_Done_Glyph(glyph);
+                
+                Color insideColor, outsideColor;
+                
+                SetColorFromU32(&insideColor, inKey->mColor);
+                SetColorFromU32(&outsideColor, inKey->mStrokeColor);
+                
+                [self GenerateStrokeBitmap:glyphSlot insideColor:&insideColor outsideColor:&outsideColor];
+            }
+            else
+            {
+                NSAssert(FALSE, @"Glyph isn't outline format for some reason.  Make sure you're using a TrueType font or other vector font.");
+            }
+
+        }
+        else
+        {
+            NSAssert(FALSE, @"Couldn't get glyph for some reason.");
+        }
+        
+    }
+    
+    GlyphCacheEntry* entry = [(GlyphCacheEntry*)[GlyphCacheEntry alloc] Init];
+    
+    memcpy(&entry->mKey, inKey, sizeof(GlyphCacheKey));
+
+    int height = glyphSlot->bitmap.rows;
+    int width = glyphSlot->bitmap.width;
+    
+    if ((height != 0) && (width != 0))
+    {
+        u32 texelSize = (strokeSize == 0) ? 1 : sizeof(u32);
+        
+        entry->mBitmapSize = texelSize * height * width;
+        
+        if (strokeSize == 0)
+        {
+            entry->mBitmap = malloc(entry->mBitmapSize);
+            memcpy(entry->mBitmap, glyphSlot->bitmap.buffer, entry->mBitmapSize);
+        }
+        else
+        {
+            // GenerateStrokeBitmap allocated this buffer, FreeType doesn't know about it.  Take it rather than copying.
+            entry->mBitmap = glyphSlot->bitmap.buffer;
+            glyphSlot->bitmap.buffer = NULL;
+        }
+        
+        TRACE_ALLOCATION(entry->mBitmapSize);
+    }
+    
+    entry->mHeight = height;
+    entry->mWidth = width;
+    
+    if (entry->mBitmap != NULL)
+    {
+        ComputeInkBounds(entry, (strokeSize == 0) ? 1 : sizeof(u32));
+    }
+    
+    entry->mLeftOffset = glyphSlot->bitmap_left;
+    entry->mHorizBearingY = glyphSlot->metrics.horiBearingY >> 6;
+    entry->mAdvanceX = glyphSlot->advance.x >> 6;
+    
+    return entry;
+}
+
 -(void)GenerateStrokeBitmap:(FT_GlyphSlot)inSlot insideColor:(Color*)inInsideColor outsideColor:(Color*)inOutsideColor
 {
     NSAssert(inSlot->bitmap.buffer == NULL, @"Bitmap was already allocated, how did this happen?");
@@ -720,7 +1072,7 @@ RasterCallback(const int y,
     FT_Bitmap* bitmap = &inSlot->bitmap;
 
     // For whitespace characters, don't do anything
-    if ([mOutlineSpans count] == 0)
+    if (mOutlineSpans.mNumSpans == 0)
     {
         bitmap->rows = 0;
         bitmap->width = 0;
@@ -734,21 +1086,24 @@ RasterCallback(const int y,
     // Render outside spans
     Rect2D rect;
     
-    GlyphSpan* first = [mOutlineSpans objectAtIndex:0];
+    int* spanX = mOutlineSpans.mX;
+    int* spanY = mOutlineSpans.mY;
+    int* spanWidth = mOutlineSpans.mWidth;
+    u8* spanCoverage = mOutlineSpans.mCoverage;
     
-    rect.mXMin = first->x;
-    rect.mYMin = first->y;
-    rect.mXMax = first->x + first->width - 1;
-    rect.mYMax = first->y;
+    rect.mXMin = spanX[0];
+    rect.mYMin = spanY[0];
+    rect.mXMax = spanX[0] + spanWidth[0] - 1;
+    rect.mYMax = spanY[0];
     
-    for (GlyphSpan* curSpan in mOutlineSpans)
+    for (u32 curSpan = 0; curSpan < mOutlineSpans.mNumSpans; curSpan++)
     {
         Rect2D curRect;
         
-        curRect.mXMin = curSpan->x;
-        curRect.mYMin = curSpan->y;
-        curRect.mXMax = curSpan->x + curSpan->width;
-        curRect.mYMax = curSpan->y;
+        curRect.mXMin = spanX[curSpan];
+        curRect.mYMin = spanY[curSpan];
+        curRect.mXMax = spanX[curSpan] + spanWidth[curSpan];
+        curRect.mYMax = spanY[curSpan];
         
         NeonUnionRect(&rect, &curRect);
     }
@@ -760,183 +1115,273 @@ RasterCallback(const int y,
     
     memset(bitmap->buffer, 0, bitmap->rows * bitmap->width * sizeof(u32));
         
-    for (GlyphSpan* curSpan in mOutlineSpans)
+    u32* texels = (u32*)bitmap->buffer;
+    u32 numTexels = bitmap->rows * bitmap->width;
+        
+    for (u32 curSpan = 0; curSpan < mOutlineSpans.mNumSpans; curSpan++)
     {
-        for (int x = 0; x < curSpan->width; x++)
-        {
-            int writeOffset = (bitmap->rows - 1 - (curSpan->y - rect.mYMin)) * bitmap->width + (curSpan->x - rect.mXMin + x);
-            writeOffset *= sizeof(u32);
+        int writeOffset = (bitmap->rows - 1 - (spanY[curSpan] - rect.mYMin)) * bitmap->width + (spanX[curSpan] - rect.mXMin);
             
-            NSAssert(((writeOffset >= 0) && (writeOffset < (bitmap->rows * bitmap->width * sizeof(u32)))), @"Attempted write out of range");
+        NSAssert(((writeOffset >= 0) && ((writeOffset + spanWidth[curSpan]) <= numTexels)), @"Attempted write out of range");
             
-            bitmap->buffer[writeOffset] = (outsideColor & 0xFF000000) >> 24;
-            bitmap->buffer[writeOffset + 1] = (outsideColor & 0x00FF0000) >> 16;
-            bitmap->buffer[writeOffset + 2] = (outsideColor & 0x0000FF00) >> 8;
-            bitmap->buffer[writeOffset + 3] = curSpan->coverage; 
-        }
+        FillStrokeSpan(&texels[writeOffset], spanWidth[curSpan], PackStrokeTexel(outsideColor, spanCoverage[curSpan]));
     }
     
-    [mOutlineSpans removeAllObjects];
+    mOutlineSpans.mNumSpans = 0;
         
     // Alpha blend inside spans on top
-    NSAssert([mInsideSpans count] > 0, @"No inside spans, how is this possible?");
+    NSAssert(mInsideSpans.mNumSpans > 0, @"No inside spans, how is this possible?");
     
-    first = [mInsideSpans objectAtIndex:0];
+    spanX = mInsideSpans.mX;
+    spanY = mInsideSpans.mY;
+    spanWidth = mInsideSpans.mWidth;
+    spanCoverage = mInsideSpans.mCoverage;
     
-    for (GlyphSpan* curSpan in mInsideSpans)
+    for (u32 curSpan = 0; curSpan < mInsideSpans.mNumSpans; curSpan++)
     {
-        for (int x = 0; x < curSpan->width; x++)
+        int writeOffset = (bitmap->rows - 1 - (spanY[curSpan] - rect.mYMin)) * bitmap->width + (spanX[curSpan] - rect.mXMin);
+        
+        NSAssert(((writeOffset >= 0) && ((writeOffset + spanWidth[curSpan]) <= numTexels)), @"Attempted write out of range");
+        
+        if (insideColor == 0)
         {
-            int writeOffset = (bitmap->rows - 1 - (curSpan->y - rect.mYMin)) * bitmap->width + (curSpan->x - rect.mXMin + x);
-            writeOffset *= sizeof(u32);
-            
-            NSAssert(((writeOffset >= 0) && (writeOffset < (bitmap->rows * bitmap->width * sizeof(u32)))), @"Attempted write out of range");
-            
-            if (insideColor == 0)
-            {
-                bitmap->buffer[writeOffset] = (outsideColor & 0xFF000000) >> 24;
-                bitmap->buffer[writeOffset + 1] = (outsideColor & 0x00FF0000) >> 16;
-                bitmap->buffer[writeOffset + 2] = (outsideColor & 0x0000FF00) >> 8;
-                bitmap->buffer[writeOffset + 3] = max(0, bitmap->buffer[writeOffset + 3] - curSpan->coverage); 
-            }
-            else
-            {
-                float destRed = (float)(bitmap->buffer[writeOffset] / 255.0);
-                float destGreen = (float)(bitmap->buffer[writeOffset + 1] / 255.0);
-                float destBlue = (float)(bitmap->buffer[writeOffset + 2] / 255.0);
-                //float destAlpha = (float)(bitmap->buffer[writeOffset + 3] / 255.0);
-                
-                float srcRed = (float)(((insideColor & 0xFF000000) >> 24) / 255.0);
-                float srcGreen = (float)(((insideColor & 0x00FF0000) >> 16) / 255.0);
-                float srcBlue = (float)(((insideColor & 0x0000FF00) >> 8) / 255.0);
-                float srcAlpha = (float)(curSpan->coverage / 255.0);
-                
-                bitmap->buffer[writeOffset] = 255.0 * ((srcRed * srcAlpha) + (destRed * (1.0 - srcAlpha)));
-                bitmap->buffer[writeOffset + 1] = 255.0 * ((srcGreen * srcAlpha) + (destGreen * (1.0 - srcAlpha)));
-                bitmap->buffer[writeOffset + 2] = 255.0 * ((srcBlue * srcAlpha) + (destBlue * (1.0 - srcAlpha)));
-                bitmap->buffer[writeOffset + 3] = 255.0;
-            }
+            EraseStrokeSpan(&texels[writeOffset], spanWidth[curSpan], outsideColor, spanCoverage[curSpan]);
+        }
+        else
+        {
+            BlendStrokeSpan(&texels[writeOffset], spanWidth[curSpan], insideColor, spanCoverage[curSpan]);
         }
     }
     
-    [mInsideSpans removeAllObjects];
+    mInsideSpans.mNumSpans = 0;
 }
 
--(void)AddToCache:(Texture*)inTexture withParams:(TextTextureParams*)inParams
+-(void)SetPersistentCacheDirectory:(NSString*)inDirectory
 {
-    NSAssert(![self LookupInCache:inParams], @"Item is already in cache");
-    
-    // Don't cache in the case where a caller wants us to load texel data into a pre-existing texture object.
-    if (inParams->mTexture)
-    {
-        return;
-    }
+    [inDirectory retain];
+    [mPersistentCacheDirectory release];
     
-    mCacheSize += [inTexture GetSizeBytes];
+    mPersistentCacheDirectory = inDirectory;
     
-    if (mCacheSize > CACHE_EVICT_BEGIN_WATERMARK)
+    if (mPersistentCacheDirectory != NULL)
     {
-        [self EvictCacheToWatermark];
+        [[NSFileManager defaultManager] createDirectoryAtPath:mPersistentCacheDirectory withIntermediateDirectories:TRUE attributes:NULL error:NULL];
     }
+}
+
+-(NSString*)CacheKeyForParams:(TextTextureParams*)inParams fontNode:(FontNode*)inFontNode
+{
+    // Every input in TextTextureParams except mTexture has to be part of the key.  Font names are case insensitive, like
+    // the ResourceManager's lookups, and are length prefixed.  The string goes last so no string can be mistaken for
+    // another set of parameters.
+    //
+    // I don't think it's necessary that two entries have the same owning texture.  Textures that are loaded into a
+    // caller's texture object aren't cached at all.
+    NSString* fontName = (inParams->mFontName != NULL) ? [inParams->mFontName lowercaseString] : @"";
+    
+    return [NSString stringWithFormat:@"%u:%@|%016llx|%u|%08x|%08x|%u|%u|%u|%u|%u|%u|%d|%p|%@",
+                [fontName length], fontName, inFontNode->mFontDataHash, inParams->mPointSize, inParams->mColor, inParams->mStrokeColor,
+                inParams->mWidth, inParams->mLeadWidth, inParams->mLeadHeight, inParams->mTrailWidth, inParams->mTrailHeight,
+                inParams->mStrokeSize, inParams->mPremultipliedAlpha ? 1 : 0, inParams->mTextureAtlas, inParams->mString];
+}
+
+-(void)AddToCache:(Texture*)inTexture withParams:(TextTextureParams*)inParams key:(NSString*)inKey
+{
+    NSAssert([mTextureCache objectForKey:inKey] == NULL, @"Item is already in cache");
     
     TextTextureBuilderCacheEntry* newEntry = [TextTextureBuilderCacheEntry alloc];
     
-    memcpy(&newEntry->mParams, inParams, sizeof(TextTextureParams));
-    [newEntry->mParams.mFontName retain];
-    [newEntry->mParams.mString retain];
+    newEntry->mKey = [inKey retain];
+    newEntry->mTexture = [inTexture retain];
     
-    [inTexture retain];
+    newEntry->mStartX = inParams->mStartX;
+    newEntry->mStartY = inParams->mStartY;
+    newEntry->mEndX = inParams->mEndX;
+    newEntry->mEndY = inParams->mEndY;
     
-    newEntry->mTexture = inTexture;
-    newEntry->mLastUsedTime = CFAbsoluteTimeGetCurrent();
+    // Add to the front of the list as the most recently used text texture.
+    newEntry->mPrev = NULL;
+    newEntry->mNext = mCacheHead;
     
-    // Add to the top of the list as the most recently used text texture.
-    [mTextureCache insertObject:newEntry atIndex:0];
-}
-
--(BOOL)CompareParams:(TextTextureParams*)inLeftParams withParams:(TextTextureParams*)inRightParams
-{
-    NSAssert(   sizeof(TextTextureParams) == TEXT_TEXTURE_PARAMS_SIZE, 
-                @"Fields were modified in the TextTextureParams structure.  We need to modify the comparison below."    );
-    
-    if ([inLeftParams->mFontName caseInsensitiveCompare:inRightParams->mFontName] != NSOrderedSame)
+    if (mCacheHead != NULL)
     {
-        return FALSE;
+        mCacheHead->mPrev = newEntry;
     }
     
-    if ([inLeftParams->mString caseInsensitiveCompare:inRightParams->mString] != NSOrderedSame)
+    mCacheHead = newEntry;
+    
+    if (mCacheTail == NULL)
     {
-        return FALSE;
+        mCacheTail = newEntry;
     }
     
-    if (    (inLeftParams->mPointSize != inRightParams->mPointSize) ||
-            (inLeftParams->mColor != inRightParams->mColor) ||
-            (inLeftParams->mWidth != inRightParams->mWidth) ||
-            (inLeftParams->mLeadWidth != inRightParams->mLeadWidth) ||
-            (inLeftParams->mLeadHeight != inRightParams->mLeadHeight) ||
-            (inLeftParams->mTrailWidth != inRightParams->mTrailWidth) ||
-            (inLeftParams->mTrailHeight != inRightParams->mTrailHeight) ||
-            (inLeftParams->mStrokeSize != inRightParams->mStrokeSize) ||
-            (inLeftParams->mStrokeColor != inRightParams->mStrokeColor) ||
-            (inLeftParams->mPremultipliedAlpha != inRightParams->mPremultipliedAlpha) ||
-            (inLeftParams->mTextureAtlas != inRightParams->mTextureAtlas)
-            //
-            // I don't think it's necessary that two entries have the same owning texture.
-            // One caller could have specified no owning texture, the other caller could have specified
-            // a particular texture that the Text string should be loaded into.  There's no reason that
-            // the same texture object can't be used for both as far as I can tell.
-            //
-            //(inLeftParams->mTexture != inRightParams->mTexture)
-            )
+    [mTextureCache setObject:newEntry forKey:inKey];
+    [newEntry release];
+    
+    mCacheSize += [inTexture GetSizeBytes];
+    
+    if (mCacheSize > CACHE_EVICT_BEGIN_WATERMARK)
     {
-        return FALSE;
+        [self EvictCacheToWatermark];
     }
-    
-    return TRUE;
 }
 
--(Texture*)LookupInCache:(TextTextureParams*)inParams
+-(Texture*)LookupInCache:(TextTextureParams*)inParams key:(NSString*)inKey
 {
-    for (TextTextureBuilderCacheEntry* curEntry in mTextureCache)
+    TextTextureBuilderCacheEntry* entry = [mTextureCache objectForKey:inKey];
+    
+    if (entry == NULL)
     {
-        if ([self CompareParams:inParams withParams:&curEntry->mParams])
+        return NULL;
+    }
+    
+    // Copy the output parameters that we cached last time
+    inParams->mStartX = entry->mStartX;
+    inParams->mStartY = entry->mStartY;
+    inParams->mEndX = entry->mEndX;
+    inParams->mEndY = entry->mEndY;
+    
+    // Move to the front of the list as the most recently used texture.
+    if (entry != mCacheHead)
+    {
+        entry->mPrev->mNext = entry->mNext;
+        
+        if (entry->mNext != NULL)
         {
-            // Copy the output parameters that we cached last time
-            inParams->mStartX = curEntry->mParams.mStartX;
-            inParams->mStartY = curEntry->mParams.mStartY;
-            inParams->mEndX = curEntry->mParams.mEndX;
-            inParams->mEndY = curEntry->mParams.mEndY;
-            
-            // Update the last time this texture was used, it moves to the
-            // top of the list as the most recently used texture.
-            curEntry->mLastUsedTime = CFAbsoluteTimeGetCurrent();
-            
-            [mTextureCache removeObject:curEntry];
-            [mTextureCache insertObject:curEntry atIndex:0];
-            
-            return curEntry->mTexture;
+            entry->mNext->mPrev = entry->mPrev;
+        }
+        else
+        {
+            mCacheTail = entry->mPrev;
         }
+        
+        entry->mPrev = NULL;
+        entry->mNext = mCacheHead;
+        
+        mCacheHead->mPrev = entry;
+        mCacheHead = entry;
     }
     
-    return NULL;
+    return entry->mTexture;
 }
 
 -(void)EvictCacheToWatermark
 {
-    while(mCacheSize > CACHE_EVICT_END_WATERMARK)
+    // The most recent entry always stays, it was just handed out
+    while ((mCacheSize > CACHE_EVICT_END_WATERMARK) && (mCacheTail != mCacheHead))
     {
-        TextTextureBuilderCacheEntry* curEntry = [mTextureCache objectAtIndex:0];
+        TextTextureBuilderCacheEntry* curEntry = mCacheTail;
         
-        [mTextureCache removeObjectAtIndex:0];
+        mCacheTail = curEntry->mPrev;
+        mCacheTail->mNext = NULL;
         
         mCacheSize -= [curEntry->mTexture GetSizeBytes];
         
-        [curEntry->mTexture release];
-        [curEntry->mParams.mFontName release];
-        [curEntry->mParams.mString release];
-        
-        [curEntry release];
+        [mTextureCache removeObjectForKey:curEntry->mKey];
+    }
+}
+
+-(NSString*)PersistentCachePathForKey:(NSString*)inKey
+{
+    const char* key = [inKey UTF8String];
+    u64 hash = HashBytes((const u8*)key, strlen(key));
+    
+    return [mPersistentCacheDirectory stringByAppendingPathComponent:[NSString stringWithFormat:@"%016llx.textcache", hash]];
+}
+
+-(Texture*)LoadPersistentTexture:(TextTextureParams*)inParams key:(NSString*)inKey
+{
+    // Atlas subtextures can't be recreated from a file, the atlas pointer in their key is only valid for this run
+    if ((mPersistentCacheDirectory == NULL) || (inParams->mTextureAtlas != NULL))
+    {
+        return NULL;
+    }
+    
+    NSData* fileData = [NSData dataWithContentsOfFile:[self PersistentCachePathForKey:inKey]];
+    
+    if ([fileData length] < sizeof(TextCacheFileHeader))
+    {
+        return NULL;
+    }
+    
+    TextCacheFileHeader header;
+    memcpy(&header, [fileData bytes], sizeof(TextCacheFileHeader));
+    
+    const char* key = [inKey UTF8String];
+    u32 keyLength = strlen(key);
+    
+    const u8* fileKey = (const u8*)[fileData bytes] + sizeof(TextCacheFileHeader);
+    u32 texelSize = header.mGLWidth * header.mGLHeight * sizeof(u32);
+    
+    // Anything that doesn't match exactly, including a hash collision, is just a miss
+    if (    (header.mMagicNumber != TEXT_CACHE_FILE_MAGIC_NUMBER) || (header.mVersion != TEXT_CACHE_FILE_VERSION) ||
+            (header.mKeyLength != keyLength) || ([fileData length] != (sizeof(TextCacheFileHeader) + keyLength + texelSize)) ||
+            (memcmp(fileKey, key, keyLength) != 0)  )
+    {
+        return NULL;
+    }
+    
+    Texture* newTexture = [Texture alloc];
+    [newTexture Init];
+    
+    newTexture->mTexBytes = malloc(texelSize);
+    memcpy(newTexture->mTexBytes, fileKey + keyLength, texelSize);
+    
+    newTexture->mWidth = header.mGLWidth;
+    newTexture->mHeight = header.mGLHeight;
+    
+    [newTexture CreateGLTexture];
+    
+    newTexture->mWidth = header.mWidth;
+    newTexture->mHeight = header.mHeight;
+    
+    newTexture->mDebugName = inParams->mString;
+    [newTexture->mDebugName retain];
+    
+    newTexture->mPremultipliedAlpha = inParams->mPremultipliedAlpha;
+    
+    inParams->mStartX = header.mStartX;
+    inParams->mStartY = header.mStartY;
+    inParams->mEndX = header.mEndX;
+    inParams->mEndY = header.mEndY;
+    
+    return [newTexture autorelease];
+}
+
+-(void)SavePersistentTexture:(Texture*)inTexture params:(TextTextureParams*)inParams key:(NSString*)inKey
+{
+    // Textures that dispose of their texels once they're uploaded have nothing left to save
+    if ((mPersistentCacheDirectory == NULL) || (inParams->mTextureAtlas != NULL) || (inTexture->mTexBytes == NULL))
+    {
+        return;
     }
+    
+    const char* key = [inKey UTF8String];
+    
+    TextCacheFileHeader header;
+    
+    header.mMagicNumber = TEXT_CACHE_FILE_MAGIC_NUMBER;
+    header.mVersion = TEXT_CACHE_FILE_VERSION;
+    header.mKeyLength = strlen(key);
+    
+    header.mWidth = inTexture->mWidth;
+    header.mHeight = inTexture->mHeight;
+    header.mGLWidth = inTexture->mGLWidth;
+    header.mGLHeight = inTexture->mGLHeight;
+    
+    header.mStartX = inParams->mStartX;
+    header.mStartY = inParams->mStartY;
+    header.mEndX = inParams->mEndX;
+    header.mEndY = inParams->mEndY;
+    
+    NSMutableData* fileData = [NSMutableData dataWithCapacity:sizeof(TextCacheFileHeader) + header.mKeyLength + (header.mGLWidth * header.mGLHeight * sizeof(u32))];
+    
+    [fileData appendBytes:&header length:sizeof(TextCacheFileHeader)];
+    [fileData appendBytes:key length:header.mKeyLength];
+    [fileData appendBytes:inTexture->mTexBytes length:header.mGLWidth * header.mGLHeight * sizeof(u32)];
+    
+    // The cache is only an optimization, failing to write it is harmless
+    [fileData writeToFile:[self PersistentCachePathForKey:inKey] atomically:TRUE];
 }
 
 @end
\ No newline at end of file
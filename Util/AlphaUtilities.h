@@ -0,0 +1,16 @@
+//
+//  AlphaUtilities.h
+//  Neon21
+//
+//  Copyright Neon Games 2010. All rights reserved.
+//
+
+// Premultiplied alpha conversions for 8 bit RGBA pixels (R, G, B, A in memory order).  Everything
+// that premultiplies should come through here so the rounding is identical across operations.
+//
+// Premultiply computes round(c * a / 255) exactly, using SSE2 where it's available.  Unpremultiply
+// computes min(255, round(c * 255 / a)) from a reciprocal table.  Pixels with zero alpha are left
+// as zero.  All functions are safe to call from any thread.
+
+void PremultiplyAlphaRGBA8(u8* ioPixels, u32 inNumPixels);
+void UnpremultiplyAlphaRGBA8(u8* ioPixels, u32 inNumPixels);
@@ -0,0 +1,124 @@
+//
+//  AlphaUtilities.m
+//  Neon21
+//
+//  Copyright Neon Games 2010. All rights reserved.
+//
+
+#import "AlphaUtilities.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <dispatch/dispatch.h>
+
+#define ALPHA_BYTES_PER_PIXEL       (4)
+#define ALPHA_RECIPROCAL_SHIFT      (16)
+
+static u32 sUnpremultiplyReciprocals[256];
+
+// (t + (t >> 8)) >> 8 with t = c * a + 128 is exactly (c * a + 127) / 255 for all 8 bit c and a
+static inline u8 PremultiplyChannel(u32 inChannel, u32 inAlpha)
+{
+    u32 t = (inChannel * inAlpha) + 128;
+    return (u8)((t + (t >> 8)) >> 8);
+}
+
+static void PremultiplyAlphaScalar(u8* ioPixels, u32 inNumPixels)
+{
+    for (u32 curPixel = 0; curPixel < inNumPixels; curPixel++)
+    {
+        u8* pixel = &ioPixels[curPixel * ALPHA_BYTES_PER_PIXEL];
+        u32 alpha = pixel[3];
+        
+        pixel[0] = PremultiplyChannel(pixel[0], alpha);
+        pixel[1] = PremultiplyChannel(pixel[1], alpha);
+        pixel[2] = PremultiplyChannel(pixel[2], alpha);
+    }
+}
+
+#if defined(__SSE2__)
+
+// Four pixels per iteration.  Each half is widened to 16 bits, multiplied by its broadcast alpha and
+// reduced with the same shift trick as the scalar path.  The products fit in 16 bits so mullo is exact.
+static u32 PremultiplyAlphaSSE2(u8* ioPixels, u32 inNumPixels)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bias = _mm_set1_epi16(128);
+    const __m128i alphaMask = _mm_set1_epi32(0xFF000000);
+    
+    u32 numVectorPixels = inNumPixels & ~3;
+    
+    for (u32 curPixel = 0; curPixel < numVectorPixels; curPixel += 4)
+    {
+        __m128i* address = (__m128i*)&ioPixels[curPixel * ALPHA_BYTES_PER_PIXEL];
+        __m128i pixels = _mm_loadu_si128(address);
+        
+        __m128i lo = _mm_unpacklo_epi8(pixels, zero);
+        __m128i hi = _mm_unpackhi_epi8(pixels, zero);
+        
+        __m128i alphaLo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+        __m128i alphaHi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+        
+        lo = _mm_add_epi16(_mm_mullo_epi16(lo, alphaLo), bias);
+        hi = _mm_add_epi16(_mm_mullo_epi16(hi, alphaHi), bias);
+        
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+        
+        // The alpha lanes were multiplied too, put the originals back
+        __m128i result = _mm_packus_epi16(lo, hi);
+        result = _mm_or_si128(_mm_andnot_si128(alphaMask, result), _mm_and_si128(alphaMask, pixels));
+        
+        _mm_storeu_si128(address, result);
+    }
+    
+    return numVectorPixels;
+}
+
+#endif
+
+void PremultiplyAlphaRGBA8(u8* ioPixels, u32 inNumPixels)
+{
+    u32 numProcessed = 0;
+    
+#if defined(__SSE2__)
+    numProcessed = PremultiplyAlphaSSE2(ioPixels, inNumPixels);
+#endif
+
+    PremultiplyAlphaScalar(&ioPixels[numProcessed * ALPHA_BYTES_PER_PIXEL], inNumPixels - numProcessed);
+}
+
+static void InitUnpremultiplyReciprocals(void* inContext)
+{
+    sUnpremultiplyReciprocals[0] = 0;
+    
+    // 16.16 fixed point 255 / a, rounded up so that exact halves still round up.  With that, (c * reciprocal + 0.5) >> 16
+    // matches round(c * 255 / a) for every 8 bit c and a.
+    for (u32 alpha = 1; alpha < 256; alpha++)
+    {
+        sUnpremultiplyReciprocals[alpha] = ((255 << ALPHA_RECIPROCAL_SHIFT) + (alpha - 1)) / alpha;
+    }
+}
+
+void UnpremultiplyAlphaRGBA8(u8* ioPixels, u32 inNumPixels)
+{
+    static dispatch_once_t sInitReciprocals;
+    dispatch_once_f(&sInitReciprocals, NULL, InitUnpremultiplyReciprocals);
+    
+    const u32 round = 1 << (ALPHA_RECIPROCAL_SHIFT - 1);
+    
+    for (u32 curPixel = 0; curPixel < inNumPixels; curPixel++)
+    {
+        u8* pixel = &ioPixels[curPixel * ALPHA_BYTES_PER_PIXEL];
+        u32 reciprocal = sUnpremultiplyReciprocals[pixel[3]];
+        
+        // Filters can leave color slightly above alpha, so clamp rather than wrap
+        for (int channel = 0; channel < 3; channel++)
+        {
+            u32 value = ((pixel[channel] * reciprocal) + round) >> ALPHA_RECIPROCAL_SHIFT;
+            pixel[channel] = (u8)min(value, 255);
+        }
+    }
+}
@@ -0,0 +1,19 @@
+//
+//  JSONUtilities.h
+//  Neon21
+//
+//  Copyright Neon Games 2010. All rights reserved.
+//
+
+// Minimal JSON reader and writer for manifests and other tool input (the 10.6 SDK has no NSJSONSerialization).
+//
+// Objects become NSDictionary, arrays NSArray, strings NSString, numbers and booleans NSNumber and null
+// NSNull.  Everything returned is autoreleased.  On failure NULL is returned, and if outError is non-NULL
+// it's set to a description of the problem including the line it occurred on.  Safe to call from any thread.
+
+NSObject* JSONObjectFromData(NSData* inData, NSString** outError);
+NSObject* JSONObjectFromFile(NSString* inPath, NSString** outError);
+
+// Writes compact JSON for the same set of classes.  Dictionary keys must be strings.  Returns NULL if anything
+// else is encountered.
+NSData* JSONDataFromObject(NSObject* inObject);
@@ -0,0 +1,712 @@
+//
+//  JSONUtilities.m
+//  Neon21
+//
+//  Copyright Neon Games 2010. All rights reserved.
+//
+
+#import "JSONUtilities.h"
+
+#define JSON_MAX_DEPTH  (64)
+
+typedef struct
+{
+    const u8*   mBytes;
+    u32         mLength;
+    u32         mOffset;
+    u32         mLine;
+    u32         mDepth;
+    NSString*   mError;
+} JSONReadContext;
+
+static NSObject* JSONReadValue(JSONReadContext* inContext);
+
+static void JSONSetError(JSONReadContext* inContext, NSString* inError)
+{
+    // Keep the innermost error, it's the one closest to the actual problem
+    if (inContext->mError == NULL)
+    {
+        inContext->mError = [NSString stringWithFormat:@"Line %u: %@", inContext->mLine, inError];
+    }
+}
+
+static void JSONSkipWhitespace(JSONReadContext* inContext)
+{
+    while (inContext->mOffset < inContext->mLength)
+    {
+        u8 curChar = inContext->mBytes[inContext->mOffset];
+        
+        if (curChar == '\n')
+        {
+            inContext->mLine++;
+        }
+        else if ((curChar != ' ') && (curChar != '\t') && (curChar != '\r'))
+        {
+            break;
+        }
+        
+        inContext->mOffset++;
+    }
+}
+
+static BOOL JSONMatchLiteral(JSONReadContext* inContext, const char* inLiteral)
+{
+    u32 length = strlen(inLiteral);
+    
+    if (((inContext->mLength - inContext->mOffset) < length) || (memcmp(&inContext->mBytes[inContext->mOffset], inLiteral, length) != 0))
+    {
+        return FALSE;
+    }
+    
+    inContext->mOffset += length;
+    
+    return TRUE;
+}
+
+static BOOL JSONReadHex4(JSONReadContext* inContext, u32* outValue)
+{
+    if ((inContext->mLength - inContext->mOffset) < 4)
+    {
+        return FALSE;
+    }
+    
+    u32 value = 0;
+    
+    for (int i = 0; i < 4; i++)
+    {
+        u8 curChar = inContext->mBytes[inContext->mOffset++];
+        
+        value <<= 4;
+        
+        if ((curChar >= '0') && (curChar <= '9'))
+        {
+            value |= curChar - '0';
+        }
+        else if ((curChar >= 'a') && (curChar <= 'f'))
+        {
+            value |= curChar - 'a' + 10;
+        }
+        else if ((curChar >= 'A') && (curChar <= 'F'))
+        {
+            value |= curChar - 'A' + 10;
+        }
+        else
+        {
+            return FALSE;
+        }
+    }
+    
+    *outValue = value;
+    
+    return TRUE;
+}
+
+static u32 JSONEncodeUTF8(u32 inCodePoint, u8* outBytes)
+{
+    if (inCodePoint < 0x80)
+    {
+        outBytes[0] = inCodePoint;
+        return 1;
+    }
+    else if (inCodePoint < 0x800)
+    {
+        outBytes[0] = 0xC0 | (inCodePoint >> 6);
+        outBytes[1] = 0x80 | (inCodePoint & 0x3F);
+        return 2;
+    }
+    else if (inCodePoint < 0x10000)
+    {
+        outBytes[0] = 0xE0 | (inCodePoint >> 12);
+        outBytes[1] = 0x80 | ((inCodePoint >> 6) & 0x3F);
+        outBytes[2] = 0x80 | (inCodePoint & 0x3F);
+        return 3;
+    }
+    
+    outBytes[0] = 0xF0 | (inCodePoint >> 18);
+    outBytes[1] = 0x80 | ((inCodePoint >> 12) & 0x3F);
+    outBytes[2] = 0x80 | ((inCodePoint >> 6) & 0x3F);
+    outBytes[3] = 0x80 | (inCodePoint & 0x3F);
+    return 4;
+}
+
+static NSString* JSONReadString(JSONReadContext* inContext)
+{
+    // Skip the opening quote
+    inContext->mOffset++;
+    
+    // Unescaped strings are copied straight out of the input, only escapes need the scratch buffer
+    u32 start = inContext->mOffset;
+    BOOL escaped = FALSE;
+    
+    while (inContext->mOffset < inContext->mLength)
+    {
+        u8 curChar = inContext->mBytes[inContext->mOffset];
+        
+        if ((curChar == '"') || (curChar == '\\'))
+        {
+            escaped = (curChar == '\\');
+            break;
+        }
+        else if (curChar < 0x20)
+        {
+            JSONSetError(inContext, @"Control character in string");
+            return NULL;
+        }
+        
+        inContext->mOffset++;
+    }
+    
+    if (inContext->mOffset >= inContext->mLength)
+    {
+        JSONSetError(inContext, @"Unterminated string");
+        return NULL;
+    }
+    
+    if (!escaped)
+    {
+        NSString* retVal = [[NSString alloc] initWithBytes:&inContext->mBytes[start] length:(inContext->mOffset - start) encoding:NSUTF8StringEncoding];
+        inContext->mOffset++;
+        
+        if (retVal == NULL)
+        {
+            JSONSetError(inContext, @"String is not valid UTF-8");
+        }
+        
+        return [retVal autorelease];
+    }
+    
+    // Escapes never expand, so the rest of the input is an upper bound on the unescaped length
+    NSMutableData* buffer = [NSMutableData dataWithLength:(inContext->mLength - start)];
+    u8* out = [buffer mutableBytes];
+    u32 outLength = inContext->mOffset - start;
+    
+    memcpy(out, &inContext->mBytes[start], outLength);
+    
+    while (TRUE)
+    {
+        if (inContext->mOffset >= inContext->mLength)
+        {
+            JSONSetError(inContext, @"Unterminated string");
+            return NULL;
+        }
+        
+        u8 curChar = inContext->mBytes[inContext->mOffset++];
+        
+        if (curChar == '"')
+        {
+            break;
+        }
+        else if (curChar < 0x20)
+        {
+            JSONSetError(inContext, @"Control character in string");
+            return NULL;
+        }
+        else if (curChar != '\\')
+        {
+            out[outLength++] = curChar;
+            continue;
+        }
+        
+        if (inContext->mOffset >= inContext->mLength)
+        {
+            JSONSetError(inContext, @"Unterminated string");
+            return NULL;
+        }
+        
+        curChar = inContext->mBytes[inContext->mOffset++];
+        
+        switch (curChar)
+        {
+            case '"':   out[outLength++] = '"';     break;
+            case '\\':  out[outLength++] = '\\';    break;
+            case '/':   out[outLength++] = '/';     break;
+            case 'b':   out[outLength++] = '\b';    break;
+            case 'f':   out[outLength++] = '\f';    break;
+            case 'n':   out[outLength++] = '\n';    break;
+            case 'r':   out[outLength++] = '\r';    break;
+            case 't':   out[outLength++] = '\t';    break;
+            
+            case 'u':
+            {
+                u32 codePoint = 0;
+                
+                if (!JSONReadHex4(inContext, &codePoint))
+                {
+                    JSONSetError(inContext, @"Invalid \\u escape");
+                    return NULL;
+                }
+                
+                // Characters outside the BMP come as a surrogate pair
+                if ((codePoint >= 0xD800) && (codePoint <= 0xDBFF))
+                {
+                    u32 lowSurrogate = 0;
+                    
+                    if (!JSONMatchLiteral(inContext, "\\u") || !JSONReadHex4(inContext, &lowSurrogate) ||
+                        (lowSurrogate < 0xDC00) || (lowSurrogate > 0xDFFF))
+                    {
+                        JSONSetError(inContext, @"Unpaired UTF-16 surrogate");
+                        return NULL;
+                    }
+                    
+                    codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (lowSurrogate - 0xDC00);
+                }
+                else if ((codePoint >= 0xDC00) && (codePoint <= 0xDFFF))
+                {
+                    JSONSetError(inContext, @"Unpaired UTF-16 surrogate");
+                    return NULL;
+                }
+                
+                outLength += JSONEncodeUTF8(codePoint, &out[outLength]);
+                break;
+            }
+            
+            default:
+            {
+                JSONSetError(inContext, [NSString stringWithFormat:@"Invalid escape \\%c", curChar]);
+                return NULL;
+            }
+        }
+    }
+    
+    NSString* retVal = [[NSString alloc] initWithBytes:out length:outLength encoding:NSUTF8StringEncoding];
+    
+    if (retVal == NULL)
+    {
+        JSONSetError(inContext, @"String is not valid UTF-8");
+    }
+    
+    return [retVal autorelease];
+}
+
+static NSNumber* JSONReadNumber(JSONReadContext* inContext)
+{
+    static const int JSON_MAX_NUMBER_LENGTH = 64;
+    
+    char numberBuffer[JSON_MAX_NUMBER_LENGTH];
+    u32 numberLength = 0;
+    BOOL integer = TRUE;
+    
+    while ((inContext->mOffset < inContext->mLength) && (numberLength < (JSON_MAX_NUMBER_LENGTH - 1)))
+    {
+        u8 curChar = inContext->mBytes[inContext->mOffset];
+        
+        if ((curChar == '.') || (curChar == 'e') || (curChar == 'E'))
+        {
+            integer = FALSE;
+        }
+        else if (!(((curChar >= '0') && (curChar <= '9')) || (curChar == '-') || (curChar == '+')))
+        {
+            break;
+        }
+        
+        numberBuffer[numberLength++] = curChar;
+        inContext->mOffset++;
+    }
+    
+    numberBuffer[numberLength] = 0;
+    
+    char* end = NULL;
+    NSNumber* retVal = NULL;
+    
+    if (integer)
+    {
+        long long value = strtoll(numberBuffer, &end, 10);
+        retVal = [NSNumber numberWithLongLong:value];
+    }
+    else
+    {
+        double value = strtod(numberBuffer, &end);
+        retVal = [NSNumber numberWithDouble:value];
+    }
+    
+    if ((numberLength == 0) || (end != &numberBuffer[numberLength]))
+    {
+        JSONSetError(inContext, [NSString stringWithFormat:@"Invalid number %s", numberBuffer]);
+        return NULL;
+    }
+    
+    return retVal;
+}
+
+static NSArray* JSONReadArray(JSONReadContext* inContext)
+{
+    // Skip the opening bracket
+    inContext->mOffset++;
+    
+    NSMutableArray* retVal = [NSMutableArray arrayWithCapacity:0];
+    
+    JSONSkipWhitespace(inContext);
+    
+    if ((inContext->mOffset < inContext->mLength) && (inContext->mBytes[inContext->mOffset] == ']'))
+    {
+        inContext->mOffset++;
+        return retVal;
+    }
+    
+    while (TRUE)
+    {
+        NSObject* value = JSONReadValue(inContext);
+        
+        if (value == NULL)
+        {
+            return NULL;
+        }
+        
+        [retVal addObject:value];
+        
+        JSONSkipWhitespace(inContext);
+        
+        if (inContext->mOffset >= inContext->mLength)
+        {
+            JSONSetError(inContext, @"Unterminated array");
+            return NULL;
+        }
+        
+        u8 curChar = inContext->mBytes[inContext->mOffset++];
+        
+        if (curChar == ']')
+        {
+            break;
+        }
+        else if (curChar != ',')
+        {
+            JSONSetError(inContext, @"Expected , or ] in array");
+            return NULL;
+        }
+    }
+    
+    return retVal;
+}
+
+static NSDictionary* JSONReadObject(JSONReadContext* inContext)
+{
+    // Skip the opening brace
+    inContext->mOffset++;
+    
+    NSMutableDictionary* retVal = [NSMutableDictionary dictionaryWithCapacity:0];
+    
+    JSONSkipWhitespace(inContext);
+    
+    if ((inContext->mOffset < inContext->mLength) && (inContext->mBytes[inContext->mOffset] == '}'))
+    {
+        inContext->mOffset++;
+        return retVal;
+    }
+    
+    while (TRUE)
+    {
+        JSONSkipWhitespace(inContext);
+        
+        if ((inContext->mOffset >= inContext->mLength) || (inContext->mBytes[inContext->mOffset] != '"'))
+        {
+            JSONSetError(inContext, @"Expected a string key in object");
+            return NULL;
+        }
+        
+        NSString* key = JSONReadString(inContext);
+        
+        if (key == NULL)
+        {
+            return NULL;
+        }
+        
+        JSONSkipWhitespace(inContext);
+        
+        if ((inContext->mOffset >= inContext->mLength) || (inContext->mBytes[inContext->mOffset] != ':'))
+        {
+            JSONSetError(inContext, @"Expected : after object key");
+            return NULL;
+        }
+        
+        inContext->mOffset++;
+        
+        NSObject* value = JSONReadValue(inContext);
+        
+        if (value == NULL)
+        {
+            return NULL;
+        }
+        
+        [retVal setObject:value forKey:key];
+        
+        JSONSkipWhitespace(inContext);
+        
+        if (inContext->mOffset >= inContext->mLength)
+        {
+            JSONSetError(inContext, @"Unterminated object");
+            return NULL;
+        }
+        
+        u8 curChar = inContext->mBytes[inContext->mOffset++];
+        
+        if (curChar == '}')
+        {
+            break;
+        }
+        else if (curChar != ',')
+        {
+            JSONSetError(inContext, @"Expected , or } in object");
+            return NULL;
+        }
+    }
+    
+    return retVal;
+}
+
+static NSObject* JSONReadValue(JSONReadContext* inContext)
+{
+    JSONSkipWhitespace(inContext);
+    
+    if (inContext->mOffset >= inContext->mLength)
+    {
+        JSONSetError(inContext, @"Unexpected end of input");
+        return NULL;
+    }
+    
+    if (inContext->mDepth >= JSON_MAX_DEPTH)
+    {
+        JSONSetError(inContext, @"Nesting is too deep");
+        return NULL;
+    }
+    
+    NSObject* retVal = NULL;
+    u8 curChar = inContext->mBytes[inContext->mOffset];
+    
+    inContext->mDepth++;
+    
+    if (curChar == '{')
+    {
+        retVal = JSONReadObject(inContext);
+    }
+    else if (curChar == '[')
+    {
+        retVal = JSONReadArray(inContext);
+    }
+    else if (curChar == '"')
+    {
+        retVal = JSONReadString(inContext);
+    }
+    else if ((curChar == '-') || ((curChar >= '0') && (curChar <= '9')))
+    {
+        retVal = JSONReadNumber(inContext);
+    }
+    else if (JSONMatchLiteral(inContext, "true"))
+    {
+        retVal = [NSNumber numberWithBool:TRUE];
+    }
+    else if (JSONMatchLiteral(inContext, "false"))
+    {
+        retVal = [NSNumber numberWithBool:FALSE];
+    }
+    else if (JSONMatchLiteral(inContext, "null"))
+    {
+        retVal = [NSNull null];
+    }
+    else
+    {
+        JSONSetError(inContext, [NSString stringWithFormat:@"Unexpected character %c", curChar]);
+    }
+    
+    inContext->mDepth--;
+    
+    return retVal;
+}
+
+NSObject* JSONObjectFromData(NSData* inData, NSString** outError)
+{
+    JSONReadContext context;
+    
+    context.mBytes = [inData bytes];
+    context.mLength = [inData length];
+    context.mOffset = 0;
+    context.mLine = 1;
+    context.mDepth = 0;
+    context.mError = NULL;
+    
+    // Skip a UTF-8 byte order mark if an editor added one
+    if ((context.mLength >= 3) && (memcmp(context.mBytes, "\xEF\xBB\xBF", 3) == 0))
+    {
+        context.mOffset = 3;
+    }
+    
+    NSObject* retVal = JSONReadValue(&context);
+    
+    if (retVal != NULL)
+    {
+        JSONSkipWhitespace(&context);
+        
+        if (context.mOffset != context.mLength)
+        {
+            JSONSetError(&context, @"Unexpected data after the top level value");
+            retVal = NULL;
+        }
+    }
+    
+    if ((retVal == NULL) && (outError != NULL))
+    {
+        *outError = context.mError;
+    }
+    
+    return retVal;
+}
+
+NSObject* JSONObjectFromFile(NSString* inPath, NSString** outError)
+{
+    NSData* data = [NSData dataWithContentsOfFile:inPath];
+    
+    if (data == NULL)
+    {
+        if (outError != NULL)
+        {
+            *outError = [NSString stringWithFormat:@"Could not read %@", inPath];
+        }
+        
+        return NULL;
+    }
+    
+    return JSONObjectFromData(data, outError);
+}
+
+
+static void JSONWriteString(NSString* inString, NSMutableData* ioData)
+{
+    const u8* bytes = (const u8*)[inString UTF8String];
+    u32 length = strlen((const char*)bytes);
+    u32 runStart = 0;
+    
+    [ioData appendBytes:"\"" length:1];
+    
+    for (u32 curByte = 0; curByte < length; curByte++)
+    {
+        u8 curChar = bytes[curByte];
+        
+        if ((curChar >= 0x20) && (curChar != '"') && (curChar != '\\'))
+        {
+            continue;
+        }
+        
+        // Flush the unescaped run before this character
+        [ioData appendBytes:&bytes[runStart] length:(curByte - runStart)];
+        runStart = curByte + 1;
+        
+        char escape[8];
+        
+        switch (curChar)
+        {
+            case '"':   strcpy(escape, "\\\"");   break;
+            case '\\':  strcpy(escape, "\\\\");   break;
+            case '\n':  strcpy(escape, "\\n");    break;
+            case '\r':  strcpy(escape, "\\r");    break;
+            case '\t':  strcpy(escape, "\\t");    break;
+            default:    snprintf(escape, sizeof(escape), "\\u%04x", curChar);    break;
+        }
+        
+        [ioData appendBytes:escape length:strlen(escape)];
+    }
+    
+    [ioData appendBytes:&bytes[runStart] length:(length - runStart)];
+    [ioData appendBytes:"\"" length:1];
+}
+
+static BOOL JSONWriteValue(NSObject* inObject, NSMutableData* ioData)
+{
+    if ([inObject isKindOfClass:[NSString class]])
+    {
+        JSONWriteString((NSString*)inObject, ioData);
+    }
+    else if ([inObject isKindOfClass:[NSNumber class]])
+    {
+        const char* string = NULL;
+        
+        // Booleans are the shared CFBoolean instances, everything else is written as a number
+        if ((CFBooleanRef)inObject == kCFBooleanTrue)
+        {
+            string = "true";
+        }
+        else if ((CFBooleanRef)inObject == kCFBooleanFalse)
+        {
+            string = "false";
+        }
+        else
+        {
+            string = [[(NSNumber*)inObject stringValue] UTF8String];
+        }
+        
+        [ioData appendBytes:string length:strlen(string)];
+    }
+    else if ([inObject isKindOfClass:[NSNull class]])
+    {
+        [ioData appendBytes:"null" length:4];
+    }
+    else if ([inObject isKindOfClass:[NSArray class]])
+    {
+        NSArray* array = (NSArray*)inObject;
+        
+        [ioData appendBytes:"[" length:1];
+        
+        for (int curIndex = 0; curIndex < [array count]; curIndex++)
+        {
+            if (curIndex != 0)
+            {
+                [ioData appendBytes:"," length:1];
+            }
+            
+            if (!JSONWriteValue([array objectAtIndex:curIndex], ioData))
+            {
+                return FALSE;
+            }
+        }
+        
+        [ioData appendBytes:"]" length:1];
+    }
+    else if ([inObject isKindOfClass:[NSDictionary class]])
+    {
+        NSDictionary* dictionary = (NSDictionary*)inObject;
+        BOOL first = TRUE;
+        
+        [ioData appendBytes:"{" length:1];
+        
+        for (NSObject* key in dictionary)
+        {
+            if (![key isKindOfClass:[NSString class]])
+            {
+                return FALSE;
+            }
+            
+            if (!first)
+            {
+                [ioData appendBytes:"," length:1];
+            }
+            
+            first = FALSE;
+            
+            JSONWriteString((NSString*)key, ioData);
+            [ioData appendBytes:":" length:1];
+            
+            if (!JSONWriteValue([dictionary objectForKey:key], ioData))
+            {
+                return FALSE;
+            }
+        }
+        
+        [ioData appendBytes:"}" length:1];
+    }
+    else
+    {
+        return FALSE;
+    }
+    
+    return TRUE;
+}
+
+NSData* JSONDataFromObject(NSObject* inObject)
+{
+    NSMutableData* data = [NSMutableData dataWithCapacity:0];
+    
+    if (!JSONWriteValue(inObject, data))
+    {
+        return NULL;
+    }
+    
+    return data;
+}
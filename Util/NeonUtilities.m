@@ -8,6 +8,7 @@
 #import "NeonUtilities.h"
 #import "NeonTypes.h"
 #import "PNGUtilities.h"
+#import "Trace.h"
 #import "png.h"
 
 void NeonGLError()
@@ -208,6 +209,9 @@ void SaveScreenRect(NSString* inFilename, int inWidth, int inHeight)
 
 void SaveScreenRectMemory(unsigned char* inBuffer, int inWidth, int inHeight)
 {
+    TRACE_SCOPE("GPU Readback");
+    TRACE_COUNT(TRACE_COUNTER_BYTES_READ, inWidth * inHeight * 4);
+    
     glReadPixels(0, 0, inWidth, inHeight, GL_RGBA, GL_UNSIGNED_BYTE, inBuffer);
 }
 
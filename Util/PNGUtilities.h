@@ -14,9 +14,63 @@ typedef struct
     u32*    mImageData;
 } PNGInfo;
 
+typedef enum
+{
+    PNG_ENCODE_MODE_DEFAULT,
+    PNG_ENCODE_MODE_FAST,       // Intermediate files.  Light compression, single cheap filter.
+    PNG_ENCODE_MODE_MAX,        // Shipping assets.  Best compression, all filters considered.
+    PNG_ENCODE_MODE_NUM
+} PNGEncodeMode;
+
+typedef struct
+{
+    int     mCompressionLevel;  // zlib compression level (0-9)
+    int     mMemLevel;          // zlib memory level (1-9)
+    int     mStrategy;          // zlib strategy (Z_DEFAULT_STRATEGY, Z_FILTERED, Z_RLE...)
+    int     mFilters;           // Mask of PNG_FILTER_* values that libpng may choose from per row
+    BOOL    mReportStats;       // Print the encoded size and encode time for each file
+    BOOL    mParallel;          // Large images are deflated in bands across all cores (see ParallelPNGEncoder.h)
+} PNGWriteParams;
+
+typedef struct
+{
+    u32     mEncodedSize;
+    double  mEncodeTime;        // In seconds
+} PNGWriteStats;
+
+// ReadPNG goes through the ResourceManager and must only be called from the main thread.  The other
+// read and write functions keep all of their state per call and can be used from any thread.
+
 BOOL ReadPNG(NSString* inFilename, TexAddressing inAddressing, PNGInfo* outInfo);
+BOOL ReadPNGFile(NSString* inFilename, TexAddressing inAddressing, PNGInfo* outInfo);
 BOOL ReadPNGBytes(unsigned char* inBytes, TexAddressing inAddressing, PNGInfo* outInfo);
+BOOL ReadPNGBytesWithLength(unsigned char* inBytes, u32 inLength, TexAddressing inAddressing, PNGInfo* outInfo);
 BOOL ReadPNGData(NSData* inData, TexAddressing inAddressing, PNGInfo* outInfo);
 
-void WritePNG(unsigned char* inImageData, NSString* inFilename, int inWidth, int inHeight);
-void WritePNGMemory(unsigned char* inImageData, int inWidth, int inHeight, unsigned char** outPNGData, u32* outPNGDataSize);
\ No newline at end of file
+void InitDefaultPNGWriteParams(PNGWriteParams* outParams);
+void InitPNGWriteParamsWithMode(PNGWriteParams* outParams, PNGEncodeMode inMode);
+
+// The mode used by WritePNG and WritePNGMemory.  Set once at startup.
+void SetDefaultPNGEncodeMode(PNGEncodeMode inMode);
+PNGEncodeMode GetDefaultPNGEncodeMode();
+BOOL PNGEncodeModeFromString(const char* inString, PNGEncodeMode* outMode);
+
+// Whether newly initialized PNGWriteParams print stats for each file.  Off by default, set once at startup.
+void SetPNGReportStats(BOOL inReportStats);
+
+BOOL WritePNG(unsigned char* inImageData, NSString* inFilename, int inWidth, int inHeight);
+BOOL WritePNGMemory(unsigned char* inImageData, int inWidth, int inHeight, unsigned char** outPNGData, u32* outPNGDataSize);
+
+// inImageData is encoded in place (no copy is made), outStats may be NULL.  Memory output is allocated
+// with malloc and grows as needed.
+BOOL WritePNGWithParams(unsigned char* inImageData, NSString* inFilename, int inWidth, int inHeight, PNGWriteParams* inParams, PNGWriteStats* outStats);
+BOOL WritePNGMemoryWithParams(  unsigned char* inImageData, int inWidth, int inHeight, unsigned char** outPNGData, u32* outPNGDataSize,
+                                PNGWriteParams* inParams, PNGWriteStats* outStats);
+
+// Called on every row as it streams through TransformPNGFile.  ioRow is 8 bit RGBA and may be modified in place.
+typedef void (*PNGRowTransform)(u8* ioRow, u32 inWidth, void* inContext);
+
+// Decodes inInputFile a band of rows at a time, runs inTransform over each row and encodes the result to inOutputFile.
+// Only a few rows are resident at once (interlaced inputs are the exception).  Safe to call from any thread.
+BOOL TransformPNGFile(  NSString* inInputFile, NSString* inOutputFile, PNGRowTransform inTransform, void* inTransformContext,
+                        PNGWriteParams* inParams, PNGWriteStats* outStats);
@@ -6,43 +6,59 @@
 //
 
 #import "PNGUtilities.h"
+#import "ParallelPNGEncoder.h"
 #import "png.h"
 
 #import "ResourceManager.h"
+#import "MappedData.h"
+#import "Trace.h"
+
+// Each encode and decode gets its own context, nothing here is shared between calls.  This lets
+// worker threads read and write PNGs at the same time.
 
 typedef struct
 {
-    unsigned char*  mBuffer;
-    u32             mBufferOffset;
-    u32             mBufferSize;
-} PNGContext;
-
-static PNGContext* sCurPNGContext = NULL;
+    const u8*   mBuffer;
+    u32         mBufferOffset;
+    u32         mBufferSize;
+} PNGReadContext;
 
-static BOOL VerifyHeader(void* inBuffer)
+typedef struct
 {
-    BOOL valid = !png_sig_cmp(inBuffer, 0, 8);
-    return valid;
-}
+    u8*         mBuffer;
+    u32         mBufferOffset;
+    u32         mBufferSize;
+} PNGWriteContext;
 
-static void CreatePNGContext()
+// Below this the single threaded libpng path is just as fast
+#define PARALLEL_PNG_MIN_IMAGE_BYTES    (1024 * 1024)
+
+// Initial guess at the encoded size, as a fraction of the raw RGBA size.  The buffer grows if this is wrong.
+#define PNG_MEMORY_INITIAL_DIVISOR      (2)
+#define PNG_MEMORY_MIN_SIZE             (4096)
+
+static BOOL VerifyHeader(const void* inBuffer, u32 inLength)
 {
-    assert(sCurPNGContext == NULL);
-    
-    sCurPNGContext = malloc(sizeof(PNGContext));
+    if (inLength < 8)
+    {
+        return FALSE;
+    }
     
-    sCurPNGContext->mBuffer = NULL;
-    sCurPNGContext->mBufferOffset = 0;
-    sCurPNGContext->mBufferSize = 0;
+    BOOL valid = !png_sig_cmp((png_bytep)inBuffer, 0, 8);
+    return valid;
 }
 
-static void PngReadFunction(png_struct* inPngPtr, png_byte* outData, png_size_t inLength)
+static void PngReadFunction(png_structp inPngPtr, png_bytep outData, png_size_t inLength)
 {
-    u8* sourceAddr = (u8*)(inPngPtr->io_ptr);
-    memcpy(outData, sourceAddr, inLength);
+    PNGReadContext* context = (PNGReadContext*)png_get_io_ptr(inPngPtr);
     
-    sourceAddr += inLength;
-    inPngPtr->io_ptr = sourceAddr;
+    if ((context->mBufferSize - context->mBufferOffset) < inLength)
+    {
+        png_error(inPngPtr, "Read past the end of the PNG data");
+    }
+    
+    memcpy(outData, &context->mBuffer[context->mBufferOffset], inLength);
+    context->mBufferOffset += inLength;
 }
 
 BOOL ReadPNG(NSString* inFilename, TexAddressing inAddressing, PNGInfo* outInfo)
@@ -51,11 +67,11 @@ BOOL ReadPNG(NSString* inFilename, TexAddressing inAddressing, PNGInfo* outInfo)
     
     if ([inFilename isAbsolutePath])
     {
-        handle = [[ResourceManager GetInstance] LoadAssetWithPath:inFilename];
+        handle = [[ResourceManager GetInstance] LoadMappedAssetWithPath:inFilename];
     }
     else
     {
-        handle = [[ResourceManager GetInstance] LoadAssetWithName:inFilename];
+        handle = [[ResourceManager GetInstance] LoadMappedAssetWithName:inFilename];
     }
     
     NSData* data = [[ResourceManager GetInstance] GetDataForHandle:handle];
@@ -67,19 +83,43 @@ BOOL ReadPNG(NSString* inFilename, TexAddressing inAddressing, PNGInfo* outInfo)
     return retVal;
 }
 
-BOOL ReadPNGData(NSData* inData, TexAddressing inAddressing, PNGInfo* outInfo)
+BOOL ReadPNGFile(NSString* inFilename, TexAddressing inAddressing, PNGInfo* outInfo)
 {
-    void* buffer = (void*)[inData bytes];
+    NSData* data = [[MappedData alloc] InitWithPath:inFilename advice:MAPPED_DATA_ADVICE_SEQUENTIAL];
     
-    return ReadPNGBytes(buffer, inAddressing, outInfo);
+    if (data == NULL)
+    {
+        return FALSE;
+    }
+    
+    BOOL retVal = ReadPNGData(data, inAddressing, outInfo);
+    
+    [data release];
+    
+    return retVal;
+}
+
+BOOL ReadPNGData(NSData* inData, TexAddressing inAddressing, PNGInfo* outInfo)
+{
+    return ReadPNGBytesWithLength((unsigned char*)[inData bytes], [inData length], inAddressing, outInfo);
 }
 
 BOOL ReadPNGBytes(unsigned char* inBytes, TexAddressing inAddressing, PNGInfo* outInfo)
-{    
-    void* buffer = inBytes;
+{
+    // Callers that don't know the length get no bounds checking beyond what the PNG itself describes
+    return ReadPNGBytesWithLength(inBytes, UINT_MAX, inAddressing, outInfo);
+}
+
+BOOL ReadPNGBytesWithLength(unsigned char* inBytes, u32 inLength, TexAddressing inAddressing, PNGInfo* outInfo)
+{
+    TRACE_SCOPE("PNG Decode");
+    
+    outInfo->mWidth = 0;
+    outInfo->mHeight = 0;
+    outInfo->mImageData = NULL;
     
     // Verify the header information
-    BOOL valid = VerifyHeader(buffer);
+    BOOL valid = VerifyHeader(inBytes, inLength);
     
     if (!valid)
     {
@@ -89,12 +129,29 @@ BOOL ReadPNGBytes(unsigned char* inBytes, TexAddressing inAddressing, PNGInfo* o
     // Create the read struct that libpng uses for maintaing its state information
     png_struct* readStruct = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
     
+    if (readStruct == NULL)
+    {
+        return FALSE;
+    }
+    
     // Create the info struct that libpng uses for other state information
     png_info* infoStruct = png_create_info_struct(readStruct);
     png_info* endInfoStruct = png_create_info_struct(readStruct);
+    
+    PNGReadContext context;
+    
+    context.mBuffer = inBytes;
+    context.mBufferOffset = 0;
+    context.mBufferSize = inLength;
+    
+    if ((infoStruct == NULL) || (endInfoStruct == NULL) || setjmp(png_jmpbuf(readStruct)))
+    {
+        png_destroy_read_struct(&readStruct, &infoStruct, &endInfoStruct);
+        return FALSE;
+    }
 
     // We don't want the png library doing file IO for us.  We'll supply it with data as it needs.
-    png_set_read_fn(readStruct, buffer, PngReadFunction);
+    png_set_read_fn(readStruct, &context, PngReadFunction);
     
     // Actually read the png
     png_read_png(readStruct, infoStruct, PNG_TRANSFORM_IDENTITY, NULL);
@@ -110,6 +167,9 @@ BOOL ReadPNGBytes(unsigned char* inBytes, TexAddressing inAddressing, PNGInfo* o
     
     outInfo->mImageData = malloc(size);
     
+    TRACE_ALLOCATION(size);
+    TRACE_COUNT(TRACE_COUNTER_PIXELS_PROCESSED, infoStruct->width * infoStruct->height);
+    
     u8** rowPointers = png_get_rows(readStruct, infoStruct);
     
     outInfo->mHeight = infoStruct->height;
@@ -147,12 +207,6 @@ BOOL ReadPNGBytes(unsigned char* inBytes, TexAddressing inAddressing, PNGInfo* o
         }
     }
     
-    if (setjmp(png_jmpbuf(readStruct)))
-    {
-        assert(FALSE);
-        return FALSE;
-    }
-    
     // Have the png library free the memory associated with this read struct
     png_destroy_read_struct(&readStruct, &infoStruct, &endInfoStruct);
             
@@ -161,158 +215,539 @@ BOOL ReadPNGBytes(unsigned char* inBytes, TexAddressing inAddressing, PNGInfo* o
 
 static void WritePNGMemoryCallback(png_structp inPngPtr, png_bytep inPngData, png_size_t inDataSize)
 {
-    memcpy(sCurPNGContext->mBuffer + sCurPNGContext->mBufferOffset, inPngData, inDataSize);
-    sCurPNGContext->mBufferOffset += inDataSize;
+    PNGWriteContext* context = (PNGWriteContext*)png_get_io_ptr(inPngPtr);
+    
+    if ((context->mBufferOffset + inDataSize) > context->mBufferSize)
+    {
+        u32 newSize = max(context->mBufferSize * 2, context->mBufferOffset + inDataSize);
+        u8* newBuffer = realloc(context->mBuffer, newSize);
+        
+        if (newBuffer == NULL)
+        {
+            png_error(inPngPtr, "Out of memory growing the PNG output buffer");
+        }
+        
+        context->mBuffer = newBuffer;
+        context->mBufferSize = newSize;
+    }
+    
+    memcpy(context->mBuffer + context->mBufferOffset, inPngData, inDataSize);
+    context->mBufferOffset += inDataSize;
 }
 
 static void FlushPNGMemoryCallback(png_structp inPngPtr)
 {
 }
 
-static void InitWritePNG(FILE* inOutputFile, png_structp* outPngPtr, png_infop* outInfoPtr)
+static PNGEncodeMode sDefaultEncodeMode = PNG_ENCODE_MODE_DEFAULT;
+static BOOL sReportStats = FALSE;
+
+static const char* sEncodeModeNames[PNG_ENCODE_MODE_NUM] = { "default", "fast", "max" };
+
+void InitDefaultPNGWriteParams(PNGWriteParams* outParams)
+{
+    InitPNGWriteParamsWithMode(outParams, PNG_ENCODE_MODE_DEFAULT);
+}
+
+void InitPNGWriteParamsWithMode(PNGWriteParams* outParams, PNGEncodeMode inMode)
+{
+    // These are what libpng would pick on its own for 8-bit RGBA data
+    outParams->mCompressionLevel = Z_DEFAULT_COMPRESSION;
+    outParams->mMemLevel = 8;
+    outParams->mStrategy = Z_FILTERED;
+    outParams->mFilters = PNG_ALL_FILTERS;
+    outParams->mReportStats = sReportStats;
+    outParams->mParallel = TRUE;
+    
+    switch(inMode)
+    {
+        case PNG_ENCODE_MODE_DEFAULT:
+        {
+            break;
+        }
+        
+        case PNG_ENCODE_MODE_FAST:
+        {
+            // The sub filter followed by run length encoding gets most of the way there for
+            // a fraction of the cost of searching for matches.
+            outParams->mCompressionLevel = 1;
+            outParams->mStrategy = Z_RLE;
+            outParams->mFilters = PNG_FILTER_SUB;
+            break;
+        }
+        
+        case PNG_ENCODE_MODE_MAX:
+        {
+            outParams->mCompressionLevel = Z_BEST_COMPRESSION;
+            outParams->mMemLevel = MAX_MEM_LEVEL;
+            break;
+        }
+        
+        default:
+        {
+            NSCAssert(FALSE, @"Unknown PNG encode mode");
+            break;
+        }
+    }
+}
+
+void SetDefaultPNGEncodeMode(PNGEncodeMode inMode)
+{
+    NSCAssert((inMode >= 0) && (inMode < PNG_ENCODE_MODE_NUM), @"Invalid PNG encode mode");
+    sDefaultEncodeMode = inMode;
+}
+
+PNGEncodeMode GetDefaultPNGEncodeMode()
+{
+    return sDefaultEncodeMode;
+}
+
+void SetPNGReportStats(BOOL inReportStats)
 {
-    *outPngPtr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    sReportStats = inReportStats;
+}
+
+BOOL PNGEncodeModeFromString(const char* inString, PNGEncodeMode* outMode)
+{
+    for (int curMode = 0; curMode < PNG_ENCODE_MODE_NUM; curMode++)
+    {
+        if (strcasecmp(inString, sEncodeModeNames[curMode]) == 0)
+        {
+            *outMode = (PNGEncodeMode)curMode;
+            return TRUE;
+        }
+    }
     
-    png_structp png_ptr = *outPngPtr;
+    return FALSE;
+}
+
+static void ApplyPNGWriteParams(png_structp inPngPtr, PNGWriteParams* inParams)
+{
+    png_set_compression_level(inPngPtr, inParams->mCompressionLevel);
+    png_set_compression_mem_level(inPngPtr, inParams->mMemLevel);
+    png_set_compression_strategy(inPngPtr, inParams->mStrategy);
+    png_set_filter(inPngPtr, PNG_FILTER_TYPE_BASE, inParams->mFilters);
+}
+
+// Encodes to inFile if it's provided, otherwise into ioContext's buffer.  Everything libpng needs lives on
+// this stack frame, so any number of these can run at once.
+static BOOL EncodePNG(FILE* inFile, PNGWriteContext* ioContext, unsigned char* inImageData, int inWidth, int inHeight, PNGWriteParams* inParams)
+{
+    TRACE_SCOPE("PNG Encode");
+    TRACE_COUNT(TRACE_COUNTER_PIXELS_PROCESSED, inWidth * inHeight);
+    
+    png_structp png_ptr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
         
     if (png_ptr == NULL)
     {
-        fclose(inOutputFile);
-        
         printf("Could not allocate write struct.  Nothing was generated.\n");
-        return;
+        return FALSE;
     }
 
-    *outInfoPtr = png_create_info_struct(png_ptr);
-    
-    png_infop info_ptr = *outInfoPtr;
+    png_infop info_ptr = png_create_info_struct(png_ptr);
     
     if (info_ptr == NULL)
     {
        png_destroy_write_struct(&png_ptr, (png_infopp)NULL);
-       fclose(inOutputFile);
        
        printf("Could not allocate write info struct.  Nothing was generated.\n");
-       return;
+       return FALSE;
+    }
+    
+    // libpng only reads from the rows, so point it straight at the caller's image rather than making a copy
+    png_bytep* rowPointers = malloc(sizeof(png_bytep) * inHeight);
+    
+    for (int y = 0; y < inHeight; y++)
+    {
+        rowPointers[y] = (png_bytep)&inImageData[inWidth * y * 4];
     }
     
     if (setjmp(png_jmpbuf(png_ptr)))
     {
        png_destroy_write_struct(&png_ptr, &info_ptr);
-       fclose(inOutputFile);
+       free(rowPointers);
        
        printf("LibPng encountered an internal error.  Hopefully it generated some useful error messages.\n");
-       return;
+       return FALSE;
     }
 
-    if (inOutputFile != NULL)
+    if (inFile != NULL)
     {
-        png_init_io(png_ptr, inOutputFile);
+        png_init_io(png_ptr, inFile);
     }
     else
     {
-        png_set_write_fn(*outPngPtr, NULL, WritePNGMemoryCallback, FlushPNGMemoryCallback);
-        assert(sCurPNGContext == NULL);
+        png_set_write_fn(png_ptr, ioContext, WritePNGMemoryCallback, FlushPNGMemoryCallback);
+    }
+    
+    ApplyPNGWriteParams(png_ptr, inParams);
+    
+    png_set_IHDR(   png_ptr, info_ptr,
+                    inWidth, inHeight, 8, PNG_COLOR_TYPE_RGB_ALPHA,
+                    PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT,
+                    PNG_FILTER_TYPE_DEFAULT );
         
-        CreatePNGContext();
+    png_set_rows(png_ptr, info_ptr, rowPointers);
+    png_write_png(png_ptr, info_ptr, PNG_TRANSFORM_IDENTITY, NULL);
+    
+    png_destroy_write_struct(&png_ptr, &info_ptr);
+    free(rowPointers);
+    
+    return TRUE;
+}
+
+static BOOL ShouldEncodeParallel(int inWidth, int inHeight, PNGWriteParams* inParams)
+{
+    return inParams->mParallel && ((inWidth * inHeight * 4) >= PARALLEL_PNG_MIN_IMAGE_BYTES) && (GetParallelPNGBandCount(inWidth, inHeight) > 1);
+}
+
+static void ReportPNGWriteStats(const char* inName, PNGWriteStats* inStats)
+{
+    printf("PNG Encode:\t%s\n\t\t%u bytes, %.2f ms\n", inName, inStats->mEncodedSize, inStats->mEncodeTime * 1000.0);
+}
+
+static NSString* ResolvePNGOutputPath(NSString* inFilename)
+{
+    // Relative paths have always been taken relative to the root directory.  Resolve them here rather
+    // than changing the working directory, which would affect every other thread.
+    if (![inFilename isAbsolutePath])
+    {
+        return [@"/" stringByAppendingPathComponent:inFilename];
     }
+    
+    return inFilename;
 }
 
-static void EndWritePNG(png_structp* inPngPtr, png_infop* inInfoPtr)
+static NSString* ResolvePNGInputPath(NSString* inFilename)
 {
-    png_write_end(*inPngPtr, *inInfoPtr);
-    png_destroy_write_struct(inPngPtr, inInfoPtr);
+    // Relative inputs are asset names, the same as ReadPNG
+    if (![inFilename isAbsolutePath])
+    {
+        return [[ResourceManager GetInstance] FindAssetPathWithName:inFilename];
+    }
+    
+    return inFilename;
 }
 
-void WritePNG(unsigned char* inImageData, NSString* inFilename, int inWidth, int inHeight)
+BOOL WritePNG(unsigned char* inImageData, NSString* inFilename, int inWidth, int inHeight)
 {
-    NSString *prevWorkingDir = [[NSFileManager defaultManager] currentDirectoryPath];
-    [[NSFileManager defaultManager] changeCurrentDirectoryPath:@"/"];
+    PNGWriteParams params;
+    InitPNGWriteParamsWithMode(&params, sDefaultEncodeMode);
     
-    FILE* file = fopen([inFilename UTF8String], "w");
+    return WritePNGWithParams(inImageData, inFilename, inWidth, inHeight, &params, NULL);
+}
+
+BOOL WritePNGWithParams(unsigned char* inImageData, NSString* inFilename, int inWidth, int inHeight, PNGWriteParams* inParams, PNGWriteStats* outStats)
+{
+    CFAbsoluteTime startTime = CFAbsoluteTimeGetCurrent();
+    
+    NSString* path = ResolvePNGOutputPath(inFilename);
+    
+    FILE* file = fopen([path UTF8String], "w");
     
     if (file == NULL)
     {
-        printf("\e[1;31mCouldn't open %s for writing...aborting\e[m\n", [inFilename UTF8String]);
-        return;
+        printf("\e[1;31mCouldn't open %s for writing...aborting\e[m\n", [path UTF8String]);
+        return FALSE;
+    }
+    
+    BOOL success = FALSE;
+    
+    unsigned char* parallelData = NULL;
+    u32 parallelDataSize = 0;
+    
+    if (ShouldEncodeParallel(inWidth, inHeight, inParams) && EncodePNGParallel(inImageData, inWidth, inHeight, inParams, &parallelData, &parallelDataSize))
+    {
+        success = (fwrite(parallelData, parallelDataSize, 1, file) == 1);
+        free(parallelData);
+    }
+    else
+    {
+        success = EncodePNG(file, NULL, inImageData, inWidth, inHeight, inParams);
+    }
+    
+    PNGWriteStats stats;
+    
+    stats.mEncodedSize = ftell(file);
+    
+    fclose(file);
+    
+    TRACE_COUNT(TRACE_COUNTER_BYTES_WRITTEN, stats.mEncodedSize);
+    
+    stats.mEncodeTime = CFAbsoluteTimeGetCurrent() - startTime;
+    
+    if (inParams->mReportStats)
+    {
+        ReportPNGWriteStats([path UTF8String], &stats);
+    }
+    
+    if (outStats != NULL)
+    {
+        *outStats = stats;
     }
+    
+    return success;
+}
 
-    png_structp png_ptr = NULL;
-    png_infop info_ptr = NULL;
+BOOL WritePNGMemory(unsigned char* inImageData, int inWidth, int inHeight, unsigned char** outPNGData, u32* outPNGDataSize)
+{
+    PNGWriteParams params;
+    InitPNGWriteParamsWithMode(&params, sDefaultEncodeMode);
+    
+    return WritePNGMemoryWithParams(inImageData, inWidth, inHeight, outPNGData, outPNGDataSize, &params, NULL);
+}
+
+BOOL WritePNGMemoryWithParams(  unsigned char* inImageData, int inWidth, int inHeight, unsigned char** outPNGData, u32* outPNGDataSize,
+                                PNGWriteParams* inParams, PNGWriteStats* outStats)
+{
+    CFAbsoluteTime startTime = CFAbsoluteTimeGetCurrent();
+    
+    BOOL success = ShouldEncodeParallel(inWidth, inHeight, inParams) && EncodePNGParallel(inImageData, inWidth, inHeight, inParams, outPNGData, outPNGDataSize);
+    
+    if (!success)
+    {
+        PNGWriteContext context;
+        
+        context.mBufferSize = max((inWidth * inHeight * 4) / PNG_MEMORY_INITIAL_DIVISOR, PNG_MEMORY_MIN_SIZE);
+        context.mBuffer = malloc(context.mBufferSize);
+        context.mBufferOffset = 0;
         
-    InitWritePNG(file, &png_ptr, &info_ptr);
+        success = (context.mBuffer != NULL) && EncodePNG(NULL, &context, inImageData, inWidth, inHeight, inParams);
         
-    png_byte** imageData = malloc(sizeof(png_byte*) * inHeight);
+        if (success)
+        {
+            *outPNGData = context.mBuffer;
+            *outPNGDataSize = context.mBufferOffset;
+        }
+        else
+        {
+            free(context.mBuffer);
+            
+            *outPNGData = NULL;
+            *outPNGDataSize = 0;
+        }
+    }
     
-    png_set_IHDR(   png_ptr, info_ptr,
-                    inWidth, inHeight, 8, PNG_COLOR_TYPE_RGB_ALPHA,
-                    PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT,
-                    PNG_FILTER_TYPE_DEFAULT );
+    PNGWriteStats stats;
     
-    for (int y = 0; y < inHeight; y++)
+    stats.mEncodedSize = *outPNGDataSize;
+    stats.mEncodeTime = CFAbsoluteTimeGetCurrent() - startTime;
+    
+    if (inParams->mReportStats)
     {
-        imageData[y] = malloc(sizeof(png_byte) * inWidth * 4);
-        
-        memcpy(imageData[y], &((int*)inImageData)[inWidth * y], inWidth * 4);
+        ReportPNGWriteStats("<memory>", &stats);
     }
-        
-    png_set_rows(png_ptr, info_ptr, imageData);
-    png_write_png(png_ptr, info_ptr, PNG_TRANSFORM_IDENTITY, NULL);
     
-    for (int y = 0; y < inHeight; y++)
+    if (outStats != NULL)
     {
-        free(imageData[y]);
+        *outStats = stats;
     }
-        
-    free(imageData);
-    EndWritePNG(&png_ptr, &info_ptr);
     
-    fclose(file);
+    return success;
+}
+
+// Rows are pulled from the decoder and pushed to the encoder this many at a time
+#define PNG_STREAM_BAND_ROWS    (16)
+
+static void SetupStreamingReadTransforms(png_structp inReadPtr, png_infop inInfoPtr)
+{
+    int colorType = png_get_color_type(inReadPtr, inInfoPtr);
+    int bitDepth = png_get_bit_depth(inReadPtr, inInfoPtr);
+    
+    // Whatever comes in, hand the row callback 8 bit RGBA
+    if (colorType == PNG_COLOR_TYPE_PALETTE)
+    {
+        png_set_palette_to_rgb(inReadPtr);
+    }
+    
+    if ((colorType == PNG_COLOR_TYPE_GRAY) && (bitDepth < 8))
+    {
+        png_set_expand_gray_1_2_4_to_8(inReadPtr);
+    }
     
-    [[NSFileManager defaultManager] changeCurrentDirectoryPath:prevWorkingDir];
+    if (png_get_valid(inReadPtr, inInfoPtr, PNG_INFO_tRNS))
+    {
+        png_set_tRNS_to_alpha(inReadPtr);
+    }
+    
+    if (bitDepth == 16)
+    {
+        png_set_strip_16(inReadPtr);
+    }
+    
+    if ((colorType == PNG_COLOR_TYPE_GRAY) || (colorType == PNG_COLOR_TYPE_GRAY_ALPHA))
+    {
+        png_set_gray_to_rgb(inReadPtr);
+    }
+    
+    if (!(colorType & PNG_COLOR_MASK_ALPHA) && !png_get_valid(inReadPtr, inInfoPtr, PNG_INFO_tRNS))
+    {
+        png_set_filler(inReadPtr, 0xFF, PNG_FILLER_AFTER);
+    }
 }
 
-void WritePNGMemory(unsigned char* inImageData, int inWidth, int inHeight, unsigned char** outPNGData, u32* outPNGDataSize)
+BOOL TransformPNGFile(  NSString* inInputFile, NSString* inOutputFile, PNGRowTransform inTransform, void* inTransformContext,
+                        PNGWriteParams* inParams, PNGWriteStats* outStats)
 {
-    png_structp png_ptr = NULL;
-    png_infop info_ptr = NULL;
-            
-    InitWritePNG(NULL, &png_ptr, &info_ptr);
+    TRACE_SCOPE("PNG Transform");
     
-    // Create a buffer double the size of raw RGBA data.  Pretty sure we won't exceed this
-    int memoryBufferSize = (inWidth * inHeight * 4) * 2;
+    CFAbsoluteTime startTime = CFAbsoluteTimeGetCurrent();
     
-    sCurPNGContext->mBuffer = malloc(memoryBufferSize);
-    sCurPNGContext->mBufferSize = memoryBufferSize;
+    NSString* inputPath = ResolvePNGInputPath(inInputFile);
+    NSString* outputPath = ResolvePNGOutputPath(inOutputFile);
+    
+    FILE* inputFile = (inputPath != NULL) ? fopen([inputPath UTF8String], "rb") : NULL;
+    
+    if (inputFile == NULL)
+    {
+        printf("\e[1;31mCouldn't open %s for reading...aborting\e[m\n", [inInputFile UTF8String]);
+        return FALSE;
+    }
+    
+    u8 header[8];
+    
+    if ((fread(header, 1, sizeof(header), inputFile) != sizeof(header)) || !VerifyHeader(header, sizeof(header)))
+    {
+        fclose(inputFile);
+        
+        printf("\e[1;31m%s isn't a valid PNG, aborting...\e[m\n", [inInputFile UTF8String]);
+        return FALSE;
+    }
+    
+    FILE* outputFile = fopen([outputPath UTF8String], "wb");
+    
+    if (outputFile == NULL)
+    {
+        fclose(inputFile);
         
-    png_byte** imageData = malloc(sizeof(png_byte*) * inHeight);
+        printf("\e[1;31mCouldn't open %s for writing...aborting\e[m\n", [inOutputFile UTF8String]);
+        return FALSE;
+    }
     
-    png_set_IHDR(   png_ptr, info_ptr,
-                    inWidth, inHeight, 8, PNG_COLOR_TYPE_RGB_ALPHA,
+    png_structp readPtr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    png_infop readInfoPtr = (readPtr != NULL) ? png_create_info_struct(readPtr) : NULL;
+    
+    png_structp writePtr = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    png_infop writeInfoPtr = (writePtr != NULL) ? png_create_info_struct(writePtr) : NULL;
+    
+    // Anything touched after the setjmp calls below has to be volatile to survive a longjmp
+    u8* volatile band = NULL;
+    png_bytep* volatile rowPointers = NULL;
+    
+    volatile BOOL success = FALSE;
+    
+    if ((readInfoPtr == NULL) || (writeInfoPtr == NULL))
+    {
+        printf("Could not allocate libpng structures.  Nothing was generated.\n");
+        goto cleanup;
+    }
+    
+    if (setjmp(png_jmpbuf(readPtr)))
+    {
+        printf("LibPng encountered an internal error reading %s.\n", [inInputFile UTF8String]);
+        goto cleanup;
+    }
+    
+    if (setjmp(png_jmpbuf(writePtr)))
+    {
+        printf("LibPng encountered an internal error writing %s.\n", [inOutputFile UTF8String]);
+        goto cleanup;
+    }
+    
+    png_init_io(readPtr, inputFile);
+    png_set_sig_bytes(readPtr, sizeof(header));
+    png_read_info(readPtr, readInfoPtr);
+    
+    SetupStreamingReadTransforms(readPtr, readInfoPtr);
+    
+    int numPasses = png_set_interlace_handling(readPtr);
+    png_read_update_info(readPtr, readInfoPtr);
+    
+    u32 width = png_get_image_width(readPtr, readInfoPtr);
+    u32 height = png_get_image_height(readPtr, readInfoPtr);
+    u32 rowBytes = png_get_rowbytes(readPtr, readInfoPtr);
+    
+    NSCAssert(rowBytes == (width * 4), @"Streaming PNG reads should always produce RGBA8 rows");
+    
+    // Interlaced images can't be streamed, every pass touches every row.  Those get the whole image as a single band.
+    u32 bandRows = (numPasses > 1) ? height : min(height, PNG_STREAM_BAND_ROWS);
+    
+    band = malloc(rowBytes * bandRows);
+    rowPointers = malloc(sizeof(png_bytep) * bandRows);
+    
+    TRACE_ALLOCATION(rowBytes * bandRows);
+    TRACE_COUNT(TRACE_COUNTER_PIXELS_PROCESSED, width * height);
+    
+    for (u32 curRow = 0; curRow < bandRows; curRow++)
+    {
+        rowPointers[curRow] = &band[curRow * rowBytes];
+    }
+    
+    png_init_io(writePtr, outputFile);
+    ApplyPNGWriteParams(writePtr, inParams);
+    
+    png_set_IHDR(   writePtr, writeInfoPtr,
+                    width, height, 8, PNG_COLOR_TYPE_RGB_ALPHA,
                     PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT,
                     PNG_FILTER_TYPE_DEFAULT );
+                    
+    png_write_info(writePtr, writeInfoPtr);
     
-    for (int y = 0; y < inHeight; y++)
+    if (numPasses > 1)
     {
-        imageData[y] = malloc(sizeof(png_byte) * inWidth * 4);
-        
-        memcpy(imageData[y], &((int*)inImageData)[inWidth * y], inWidth * 4);
+        png_read_image(readPtr, rowPointers);
     }
+    
+    for (u32 bandStart = 0; bandStart < height; bandStart += bandRows)
+    {
+        u32 numRows = min(bandRows, height - bandStart);
         
-    png_set_rows(png_ptr, info_ptr, imageData);
-    png_write_png(png_ptr, info_ptr, PNG_TRANSFORM_IDENTITY, NULL);
+        if (numPasses == 1)
+        {
+            png_read_rows(readPtr, rowPointers, NULL, numRows);
+        }
+        
+        for (u32 curRow = 0; curRow < numRows; curRow++)
+        {
+            inTransform(rowPointers[curRow], width, inTransformContext);
+        }
+        
+        png_write_rows(writePtr, rowPointers, numRows);
+    }
     
-    for (int y = 0; y < inHeight; y++)
+    png_read_end(readPtr, NULL);
+    png_write_end(writePtr, writeInfoPtr);
+    
+    success = TRUE;
+    
+cleanup:
+    png_destroy_read_struct(&readPtr, &readInfoPtr, NULL);
+    png_destroy_write_struct(&writePtr, &writeInfoPtr);
+    
+    free(band);
+    free(rowPointers);
+    
+    PNGWriteStats stats;
+    
+    stats.mEncodedSize = ftell(outputFile);
+    
+    TRACE_COUNT(TRACE_COUNTER_BYTES_READ, ftell(inputFile));
+    TRACE_COUNT(TRACE_COUNTER_BYTES_WRITTEN, stats.mEncodedSize);
+    
+    fclose(inputFile);
+    fclose(outputFile);
+    
+    stats.mEncodeTime = CFAbsoluteTimeGetCurrent() - startTime;
+    
+    if (success && inParams->mReportStats)
     {
-        free(imageData[y]);
+        ReportPNGWriteStats([inOutputFile UTF8String], &stats);
     }
-        
-    free(imageData);
-    EndWritePNG(&png_ptr, &info_ptr);
     
-    *outPNGData = sCurPNGContext->mBuffer;
-    *outPNGDataSize = sCurPNGContext->mBufferOffset;
+    if (outStats != NULL)
+    {
+        *outStats = stats;
+    }
     
-    free(sCurPNGContext);
-    sCurPNGContext = NULL;
-}
\ No newline at end of file
+    return success;
+}
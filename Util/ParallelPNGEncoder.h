@@ -0,0 +1,19 @@
+//
+//  ParallelPNGEncoder.h
+//  Neon21
+//
+//  Copyright Neon Games 2010. All rights reserved.
+//
+
+#import "PNGUtilities.h"
+
+// Splits the filtered scanlines into bands and deflates each band on its own thread.  The bands are
+// stitched into a single zlib stream (full flush between bands) with a combined Adler-32, so the
+// result is an ordinary PNG that any decoder can read.
+//
+// On success *outPNGData is allocated with malloc and must be freed by the caller.
+
+BOOL EncodePNGParallel( unsigned char* inImageData, int inWidth, int inHeight, PNGWriteParams* inParams,
+                        unsigned char** outPNGData, u32* outPNGDataSize );
+
+u32  GetParallelPNGBandCount(int inWidth, int inHeight);
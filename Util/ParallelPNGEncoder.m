@@ -0,0 +1,498 @@
+//
+//  ParallelPNGEncoder.m
+//  Neon21
+//
+//  Copyright Neon Games 2010. All rights reserved.
+//
+
+#import "ParallelPNGEncoder.h"
+#import "png.h"
+
+#define PNG_BYTES_PER_PIXEL             (4)
+#define PNG_SIGNATURE_SIZE              (8)
+#define PNG_CHUNK_OVERHEAD              (12)    // Length, type and CRC
+#define PNG_IHDR_SIZE                   (13)
+#define ZLIB_HEADER_SIZE                (2)
+#define ZLIB_ADLER_SIZE                 (4)
+#define NUM_ROW_FILTERS                 (5)
+
+// Bands smaller than this spend more on the flush markers and lost matches than they gain from the extra thread
+#define PARALLEL_PNG_MIN_BAND_BYTES     (256 * 1024)
+
+static const u8 sPNGSignature[PNG_SIGNATURE_SIZE] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+
+static const int sFilterFlags[NUM_ROW_FILTERS] = { PNG_FILTER_NONE, PNG_FILTER_SUB, PNG_FILTER_UP, PNG_FILTER_AVG, PNG_FILTER_PAETH };
+
+typedef struct
+{
+    // Input
+    u8*             mImageData;
+    int             mWidth;
+    int             mStartRow;
+    int             mNumRows;
+    BOOL            mFirstBand;
+    BOOL            mLastBand;
+    PNGWriteParams* mParams;
+    const u8*       mZlibHeader;
+    
+    // Output
+    u8*             mCompressedData;
+    u32             mCompressedSize;
+    u32             mUncompressedSize;
+    uLong           mAdler;
+    uLong           mChunkCRC;          // CRC of the IDAT type, the zlib header (first band) and the compressed data
+    BOOL            mSuccess;
+} PNGBand;
+
+static u8* WriteU32BE(u8* inDest, u32 inValue)
+{
+    inDest[0] = (inValue >> 24) & 0xFF;
+    inDest[1] = (inValue >> 16) & 0xFF;
+    inDest[2] = (inValue >> 8) & 0xFF;
+    inDest[3] = inValue & 0xFF;
+    
+    return inDest + 4;
+}
+
+static u8* WriteChunk(u8* inDest, const char* inType, const u8* inData, u32 inLength)
+{
+    inDest = WriteU32BE(inDest, inLength);
+    
+    memcpy(inDest, inType, 4);
+    
+    if (inLength != 0)
+    {
+        memcpy(inDest + 4, inData, inLength);
+    }
+    
+    uLong crc = crc32(0, inDest, 4 + inLength);
+    
+    return WriteU32BE(inDest + 4 + inLength, crc);
+}
+
+static u8 PaethPredictor(int inLeft, int inUp, int inUpLeft)
+{
+    int p = inLeft + inUp - inUpLeft;
+    int pa = abs(p - inLeft);
+    int pb = abs(p - inUp);
+    int pc = abs(p - inUpLeft);
+    
+    if ((pa <= pb) && (pa <= pc))
+    {
+        return inLeft;
+    }
+    else if (pb <= pc)
+    {
+        return inUp;
+    }
+    
+    return inUpLeft;
+}
+
+// Writes the filter type byte followed by the filtered row.  inPrevRow is NULL for the first row of the image.
+static void FilterRow(const u8* inRow, const u8* inPrevRow, int inRowBytes, int inFilterIndex, u8* outFiltered)
+{
+    outFiltered[0] = inFilterIndex;
+    u8* out = outFiltered + 1;
+    
+    for (int i = 0; i < inRowBytes; i++)
+    {
+        int left = (i >= PNG_BYTES_PER_PIXEL) ? inRow[i - PNG_BYTES_PER_PIXEL] : 0;
+        int up = (inPrevRow != NULL) ? inPrevRow[i] : 0;
+        int upLeft = ((inPrevRow != NULL) && (i >= PNG_BYTES_PER_PIXEL)) ? inPrevRow[i - PNG_BYTES_PER_PIXEL] : 0;
+        
+        switch(inFilterIndex)
+        {
+            case PNG_FILTER_VALUE_NONE:
+            {
+                out[i] = inRow[i];
+                break;
+            }
+            
+            case PNG_FILTER_VALUE_SUB:
+            {
+                out[i] = inRow[i] - left;
+                break;
+            }
+            
+            case PNG_FILTER_VALUE_UP:
+            {
+                out[i] = inRow[i] - up;
+                break;
+            }
+            
+            case PNG_FILTER_VALUE_AVG:
+            {
+                out[i] = inRow[i] - ((left + up) >> 1);
+                break;
+            }
+            
+            case PNG_FILTER_VALUE_PAETH:
+            {
+                out[i] = inRow[i] - PaethPredictor(left, up, upLeft);
+                break;
+            }
+        }
+    }
+}
+
+// Same heuristic libpng uses: the filter with the smallest sum of absolute (signed) differences usually compresses best.
+static u32 FilteredRowCost(const u8* inFiltered, int inLength)
+{
+    u32 cost = 0;
+    
+    for (int i = 0; i < inLength; i++)
+    {
+        u8 val = inFiltered[i];
+        cost += (val < 128) ? val : (256 - val);
+    }
+    
+    return cost;
+}
+
+static const u8* SelectFilteredRow(const u8* inRow, const u8* inPrevRow, int inRowBytes, int inFilters, u8* inScratch)
+{
+    const u8* bestRow = NULL;
+    u32 bestCost = 0xFFFFFFFF;
+    
+    for (int curFilter = 0; curFilter < NUM_ROW_FILTERS; curFilter++)
+    {
+        if (!(inFilters & sFilterFlags[curFilter]))
+        {
+            continue;
+        }
+        
+        u8* candidate = &inScratch[curFilter * (inRowBytes + 1)];
+        FilterRow(inRow, inPrevRow, inRowBytes, curFilter, candidate);
+        
+        if (inFilters == sFilterFlags[curFilter])
+        {
+            // Only one filter allowed, no point measuring it
+            return candidate;
+        }
+        
+        u32 cost = FilteredRowCost(candidate + 1, inRowBytes);
+        
+        if (cost < bestCost)
+        {
+            bestCost = cost;
+            bestRow = candidate;
+        }
+    }
+    
+    if (bestRow == NULL)
+    {
+        // Empty filter mask, fall back to no filtering
+        bestRow = inScratch;
+        FilterRow(inRow, inPrevRow, inRowBytes, PNG_FILTER_VALUE_NONE, inScratch);
+    }
+    
+    return bestRow;
+}
+
+static BOOL GrowBandOutput(PNGBand* ioBand, z_stream* ioStream, u32* ioCapacity)
+{
+    u32 offset = ioStream->next_out - ioBand->mCompressedData;
+    u32 newCapacity = *ioCapacity * 2;
+    
+    u8* newData = realloc(ioBand->mCompressedData, newCapacity);
+    
+    if (newData == NULL)
+    {
+        return FALSE;
+    }
+    
+    ioBand->mCompressedData = newData;
+    *ioCapacity = newCapacity;
+    
+    ioStream->next_out = newData + offset;
+    ioStream->avail_out = newCapacity - offset;
+    
+    return TRUE;
+}
+
+static void CompressBand(void* inContext, size_t inBandIndex)
+{
+    PNGBand* band = &((PNGBand*)inContext)[inBandIndex];
+    
+    int rowBytes = band->mWidth * PNG_BYTES_PER_PIXEL;
+    int filteredRowBytes = rowBytes + 1;
+    
+    band->mSuccess = FALSE;
+    band->mCompressedData = NULL;
+    band->mCompressedSize = 0;
+    band->mUncompressedSize = filteredRowBytes * band->mNumRows;
+    band->mAdler = adler32(0, NULL, 0);
+    
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    
+    // Raw deflate, the zlib header and trailer are written once for the whole image
+    if (deflateInit2(&stream, band->mParams->mCompressionLevel, Z_DEFLATED, -MAX_WBITS, band->mParams->mMemLevel, band->mParams->mStrategy) != Z_OK)
+    {
+        return;
+    }
+    
+    u8* scratch = malloc(filteredRowBytes * NUM_ROW_FILTERS);
+    
+    // Extra room for the flush marker at the end of the band
+    u32 capacity = deflateBound(&stream, band->mUncompressedSize) + 64;
+    band->mCompressedData = malloc(capacity);
+    
+    stream.next_out = band->mCompressedData;
+    stream.avail_out = capacity;
+    
+    BOOL success = (scratch != NULL) && (band->mCompressedData != NULL);
+    
+    for (int curRow = 0; (curRow < band->mNumRows) && success; curRow++)
+    {
+        int imageRow = band->mStartRow + curRow;
+        
+        const u8* row = &band->mImageData[imageRow * rowBytes];
+        const u8* prevRow = (imageRow == 0) ? NULL : (row - rowBytes);
+        
+        const u8* filtered = SelectFilteredRow(row, prevRow, rowBytes, band->mParams->mFilters, scratch);
+        
+        band->mAdler = adler32(band->mAdler, filtered, filteredRowBytes);
+        
+        int flush = Z_NO_FLUSH;
+        
+        if (curRow == (band->mNumRows - 1))
+        {
+            // Full flush byte aligns the band and drops the history, so the next band can be appended as is
+            flush = band->mLastBand ? Z_FINISH : Z_FULL_FLUSH;
+        }
+        
+        stream.next_in = (Bytef*)filtered;
+        stream.avail_in = filteredRowBytes;
+        
+        while (TRUE)
+        {
+            if ((stream.avail_out == 0) && !GrowBandOutput(band, &stream, &capacity))
+            {
+                success = FALSE;
+                break;
+            }
+            
+            int err = deflate(&stream, flush);
+            
+            if (err == Z_STREAM_ERROR)
+            {
+                success = FALSE;
+                break;
+            }
+            
+            if (flush == Z_FINISH)
+            {
+                if (err == Z_STREAM_END)
+                {
+                    break;
+                }
+            }
+            else if ((stream.avail_in == 0) && (stream.avail_out != 0))
+            {
+                break;
+            }
+        }
+    }
+    
+    band->mCompressedSize = stream.next_out - band->mCompressedData;
+    
+    deflateEnd(&stream);
+    free(scratch);
+    
+    if (success)
+    {
+        band->mChunkCRC = crc32(0, (const Bytef*)"IDAT", 4);
+        
+        if (band->mFirstBand)
+        {
+            band->mChunkCRC = crc32(band->mChunkCRC, band->mZlibHeader, ZLIB_HEADER_SIZE);
+        }
+        
+        band->mChunkCRC = crc32(band->mChunkCRC, band->mCompressedData, band->mCompressedSize);
+    }
+    
+    band->mSuccess = success;
+}
+
+static void WriteZlibHeader(int inCompressionLevel, u8* outHeader)
+{
+    // 32K window, deflate
+    u8 cmf = 0x78;
+    u8 level = 2;
+    
+    if ((inCompressionLevel >= 0) && (inCompressionLevel < 2))
+    {
+        level = 0;
+    }
+    else if ((inCompressionLevel >= 2) && (inCompressionLevel < 6))
+    {
+        level = 1;
+    }
+    else if (inCompressionLevel > 6)
+    {
+        level = 3;
+    }
+    
+    u8 flg = level << 6;
+    flg += 31 - (((cmf << 8) + flg) % 31);
+    
+    outHeader[0] = cmf;
+    outHeader[1] = flg;
+}
+
+u32 GetParallelPNGBandCount(int inWidth, int inHeight)
+{
+    u32 imageBytes = inWidth * inHeight * PNG_BYTES_PER_PIXEL;
+    u32 numBands = [[NSProcessInfo processInfo] activeProcessorCount];
+    
+    numBands = min(numBands, imageBytes / PARALLEL_PNG_MIN_BAND_BYTES);
+    numBands = min(numBands, (u32)inHeight);
+    
+    return max(numBands, 1);
+}
+
+BOOL EncodePNGParallel( unsigned char* inImageData, int inWidth, int inHeight, PNGWriteParams* inParams,
+                        unsigned char** outPNGData, u32* outPNGDataSize )
+{
+    NSCAssert((inWidth > 0) && (inHeight > 0), @"Can't encode an empty image");
+    
+    u8 zlibHeader[ZLIB_HEADER_SIZE];
+    WriteZlibHeader(inParams->mCompressionLevel, zlibHeader);
+    
+    u32 numBands = GetParallelPNGBandCount(inWidth, inHeight);
+    PNGBand* bands = malloc(sizeof(PNGBand) * numBands);
+    
+    int rowsPerBand = inHeight / numBands;
+    int extraRows = inHeight % numBands;
+    int curRow = 0;
+    
+    for (int curBand = 0; curBand < numBands; curBand++)
+    {
+        PNGBand* band = &bands[curBand];
+        
+        band->mImageData = inImageData;
+        band->mWidth = inWidth;
+        band->mStartRow = curRow;
+        band->mNumRows = rowsPerBand + ((curBand < extraRows) ? 1 : 0);
+        band->mFirstBand = (curBand == 0);
+        band->mLastBand = (curBand == (numBands - 1));
+        band->mParams = inParams;
+        band->mZlibHeader = zlibHeader;
+        
+        curRow += band->mNumRows;
+    }
+    
+    dispatch_apply_f(numBands, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), bands, CompressBand);
+    
+    BOOL success = TRUE;
+    uLong adler = bands[0].mAdler;
+    u32 totalSize = PNG_SIGNATURE_SIZE + (PNG_CHUNK_OVERHEAD + PNG_IHDR_SIZE) + PNG_CHUNK_OVERHEAD;
+    
+    for (int curBand = 0; curBand < numBands; curBand++)
+    {
+        success = success && bands[curBand].mSuccess;
+        
+        if (curBand != 0)
+        {
+            adler = adler32_combine(adler, bands[curBand].mAdler, bands[curBand].mUncompressedSize);
+        }
+        
+        totalSize += PNG_CHUNK_OVERHEAD + bands[curBand].mCompressedSize;
+    }
+    
+    totalSize += ZLIB_HEADER_SIZE + ZLIB_ADLER_SIZE;
+    
+    u8* pngData = NULL;
+    
+    if (success)
+    {
+        pngData = malloc(totalSize);
+        success = (pngData != NULL);
+    }
+    
+    if (success)
+    {
+        u8* out = pngData;
+        
+        memcpy(out, sPNGSignature, PNG_SIGNATURE_SIZE);
+        out += PNG_SIGNATURE_SIZE;
+        
+        u8 ihdr[PNG_IHDR_SIZE];
+        
+        WriteU32BE(&ihdr[0], inWidth);
+        WriteU32BE(&ihdr[4], inHeight);
+        ihdr[8] = 8;                                // Bit depth
+        ihdr[9] = PNG_COLOR_TYPE_RGB_ALPHA;
+        ihdr[10] = PNG_COMPRESSION_TYPE_BASE;
+        ihdr[11] = PNG_FILTER_TYPE_BASE;
+        ihdr[12] = PNG_INTERLACE_NONE;
+        
+        out = WriteChunk(out, "IHDR", ihdr, PNG_IHDR_SIZE);
+        
+        // One IDAT per band.  The zlib header goes in front of the first band and the Adler-32 of the whole
+        // stream after the last.  Each band already computed the CRC of its own chunk, the last one just
+        // needs the trailer folded in.
+        
+        u8 adlerBytes[ZLIB_ADLER_SIZE];
+        WriteU32BE(adlerBytes, adler);
+        
+        for (int curBand = 0; curBand < numBands; curBand++)
+        {
+            PNGBand* band = &bands[curBand];
+            
+            u32 chunkLength = band->mCompressedSize;
+            uLong chunkCRC = band->mChunkCRC;
+            
+            if (band->mFirstBand)
+            {
+                chunkLength += ZLIB_HEADER_SIZE;
+            }
+            
+            if (band->mLastBand)
+            {
+                chunkLength += ZLIB_ADLER_SIZE;
+                chunkCRC = crc32_combine(chunkCRC, crc32(0, adlerBytes, ZLIB_ADLER_SIZE), ZLIB_ADLER_SIZE);
+            }
+            
+            out = WriteU32BE(out, chunkLength);
+            
+            memcpy(out, "IDAT", 4);
+            out += 4;
+            
+            if (band->mFirstBand)
+            {
+                memcpy(out, zlibHeader, ZLIB_HEADER_SIZE);
+                out += ZLIB_HEADER_SIZE;
+            }
+            
+            memcpy(out, band->mCompressedData, band->mCompressedSize);
+            out += band->mCompressedSize;
+            
+            if (band->mLastBand)
+            {
+                memcpy(out, adlerBytes, ZLIB_ADLER_SIZE);
+                out += ZLIB_ADLER_SIZE;
+            }
+            
+            out = WriteU32BE(out, chunkCRC);
+        }
+        
+        out = WriteChunk(out, "IEND", NULL, 0);
+        
+        NSCAssert((out - pngData) == totalSize, @"PNG size mismatch");
+        
+        *outPNGData = pngData;
+        *outPNGDataSize = totalSize;
+    }
+    
+    for (int curBand = 0; curBand < numBands; curBand++)
+    {
+        free(bands[curBand].mCompressedData);
+    }
+    
+    free(bands);
+    
+    return success;
+}
@@ -0,0 +1,76 @@
+//
+//  PrefetchLoader.h
+//  Neon21
+//
+//  Copyright Neon Games 2010. All rights reserved.
+//
+
+#import "PNGUtilities.h"
+
+// Reads and decodes a list of PNGs on a background thread, a few files ahead of whoever is consuming them.
+// The loader stops reading ahead once mMaxQueuedImages images or mMaxQueuedBytes of decoded pixels are
+// waiting, so memory stays bounded no matter how many files there are.
+
+typedef struct
+{
+    u32     mMaxQueuedImages;
+    u32     mMaxQueuedBytes;
+    BOOL    mReportStats;
+} PrefetchLoaderParams;
+
+typedef struct
+{
+    u32     mNumLoaded;
+    u32     mNumFailed;
+    double  mStallTime;         // Consumer waiting for the loader (I/O bound), in seconds
+    double  mComputeTime;       // Consumer working between images (compute bound), in seconds
+    double  mLoadTime;          // Loader reading and decoding, in seconds
+    double  mBackpressureTime;  // Loader waiting for the queue to drain, in seconds
+} PrefetchLoaderStats;
+
+@interface PrefetchedImage : NSObject
+{
+    @public
+        NSString*   mFileName;
+        PNGInfo     mPNGInfo;       // Freed with the PrefetchedImage
+}
+
+-(void)dealloc;
+
+@end
+
+@class Queue;
+
+@interface PrefetchLoader : NSObject
+{
+    PrefetchLoaderParams    mParams;
+    PrefetchLoaderStats     mStats;
+    
+    NSArray*                mFileNames;
+    
+    NSCondition*            mCondition;
+    Queue*                  mQueue;
+    u32                     mQueuedBytes;
+    BOOL                    mLoaderFinished;
+    BOOL                    mCancelled;
+    
+    CFAbsoluteTime          mLastImageTime;
+}
+
+-(PrefetchLoader*)InitWithFileNames:(NSArray*)inFileNames params:(PrefetchLoaderParams*)inParams;
+-(void)dealloc;
++(void)InitDefaultParams:(PrefetchLoaderParams*)outParams;
+
+-(void)Start;
+-(void)Cancel;
+
+// Blocks until the next image is decoded.  Images come back in the order they were given, files that fail to
+// load are skipped.  Returns NULL once every file has been handed out.  The returned image is autoreleased.
+-(PrefetchedImage*)NextImage;
+
+-(void)GetStats:(PrefetchLoaderStats*)outStats;
+-(void)ReportStats;
+
+-(void)LoaderThread;
+
+@end
@@ -0,0 +1,208 @@
+//
+//  PrefetchLoader.m
+//  Neon21
+//
+//  Copyright Neon Games 2010. All rights reserved.
+//
+
+#import "PrefetchLoader.h"
+#import "Queue.h"
+
+static const u32 PREFETCH_DEFAULT_MAX_QUEUED_IMAGES = 4;
+static const u32 PREFETCH_DEFAULT_MAX_QUEUED_BYTES = 256 * 1024 * 1024;
+
+@implementation PrefetchedImage
+
+-(void)dealloc
+{
+    free(mPNGInfo.mImageData);
+    [mFileName release];
+    
+    [super dealloc];
+}
+
+@end
+
+@implementation PrefetchLoader
+
+-(PrefetchLoader*)InitWithFileNames:(NSArray*)inFileNames params:(PrefetchLoaderParams*)inParams
+{
+    NSAssert(inParams->mMaxQueuedImages > 0, @"Prefetch queue must hold at least one image");
+    
+    memcpy(&mParams, inParams, sizeof(PrefetchLoaderParams));
+    memset(&mStats, 0, sizeof(PrefetchLoaderStats));
+    
+    mFileNames = [inFileNames copy];
+    
+    mCondition = [[NSCondition alloc] init];
+    mQueue = [(Queue*)[Queue alloc] Init];
+    mQueuedBytes = 0;
+    mLoaderFinished = FALSE;
+    mCancelled = FALSE;
+    
+    mLastImageTime = 0;
+    
+    return self;
+}
+
+-(void)dealloc
+{
+    [mFileNames release];
+    [mCondition release];
+    [mQueue release];
+    
+    [super dealloc];
+}
+
++(void)InitDefaultParams:(PrefetchLoaderParams*)outParams
+{
+    outParams->mMaxQueuedImages = PREFETCH_DEFAULT_MAX_QUEUED_IMAGES;
+    outParams->mMaxQueuedBytes = PREFETCH_DEFAULT_MAX_QUEUED_BYTES;
+    outParams->mReportStats = FALSE;
+}
+
+-(void)Start
+{
+    // The thread retains us until it finishes
+    [NSThread detachNewThreadSelector:@selector(LoaderThread) toTarget:self withObject:NULL];
+}
+
+-(void)Cancel
+{
+    [mCondition lock];
+    
+    mCancelled = TRUE;
+    [mCondition broadcast];
+    
+    [mCondition unlock];
+}
+
+-(PrefetchedImage*)NextImage
+{
+    CFAbsoluteTime startTime = CFAbsoluteTimeGetCurrent();
+    PrefetchedImage* retVal = NULL;
+    
+    [mCondition lock];
+    
+    if (mLastImageTime != 0)
+    {
+        mStats.mComputeTime += startTime - mLastImageTime;
+    }
+    
+    while (([mQueue GetCount] == 0) && (!mLoaderFinished) && (!mCancelled))
+    {
+        [mCondition wait];
+    }
+    
+    if ([mQueue GetCount] > 0)
+    {
+        retVal = (PrefetchedImage*)[mQueue Dequeue];
+        mQueuedBytes -= retVal->mPNGInfo.mWidth * retVal->mPNGInfo.mHeight * 4;
+        
+        // Wake up the loader if it was waiting on us
+        [mCondition broadcast];
+    }
+    
+    mLastImageTime = CFAbsoluteTimeGetCurrent();
+    mStats.mStallTime += mLastImageTime - startTime;
+    
+    [mCondition unlock];
+    
+    if ((retVal == NULL) && (mParams.mReportStats))
+    {
+        [self ReportStats];
+    }
+    
+    return retVal;
+}
+
+-(void)GetStats:(PrefetchLoaderStats*)outStats
+{
+    [mCondition lock];
+    memcpy(outStats, &mStats, sizeof(PrefetchLoaderStats));
+    [mCondition unlock];
+}
+
+-(void)ReportStats
+{
+    PrefetchLoaderStats stats;
+    [self GetStats:&stats];
+    
+    printf("Prefetch:\t%u files, %u failed\n\t\t%.2f ms stalled on I/O, %.2f ms computing\n\t\t%.2f ms loading, %.2f ms blocked on memory\n",
+            stats.mNumLoaded, stats.mNumFailed, stats.mStallTime * 1000.0, stats.mComputeTime * 1000.0,
+            stats.mLoadTime * 1000.0, stats.mBackpressureTime * 1000.0);
+}
+
+-(void)LoaderThread
+{
+    int numFiles = [mFileNames count];
+    
+    for (int curFile = 0; curFile < numFiles; curFile++)
+    {
+        NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+        
+        // Hold off while the consumer has enough queued up, but always allow one image through so a single
+        // file larger than the memory budget can't stall us forever.
+        
+        CFAbsoluteTime waitStartTime = CFAbsoluteTimeGetCurrent();
+        
+        [mCondition lock];
+        
+        while ( (!mCancelled) && ([mQueue GetCount] > 0) &&
+                (([mQueue GetCount] >= mParams.mMaxQueuedImages) || (mQueuedBytes >= mParams.mMaxQueuedBytes))  )
+        {
+            [mCondition wait];
+        }
+        
+        BOOL cancelled = mCancelled;
+        CFAbsoluteTime loadStartTime = CFAbsoluteTimeGetCurrent();
+        mStats.mBackpressureTime += loadStartTime - waitStartTime;
+        
+        [mCondition unlock];
+        
+        if (cancelled)
+        {
+            [pool release];
+            break;
+        }
+        
+        NSString* fileName = [mFileNames objectAtIndex:curFile];
+        
+        PrefetchedImage* image = [[PrefetchedImage alloc] init];
+        image->mFileName = [fileName retain];
+        
+        BOOL success = ReadPNGFile(fileName, TEX_ADDRESSING_8, &image->mPNGInfo);
+        
+        [mCondition lock];
+        
+        mStats.mLoadTime += CFAbsoluteTimeGetCurrent() - loadStartTime;
+        
+        if (success)
+        {
+            mStats.mNumLoaded++;
+            mQueuedBytes += image->mPNGInfo.mWidth * image->mPNGInfo.mHeight * 4;
+            
+            [mQueue Enqueue:image];
+            [mCondition broadcast];
+        }
+        else
+        {
+            mStats.mNumFailed++;
+            printf("\e[1;31mCould not read %s\e[m\n", [fileName UTF8String]);
+        }
+        
+        [mCondition unlock];
+        
+        [image release];
+        [pool release];
+    }
+    
+    [mCondition lock];
+    
+    mLoaderFinished = TRUE;
+    [mCondition broadcast];
+    
+    [mCondition unlock];
+}
+
+@end
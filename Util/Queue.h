@@ -15,5 +15,6 @@
 
 -(void)Enqueue:(NSObject*)inObject;
 -(NSObject*)Dequeue;
+-(u32)GetCount;
 
 @end
\ No newline at end of file
@@ -18,9 +18,9 @@
 
 -(void)dealloc
 {
-    [super dealloc];
-    
     [mArray release];
+    
+    [super dealloc];
 }
 
 -(void)Enqueue:(NSObject*)inObject
@@ -38,6 +38,8 @@
 		
 		if (retVal != NULL)
 		{
+			// The array holds the only reference, keep the object alive for the caller
+			[[retVal retain] autorelease];
 			[mArray removeObjectAtIndex:0];
 		}
 	}
@@ -45,4 +47,9 @@
     return retVal;
 }
 
+-(u32)GetCount
+{
+    return [mArray count];
+}
+
 @end
\ No newline at end of file
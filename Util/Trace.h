@@ -0,0 +1,68 @@
+//
+//  Trace.h
+//  Neon21
+//
+//  Copyright Neon Games 2010. All rights reserved.
+//
+
+// Scoped timers and counters for finding out where a build's time goes.
+//
+// Tracing is off unless TraceInit is given an output path (the image processor takes it from
+// NEON_IMAGE_PROCESSOR_TRACE).  When off, a TRACE_SCOPE or TRACE_COUNT costs one load and branch.  When on, every
+// scope is recorded as a Chrome trace event (load the output in chrome://tracing), and TraceTerm prints a one line
+// summary of time per stage and the counters.
+//
+// TRACE_SCOPE times from where it appears to the end of the enclosing block.  Names must be string literals, they
+// aren't copied.  Everything here is safe to call from any thread.
+
+typedef enum
+{
+    TRACE_COUNTER_PIXELS_PROCESSED,
+    TRACE_COUNTER_BYTES_READ,
+    TRACE_COUNTER_BYTES_WRITTEN,
+    TRACE_COUNTER_ALLOCATIONS,
+    TRACE_COUNTER_ALLOCATED_BYTES,
+    TRACE_COUNTER_NUM
+} TraceCounter;
+
+typedef struct
+{
+    const char* mName;
+    u64         mStartTime;
+} TraceScope;
+
+extern BOOL gTraceEnabled;
+
+void TraceInit(const char* inOutputPath);
+void TraceTerm();
+
+u64  TraceGetTime();
+void TraceScopeEnd(TraceScope* inScope);
+void TraceCounterAdd(TraceCounter inCounter, u64 inValue);
+
+#define TRACE_CONCAT_INNER(a, b)    a##b
+#define TRACE_CONCAT(a, b)          TRACE_CONCAT_INNER(a, b)
+
+#define TRACE_SCOPE(inName)                                                                                         \
+    TraceScope TRACE_CONCAT(traceScope, __LINE__) __attribute__((cleanup(TraceScopeEnd))) =                         \
+        { inName, gTraceEnabled ? TraceGetTime() : 0 }
+
+#define TRACE_COUNT(inCounter, inValue)                                                                             \
+    do                                                                                                              \
+    {                                                                                                               \
+        if (gTraceEnabled)                                                                                          \
+        {                                                                                                           \
+            TraceCounterAdd(inCounter, inValue);                                                                    \
+        }                                                                                                           \
+    } while (0)
+
+// Counts one allocation of inSize bytes
+#define TRACE_ALLOCATION(inSize)                                                                                    \
+    do                                                                                                              \
+    {                                                                                                               \
+        if (gTraceEnabled)                                                                                          \
+        {                                                                                                           \
+            TraceCounterAdd(TRACE_COUNTER_ALLOCATIONS, 1);                                                          \
+            TraceCounterAdd(TRACE_COUNTER_ALLOCATED_BYTES, inSize);                                                 \
+        }                                                                                                           \
+    } while (0)
@@ -0,0 +1,245 @@
+//
+//  Trace.m
+//  Neon21
+//
+//  Copyright Neon Games 2010. All rights reserved.
+//
+
+#import "Trace.h"
+
+#import <libkern/OSAtomic.h>
+#import <mach/mach_time.h>
+#import <pthread.h>
+#import <sys/resource.h>
+
+#define TRACE_INITIAL_EVENT_CAPACITY    (4096)
+
+typedef struct
+{
+    const char* mName;
+    u64         mStartTime;
+    u64         mDuration;
+    u32         mThreadID;
+} TraceEvent;
+
+typedef struct
+{
+    const char* mName;
+    u64         mTotalTime;
+    u32         mCount;
+} TraceStageTotal;
+
+BOOL gTraceEnabled = FALSE;
+
+static char*            sTraceOutputPath = NULL;
+static u64              sTraceStartTime = 0;
+static mach_timebase_info_data_t sTimebase;
+
+static OSSpinLock       sEventLock = OS_SPINLOCK_INIT;
+static TraceEvent*      sEvents = NULL;
+static u32              sNumEvents = 0;
+static u32              sEventCapacity = 0;
+
+static volatile int64_t sCounters[TRACE_COUNTER_NUM];
+
+static const char* sCounterNames[TRACE_COUNTER_NUM] = { "Pixels Processed", "Bytes Read", "Bytes Written", "Allocations", "Allocated Bytes" };
+
+static double TraceTimeToMicroseconds(u64 inTime)
+{
+    return ((double)inTime * (double)sTimebase.numer / (double)sTimebase.denom) / 1000.0;
+}
+
+void TraceInit(const char* inOutputPath)
+{
+    if ((inOutputPath == NULL) || (inOutputPath[0] == 0))
+    {
+        return;
+    }
+    
+    mach_timebase_info(&sTimebase);
+    
+    sTraceOutputPath = strdup(inOutputPath);
+    sTraceStartTime = mach_absolute_time();
+    
+    sEventCapacity = TRACE_INITIAL_EVENT_CAPACITY;
+    sEvents = malloc(sizeof(TraceEvent) * sEventCapacity);
+    sNumEvents = 0;
+    
+    memset((void*)sCounters, 0, sizeof(sCounters));
+    
+    gTraceEnabled = TRUE;
+}
+
+u64 TraceGetTime()
+{
+    // Never 0, so TraceScopeEnd can tell scopes that started while tracing was off
+    return mach_absolute_time() | 1;
+}
+
+void TraceScopeEnd(TraceScope* inScope)
+{
+    if ((inScope->mStartTime == 0) || (!gTraceEnabled))
+    {
+        return;
+    }
+    
+    TraceEvent event;
+    
+    event.mName = inScope->mName;
+    event.mStartTime = inScope->mStartTime;
+    event.mDuration = mach_absolute_time() - inScope->mStartTime;
+    event.mThreadID = pthread_mach_thread_np(pthread_self());
+    
+    OSSpinLockLock(&sEventLock);
+    
+    // TraceTerm may have run on another thread since the check above
+    if (sEvents != NULL)
+    {
+        if (sNumEvents == sEventCapacity)
+        {
+            sEventCapacity *= 2;
+            sEvents = realloc(sEvents, sizeof(TraceEvent) * sEventCapacity);
+        }
+        
+        sEvents[sNumEvents++] = event;
+    }
+    
+    OSSpinLockUnlock(&sEventLock);
+}
+
+void TraceCounterAdd(TraceCounter inCounter, u64 inValue)
+{
+    OSAtomicAdd64((int64_t)inValue, &sCounters[inCounter]);
+}
+
+static void TraceWriteJSONString(FILE* inFile, const char* inString)
+{
+    fputc('"', inFile);
+    
+    for (const char* cur = inString; *cur != 0; cur++)
+    {
+        if ((*cur == '"') || (*cur == '\\'))
+        {
+            fputc('\\', inFile);
+        }
+        
+        fputc(*cur, inFile);
+    }
+    
+    fputc('"', inFile);
+}
+
+static void TraceWriteChromeTrace(u64 inEndTime, long inPeakRSS)
+{
+    FILE* file = fopen(sTraceOutputPath, "w");
+    
+    if (file == NULL)
+    {
+        printf("\e[1;31mCould not write trace to %s\e[m\n", sTraceOutputPath);
+        return;
+    }
+    
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    
+    for (u32 curEvent = 0; curEvent < sNumEvents; curEvent++)
+    {
+        TraceEvent* event = &sEvents[curEvent];
+        
+        fprintf(file, "{\"name\":");
+        TraceWriteJSONString(file, event->mName);
+        fprintf(file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f},\n", event->mThreadID,
+                TraceTimeToMicroseconds(event->mStartTime - sTraceStartTime), TraceTimeToMicroseconds(event->mDuration));
+    }
+    
+    // Counters are only totalled, so they're written once at the end of the trace
+    double endTime = TraceTimeToMicroseconds(inEndTime - sTraceStartTime);
+    
+    for (int curCounter = 0; curCounter < TRACE_COUNTER_NUM; curCounter++)
+    {
+        fprintf(file, "{\"name\":\"%s\",\"ph\":\"C\",\"pid\":1,\"tid\":0,\"ts\":%.3f,\"args\":{\"value\":%lld}},\n",
+                sCounterNames[curCounter], endTime, sCounters[curCounter]);
+    }
+    
+    fprintf(file, "{\"name\":\"Peak RSS\",\"ph\":\"C\",\"pid\":1,\"tid\":0,\"ts\":%.3f,\"args\":{\"value\":%ld}}\n]}\n", endTime, inPeakRSS);
+    
+    fclose(file);
+}
+
+static void TracePrintSummary(u64 inEndTime, long inPeakRSS)
+{
+    // Events are grouped by name.  There are only a handful of distinct stages, so a linear search is fine.
+    TraceStageTotal* stages = malloc(sizeof(TraceStageTotal) * max(sNumEvents, 1));
+    u32 numStages = 0;
+    
+    for (u32 curEvent = 0; curEvent < sNumEvents; curEvent++)
+    {
+        TraceEvent* event = &sEvents[curEvent];
+        u32 curStage = 0;
+        
+        for (curStage = 0; curStage < numStages; curStage++)
+        {
+            if ((stages[curStage].mName == event->mName) || (strcmp(stages[curStage].mName, event->mName) == 0))
+            {
+                break;
+            }
+        }
+        
+        if (curStage == numStages)
+        {
+            stages[numStages].mName = event->mName;
+            stages[numStages].mTotalTime = 0;
+            stages[numStages].mCount = 0;
+            numStages++;
+        }
+        
+        stages[curStage].mTotalTime += event->mDuration;
+        stages[curStage].mCount++;
+    }
+    
+    printf("Trace:\t%.2f ms", TraceTimeToMicroseconds(inEndTime - sTraceStartTime) / 1000.0);
+    
+    for (u32 curStage = 0; curStage < numStages; curStage++)
+    {
+        printf(", %s %.2f ms (%u)", stages[curStage].mName, TraceTimeToMicroseconds(stages[curStage].mTotalTime) / 1000.0, stages[curStage].mCount);
+    }
+    
+    for (int curCounter = 0; curCounter < TRACE_COUNTER_NUM; curCounter++)
+    {
+        printf(", %s %lld", sCounterNames[curCounter], sCounters[curCounter]);
+    }
+    
+    printf(", Peak RSS %.1f MB -> %s\n", (double)inPeakRSS / (1024.0 * 1024.0), sTraceOutputPath);
+    
+    free(stages);
+}
+
+void TraceTerm()
+{
+    if (!gTraceEnabled)
+    {
+        return;
+    }
+    
+    gTraceEnabled = FALSE;
+    
+    u64 endTime = mach_absolute_time();
+    
+    // ru_maxrss is in bytes on Mac OS X
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    
+    OSSpinLockLock(&sEventLock);
+    
+    TraceWriteChromeTrace(endTime, usage.ru_maxrss);
+    TracePrintSummary(endTime, usage.ru_maxrss);
+    
+    free(sEvents);
+    sEvents = NULL;
+    sNumEvents = 0;
+    sEventCapacity = 0;
+    
+    OSSpinLockUnlock(&sEventLock);
+    
+    free(sTraceOutputPath);
+    sTraceOutputPath = NULL;
+}
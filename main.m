@@ -7,8 +7,26 @@
 #import "TextTextureBuilder.h"
 
 #import "GLHelper.h"
+#import "PNGUtilities.h"
+#import "JSONUtilities.h"
 
 #import "Operation.h"
+#import "WorkerProtocol.h"
+#import "JobGraph.h"
+#import "ImageStore.h"
+#import "Trace.h"
+
+#import <dispatch/dispatch.h>
+#import <signal.h>
+#import <errno.h>
+#import <sys/socket.h>
+
+typedef struct
+{
+    Operation*  mOperation;
+    BOOL        mSuccess;
+    NSString*   mError;
+} BatchEntry;
 
 void InitOpenGL()
 {
@@ -32,6 +50,22 @@ void InitOpenGL()
     [openGLContext makeCurrentContext];
 }
 
+// Directory that relative arguments are checked against while parsing.  NULL is the working directory.  Only
+// ParseArgsArray sets this, and parsing always happens on the main thread.
+static NSString* sArgumentDirectory = NULL;
+
+static BOOL ArgumentFileExists(NSString* inPath, BOOL* outDirectory)
+{
+    NSString* path = inPath;
+    
+    if ((sArgumentDirectory != NULL) && (![path isAbsolutePath]))
+    {
+        path = [sArgumentDirectory stringByAppendingPathComponent:path];
+    }
+    
+    return [[NSFileManager defaultManager] fileExistsAtPath:path isDirectory:outDirectory];
+}
+
 BOOL GetInputOutputParameters(int argc, const char* argv[], NSString** outInputFile, NSString** outOutputFile)
 {
     if (argc != 4)
@@ -91,14 +125,24 @@ BOOL GetBloomParameters(int argc, const char* argv[], NSString** outInputFile, N
     return success;
 }
 
-BOOL GetPremultiplyAlphaParameters(int argc, const char* argv[], NSString** outInputFile, NSString** outOutputFile)
+BOOL GetPremultiplyAlphaParameters(int argc, const char* argv[], NSString** outInputFile, NSString** outOutputFile, BOOL* outDirectory)
 {
     BOOL success = GetInputOutputParameters(argc, argv, outInputFile, outOutputFile);
     
+    *outDirectory = FALSE;
+    
     if (success)
     {
         success = FALSE;
         
+        // A directory of PNGs is premultiplied into an output directory with the same layout
+        ArgumentFileExists(*outInputFile, outDirectory);
+        
+        if (*outDirectory)
+        {
+            return TRUE;
+        }
+        
         if ([[*outOutputFile pathExtension] caseInsensitiveCompare:@"png"] == NSOrderedSame)
         {
             success = TRUE;
@@ -128,7 +172,7 @@ BOOL GetGenerateMipmapParameters(int argc, const char* argv[], NSString** outInp
         
         BOOL directory = FALSE;
         
-        [[NSFileManager defaultManager] fileExistsAtPath:*outInputFile isDirectory:&directory];
+        ArgumentFileExists(*outInputFile, &directory);
         
         if (directory)
         {
@@ -190,7 +234,7 @@ BOOL GetGenerateAtlasParameters(int argc, const char* argv[], NSString** outInpu
         
         BOOL directory = FALSE;
         
-        [[NSFileManager defaultManager] fileExistsAtPath:*outInputDirectory isDirectory:&directory];
+        ArgumentFileExists(*outInputDirectory, &directory);
         
         if (directory)
         {
@@ -201,6 +245,63 @@ BOOL GetGenerateAtlasParameters(int argc, const char* argv[], NSString** outInpu
     return success;
 }
 
+BOOL GetGenerateTextAtlasParameters(int argc, const char* argv[], NSMutableArray* outExtraArguments, NSString** outStringsFile, NSString** outOutputFile)
+{
+    if (argc < 4)
+    {
+        return FALSE;
+    }
+    
+    *outStringsFile = [NSString stringWithUTF8String:argv[argc - 2]];
+    *outOutputFile = [NSString stringWithUTF8String:argv[argc - 1]];
+    
+    char *fontPath = getenv("NEON_IMAGE_PROCESSOR_FONT_PATH");
+    
+    if (fontPath == NULL)
+    {
+        NSLog(@"Font path isn't set.  Make sure that NEON_IMAGE_PROCESSOR_FONT_PATH is defined.");
+        return FALSE;
+    }
+    
+    if (!ArgumentFileExists(*outStringsFile, NULL))
+    {
+        return FALSE;
+    }
+    
+    [outExtraArguments addObject:[NSString stringWithUTF8String:FONT_PATH_PARAMETER_NAME]];
+    [outExtraArguments addObject:[NSString stringWithUTF8String:fontPath]];
+    
+    for (int curArg = 2; curArg < (argc - 2); curArg++)
+    {
+        [outExtraArguments addObject:[NSString stringWithUTF8String:argv[curArg]]];
+    }
+    
+    return TRUE;
+}
+
+BOOL GetPackBigFileParameters(int argc, const char* argv[], NSString** outInput, NSString** outOutputFile, NSMutableArray* outExtraArguments)
+{
+    if (argc < 4)
+    {
+        return FALSE;
+    }
+    
+    *outInput = [NSString stringWithUTF8String:argv[argc - 2]];
+    *outOutputFile = [NSString stringWithUTF8String:argv[argc - 1]];
+    
+    if (!ArgumentFileExists(*outInput, NULL))
+    {
+        return FALSE;
+    }
+    
+    for (int curArg = 2; curArg < (argc - 2); curArg++)
+    {
+        [outExtraArguments addObject:[NSString stringWithUTF8String:argv[curArg]]];
+    }
+    
+    return TRUE;
+}
+
 void DisplayHelp()
 {
     printf("Usage is Neon21ImageProcessor <Action> <Input File> <Output File>\n\n");
@@ -212,8 +313,35 @@ void DisplayHelp()
     printf("-generateText\n");
     printf("-generateStinger\n");
     printf("-generateAtlas\n");
+    printf("-packBigFile\n");
+    printf("-generateSDFAtlas\n");
+    printf("-generateTextAtlas\n");
+    printf("-batch <Manifest>\n");
+    printf("-serve <Socket Path>\n");
+    printf("-graph <Graph>\n");
     printf("\n");
     printf("Run with one of these arguments specified to get more information about the argument syntax\n");
+    printf("\n");
+    printf("Set NEON_IMAGE_PROCESSOR_PNG_MODE to default, fast or max to control how output PNGs are compressed\n");
+    printf("Set NEON_IMAGE_PROCESSOR_PNG_STATS to print the encoded size and time of every PNG written\n");
+    printf("Set %s to the socket of a -serve worker to have it perform operations instead.  The worker has to be started\n", WORKER_SOCKET_ENVIRONMENT_VARIABLE);
+    printf("with the same font path, PNG and text cache settings, or it refuses the request\n");
+    printf("Set NEON_IMAGE_PROCESSOR_TEXT_CACHE to a directory to keep generated text textures between runs\n");
+    printf("Set NEON_IMAGE_PROCESSOR_TRACE to a path to write a Chrome trace (chrome://tracing) and print a timing summary\n");
+}
+
+void DisplayBatchHelp()
+{
+    printf("Batch mode runs every operation in a JSON manifest in one process:\n\n");
+    printf("{\n");
+    printf("    \"operations\" :\n");
+    printf("    [\n");
+    printf("        [\"-generateText\", \"-fontName\", \"Font.ttf\", \"Hello\", \"Hello.png\"],\n");
+    printf("        [\"-premultiplyAlpha\", \"Input.png\", \"Output.papng\"]\n");
+    printf("    ]\n");
+    printf("}\n\n");
+    printf("Each operation takes the same arguments as on the command line.  Relative paths are relative to the manifest.\n");
+    printf("Operations that read or write the same paths run in manifest order, the rest run concurrently.\n");
 }
 
 Operation* ParseArgs(int argc, const char* argv[])
@@ -238,7 +366,7 @@ Operation* ParseArgs(int argc, const char* argv[])
 
                 NSString* inputFile;
                 NSString* outputFile;
-				NSMutableArray* argArray = [[NSMutableArray alloc] initWithCapacity:BLOOM_INITIAL_ARGUMENT_CAPACITY];
+				NSMutableArray* argArray = [NSMutableArray arrayWithCapacity:BLOOM_INITIAL_ARGUMENT_CAPACITY];
                 
                 BOOL success = GetBloomParameters(argc, argv, &inputFile, &outputFile, argArray);
                 
@@ -261,21 +389,31 @@ Operation* ParseArgs(int argc, const char* argv[])
             {
                 NSString* inputFile;
                 NSString* outputFile;
+                BOOL directory;
                 
-                BOOL success = GetPremultiplyAlphaParameters(argc, argv, &inputFile, &outputFile);
+                BOOL success = GetPremultiplyAlphaParameters(argc, argv, &inputFile, &outputFile, &directory);
                 
                 if (success)
                 {
                     Operation* operation = [Operation OperationWithType:OPERATION_PREMULTIPLY_ALPHA];
                     
                     [operation SetInputFile:inputFile];
-                    [operation SetOutputFile:outputFile];
+                    
+                    if (directory)
+                    {
+                        [operation SetOutputDirectory:outputFile];
+                    }
+                    else
+                    {
+                        [operation SetOutputFile:outputFile];
+                    }
                     
                     return operation;
                 }
                 else
                 {
                     printf("Premultiply Alpha operation needs an input file in PNG format and an output file in PAPNG format.\n");
+                    printf("If the input is a directory, every PNG in it is processed and the output must be a directory.\n");
                 }
             }
             else if ([actionArg caseInsensitiveCompare:@"-generateMipmaps"] == NSOrderedSame)
@@ -304,7 +442,7 @@ Operation* ParseArgs(int argc, const char* argv[])
                 static const int TEXT_INITIAL_ARGUMENT_CAPACITY = 5;
                 
                 NSString* outputFile;
-                NSMutableArray* argArray = [[NSMutableArray alloc] initWithCapacity:TEXT_INITIAL_ARGUMENT_CAPACITY];
+                NSMutableArray* argArray = [NSMutableArray arrayWithCapacity:TEXT_INITIAL_ARGUMENT_CAPACITY];
                 
                 BOOL success = GetGenerateTextParameters(argc, argv, argArray, &outputFile);
                 
@@ -328,7 +466,7 @@ Operation* ParseArgs(int argc, const char* argv[])
                 static const int TEXT_INITIAL_ARGUMENT_CAPACITY = 5;
                 
                 NSString* outputFile;
-                NSMutableArray* argArray = [[NSMutableArray alloc] initWithCapacity:TEXT_INITIAL_ARGUMENT_CAPACITY];
+                NSMutableArray* argArray = [NSMutableArray arrayWithCapacity:TEXT_INITIAL_ARGUMENT_CAPACITY];
                 
                 BOOL success = GetGenerateTextParameters(argc, argv, argArray, &outputFile);
                 
@@ -373,6 +511,86 @@ Operation* ParseArgs(int argc, const char* argv[])
                     printf("Output must be a filename ending in .atlas.\n");
                 }
             }
+            else if ([actionArg caseInsensitiveCompare:@"-packBigFile"] == NSOrderedSame)
+            {
+                static const int PACK_BIGFILE_INITIAL_ARGUMENT_CAPACITY = 3;
+                
+                NSString* input;
+                NSString* outputFile;
+                NSMutableArray* argArray = [NSMutableArray arrayWithCapacity:PACK_BIGFILE_INITIAL_ARGUMENT_CAPACITY];
+                
+                BOOL success = GetPackBigFileParameters(argc, argv, &input, &outputFile, argArray);
+                
+                if (success)
+                {
+                    Operation* operation = [Operation OperationWithType:OPERATION_PACK_BIGFILE];
+                    
+                    [operation SetInputFile:input];
+                    [operation SetOutputFile:outputFile];
+                    [operation SetArguments:argArray];
+                    
+                    return operation;
+                }
+                else
+                {
+                    printf("Pack BigFile operation takes [-compress] [-compressionLevel <0-9>] [-alignment <bytes>], then an input directory\n");
+                    printf("or manifest and the output archive.  Manifest lines are a path, optionally followed by a tab and a locality group.\n");
+                }
+            }
+            else if ([actionArg caseInsensitiveCompare:@"-generateSDFAtlas"] == NSOrderedSame)
+            {
+                static const int SDF_ATLAS_INITIAL_ARGUMENT_CAPACITY = 4;
+                
+                NSString* fontFile;
+                NSString* outputFile;
+                NSMutableArray* argArray = [NSMutableArray arrayWithCapacity:SDF_ATLAS_INITIAL_ARGUMENT_CAPACITY];
+                
+                // Same shape as -packBigFile, options followed by an existing input and the output
+                BOOL success = GetPackBigFileParameters(argc, argv, &fontFile, &outputFile, argArray);
+                
+                if (success)
+                {
+                    Operation* operation = [Operation OperationWithType:OPERATION_GENERATE_SDF_ATLAS];
+                    
+                    [operation SetInputFile:fontFile];
+                    [operation SetOutputFile:outputFile];
+                    [operation SetArguments:argArray];
+                    
+                    return operation;
+                }
+                else
+                {
+                    printf("Generate SDF Atlas operation takes [-glyphSize <pixels>] [-spread <pixels>] [-padding <pixels>] [-characters <string>],\n");
+                    printf("then a font file and the output .png.  Glyph metrics and kerning are written next to it as a .sdffont JSON file.\n");
+                }
+            }
+            else if ([actionArg caseInsensitiveCompare:@"-generateTextAtlas"] == NSOrderedSame)
+            {
+                static const int TEXT_ATLAS_INITIAL_ARGUMENT_CAPACITY = 5;
+                
+                NSString* stringsFile;
+                NSString* outputFile;
+                NSMutableArray* argArray = [NSMutableArray arrayWithCapacity:TEXT_ATLAS_INITIAL_ARGUMENT_CAPACITY];
+                
+                BOOL success = GetGenerateTextAtlasParameters(argc, argv, argArray, &stringsFile, &outputFile);
+                
+                if (success)
+                {
+                    Operation* operation = [Operation OperationWithType:OPERATION_GENERATE_TEXT_ATLAS];
+                    
+                    [operation SetInputFile:stringsFile];
+                    [operation SetOutputFile:outputFile];
+                    [operation SetArguments:argArray];
+                    
+                    return operation;
+                }
+                else
+                {
+                    printf("Generate Text Atlas operation takes the same options as -generateText, plus [-pageSize <texels>] [-padding <texels>],\n");
+                    printf("then a strings file and the output .textatlas.  Each line of the strings file is a string, or a name, a tab and a string.\n");
+                    printf("Pages are written next to the output as <name>_0.png, <name>_1.png and so on.\n");
+                }
+            }
             else
             {
                 printf("Unrecognized operation: %s\n", argv[1]);
@@ -383,13 +601,506 @@ Operation* ParseArgs(int argc, const char* argv[])
     return NULL;
 }
 
+// Parses an operation from an array of command line arguments (without the executable name).  Relative paths are
+// resolved against inDirectory.  The returned operation is owned by the caller.
+Operation* ParseArgsArray(NSArray* inArgs, NSString* inDirectory)
+{
+    BOOL validArgs = [inArgs isKindOfClass:[NSArray class]] && ([inArgs count] > 0);
+    
+    for (int curArg = 0; validArgs && (curArg < [inArgs count]); curArg++)
+    {
+        validArgs = [[inArgs objectAtIndex:curArg] isKindOfClass:[NSString class]];
+    }
+    
+    if (!validArgs)
+    {
+        printf("Operations must be non-empty arrays of argument strings\n");
+        return NULL;
+    }
+    
+    int argc = [inArgs count] + 1;
+    const char** argv = malloc(sizeof(char*) * argc);
+    
+    argv[0] = "Neon21ImageProcessor";
+    
+    for (int curArg = 1; curArg < argc; curArg++)
+    {
+        argv[curArg] = [[inArgs objectAtIndex:(curArg - 1)] UTF8String];
+    }
+    
+    // Check arguments against inDirectory so they see the same files the operation will.  The working directory is
+    // left alone, operations from earlier entries or requests may still be running on other threads.
+    sArgumentDirectory = inDirectory;
+    
+    Operation* operation = ParseArgs(argc, argv);
+    [operation ResolvePathsRelativeTo:inDirectory];
+    
+    sArgumentDirectory = NULL;
+    
+    free(argv);
+    
+    return operation;
+}
+
+void DisplayGraphHelp()
+{
+    printf("Graph mode runs the operations in a JSON file as a dependency graph:\n\n");
+    printf("{\n");
+    printf("    \"nodes\" :\n");
+    printf("    [\n");
+    printf("        { \"name\" : \"Title\", \"args\" : [\"-generateText\", \"-fontName\", \"Font.ttf\", \"Title\", \"mem:Title.png\"] },\n");
+    printf("        { \"name\" : \"TitleMips\", \"args\" : [\"-generateMipmaps\", \"mem:Title.png\", \"Mipmaps\"], \"cache\" : false }\n");
+    printf("    ]\n");
+    printf("}\n\n");
+    printf("A node runs after every node that writes one of its inputs.  Paths starting with %s are kept in memory\n", [IMAGE_STORE_PATH_PREFIX UTF8String]);
+    printf("instead of being written to disk.  Nodes whose outputs are newer than their inputs and the graph file are\n");
+    printf("skipped, unless \"cache\" is false.  Relative paths are relative to the graph file.\n");
+}
+
+static void PerformBatchEntry(void* inContext)
+{
+    BatchEntry* entry = (BatchEntry*)inContext;
+    
+    NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+    
+    // A failed assertion only fails its own entry, not the whole batch
+    @try
+    {
+        entry->mSuccess = [entry->mOperation Perform];
+    }
+    @catch (NSException* exception)
+    {
+        entry->mSuccess = FALSE;
+        entry->mError = [[exception reason] retain];
+    }
+    
+    [pool release];
+}
+
+int RunBatch(NSString* inManifestPath)
+{
+    NSString* error = NULL;
+    NSDictionary* manifest = (NSDictionary*)JSONObjectFromFile(inManifestPath, &error);
+    NSArray* operationArgs = NULL;
+    
+    if ([manifest isKindOfClass:[NSDictionary class]])
+    {
+        operationArgs = [manifest objectForKey:@"operations"];
+    }
+    
+    if (![operationArgs isKindOfClass:[NSArray class]])
+    {
+        if (error == NULL)
+        {
+            error = @"Expected an object with an \"operations\" array";
+        }
+        
+        printf("\e[1;31mCould not read batch manifest %s: %s\e[m\n", [inManifestPath UTF8String], [error UTF8String]);
+        return 1;
+    }
+    
+    int numEntries = [operationArgs count];
+    int numFailed = 0;
+    
+    // Parse everything up front, so a typo anywhere in the manifest is reported before any work is done
+    NSString* manifestDirectory = [[inManifestPath stringByStandardizingPath] stringByDeletingLastPathComponent];
+    
+    if (![manifestDirectory isAbsolutePath])
+    {
+        manifestDirectory = [[[NSFileManager defaultManager] currentDirectoryPath] stringByAppendingPathComponent:manifestDirectory];
+    }
+    
+    // Entries that share paths run in manifest order, everything else runs concurrently.  Nothing is cached, a batch
+    // always runs every entry.
+    JobGraph* graph = [(JobGraph*)[JobGraph alloc] Init];
+    [graph SetManifestOrder:TRUE];
+    
+    for (int curEntry = 0; curEntry < numEntries; curEntry++)
+    {
+        NSArray* args = [operationArgs objectAtIndex:curEntry];
+        Operation* operation = ParseArgsArray(args, manifestDirectory);
+        
+        if (operation == NULL)
+        {
+            printf("\e[1;31mBatch entry %d is invalid\e[m\n", curEntry);
+            numFailed++;
+            continue;
+        }
+        
+        NSString* name = [NSString stringWithFormat:@"%d (%@)", curEntry, [args componentsJoinedByString:@" "]];
+        
+        [graph AddNodeWithName:name operation:operation cache:FALSE];
+        [operation release];
+    }
+    
+    if (numFailed == 0)
+    {
+        [graph Run];
+        numFailed = [graph GetNumFailed];
+    }
+    
+    [graph release];
+    
+    printf("Batch:\t%s\n\t%d operations, %d failed\n", [inManifestPath UTF8String], numEntries, numFailed);
+    
+    return (numFailed == 0) ? 0 : 1;
+}
+
+static char sServerSocketPath[PATH_MAX];
+
+static void ServerSignalHandler(int inSignal)
+{
+    // Only async signal safe calls in here
+    unlink(sServerSocketPath);
+    _exit(0);
+}
+
+typedef struct
+{
+    Operation*  mOperation;
+    int         mConnection;
+} ServerJob;
+
+static void PerformServerJob(void* inContext)
+{
+    ServerJob* job = (ServerJob*)inContext;
+    
+    NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+    
+    BatchEntry entry;
+    
+    entry.mOperation = job->mOperation;
+    entry.mSuccess = FALSE;
+    entry.mError = NULL;
+    
+    PerformBatchEntry(&entry);
+    
+    NSMutableDictionary* response = [NSMutableDictionary dictionaryWithCapacity:3];
+    
+    [response setObject:[NSNumber numberWithBool:entry.mSuccess] forKey:@"success"];
+    [response setObject:[job->mOperation GetOutputPaths] forKey:@"outputs"];
+    
+    if (!entry.mSuccess)
+    {
+        [response setObject:((entry.mError != NULL) ? entry.mError : @"Operation failed, see the worker's output") forKey:@"error"];
+    }
+    
+    WorkerWriteMessage(job->mConnection, response);
+    close(job->mConnection);
+    
+    [entry.mError release];
+    [job->mOperation release];
+    free(job);
+    
+    [pool release];
+}
+
+// Nothing outlives a request in the worker, so there's no one to read an in memory output and no request can see another's
+static BOOL OperationUsesImageStore(Operation* inOperation)
+{
+    for (NSString* curPath in [[inOperation GetInputPaths] arrayByAddingObjectsFromArray:[inOperation GetOutputPaths]])
+    {
+        if (IsImageStorePath(curPath))
+        {
+            return TRUE;
+        }
+    }
+    
+    return FALSE;
+}
+
+int RunServer(NSString* inSocketPath)
+{
+    int listenSocket = WorkerListen(inSocketPath);
+    
+    if (listenSocket < 0)
+    {
+        return 1;
+    }
+    
+    strlcpy(sServerSocketPath, [inSocketPath fileSystemRepresentation], sizeof(sServerSocketPath));
+    
+    signal(SIGINT, ServerSignalHandler);
+    signal(SIGTERM, ServerSignalHandler);
+    
+    // Clients that go away before reading their response shouldn't take the worker down with them
+    signal(SIGPIPE, SIG_IGN);
+    
+    printf("Serving on %s\n", sServerSocketPath);
+    
+    dispatch_queue_t queue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+    
+    while (TRUE)
+    {
+        int connection = accept(listenSocket, NULL, NULL);
+        
+        if (connection < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            
+            printf("\e[1;31mCould not accept a connection: %s\e[m\n", strerror(errno));
+            break;
+        }
+        
+        NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+        
+        // Requests are read here, one connection at a time, so a client that never finishes sending can't hold up everyone else
+        NSString* error = @"Could not set a receive timeout";
+        NSDictionary* request = NULL;
+        
+        if (WorkerSetReceiveTimeout(connection, WORKER_REQUEST_TIMEOUT_SECONDS))
+        {
+            request = WorkerReadMessage(connection, &error);
+        }
+        
+        Operation* operation = NULL;
+        
+        // The font path, PNG mode and text cache were read when the worker started, so requests have to match them
+        if (request != NULL)
+        {
+            error = WorkerCheckEnvironment([request objectForKey:@"environment"]);
+        }
+        
+        if ((request != NULL) && (error == NULL))
+        {
+            NSString* directory = [request objectForKey:@"directory"];
+            
+            if ((![directory isKindOfClass:[NSString class]]) || (![directory isAbsolutePath]))
+            {
+                error = @"Requests need an absolute \"directory\"";
+            }
+            else
+            {
+                operation = ParseArgsArray([request objectForKey:@"args"], directory);
+                
+                if (operation == NULL)
+                {
+                    error = @"Invalid operation arguments, see the worker's output";
+                }
+                else if (OperationUsesImageStore(operation))
+                {
+                    error = [NSString stringWithFormat:@"%@ paths are only supported by -batch and -graph", IMAGE_STORE_PATH_PREFIX];
+                    
+                    [operation release];
+                    operation = NULL;
+                }
+            }
+        }
+        
+        if (operation == NULL)
+        {
+            NSMutableDictionary* response = [NSMutableDictionary dictionaryWithCapacity:3];
+            
+            [response setObject:[NSNumber numberWithBool:FALSE] forKey:@"success"];
+            [response setObject:[NSArray array] forKey:@"outputs"];
+            [response setObject:error forKey:@"error"];
+            
+            WorkerWriteMessage(connection, response);
+            close(connection);
+        }
+        else
+        {
+            ServerJob* job = malloc(sizeof(ServerJob));
+            
+            job->mOperation = operation;
+            job->mConnection = connection;
+            
+            // Same split as -batch, OpenGL operations run here one at a time and the rest run concurrently
+            if ([operation RequiresMainThread])
+            {
+                PerformServerJob(job);
+            }
+            else
+            {
+                dispatch_async_f(queue, job, PerformServerJob);
+            }
+        }
+        
+        [pool release];
+    }
+    
+    close(listenSocket);
+    unlink(sServerSocketPath);
+    
+    return 1;
+}
+
+// Returns TRUE if the worker handled the invocation, in which case outExitCode is set.  Returns FALSE if there's no
+// worker to talk to, and the operation should just be performed locally.
+BOOL RunClient(NSString* inSocketPath, int argc, const char* argv[], int* outExitCode)
+{
+    int connection = WorkerConnect(inSocketPath);
+    
+    if (connection < 0)
+    {
+        printf("No worker is serving %s, running locally\n", [inSocketPath UTF8String]);
+        return FALSE;
+    }
+    
+    NSMutableArray* args = [NSMutableArray arrayWithCapacity:argc];
+    
+    for (int curArg = 1; curArg < argc; curArg++)
+    {
+        [args addObject:[NSString stringWithUTF8String:argv[curArg]]];
+    }
+    
+    NSMutableDictionary* request = [NSMutableDictionary dictionaryWithCapacity:3];
+    
+    [request setObject:args forKey:@"args"];
+    [request setObject:[[NSFileManager defaultManager] currentDirectoryPath] forKey:@"directory"];
+    [request setObject:WorkerGetEnvironment() forKey:@"environment"];
+    
+    NSString* error = NULL;
+    NSDictionary* response = NULL;
+    
+    if (WorkerWriteMessage(connection, request))
+    {
+        response = WorkerReadMessage(connection, &error);
+    }
+    else
+    {
+        error = @"Could not send the request";
+    }
+    
+    close(connection);
+    
+    *outExitCode = 1;
+    
+    if (response == NULL)
+    {
+        printf("\e[1;31mWorker at %s failed: %s\e[m\n", [inSocketPath UTF8String], [error UTF8String]);
+    }
+    else if ([[response objectForKey:@"success"] boolValue])
+    {
+        NSArray* outputs = [response objectForKey:@"outputs"];
+        
+        for (int curOutput = 0; curOutput < [outputs count]; curOutput++)
+        {
+            printf("%s:\tOutput %s\n", argv[1], [[[outputs objectAtIndex:curOutput] description] UTF8String]);
+        }
+        
+        *outExitCode = 0;
+    }
+    else
+    {
+        printf("\e[1;31m%s failed: %s\e[m\n", argv[1], [[[response objectForKey:@"error"] description] UTF8String]);
+    }
+    
+    return TRUE;
+}
+
+int RunGraph(NSString* inGraphPath)
+{
+    NSString* error = NULL;
+    NSDictionary* graphDescription = (NSDictionary*)JSONObjectFromFile(inGraphPath, &error);
+    NSArray* nodes = NULL;
+    
+    if ([graphDescription isKindOfClass:[NSDictionary class]])
+    {
+        nodes = [graphDescription objectForKey:@"nodes"];
+    }
+    
+    if (![nodes isKindOfClass:[NSArray class]])
+    {
+        if (error == NULL)
+        {
+            error = @"Expected an object with a \"nodes\" array";
+        }
+        
+        printf("\e[1;31mCould not read job graph %s: %s\e[m\n", [inGraphPath UTF8String], [error UTF8String]);
+        return 1;
+    }
+    
+    NSString* graphDirectory = [[inGraphPath stringByStandardizingPath] stringByDeletingLastPathComponent];
+    
+    if (![graphDirectory isAbsolutePath])
+    {
+        graphDirectory = [[[NSFileManager defaultManager] currentDirectoryPath] stringByAppendingPathComponent:graphDirectory];
+    }
+    
+    JobGraph* graph = [(JobGraph*)[JobGraph alloc] Init];
+    BOOL success = TRUE;
+    
+    // Editing the graph can change any node's arguments, so it counts as an input to all of them
+    [graph AddInputFile:[graphDirectory stringByAppendingPathComponent:[inGraphPath lastPathComponent]]];
+    
+    for (int curNode = 0; curNode < [nodes count]; curNode++)
+    {
+        NSDictionary* node = [nodes objectAtIndex:curNode];
+        Operation* operation = NULL;
+        
+        if ([node isKindOfClass:[NSDictionary class]])
+        {
+            operation = ParseArgsArray([node objectForKey:@"args"], graphDirectory);
+        }
+        
+        if (operation == NULL)
+        {
+            printf("\e[1;31mJob graph node %d is invalid\e[m\n", curNode);
+            success = FALSE;
+            continue;
+        }
+        
+        NSString* name = [node objectForKey:@"name"];
+        NSNumber* cache = [node objectForKey:@"cache"];
+        
+        if (![name isKindOfClass:[NSString class]])
+        {
+            name = [NSString stringWithFormat:@"%d", curNode];
+        }
+        
+        [graph AddNodeWithName:name operation:operation cache:([cache isKindOfClass:[NSNumber class]] ? [cache boolValue] : TRUE)];
+        [operation release];
+    }
+    
+    success = success && [graph Run];
+    
+    [graph release];
+    
+    return success ? 0 : 1;
+}
+
+void InitPNGEncodeMode()
+{
+    char* pngMode = getenv("NEON_IMAGE_PROCESSOR_PNG_MODE");
+    
+    if (pngMode != NULL)
+    {
+        PNGEncodeMode mode = PNG_ENCODE_MODE_DEFAULT;
+        
+        if (PNGEncodeModeFromString(pngMode, &mode))
+        {
+            SetDefaultPNGEncodeMode(mode);
+        }
+        else
+        {
+            printf("Unrecognized NEON_IMAGE_PROCESSOR_PNG_MODE %s.  Use default, fast or max.\n", pngMode);
+        }
+    }
+    
+    // Per file encode stats are noisy for directory and atlas operations, so they're only printed when asked for
+    SetPNGReportStats(getenv("NEON_IMAGE_PROCESSOR_PNG_STATS") != NULL);
+}
+
 void InitEngine()
 {
     [ResourceManager CreateInstance];
     [TextureManager CreateInstance];
     [TextTextureBuilder CreateInstance];
     
+    char* textCacheDirectory = getenv("NEON_IMAGE_PROCESSOR_TEXT_CACHE");
+    
+    if (textCacheDirectory != NULL)
+    {
+        [[TextTextureBuilder GetInstance] SetPersistentCacheDirectory:[NSString stringWithUTF8String:textCacheDirectory]];
+    }
+    
     [GLHelper CreateInstance];
+    
+    [ImageStore CreateInstance];
 }
 
 void TerminateEngine()
@@ -399,23 +1110,105 @@ void TerminateEngine()
     [TextTextureBuilder DestroyInstance];
     
     [GLHelper DestroyInstance];
+    
+    [ImageStore DestroyInstance];
 }
 
 int main (int argc, const char * argv[])
 {
     NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
     
+    int retVal = 0;
+    NSString* actionArg = (argc >= 2) ? [NSString stringWithUTF8String:argv[1]] : NULL;
+    
+    // Forward single operations to a running worker if there is one, before paying for any initialization
+    char* serverSocketPath = getenv(WORKER_SOCKET_ENVIRONMENT_VARIABLE);
+    
+    if ((serverSocketPath != NULL) && (actionArg != NULL) && ([actionArg caseInsensitiveCompare:@"-help"] != NSOrderedSame) &&
+        ([actionArg caseInsensitiveCompare:@"-batch"] != NSOrderedSame) && ([actionArg caseInsensitiveCompare:@"-serve"] != NSOrderedSame) &&
+        ([actionArg caseInsensitiveCompare:@"-graph"] != NSOrderedSame))
+    {
+        if (RunClient([NSString stringWithUTF8String:serverSocketPath], argc, argv, &retVal))
+        {
+            [pool drain];
+            return retVal;
+        }
+    }
+    
+    TraceInit(getenv("NEON_IMAGE_PROCESSOR_TRACE"));
+    
     InitOpenGL();
-    Operation* operation = ParseArgs(argc, argv);
     
-    if (operation)
+    if ((actionArg != NULL) && ([actionArg caseInsensitiveCompare:@"-serve"] == NSOrderedSame))
+    {
+        if (argc == 3)
+        {
+            // The engine, ResourceManager index, FreeType faces and GCD's thread pool stay warm between requests
+            InitPNGEncodeMode();
+            InitEngine();
+            retVal = RunServer([NSString stringWithUTF8String:argv[2]]);
+            TerminateEngine();
+        }
+        else
+        {
+            printf("Serve needs the path of the Unix domain socket to listen on.  Requests use the protocol in WorkerProtocol.h\n");
+            retVal = 1;
+        }
+    }
+    else if ((actionArg != NULL) && ([actionArg caseInsensitiveCompare:@"-graph"] == NSOrderedSame))
+    {
+        if (argc == 3)
+        {
+            InitPNGEncodeMode();
+            InitEngine();
+            retVal = RunGraph([NSString stringWithUTF8String:argv[2]]);
+            TerminateEngine();
+        }
+        else
+        {
+            DisplayGraphHelp();
+            retVal = 1;
+        }
+    }
+    else if ((actionArg != NULL) && ([actionArg caseInsensitiveCompare:@"-batch"] == NSOrderedSame))
+    {
+        if (argc == 3)
+        {
+            // Engine setup, loaded fonts and the PNG encoder are shared by every operation in the manifest
+            InitPNGEncodeMode();
+            InitEngine();
+            retVal = RunBatch([NSString stringWithUTF8String:argv[2]]);
+            TerminateEngine();
+        }
+        else
+        {
+            DisplayBatchHelp();
+            retVal = 1;
+        }
+    }
+    else
     {
-        InitEngine();
-        [operation Perform];
-        TerminateEngine();
+        Operation* operation = ParseArgs(argc, argv);
+        
+        if (operation)
+        {
+            InitPNGEncodeMode();
+            InitEngine();
+            
+            if (![operation Perform])
+            {
+                retVal = 1;
+            }
+            
+            TerminateEngine();
+            
+            [operation release];
+        }
     }
     
+    TraceTerm();
+    
     [pool drain];
     
-    return 0;
+    return retVal;
 }